@@ -0,0 +1,555 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+#include "checkpoint.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "genome.h"
+#include "machine/machine.h"
+#include "parallel.h"
+#include "randomizer.h"
+
+//******************************************************************************
+// Type definitions
+//******************************************************************************
+struct checkpoint_writer_s {
+    // Running or finished save, NULL if none was started since the last wait.
+    parallel_task_t *task;
+    // Copy of the state being saved, owned by the writer.
+    checkpoint_state_t snapshot;
+    char *path;
+    bool success;
+};
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+#define CHECKPOINT_MAGIC        (0x676b6331U)
+
+// File layout, all numbers little endian:
+// - magic, then the machine configuration, see config_get(), as 32 bits words,
+// - generation, 64 bits,
+// - number of genomes, of objectives per genome and of streams, 32 bits each,
+//   and a 32 bits zero,
+// - key and counter of each stream, 64 bits each,
+// - objectives, as the 64 bits of each double,
+// - genomes, in the form of genome_serialize(), one after the other.
+#define CHECKPOINT_CONFIG_SIZE  (1 + MACHINE_CONFIG_SIZE)
+#define CHECKPOINT_HEADER_SIZE  (4 * CHECKPOINT_CONFIG_SIZE + 8 + 4 * 4)
+#define CHECKPOINT_STREAM_SIZE  (16)
+#define CHECKPOINT_OBJECTIVE_SIZE   (8)
+
+// Data is written to file by chunks of about this size.
+#define CHECKPOINT_CHUNK_SIZE   (1 << 20)
+
+#define CHECKPOINT_TEMP_SUFFIX  ".tmp"
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+static bool state_write(FILE *file, checkpoint_state_t const * const state);
+static bool state_read(uint8_t const data[], size_t const size,
+                       checkpoint_state_t * const state,
+                       int const nb_threads);
+static bool state_copy(checkpoint_state_t * const dst,
+                       checkpoint_state_t const * const src);
+static void writer_save(void *context);
+static void config_get(uint32_t config[CHECKPOINT_CONFIG_SIZE]);
+static uint8_t *bytes_put(uint8_t *data, uint64_t const value,
+                          int const nb_bytes);
+static uint64_t bytes_get(uint8_t const **data, int const nb_bytes);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+//  ----------------------------------------------------------------------------
+/// \brief  Save a state to file.
+/// \param  path
+/// \param  state
+/// \return True on success.
+//  ----------------------------------------------------------------------------
+bool checkpoint_save(char const * const path,
+                     checkpoint_state_t const * const state)
+{
+    assert(path);
+    assert(state);
+
+    char *temp_path = malloc(strlen(path) + sizeof CHECKPOINT_TEMP_SUFFIX);
+    if (temp_path == NULL) {
+        fprintf(stderr, "%s: could not allocate path.\n", __func__);
+        return false;
+    }
+    strcpy(temp_path, path);
+    strcat(temp_path, CHECKPOINT_TEMP_SUFFIX);
+
+    FILE *file = fopen(temp_path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "%s: could not open %s.\n", __func__, temp_path);
+        free(temp_path);
+        return false;
+    }
+    bool success = state_write(file, state);
+    success = fclose(file) == 0 && success;
+    if (success && rename(temp_path, path) != 0) {
+        fprintf(stderr, "%s: could not rename to %s.\n", __func__, path);
+        success = false;
+    }
+    if (!success) {
+        remove(temp_path);
+    }
+    free(temp_path);
+    return success;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Load a state. The whole file is read at once, then decoded.
+/// \param  path
+/// \param  state
+/// \param  nb_threads
+/// \return True on success.
+//  ----------------------------------------------------------------------------
+bool checkpoint_load(char const * const path, checkpoint_state_t * const state,
+                     int const nb_threads)
+{
+    assert(path);
+    assert(state);
+
+    *state = (checkpoint_state_t) { .generation = 0 };
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "%s: could not open %s.\n", __func__, path);
+        return false;
+    }
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        size = ftell(file);
+    }
+    if (size < 0 || fseek(file, 0, SEEK_SET) != 0) {
+        fprintf(stderr, "%s: could not get the size of %s.\n", __func__, path);
+        fclose(file);
+        return false;
+    }
+
+    uint8_t *data = malloc(size > 0 ? size : 1);
+    if (data == NULL) {
+        fprintf(stderr, "%s: could not allocate data.\n", __func__);
+        fclose(file);
+        return false;
+    }
+    bool success = fread(data, 1, size, file) == (size_t) size;
+    fclose(file);
+    if (!success) {
+        fprintf(stderr, "%s: could not read %s.\n", __func__, path);
+    } else {
+        success = state_read(data, size, state, nb_threads);
+    }
+    free(data);
+    return success;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Free a state.
+/// \param  state
+//  ----------------------------------------------------------------------------
+void checkpoint_state_free(checkpoint_state_t * const state)
+{
+    assert(state);
+
+    if (state->population != NULL) {
+        for (int i = 0; i < state->nb_genomes; i++) {
+            if (state->population[i] != NULL) {
+                genome_destroy(&state->population[i]);
+            }
+        }
+    }
+    free(state->population);
+    free(state->objectives);
+    free(state->streams);
+    *state = (checkpoint_state_t) { .generation = 0 };
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create a writer.
+/// \return Pointer to the new writer, NULL on failure.
+//  ----------------------------------------------------------------------------
+checkpoint_writer_t *checkpoint_writer_create(void)
+{
+    checkpoint_writer_t *writer = malloc(sizeof *writer);
+    if (writer == NULL) {
+        fprintf(stderr, "%s: could not allocate writer.\n", __func__);
+        return NULL;
+    }
+    *writer = (checkpoint_writer_t) { .success = true };
+    return writer;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Free a writer after its save is done.
+/// \param  writer
+//  ----------------------------------------------------------------------------
+void checkpoint_writer_destroy(checkpoint_writer_t **writer)
+{
+    assert(writer);
+    if (*writer == NULL) {
+        return;
+    }
+    checkpoint_writer_wait(*writer);
+    free(*writer);
+    *writer = NULL;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Copy a state and write the copy from a thread of its own.
+/// \param  writer
+/// \param  path
+/// \param  state
+/// \return True if the save was started.
+//  ----------------------------------------------------------------------------
+bool checkpoint_writer_start(checkpoint_writer_t * const writer,
+                             char const * const path,
+                             checkpoint_state_t const * const state)
+{
+    assert(writer);
+    assert(path);
+    assert(state);
+
+    checkpoint_writer_wait(writer);
+
+    writer->path = malloc(strlen(path) + 1);
+    if (writer->path == NULL) {
+        fprintf(stderr, "%s: could not allocate path.\n", __func__);
+        return false;
+    }
+    strcpy(writer->path, path);
+    if (!state_copy(&writer->snapshot, state)) {
+        fprintf(stderr, "%s: could not copy the state.\n", __func__);
+        free(writer->path);
+        writer->path = NULL;
+        return false;
+    }
+
+    writer->task = parallel_task_start(writer_save, writer);
+    if (writer->task == NULL) {
+        checkpoint_state_free(&writer->snapshot);
+        free(writer->path);
+        writer->path = NULL;
+        return false;
+    }
+    return true;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Check whether a save is running.
+/// \param  writer
+/// \return True if it is.
+//  ----------------------------------------------------------------------------
+bool checkpoint_writer_busy(checkpoint_writer_t const * const writer)
+{
+    assert(writer);
+    return writer->task != NULL && !parallel_task_done(writer->task);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Wait for the running save and free its copy of the state.
+/// \param  writer
+/// \return Success of the last save.
+//  ----------------------------------------------------------------------------
+bool checkpoint_writer_wait(checkpoint_writer_t * const writer)
+{
+    assert(writer);
+
+    if (writer->task != NULL) {
+        parallel_task_join(&writer->task);
+        checkpoint_state_free(&writer->snapshot);
+        free(writer->path);
+        writer->path = NULL;
+    }
+    return writer->success;
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+//  ----------------------------------------------------------------------------
+/// \brief  Write a state to an open file, chunk by chunk.
+/// \param  file
+/// \param  state
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+static bool state_write(FILE *file, checkpoint_state_t const * const state)
+{
+    assert(file);
+    assert(state);
+    assert(state->population || state->nb_genomes == 0);
+    assert(state->objectives || state->nb_objectives == 0
+           || state->nb_genomes == 0);
+    assert(state->streams || state->nb_streams == 0);
+
+    size_t capacity = CHECKPOINT_CHUNK_SIZE;
+    uint8_t *chunk = malloc(capacity);
+    if (chunk == NULL) {
+        fprintf(stderr, "%s: could not allocate chunk.\n", __func__);
+        return false;
+    }
+
+    uint32_t config[CHECKPOINT_CONFIG_SIZE];
+    config_get(config);
+    uint8_t *data = chunk;
+    for (int i = 0; i < CHECKPOINT_CONFIG_SIZE; i++) {
+        data = bytes_put(data, config[i], 4);
+    }
+    data = bytes_put(data, state->generation, 8);
+    data = bytes_put(data, state->nb_genomes, 4);
+    data = bytes_put(data, state->nb_objectives, 4);
+    data = bytes_put(data, state->nb_streams, 4);
+    data = bytes_put(data, 0, 4);
+
+    // Each item is put in the chunk, which is written when the next item does
+    // not fit. The chunk grows for a genome bigger than it.
+    bool success = true;
+    size_t const nb_values = (size_t) state->nb_genomes * state->nb_objectives;
+    size_t const nb_items = state->nb_streams + nb_values + state->nb_genomes;
+    for (size_t i = 0; i < nb_items && success; i++) {
+        size_t const genome = i - state->nb_streams - nb_values;
+        size_t const size = i < (size_t) state->nb_streams
+            ? CHECKPOINT_STREAM_SIZE
+            : i < state->nb_streams + nb_values ? CHECKPOINT_OBJECTIVE_SIZE
+            : genome_serialized_size_get(state->population[genome]);
+
+        if (size > capacity - (size_t) (data - chunk)) {
+            success = fwrite(chunk, 1, data - chunk, file)
+                      == (size_t) (data - chunk);
+            data = chunk;
+        }
+        if (size > capacity) {
+            uint8_t *bigger = malloc(size);
+            if (bigger == NULL) {
+                fprintf(stderr, "%s: could not allocate chunk.\n", __func__);
+                success = false;
+                break;
+            }
+            free(chunk);
+            chunk = bigger;
+            data = chunk;
+            capacity = size;
+        }
+
+        if (i < (size_t) state->nb_streams) {
+            data = bytes_put(data, state->streams[i].key, 8);
+            data = bytes_put(data, state->streams[i].counter, 8);
+        } else if (i < state->nb_streams + nb_values) {
+            uint64_t bits;
+            memcpy(&bits, &state->objectives[i - state->nb_streams],
+                   sizeof bits);
+            data = bytes_put(data, bits, 8);
+        } else {
+            data += genome_serialize(state->population[genome], data, size);
+        }
+    }
+    if (success) {
+        success = fwrite(chunk, 1, data - chunk, file)
+                  == (size_t) (data - chunk);
+    }
+    if (!success) {
+        fprintf(stderr, "%s: could not write the state.\n", __func__);
+    }
+    free(chunk);
+    return success;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Decode a state from the content of a file.
+/// \param  data
+/// \param  size
+/// \param  state       Output, empty on entry.
+/// \param  nb_threads
+/// \return True on success.
+//  ----------------------------------------------------------------------------
+static bool state_read(uint8_t const data[], size_t const size,
+                       checkpoint_state_t * const state,
+                       int const nb_threads)
+{
+    uint8_t const *const end = data + size;
+
+    if (size < CHECKPOINT_HEADER_SIZE) {
+        fprintf(stderr, "%s: not a checkpoint.\n", __func__);
+        return false;
+    }
+    uint32_t config[CHECKPOINT_CONFIG_SIZE];
+    config_get(config);
+    for (int i = 0; i < CHECKPOINT_CONFIG_SIZE; i++) {
+        if (bytes_get(&data, 4) != config[i]) {
+            fprintf(stderr, "%s: %s.\n", __func__, i == 0 ? "not a checkpoint"
+                    : "saved with another machine configuration");
+            return false;
+        }
+    }
+    uint64_t const generation = bytes_get(&data, 8);
+    uint32_t const nb_genomes = (uint32_t) bytes_get(&data, 4);
+    uint32_t const nb_objectives = (uint32_t) bytes_get(&data, 4);
+    uint32_t const nb_streams = (uint32_t) bytes_get(&data, 4);
+    bytes_get(&data, 4);
+
+    // The counts are checked against the size before allocating from them.
+    size_t const nb_values = (size_t) nb_genomes * nb_objectives;
+    if (nb_genomes > INT32_MAX || nb_objectives > INT32_MAX
+        || nb_streams > INT32_MAX
+        || (size_t) (end - data) / CHECKPOINT_STREAM_SIZE < nb_streams
+        || ((size_t) (end - data) - (size_t) nb_streams
+            * CHECKPOINT_STREAM_SIZE) / CHECKPOINT_OBJECTIVE_SIZE
+           < nb_values) {
+        fprintf(stderr, "%s: data too short.\n", __func__);
+        return false;
+    }
+
+    state->generation = generation;
+    state->nb_genomes = (int) nb_genomes;
+    state->nb_objectives = (int) nb_objectives;
+    state->nb_streams = (int) nb_streams;
+    state->streams = malloc((nb_streams > 0 ? nb_streams : 1)
+                            * sizeof *state->streams);
+    state->objectives = malloc((nb_values > 0 ? nb_values : 1)
+                               * sizeof *state->objectives);
+    state->population = malloc((nb_genomes > 0 ? nb_genomes : 1)
+                               * sizeof *state->population);
+    if (state->streams == NULL || state->objectives == NULL
+        || state->population == NULL) {
+        fprintf(stderr, "%s: could not allocate the state.\n", __func__);
+        state->nb_genomes = 0;
+        checkpoint_state_free(state);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < nb_streams; i++) {
+        state->streams[i].key = bytes_get(&data, 8);
+        state->streams[i].counter = bytes_get(&data, 8);
+    }
+    for (size_t i = 0; i < nb_values; i++) {
+        uint64_t const bits = bytes_get(&data, 8);
+        memcpy(&state->objectives[i], &bits, sizeof bits);
+    }
+
+    size_t nb_read;
+    if (!genome_population_deserialize(data, end - data, state->population,
+                                       (int) nb_genomes, &nb_read,
+                                       nb_threads)) {
+        state->nb_genomes = 0;
+        checkpoint_state_free(state);
+        return false;
+    }
+    if (nb_read != (size_t) (end - data)) {
+        fprintf(stderr, "%s: data after the genomes.\n", __func__);
+        checkpoint_state_free(state);
+        return false;
+    }
+    return true;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Copy a state, genomes included.
+/// \param  dst     Output, empty on entry. Left empty on failure.
+/// \param  src
+/// \return True on success.
+//  ----------------------------------------------------------------------------
+static bool state_copy(checkpoint_state_t * const dst,
+                       checkpoint_state_t const * const src)
+{
+    size_t const nb_values = (size_t) src->nb_genomes * src->nb_objectives;
+
+    *dst = (checkpoint_state_t) {
+        .generation = src->generation,
+        .nb_objectives = src->nb_objectives,
+        .nb_streams = src->nb_streams
+    };
+    dst->streams = malloc((src->nb_streams > 0 ? src->nb_streams : 1)
+                          * sizeof *dst->streams);
+    dst->objectives = malloc((nb_values > 0 ? nb_values : 1)
+                             * sizeof *dst->objectives);
+    dst->population = calloc(src->nb_genomes > 0 ? src->nb_genomes : 1,
+                             sizeof *dst->population);
+    if (dst->streams == NULL || dst->objectives == NULL
+        || dst->population == NULL) {
+        checkpoint_state_free(dst);
+        return false;
+    }
+    if (src->nb_streams > 0) {
+        memcpy(dst->streams, src->streams,
+               src->nb_streams * sizeof *dst->streams);
+    }
+    if (nb_values > 0) {
+        memcpy(dst->objectives, src->objectives,
+               nb_values * sizeof *dst->objectives);
+    }
+
+    dst->nb_genomes = src->nb_genomes;
+    for (int i = 0; i < src->nb_genomes; i++) {
+        genome_copy(&dst->population[i], src->population[i]);
+        if (dst->population[i] == NULL) {
+            checkpoint_state_free(dst);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Run from the thread of the writer's task.
+static void writer_save(void *context)
+{
+    checkpoint_writer_t *writer = context;
+    writer->success = checkpoint_save(writer->path, &writer->snapshot);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the magic and the machine configuration a checkpoint depends
+/// on. Genes are only meaningful with the registers and operations they were
+/// evolved with.
+/// \param  config  Output.
+//  ----------------------------------------------------------------------------
+static void config_get(uint32_t config[CHECKPOINT_CONFIG_SIZE])
+{
+    config[0] = CHECKPOINT_MAGIC;
+    machine_config_get(&config[1]);
+}
+
+
+// Write the nb_bytes low bytes of value, little endian, and return the end.
+static uint8_t *bytes_put(uint8_t *data, uint64_t const value,
+                          int const nb_bytes)
+{
+    for (int i = 0; i < nb_bytes; i++) {
+        *data++ = (uint8_t) (value >> (8 * i));
+    }
+    return data;
+}
+
+
+// Read a little endian value of nb_bytes and move past it.
+static uint64_t bytes_get(uint8_t const **data, int const nb_bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < nb_bytes; i++) {
+        value |= (uint64_t) (*data)[i] << (8 * i);
+    }
+    *data += nb_bytes;
+    return value;
+}
@@ -0,0 +1,104 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+#ifndef CHECKPOINT_H_INCLUDED
+#define CHECKPOINT_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "genome.h"
+#include "randomizer.h"
+
+// State of an evolution, enough to go on from where it was saved and get the
+// same results as if it had not stopped.
+typedef struct {
+    uint64_t generation;
+    genome_t **population;
+    int nb_genomes;
+    // nb_objectives values per genome, genome after genome. Can be NULL if
+    // nb_objectives is 0.
+    double *objectives;
+    int nb_objectives;
+    // Random streams of the evolution, in whatever order it uses them. Can be
+    // NULL if nb_streams is 0.
+    random_stream_t *streams;
+    int nb_streams;
+} checkpoint_state_t;
+
+// Saves checkpoints in the background. The state is copied when a save is
+// started, and written to file by a thread of its own while the evolution
+// goes on with the original.
+typedef struct checkpoint_writer_s checkpoint_writer_t;
+
+//  ----------------------------------------------------------------------------
+/// \brief  Save a state to file, from the calling thread. The file is written
+/// under a temporary name and renamed when complete, so that a previous
+/// checkpoint at path is only replaced by a complete one.
+/// \param  path
+/// \param  state
+/// \return True if the checkpoint was saved.
+//  ----------------------------------------------------------------------------
+bool checkpoint_save(char const * const path,
+                     checkpoint_state_t const * const state);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Load a state saved by checkpoint_save() or by a writer. The machine
+/// configuration must be the one it was saved with.
+/// \param  path
+/// \param  state       Output, to be freed with checkpoint_state_free().
+/// \param  nb_threads  Number of threads to decode the genomes from.
+/// \return True on success. On failure state is left empty.
+//  ----------------------------------------------------------------------------
+bool checkpoint_load(char const * const path, checkpoint_state_t * const state,
+                     int const nb_threads);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Destroy the genomes and free the arrays of a loaded state, and set
+/// it empty.
+/// \param  state
+//  ----------------------------------------------------------------------------
+void checkpoint_state_free(checkpoint_state_t * const state);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create a writer, with no save running.
+/// \return Pointer to the new writer, NULL on failure.
+//  ----------------------------------------------------------------------------
+checkpoint_writer_t *checkpoint_writer_create(void);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Wait for the running save, if any, free the writer and set the
+/// pointer to NULL.
+/// \param  writer
+//  ----------------------------------------------------------------------------
+void checkpoint_writer_destroy(checkpoint_writer_t **writer);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Start saving a state in the background. Waits for the previous
+/// save of the writer first, if it is still running. Only copying the state
+/// is done before returning, state can be modified or freed afterwards.
+/// \param  writer
+/// \param  path
+/// \param  state
+/// \return True if the save was started.
+//  ----------------------------------------------------------------------------
+bool checkpoint_writer_start(checkpoint_writer_t * const writer,
+                             char const * const path,
+                             checkpoint_state_t const * const state);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Check whether a save is running, without waiting.
+/// \param  writer
+/// \return True if the last save started has not finished yet.
+//  ----------------------------------------------------------------------------
+bool checkpoint_writer_busy(checkpoint_writer_t const * const writer);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Wait for the running save to finish.
+/// \param  writer
+/// \return True if the last save started succeeded, or if none was started.
+//  ----------------------------------------------------------------------------
+bool checkpoint_writer_wait(checkpoint_writer_t * const writer);
+
+#endif // CHECKPOINT_H_INCLUDED
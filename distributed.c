@@ -0,0 +1,732 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+#include "distributed.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "evaluator.h"
+#include "fitness.h"
+#include "genome.h"
+#include "machine/machine.h"
+#include "network.h"
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+// Number of batches sent to a worker before the first is answered.
+#define DISTRIBUTED_PIPELINE_DEPTH  (3)
+
+// Longest message accepted, guards against corrupted lengths.
+#define DISTRIBUTED_MESSAGE_MAX     (1U << 28)
+
+// Bytes read from a worker at once.
+#define DISTRIBUTED_RECEIVE_SIZE    (64 * 1024)
+
+#define DISTRIBUTED_MAGIC           (0x67656e31U)
+#define DISTRIBUTED_HELLO_SIZE      (1 + MACHINE_CONFIG_SIZE)
+
+//******************************************************************************
+// Type definitions
+//******************************************************************************
+// Every message starts with a header, followed by length bytes of payload.
+// Integers are in host order, master and workers share the configuration.
+// - HELLO, master to worker: the machine configuration, see hello_get().
+// - CASES, master to worker: nb_cases, nb_inputs, the inputs, the targets.
+// - BATCH, master to worker: first, nb_genomes, then the serialized genomes.
+// - RESULT, worker to master: first, nb_genomes, then the objectives.
+// - QUIT, master to worker: no payload.
+typedef enum {
+    MESSAGE_HELLO,
+    MESSAGE_CASES,
+    MESSAGE_BATCH,
+    MESSAGE_RESULT,
+    MESSAGE_QUIT
+} message_type_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t length;
+} message_header_t;
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} buffer_t;
+
+// Genomes [first, first + nb_genomes) of the population being evaluated.
+typedef struct {
+    int first;
+    int nb_genomes;
+} batch_t;
+
+// Connection to a worker, with the data not sent yet, the data received and
+// not yet processed, and the batches sent and not answered, oldest first.
+typedef struct {
+    int connection;
+    buffer_t out;
+    size_t nb_sent;
+    buffer_t in;
+    batch_t batches[DISTRIBUTED_PIPELINE_DEPTH];
+    int first_batch;
+    int nb_batches;
+} link_t;
+
+struct distributed_master_s {
+    link_t *links;
+    int nb_workers;
+};
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+static void hello_get(uint32_t hello[DISTRIBUTED_HELLO_SIZE]);
+static bool cases_read(uint8_t const * const payload, uint32_t const length,
+                       evaluator_cases_t * const cases,
+                       register_value_t ** const values);
+static bool batch_evaluate(int const connection,
+                           uint8_t const * const payload,
+                           uint32_t const length,
+                           evaluator_cases_t const * const cases,
+                           int const nb_threads);
+static bool batch_append(link_t * const link, genome_t * const population[],
+                         int const first, int const nb_genomes);
+static bool message_append(buffer_t * const buffer, message_type_t const type,
+                           void const * const payload, size_t const length);
+static int link_receive(link_t * const link, double objectives[]);
+static bool link_send(link_t * const link);
+static bool buffer_reserve(buffer_t * const buffer, size_t const capacity);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+//  ----------------------------------------------------------------------------
+/// \brief  Serve a master: answer each batch with its objectives, in the order
+/// received. The next batches wait in the socket while one is evaluated.
+/// \param  connection
+/// \param  nb_threads
+/// \return True if the master quit normally.
+//  ----------------------------------------------------------------------------
+bool distributed_worker_run(int const connection, int const nb_threads)
+{
+    uint8_t *payload = NULL;
+    uint32_t payload_capacity = 0;
+    register_value_t *values = NULL;
+    evaluator_cases_t cases = { 0 };
+    bool configured = false;
+    bool has_cases = false;
+    bool quit = false;
+
+    message_header_t header;
+    while (!quit && network_read(connection, &header, sizeof header)) {
+        if (header.length > DISTRIBUTED_MESSAGE_MAX) {
+            fprintf(stderr, "%s: message too long.\n", __func__);
+            break;
+        }
+        if (header.length > payload_capacity) {
+            uint8_t *larger = realloc(payload, header.length);
+            if (larger == NULL) {
+                fprintf(stderr, "%s: could not allocate message.\n",
+                        __func__);
+                break;
+            }
+            payload = larger;
+            payload_capacity = header.length;
+        }
+        if (!network_read(connection, payload, header.length)) {
+            break;
+        }
+
+        bool success = true;
+        if (header.type == MESSAGE_HELLO) {
+            uint32_t hello[DISTRIBUTED_HELLO_SIZE];
+            hello_get(hello);
+            configured = header.length == sizeof hello
+                         && memcmp(payload, hello, sizeof hello) == 0;
+            if (!configured) {
+                fprintf(stderr, "%s: master configured differently.\n",
+                        __func__);
+            }
+            success = configured;
+        } else if (header.type == MESSAGE_QUIT) {
+            quit = true;
+        } else if (!configured) {
+            fprintf(stderr, "%s: no hello from master.\n", __func__);
+            success = false;
+        } else if (header.type == MESSAGE_CASES) {
+            has_cases = cases_read(payload, header.length, &cases, &values);
+            success = has_cases;
+        } else if (header.type == MESSAGE_BATCH && has_cases) {
+            success = batch_evaluate(connection, payload, header.length, &cases,
+                                     nb_threads);
+        } else {
+            fprintf(stderr, "%s: unexpected message %u.\n", __func__,
+                    header.type);
+            success = false;
+        }
+        if (!success) {
+            break;
+        }
+    }
+
+    network_close(connection);
+    free(payload);
+    free(values);
+    return quit;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Fork worker processes. A worker does not keep the connections to
+/// the workers forked before it, so that they see the master close them.
+/// \param  nb_workers
+/// \param  nb_threads
+/// \param  connections
+/// \param  processes
+/// \return True if all workers were started.
+//  ----------------------------------------------------------------------------
+bool distributed_workers_spawn(int const nb_workers, int const nb_threads,
+                               int connections[], int processes[])
+{
+    assert(connections || nb_workers == 0);
+    assert(processes || nb_workers == 0);
+
+    for (int i = 0; i < nb_workers; i++) {
+        processes[i] = network_process_fork(&connections[i], connections, i);
+        if (processes[i] == 0) {
+            network_process_exit(distributed_worker_run(connections[i],
+                                                        nb_threads));
+        }
+
+        if (processes[i] < 0) {
+            // Closing the connections stops the workers already started.
+            for (int j = 0; j < i; j++) {
+                network_close(connections[j]);
+            }
+            distributed_workers_wait(processes, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Wait for workers to end.
+/// \param  processes
+/// \param  nb_workers
+/// \return True if all of them ended normally.
+//  ----------------------------------------------------------------------------
+bool distributed_workers_wait(int const processes[], int const nb_workers)
+{
+    bool success = true;
+    for (int i = 0; i < nb_workers; i++) {
+        success &= network_process_wait(processes[i]);
+    }
+    return success;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create a master. The hello and the cases are queued for each
+/// worker, and sent with the first batches.
+/// \param  connections
+/// \param  nb_workers
+/// \param  cases
+/// \return Pointer to the new master, NULL on failure.
+//  ----------------------------------------------------------------------------
+distributed_master_t *distributed_master_create(int const connections[],
+                                                int const nb_workers,
+                                                evaluator_cases_t const *
+                                                const cases)
+{
+    assert(connections || nb_workers == 0);
+    assert(cases);
+
+    if (nb_workers < 1) {
+        fprintf(stderr, "%s: at least one worker is needed.\n", __func__);
+        return NULL;
+    }
+    if (cases->targets == NULL && cases->nb_cases > 0) {
+        fprintf(stderr, "%s: the cases have no targets.\n", __func__);
+        return NULL;
+    }
+
+    distributed_master_t *master = malloc(sizeof *master);
+    link_t *links = calloc(nb_workers, sizeof *links);
+    if (master == NULL || links == NULL) {
+        fprintf(stderr, "%s: could not allocate master.\n", __func__);
+        free(master);
+        free(links);
+        return NULL;
+    }
+    *master = (distributed_master_t) {
+        .links = links,
+        .nb_workers = nb_workers
+    };
+
+    uint32_t hello[DISTRIBUTED_HELLO_SIZE];
+    hello_get(hello);
+    size_t const nb_values = (size_t) cases->nb_cases * cases->nb_inputs;
+    uint32_t const counts[2] = {
+        (uint32_t) cases->nb_cases,
+        (uint32_t) cases->nb_inputs
+    };
+    size_t const cases_length = sizeof counts + (nb_values + cases->nb_cases)
+                                * sizeof (register_value_t);
+
+    bool success = cases_length <= DISTRIBUTED_MESSAGE_MAX;
+    for (int i = 0; i < nb_workers; i++) {
+        link_t *link = &links[i];
+        link->connection = connections[i];
+        if (!success) {
+            continue;
+        }
+
+        success = network_nonblocking_set(link->connection, true)
+                  && message_append(&link->out, MESSAGE_HELLO, hello,
+                                    sizeof hello)
+                  && message_append(&link->out, MESSAGE_CASES, NULL,
+                                    cases_length);
+        if (success) {
+            // The cases payload is filled in place.
+            uint8_t *payload = &link->out.data[link->out.size - cases_length];
+            memcpy(payload, counts, sizeof counts);
+            payload += sizeof counts;
+            memcpy(payload, cases->inputs,
+                   nb_values * sizeof (register_value_t));
+            payload += nb_values * sizeof (register_value_t);
+            memcpy(payload, cases->targets,
+                   cases->nb_cases * sizeof (register_value_t));
+        }
+    }
+
+    if (!success) {
+        fprintf(stderr, "%s: could not prepare the workers.\n", __func__);
+        distributed_master_destroy(&master);
+    }
+    return master;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Send the workers what is left to send followed by a quit message,
+/// then close the connections.
+/// \param  master
+//  ----------------------------------------------------------------------------
+void distributed_master_destroy(distributed_master_t **master)
+{
+    if (*master == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < (*master)->nb_workers; i++) {
+        link_t *link = &(*master)->links[i];
+        if (network_nonblocking_set(link->connection, false)
+            && message_append(&link->out, MESSAGE_QUIT, NULL, 0)) {
+            // A worker that is gone cannot be told anything.
+            network_write(link->connection, &link->out.data[link->nb_sent],
+                          link->out.size - link->nb_sent);
+        }
+        network_close(link->connection);
+        free(link->out.data);
+        free(link->in.data);
+    }
+
+    free((*master)->links);
+    free(*master);
+    *master = NULL;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Evaluate a population on the workers. Each worker is kept
+/// DISTRIBUTED_PIPELINE_DEPTH batches ahead, a new batch going to whichever
+/// worker answers, so faster workers get more batches.
+/// \param  master
+/// \param  population
+/// \param  nb_genomes
+/// \param  objectives
+/// \param  batch_size
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool distributed_population_evaluate(distributed_master_t * const master,
+                                     genome_t * const population[],
+                                     int const nb_genomes,
+                                     double objectives[],
+                                     int const batch_size)
+{
+    assert(master);
+    assert(population || nb_genomes == 0);
+    assert(objectives || nb_genomes == 0);
+
+    if (batch_size < 1) {
+        fprintf(stderr, "%s: batch_size must be at least 1.\n", __func__);
+        return false;
+    }
+
+    int *connections = malloc(master->nb_workers * sizeof *connections);
+    bool *writing = malloc(master->nb_workers * sizeof *writing);
+    bool *readable = malloc(master->nb_workers * sizeof *readable);
+    bool *writable = malloc(master->nb_workers * sizeof *writable);
+    bool success = connections != NULL && writing != NULL
+                   && readable != NULL && writable != NULL;
+    if (!success) {
+        fprintf(stderr, "%s: could not allocate memory.\n", __func__);
+    }
+
+    int nb_queued = 0;
+    int nb_done = 0;
+    while (success && nb_done < nb_genomes) {
+        for (int i = 0; i < master->nb_workers && success; i++) {
+            link_t *link = &master->links[i];
+            while (success && link->nb_batches < DISTRIBUTED_PIPELINE_DEPTH
+                   && nb_queued < nb_genomes) {
+                int nb_batch = nb_genomes - nb_queued;
+                if (nb_batch > batch_size) {
+                    nb_batch = batch_size;
+                }
+                success = batch_append(link, population, nb_queued, nb_batch);
+                nb_queued += nb_batch;
+            }
+            connections[i] = link->connection;
+            writing[i] = link->nb_sent < link->out.size;
+        }
+
+        success = success && network_wait(connections, writing,
+                                          master->nb_workers, readable,
+                                          writable);
+        for (int i = 0; i < master->nb_workers && success; i++) {
+            link_t *link = &master->links[i];
+            if (writable[i]) {
+                success = link_send(link);
+            }
+            if (success && readable[i]) {
+                int nb_received = link_receive(link, objectives);
+                success = nb_received >= 0;
+                nb_done += nb_received;
+            }
+        }
+        if (!success) {
+            fprintf(stderr, "%s: lost a worker.\n", __func__);
+        }
+    }
+
+    free(connections);
+    free(writing);
+    free(readable);
+    free(writable);
+    return success;
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+//  ----------------------------------------------------------------------------
+/// \brief  Get the magic and the machine configuration, which must be the
+/// same for the master and the workers.
+/// \param  hello   Output.
+//  ----------------------------------------------------------------------------
+static void hello_get(uint32_t hello[DISTRIBUTED_HELLO_SIZE])
+{
+    hello[0] = DISTRIBUTED_MAGIC;
+    machine_config_get(&hello[1]);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Read the cases sent by the master.
+/// \param  payload
+/// \param  length
+/// \param  cases   Output, pointing to values.
+/// \param  values  Storage of the inputs and targets, reallocated.
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+static bool cases_read(uint8_t const * const payload, uint32_t const length,
+                       evaluator_cases_t * const cases,
+                       register_value_t ** const values)
+{
+    uint32_t counts[2];
+    if (length < sizeof counts) {
+        fprintf(stderr, "%s: message too short.\n", __func__);
+        return false;
+    }
+    memcpy(counts, payload, sizeof counts);
+
+    uint64_t const nb_values = (uint64_t) counts[0] * (counts[1] + 1);
+    if (counts[1] > NB_REGISTERS || counts[0] > DISTRIBUTED_MESSAGE_MAX
+        || length != sizeof counts + nb_values * sizeof (register_value_t)) {
+        fprintf(stderr, "%s: invalid cases.\n", __func__);
+        return false;
+    }
+
+    free(*values);
+    *values = malloc((nb_values ? nb_values : 1) * sizeof **values);
+    if (*values == NULL) {
+        fprintf(stderr, "%s: could not allocate cases.\n", __func__);
+        return false;
+    }
+    memcpy(*values, &payload[sizeof counts],
+           nb_values * sizeof (register_value_t));
+
+    *cases = (evaluator_cases_t) {
+        .nb_cases = (int) counts[0],
+        .nb_inputs = (int) counts[1],
+        .inputs = *values,
+        .targets = &(*values)[(size_t) counts[0] * counts[1]]
+    };
+    return true;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Evaluate a batch and send back its result.
+/// \param  connection
+/// \param  payload Batch message.
+/// \param  length
+/// \param  cases
+/// \param  nb_threads
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+static bool batch_evaluate(int const connection,
+                           uint8_t const * const payload,
+                           uint32_t const length,
+                           evaluator_cases_t const * const cases,
+                           int const nb_threads)
+{
+    uint32_t batch[2];
+    if (length < sizeof batch) {
+        fprintf(stderr, "%s: message too short.\n", __func__);
+        return false;
+    }
+    memcpy(batch, payload, sizeof batch);
+    uint32_t const nb_genomes = batch[1];
+    if (nb_genomes > (length - sizeof batch) / 4) {
+        fprintf(stderr, "%s: invalid batch.\n", __func__);
+        return false;
+    }
+
+    size_t const result_length = sizeof batch
+                                 + nb_genomes * FITNESS_NB_OBJECTIVES
+                                 * sizeof (double);
+    genome_t **genomes = calloc(nb_genomes ? nb_genomes : 1, sizeof *genomes);
+    uint8_t *result = malloc(sizeof (message_header_t) + result_length);
+    bool success = genomes != NULL && result != NULL;
+
+    size_t position = sizeof batch;
+    for (uint32_t g = 0; g < nb_genomes && success; g++) {
+        size_t nb_read;
+        genomes[g] = genome_deserialize(&payload[position], length - position,
+                                        &nb_read);
+        success = genomes[g] != NULL;
+        position += success ? nb_read : 0;
+    }
+
+    if (success) {
+        message_header_t const header = {
+            .type = MESSAGE_RESULT,
+            .length = (uint32_t) result_length
+        };
+        memcpy(result, &header, sizeof header);
+        memcpy(&result[sizeof header], batch, sizeof batch);
+        double *objectives = (double *) &result[sizeof header + sizeof batch];
+        success = fitness_population_evaluate(genomes, (int) nb_genomes, cases,
+                                              objectives, nb_threads)
+                  && network_write(connection, result,
+                                   sizeof header + result_length);
+    } else {
+        fprintf(stderr, "%s: invalid batch.\n", __func__);
+    }
+
+    for (uint32_t g = 0; genomes != NULL && g < nb_genomes; g++) {
+        genome_destroy(&genomes[g]);
+    }
+    free(genomes);
+    free(result);
+    return success;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Queue a batch of genomes for a worker.
+/// \param  link
+/// \param  population
+/// \param  first       First genome of the batch.
+/// \param  nb_genomes  Number of genomes in the batch.
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+static bool batch_append(link_t * const link, genome_t * const population[],
+                         int const first, int const nb_genomes)
+{
+    uint32_t const batch[2] = { (uint32_t) first, (uint32_t) nb_genomes };
+    size_t length = sizeof batch;
+    for (int g = first; g < first + nb_genomes; g++) {
+        length += genome_serialized_size_get(population[g]);
+    }
+    if (length > DISTRIBUTED_MESSAGE_MAX) {
+        fprintf(stderr, "%s: batch too large.\n", __func__);
+        return false;
+    }
+    if (!message_append(&link->out, MESSAGE_BATCH, NULL, length)) {
+        return false;
+    }
+
+    uint8_t *payload = &link->out.data[link->out.size - length];
+    memcpy(payload, batch, sizeof batch);
+    payload += sizeof batch;
+    for (int g = first; g < first + nb_genomes; g++) {
+        payload += genome_serialize(population[g], payload,
+                                    genome_serialized_size_get(population[g]));
+    }
+
+    int const last = (link->first_batch + link->nb_batches)
+                     % DISTRIBUTED_PIPELINE_DEPTH;
+    link->batches[last] = (batch_t) {
+        .first = first,
+        .nb_genomes = nb_genomes
+    };
+    link->nb_batches++;
+    return true;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Append a message to a buffer.
+/// \param  buffer
+/// \param  type
+/// \param  payload Payload to copy, or NULL to leave it to the caller.
+/// \param  length  Length of the payload.
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+static bool message_append(buffer_t * const buffer, message_type_t const type,
+                           void const * const payload, size_t const length)
+{
+    message_header_t const header = {
+        .type = type,
+        .length = (uint32_t) length
+    };
+    if (!buffer_reserve(buffer, buffer->size + sizeof header + length)) {
+        fprintf(stderr, "%s: could not allocate message.\n", __func__);
+        return false;
+    }
+
+    memcpy(&buffer->data[buffer->size], &header, sizeof header);
+    buffer->size += sizeof header;
+    if (payload != NULL) {
+        memcpy(&buffer->data[buffer->size], payload, length);
+    }
+    buffer->size += length;
+    return true;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Read what a worker sent, and store the objectives of the complete
+/// results.
+/// \param  link
+/// \param  objectives  Objectives of the population.
+/// \return Number of genomes whose objectives were stored, -1 on error.
+//  ----------------------------------------------------------------------------
+static int link_receive(link_t * const link, double objectives[])
+{
+    if (!buffer_reserve(&link->in, link->in.size + DISTRIBUTED_RECEIVE_SIZE)) {
+        fprintf(stderr, "%s: could not allocate input.\n", __func__);
+        return -1;
+    }
+    long const nb_read = network_receive(link->connection,
+                                         &link->in.data[link->in.size],
+                                         DISTRIBUTED_RECEIVE_SIZE);
+    if (nb_read < 0) {
+        return -1;
+    }
+    link->in.size += nb_read;
+
+    int nb_genomes = 0;
+    size_t position = 0;
+    message_header_t header;
+    while (link->in.size - position >= sizeof header) {
+        memcpy(&header, &link->in.data[position], sizeof header);
+        if (link->in.size - position - sizeof header < header.length) {
+            break;
+        }
+
+        batch_t const *expected = &link->batches[link->first_batch];
+        uint8_t const *payload = &link->in.data[position + sizeof header];
+        uint32_t batch[2];
+        size_t const nb_values = (size_t) expected->nb_genomes
+                                 * FITNESS_NB_OBJECTIVES;
+        if (header.type != MESSAGE_RESULT || link->nb_batches == 0
+            || header.length != sizeof batch + nb_values * sizeof (double)) {
+            fprintf(stderr, "%s: unexpected message.\n", __func__);
+            return -1;
+        }
+        memcpy(batch, payload, sizeof batch);
+        if (batch[0] != (uint32_t) expected->first
+            || batch[1] != (uint32_t) expected->nb_genomes) {
+            fprintf(stderr, "%s: unexpected batch.\n", __func__);
+            return -1;
+        }
+        memcpy(&objectives[(size_t) expected->first * FITNESS_NB_OBJECTIVES],
+               &payload[sizeof batch], nb_values * sizeof (double));
+
+        nb_genomes += expected->nb_genomes;
+        link->first_batch = (link->first_batch + 1)
+                            % DISTRIBUTED_PIPELINE_DEPTH;
+        link->nb_batches--;
+        position += sizeof header + header.length;
+    }
+
+    memmove(link->in.data, &link->in.data[position], link->in.size - position);
+    link->in.size -= position;
+    return nb_genomes;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Send what the socket accepts of the data queued for a worker.
+/// \param  link
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+static bool link_send(link_t * const link)
+{
+    long const nb_written = network_send(link->connection,
+                                         &link->out.data[link->nb_sent],
+                                         link->out.size - link->nb_sent);
+    if (nb_written < 0) {
+        return false;
+    }
+
+    link->nb_sent += nb_written;
+    if (link->nb_sent == link->out.size) {
+        link->nb_sent = 0;
+        link->out.size = 0;
+    }
+    return true;
+}
+
+
+static bool buffer_reserve(buffer_t * const buffer, size_t const capacity)
+{
+    if (capacity <= buffer->capacity) {
+        return true;
+    }
+    size_t new_capacity = buffer->capacity ? 2 * buffer->capacity : 4096;
+    while (new_capacity < capacity) {
+        new_capacity *= 2;
+    }
+    uint8_t *data = realloc(buffer->data, new_capacity);
+    if (data == NULL) {
+        return false;
+    }
+    buffer->data = data;
+    buffer->capacity = new_capacity;
+    return true;
+}
@@ -0,0 +1,85 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+#ifndef DISTRIBUTED_H_INCLUDED
+#define DISTRIBUTED_H_INCLUDED
+
+#include <stdbool.h>
+
+#include "evaluator.h"
+#include "genome.h"
+
+// Evaluation of a population by worker processes, possibly on other hosts.
+// The master sends batches of serialized genomes over stream sockets, several
+// per worker so that a worker always has the next batch waiting, and collects
+// the fitness objectives as they come back. Master and workers must be built
+// with the same machine configuration, which is checked on connection. The
+// connections are opened with the network module.
+typedef struct distributed_master_s distributed_master_t;
+
+//  ----------------------------------------------------------------------------
+/// \brief  Serve a master on a connection until it quits or the connection is
+/// lost. The connection is closed on return.
+/// \param  connection  Connection to the master.
+/// \param  nb_threads  Number of threads evaluating each batch.
+/// \return True if the master quit normally.
+//  ----------------------------------------------------------------------------
+bool distributed_worker_run(int const connection, int const nb_threads);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Start worker processes on this host, each connected to the caller.
+/// \param  nb_workers  Number of processes.
+/// \param  nb_threads  Number of threads of each worker.
+/// \param  connections Output, connection to each worker.
+/// \param  processes   Output, process id of each worker.
+/// \return True if all workers were started. Else none is left running.
+//  ----------------------------------------------------------------------------
+bool distributed_workers_spawn(int const nb_workers, int const nb_threads,
+                               int connections[], int processes[]);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Wait for spawned workers to end, after their master is destroyed.
+/// \param  processes   Process id of each worker.
+/// \param  nb_workers  Number of workers.
+/// \return True if all of them ended normally.
+//  ----------------------------------------------------------------------------
+bool distributed_workers_wait(int const processes[], int const nb_workers);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create a master for connected workers and send them the cases.
+/// \param  connections Connection to each worker, owned by the master from
+/// now on.
+/// \param  nb_workers  Number of workers.
+/// \param  cases       Fitness cases, with targets.
+/// \return Pointer to the new master, NULL on failure.
+//  ----------------------------------------------------------------------------
+distributed_master_t *distributed_master_create(int const connections[],
+                                                int const nb_workers,
+                                                evaluator_cases_t const *
+                                                const cases);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Tell the workers to quit, close the connections and free the
+/// master.
+/// \param  master
+//  ----------------------------------------------------------------------------
+void distributed_master_destroy(distributed_master_t **master);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Compute the objectives of a population on the workers. Same result
+/// as fitness_population_evaluate().
+/// \param  master
+/// \param  population  Array of genomes.
+/// \param  nb_genomes  Number of genomes.
+/// \param  objectives  Output, FITNESS_NB_OBJECTIVES values per genome.
+/// \param  batch_size  Number of genomes sent at once.
+/// \return True if no error. A master whose worker failed must be destroyed.
+//  ----------------------------------------------------------------------------
+bool distributed_population_evaluate(distributed_master_t * const master,
+                                     genome_t * const population[],
+                                     int const nb_genomes,
+                                     double objectives[],
+                                     int const batch_size);
+
+#endif // DISTRIBUTED_H_INCLUDED
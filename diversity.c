@@ -0,0 +1,671 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+#include "diversity.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <malloc.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "genome.h"
+#include "machine/machine.h"
+#include "parallel.h"
+#include "randomizer.h"
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+// Genomes are hashed with DIVERSITY_NB_BANDS * DIVERSITY_BAND_ROWS min-hashes
+// of their pairs of consecutive genes. Two genomes share the bucket of a band
+// if all the min-hashes of the band are equal, which is likely if they share
+// most of their pairs: with a fraction s of pairs in common, the probability
+// that they share at least one bucket is 1 - (1 - s^ROWS)^BANDS.
+#define DIVERSITY_NB_BANDS      (8)
+#define DIVERSITY_BAND_ROWS     (2)
+#define DIVERSITY_NB_HASHES     (DIVERSITY_NB_BANDS * DIVERSITY_BAND_ROWS)
+
+// Most genomes taken from the buckets for a query, so that queries stay cheap
+// in a converged population where all genomes share the same buckets.
+#define DIVERSITY_CANDIDATES_MAX    (64)
+
+// Random genomes added to the candidates of diversity_nearest_find().
+#define DIVERSITY_NB_SAMPLES    (8)
+
+// Rows of the edit distance up to this length are kept on the stack.
+#define DIVERSITY_ROW_STACK     (512)
+
+//******************************************************************************
+// Type definitions
+//******************************************************************************
+// The buckets of each band are chains of genomes, linked through prev and
+// next, so that a genome can be moved to another bucket in constant time.
+struct diversity_index_s {
+    genome_t * const *population;
+    int nb_genomes;
+    uint64_t seeds[DIVERSITY_NB_HASHES];
+    diversity_histogram_t *histograms;
+    // Key of the bucket of genome i in band b at [i * DIVERSITY_NB_BANDS + b],
+    // and its neighbours in the chain of that bucket, -1 at the ends.
+    uint64_t *keys;
+    int *prev;
+    int *next;
+    // First genome of bucket k of band b at [b * nb_buckets + k], -1 if empty.
+    int *heads;
+    int nb_buckets;
+};
+
+// A genome to compare with, and the lower bound of its distance.
+typedef struct {
+    int position;
+    int bound;
+} candidate_t;
+
+// Arguments of index_fill() and niche_count(), run from several threads.
+typedef struct {
+    diversity_index_t *index;
+    int radius;
+    int *counts;
+} index_work_t;
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+static void keys_compute(diversity_index_t const * const index,
+                         genome_t const * const genome,
+                         uint64_t keys[DIVERSITY_NB_BANDS]);
+static void index_fill(void *context, int begin, int end);
+static void bucket_link(diversity_index_t * const index, int const position);
+static void bucket_unlink(diversity_index_t * const index,
+                          int const position);
+static int candidates_gather(diversity_index_t const * const index,
+                             uint64_t const keys[DIVERSITY_NB_BANDS],
+                             int const exclude, candidate_t candidates[]);
+static bool candidate_add(candidate_t candidates[], int * const nb_candidates,
+                          int const position, int const exclude);
+static void niche_count(void *context, int begin, int end);
+static bool gene_equal(command_t const * const gene1,
+                       command_t const * const gene2);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+//  ----------------------------------------------------------------------------
+/// \brief  Get the bounded edit distance of two genomes. The common prefix and
+/// suffix are skipped, then only the diagonals at most bound away from the
+/// main one are computed, row by row, until a row exceeds bound.
+/// \param  genome1
+/// \param  genome2
+/// \param  bound
+/// \return Distance, bound + 1 if larger.
+//  ----------------------------------------------------------------------------
+int diversity_edit_distance(genome_t const * const genome1,
+                            genome_t const * const genome2, int const bound)
+{
+    assert(genome1);
+    assert(genome2);
+    assert(bound >= 0);
+
+    int prefix = genome_diff_first(genome1, genome2);
+    if (prefix < 0) {
+        return 0;
+    }
+    command_t const *genes1 = &genome_genes_get(genome1)[prefix];
+    command_t const *genes2 = &genome_genes_get(genome2)[prefix];
+    int size1 = genome_size_get(genome1) - prefix;
+    int size2 = genome_size_get(genome2) - prefix;
+    while (size1 > 0 && size2 > 0
+           && gene_equal(&genes1[size1 - 1], &genes2[size2 - 1])) {
+        size1--;
+        size2--;
+    }
+
+    int const too_far = bound + 1;
+    if (size1 - size2 > bound || size2 - size1 > bound) {
+        return too_far;
+    }
+    if (size1 == 0 || size2 == 0) {
+        return size1 + size2;
+    }
+
+    int stack_rows[2 * DIVERSITY_ROW_STACK];
+    int *rows = stack_rows;
+    if (size2 + 1 > DIVERSITY_ROW_STACK) {
+        rows = malloc(2 * (size2 + 1) * sizeof *rows);
+        if (rows == NULL) {
+            fprintf(stderr, "%s: could not allocate rows.\n", __func__);
+            return too_far;
+        }
+    }
+    int *previous = rows;
+    int *current = &rows[size2 + 1];
+
+    // Cells out of the band count as too far.
+    for (int j = 0; j <= size2; j++) {
+        previous[j] = j <= bound ? j : too_far;
+    }
+    int distance = too_far;
+    for (int i = 1; i <= size1; i++) {
+        int const low = i - bound > 1 ? i - bound : 1;
+        int const high = i + bound < size2 ? i + bound : size2;
+        current[low - 1] = low == 1 && i <= bound ? i : too_far;
+        int row_min = current[low - 1];
+
+        for (int j = low; j <= high; j++) {
+            int cell = previous[j - 1]
+                + !gene_equal(&genes1[i - 1], &genes2[j - 1]);
+            if (previous[j] + 1 < cell) {
+                cell = previous[j] + 1;
+            }
+            if (current[j - 1] + 1 < cell) {
+                cell = current[j - 1] + 1;
+            }
+            current[j] = cell < too_far ? cell : too_far;
+            if (current[j] < row_min) {
+                row_min = current[j];
+            }
+        }
+        if (high < size2) {
+            current[high + 1] = too_far;
+        }
+        if (row_min >= too_far) {
+            break;
+        }
+
+        int *swap = previous;
+        previous = current;
+        current = swap;
+        if (i == size1) {
+            distance = previous[size2];
+        }
+    }
+
+    if (rows != stack_rows) {
+        free(rows);
+    }
+    return distance;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Compute the gene histogram of a genome.
+/// \param  genome
+/// \param  histogram
+//  ----------------------------------------------------------------------------
+void diversity_histogram_compute(genome_t const * const genome,
+                                 diversity_histogram_t * const histogram)
+{
+    assert(genome);
+    assert(histogram);
+
+    memset(histogram, 0, sizeof *histogram);
+    command_t const *genes = genome_genes_get(genome);
+    for (int i = 0; i < genome_size_get(genome); i++) {
+        uint64_t const word = (uint64_t) genes[i].dst
+            | (uint64_t) genes[i].op << 8
+            | (uint64_t) genes[i].src1 << 16
+            | (uint64_t) genes[i].src2 << 24;
+        uint16_t *bin = &histogram->bins[random_mix(word) >> 58];
+        if (*bin < UINT16_MAX) {
+            (*bin)++;
+        }
+    }
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the lower bound of the edit distance given by two histograms.
+/// A replaced gene changes the sum of the bin differences, l1, by at most 2,
+/// an inserted or deleted one by 1 and the size difference by 1. The p
+/// insertions and deletions and s replacements therefore satisfy l1 <= p + 2 s
+/// and p >= size difference, so p + s >= (l1 + size difference) / 2. The loop
+/// has no branch, so that it vectorizes.
+/// \param  histogram1
+/// \param  histogram2
+/// \return Lower bound of the edit distance.
+//  ----------------------------------------------------------------------------
+int diversity_histogram_distance(diversity_histogram_t const * const
+                                 histogram1,
+                                 diversity_histogram_t const * const
+                                 histogram2)
+{
+    assert(histogram1);
+    assert(histogram2);
+
+    int l1 = 0;
+    int size_difference = 0;
+    for (int i = 0; i < DIVERSITY_NB_BINS; i++) {
+        int const difference = (int) histogram1->bins[i]
+            - (int) histogram2->bins[i];
+        l1 += difference < 0 ? -difference : difference;
+        size_difference += difference;
+    }
+    if (size_difference < 0) {
+        size_difference = -size_difference;
+    }
+    return (l1 + size_difference + 1) / 2;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create an index. The histograms and bucket keys are computed from
+/// several threads, the buckets are then linked in population order.
+/// \param  population
+/// \param  nb_genomes
+/// \param  seed
+/// \param  nb_threads
+/// \return Pointer to the new index, NULL on failure.
+//  ----------------------------------------------------------------------------
+diversity_index_t *diversity_index_create(genome_t * const population[],
+                                          int const nb_genomes,
+                                          uint64_t const seed,
+                                          int const nb_threads)
+{
+    assert(population || nb_genomes == 0);
+
+    diversity_index_t *index = malloc(sizeof *index);
+    if (index == NULL) {
+        fprintf(stderr, "%s: could not allocate index.\n", __func__);
+        return NULL;
+    }
+    index->population = population;
+    index->nb_genomes = nb_genomes;
+    index->nb_buckets = 1;
+    while (index->nb_buckets < nb_genomes) {
+        index->nb_buckets *= 2;
+    }
+
+    random_stream_t stream;
+    random_stream_init(&stream, seed, 0, 0);
+    random_stream_fill(&stream, index->seeds, DIVERSITY_NB_HASHES);
+
+    size_t const nb_entries = (size_t) nb_genomes * DIVERSITY_NB_BANDS + 1;
+    index->histograms = malloc((nb_genomes + 1)
+                               * sizeof *index->histograms);
+    index->keys = malloc(nb_entries * sizeof *index->keys);
+    index->prev = malloc(nb_entries * sizeof *index->prev);
+    index->next = malloc(nb_entries * sizeof *index->next);
+    index->heads = malloc((size_t) index->nb_buckets * DIVERSITY_NB_BANDS
+                          * sizeof *index->heads);
+    if (index->histograms == NULL || index->keys == NULL
+        || index->prev == NULL || index->next == NULL
+        || index->heads == NULL) {
+        fprintf(stderr, "%s: could not allocate index.\n", __func__);
+        diversity_index_destroy(&index);
+        return NULL;
+    }
+
+    for (size_t k = 0; k < (size_t) index->nb_buckets * DIVERSITY_NB_BANDS;
+         k++) {
+        index->heads[k] = -1;
+    }
+    index_work_t work = { .index = index };
+    parallel_for(nb_genomes, nb_threads, index_fill, &work);
+    // Linked from the last, so that each chain is in population order.
+    for (int i = nb_genomes - 1; i >= 0; i--) {
+        bucket_link(index, i);
+    }
+    return index;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Free an index.
+/// \param  index
+//  ----------------------------------------------------------------------------
+void diversity_index_destroy(diversity_index_t **index)
+{
+    assert(index);
+    if (*index == NULL) {
+        return;
+    }
+    free((*index)->histograms);
+    free((*index)->keys);
+    free((*index)->prev);
+    free((*index)->next);
+    free((*index)->heads);
+    free(*index);
+    *index = NULL;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Move a genome to the buckets of its current genes.
+/// \param  index
+/// \param  position
+//  ----------------------------------------------------------------------------
+void diversity_index_update(diversity_index_t * const index,
+                            int const position)
+{
+    assert(index);
+    assert(position >= 0 && position < index->nb_genomes);
+
+    genome_t const *genome = index->population[position];
+    bucket_unlink(index, position);
+    diversity_histogram_compute(genome, &index->histograms[position]);
+    keys_compute(index, genome,
+                 &index->keys[(size_t) position * DIVERSITY_NB_BANDS]);
+    bucket_link(index, position);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Find a close genome. The candidates are compared by increasing
+/// histogram bound, and the search stops at the first bound that is not
+/// below the best distance found. Each distance is only computed up to the
+/// best one.
+/// \param  index
+/// \param  genome
+/// \param  exclude
+/// \param  stream
+/// \param  distance
+/// \return Index of the neighbour, -1 if none.
+//  ----------------------------------------------------------------------------
+int diversity_nearest_find(diversity_index_t const * const index,
+                           genome_t const * const genome, int const exclude,
+                           random_stream_t * const stream,
+                           int * const distance)
+{
+    assert(index);
+    assert(genome);
+    assert(stream);
+
+    uint64_t keys[DIVERSITY_NB_BANDS];
+    keys_compute(index, genome, keys);
+    candidate_t candidates[DIVERSITY_CANDIDATES_MAX + DIVERSITY_NB_SAMPLES];
+    int nb_candidates = candidates_gather(index, keys, exclude, candidates);
+    for (int s = 0; s < DIVERSITY_NB_SAMPLES && index->nb_genomes > 0; s++) {
+        candidate_add(candidates, &nb_candidates,
+                      random_stream_get(stream, index->nb_genomes), exclude);
+    }
+
+    diversity_histogram_t histogram;
+    diversity_histogram_compute(genome, &histogram);
+    for (int c = 0; c < nb_candidates; c++) {
+        candidate_t const candidate = {
+            .position = candidates[c].position,
+            .bound = diversity_histogram_distance(
+                &histogram, &index->histograms[candidates[c].position])
+        };
+        int k = c;
+        for (; k > 0 && (candidates[k - 1].bound > candidate.bound
+                         || (candidates[k - 1].bound == candidate.bound
+                             && candidates[k - 1].position
+                             > candidate.position)); k--) {
+            candidates[k] = candidates[k - 1];
+        }
+        candidates[k] = candidate;
+    }
+
+    int nearest = -1;
+    int best = INT_MAX;
+    int const size = genome_size_get(genome);
+    for (int c = 0; c < nb_candidates && candidates[c].bound < best; c++) {
+        genome_t const *other = index->population[candidates[c].position];
+        int const other_size = genome_size_get(other);
+        int bound = size > other_size ? size : other_size;
+        if (best - 1 < bound) {
+            bound = best - 1;
+        }
+        int const d = diversity_edit_distance(genome, other, bound);
+        if (d < best) {
+            best = d;
+            nearest = candidates[c].position;
+        }
+    }
+
+    if (distance != NULL) {
+        *distance = best;
+    }
+    return nearest;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Count the genomes around each genome.
+/// \param  index
+/// \param  radius
+/// \param  counts
+/// \param  nb_threads
+//  ----------------------------------------------------------------------------
+void diversity_niche_counts_get(diversity_index_t const * const index,
+                                int const radius, int counts[],
+                                int const nb_threads)
+{
+    assert(index);
+    assert(radius >= 0);
+    assert(counts || index->nb_genomes == 0);
+
+    index_work_t work = {
+        .index = (diversity_index_t *) index,
+        .radius = radius,
+        .counts = counts
+    };
+    parallel_for(index->nb_genomes, nb_threads, niche_count, &work);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Replace the closest genome by an offspring if it is at least as
+/// fit.
+/// \param  index
+/// \param  population
+/// \param  fitness
+/// \param  offspring
+/// \param  offspring_fitness
+/// \param  stream
+/// \return Index of the replaced genome, -1 if none.
+//  ----------------------------------------------------------------------------
+int diversity_crowding_replace(diversity_index_t * const index,
+                               genome_t *population[], double fitness[],
+                               genome_t * const offspring,
+                               double const offspring_fitness,
+                               random_stream_t * const stream)
+{
+    assert(index);
+    assert(population == index->population);
+    assert(fitness);
+    assert(offspring);
+
+    int const nearest = diversity_nearest_find(index, offspring, -1, stream,
+                                               NULL);
+    if (nearest < 0 || offspring_fitness > fitness[nearest]) {
+        return -1;
+    }
+    genome_destroy(&population[nearest]);
+    population[nearest] = offspring;
+    fitness[nearest] = offspring_fitness;
+    diversity_index_update(index, nearest);
+    return nearest;
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+//  ----------------------------------------------------------------------------
+/// \brief  Compute the bucket keys of a genome. Each min-hash is the smallest
+/// hash of the pairs of consecutive genes, or of the single gene of a genome
+/// of one gene, and the key of a band hashes its min-hashes.
+/// \param  index
+/// \param  genome
+/// \param  keys    Output, key of each band.
+//  ----------------------------------------------------------------------------
+static void keys_compute(diversity_index_t const * const index,
+                         genome_t const * const genome,
+                         uint64_t keys[DIVERSITY_NB_BANDS])
+{
+    uint64_t minima[DIVERSITY_NB_HASHES];
+    for (int h = 0; h < DIVERSITY_NB_HASHES; h++) {
+        minima[h] = UINT64_MAX;
+    }
+
+    command_t const *genes = genome_genes_get(genome);
+    int const size = genome_size_get(genome);
+    uint64_t previous = 0;
+    for (int i = 0; i < size; i++) {
+        uint64_t const word = (uint64_t) genes[i].dst
+            | (uint64_t) genes[i].op << 8
+            | (uint64_t) genes[i].src1 << 16
+            | (uint64_t) genes[i].src2 << 24;
+        uint64_t const pair = previous << 32 | word;
+        previous = word;
+        if (i == 0 && size > 1) {
+            continue;
+        }
+        for (int h = 0; h < DIVERSITY_NB_HASHES; h++) {
+            uint64_t const hash = random_mix(pair ^ index->seeds[h]);
+            if (hash < minima[h]) {
+                minima[h] = hash;
+            }
+        }
+    }
+
+    for (int b = 0; b < DIVERSITY_NB_BANDS; b++) {
+        uint64_t key = index->seeds[b];
+        for (int r = 0; r < DIVERSITY_BAND_ROWS; r++) {
+            key = random_mix(key ^ minima[b * DIVERSITY_BAND_ROWS + r]);
+        }
+        keys[b] = key;
+    }
+}
+
+
+// Compute the histograms and keys of the genomes [begin, end).
+static void index_fill(void *context, int begin, int end)
+{
+    diversity_index_t *index = ((index_work_t *) context)->index;
+
+    for (int i = begin; i < end; i++) {
+        diversity_histogram_compute(index->population[i],
+                                    &index->histograms[i]);
+        keys_compute(index, index->population[i],
+                     &index->keys[(size_t) i * DIVERSITY_NB_BANDS]);
+    }
+}
+
+
+// Put a genome first in the buckets of its keys.
+static void bucket_link(diversity_index_t * const index, int const position)
+{
+    for (int b = 0; b < DIVERSITY_NB_BANDS; b++) {
+        size_t const entry = (size_t) position * DIVERSITY_NB_BANDS + b;
+        int *head = &index->heads[(size_t) b * index->nb_buckets
+                                  + (index->keys[entry]
+                                     & (index->nb_buckets - 1))];
+        index->prev[entry] = -1;
+        index->next[entry] = *head;
+        if (*head >= 0) {
+            index->prev[(size_t) *head * DIVERSITY_NB_BANDS + b] = position;
+        }
+        *head = position;
+    }
+}
+
+
+// Take a genome out of the buckets of its keys.
+static void bucket_unlink(diversity_index_t * const index, int const position)
+{
+    for (int b = 0; b < DIVERSITY_NB_BANDS; b++) {
+        size_t const entry = (size_t) position * DIVERSITY_NB_BANDS + b;
+        int const prev = index->prev[entry];
+        int const next = index->next[entry];
+        if (prev >= 0) {
+            index->next[(size_t) prev * DIVERSITY_NB_BANDS + b] = next;
+        } else {
+            index->heads[(size_t) b * index->nb_buckets
+                         + (index->keys[entry]
+                            & (index->nb_buckets - 1))] = next;
+        }
+        if (next >= 0) {
+            index->prev[(size_t) next * DIVERSITY_NB_BANDS + b] = prev;
+        }
+    }
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Gather the genomes sharing a bucket with the given keys, band after
+/// band, up to DIVERSITY_CANDIDATES_MAX of them. Genomes merely in the same
+/// chain, with another key, are skipped.
+/// \param  index
+/// \param  keys
+/// \param  exclude     Index of a genome to skip, or -1.
+/// \param  candidates  Output.
+/// \return Number of candidates.
+//  ----------------------------------------------------------------------------
+static int candidates_gather(diversity_index_t const * const index,
+                             uint64_t const keys[DIVERSITY_NB_BANDS],
+                             int const exclude, candidate_t candidates[])
+{
+    int nb_candidates = 0;
+    for (int b = 0; b < DIVERSITY_NB_BANDS; b++) {
+        int position = index->heads[(size_t) b * index->nb_buckets
+                                    + (keys[b] & (index->nb_buckets - 1))];
+        while (position >= 0 && nb_candidates < DIVERSITY_CANDIDATES_MAX) {
+            size_t const entry = (size_t) position * DIVERSITY_NB_BANDS + b;
+            if (index->keys[entry] == keys[b]) {
+                candidate_add(candidates, &nb_candidates, position, exclude);
+            }
+            position = index->next[entry];
+        }
+    }
+    return nb_candidates;
+}
+
+
+// Add a candidate unless it is excluded or already there.
+static bool candidate_add(candidate_t candidates[], int * const nb_candidates,
+                          int const position, int const exclude)
+{
+    if (position == exclude) {
+        return false;
+    }
+    for (int c = 0; c < *nb_candidates; c++) {
+        if (candidates[c].position == position) {
+            return false;
+        }
+    }
+    candidates[(*nb_candidates)++] = (candidate_t) { .position = position };
+    return true;
+}
+
+
+// Count the neighbours of the genomes [begin, end).
+static void niche_count(void *context, int begin, int end)
+{
+    index_work_t const *work = context;
+    diversity_index_t const *index = work->index;
+    candidate_t candidates[DIVERSITY_CANDIDATES_MAX];
+
+    for (int i = begin; i < end; i++) {
+        int const nb_candidates = candidates_gather(
+            index, &index->keys[(size_t) i * DIVERSITY_NB_BANDS], i,
+            candidates);
+        int count = 1;
+        for (int c = 0; c < nb_candidates; c++) {
+            int const other = candidates[c].position;
+            if (diversity_histogram_distance(&index->histograms[i],
+                                             &index->histograms[other])
+                <= work->radius
+                && diversity_edit_distance(index->population[i],
+                                           index->population[other],
+                                           work->radius) <= work->radius) {
+                count++;
+            }
+        }
+        work->counts[i] = count;
+    }
+}
+
+
+static bool gene_equal(command_t const * const gene1,
+                       command_t const * const gene2)
+{
+    return gene1->dst == gene2->dst && gene1->op == gene2->op
+           && gene1->src1 == gene2->src1 && gene1->src2 == gene2->src2;
+}
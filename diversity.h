@@ -0,0 +1,141 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+#ifndef DIVERSITY_H_INCLUDED
+#define DIVERSITY_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "genome.h"
+#include "randomizer.h"
+
+// Number of bins of a gene histogram.
+#define DIVERSITY_NB_BINS   (64)
+
+// Number of genes of a genome falling in each bin, genes being spread over the
+// bins by a hash. Cheap to compare, see diversity_histogram_distance().
+typedef struct {
+    uint16_t bins[DIVERSITY_NB_BINS];
+} diversity_histogram_t;
+
+// Index of a population to find the genomes close to a given one without
+// comparing it to all, by locality sensitive hashing: genomes sharing many
+// pairs of consecutive genes are likely to share a bucket.
+typedef struct diversity_index_s diversity_index_t;
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the edit distance between two genomes, the smallest number of
+/// genes to insert, delete or replace to turn one into the other. Only
+/// distances up to bound are computed exactly, which takes time in
+/// proportion to bound instead of the genome size.
+/// \param  genome1
+/// \param  genome2
+/// \param  bound   Largest distance of interest, not negative.
+/// \return Distance, bound + 1 if it is larger than bound.
+//  ----------------------------------------------------------------------------
+int diversity_edit_distance(genome_t const * const genome1,
+                            genome_t const * const genome2, int const bound);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Compute the gene histogram of a genome. Bins saturate at
+/// UINT16_MAX genes.
+/// \param  genome
+/// \param  histogram   Output.
+//  ----------------------------------------------------------------------------
+void diversity_histogram_compute(genome_t const * const genome,
+                                 diversity_histogram_t * const histogram);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get a distance between gene histograms that is never more than the
+/// edit distance between their genomes.
+/// \param  histogram1
+/// \param  histogram2
+/// \return Lower bound of the edit distance.
+//  ----------------------------------------------------------------------------
+int diversity_histogram_distance(diversity_histogram_t const * const
+                                 histogram1,
+                                 diversity_histogram_t const * const
+                                 histogram2);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Index a population. The index refers to the population array,
+/// which must outlive it. A genome replaced in the array must be reindexed
+/// with diversity_index_update().
+/// \param  population  Array of genomes.
+/// \param  nb_genomes  Number of genomes.
+/// \param  seed        Seed of the hashes.
+/// \param  nb_threads  Number of threads to use.
+/// \return Pointer to the new index, NULL on failure.
+//  ----------------------------------------------------------------------------
+diversity_index_t *diversity_index_create(genome_t * const population[],
+                                          int const nb_genomes,
+                                          uint64_t const seed,
+                                          int const nb_threads);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Free an index and set the pointer to NULL.
+/// \param  index
+//  ----------------------------------------------------------------------------
+void diversity_index_destroy(diversity_index_t **index);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Reindex a genome after it was replaced or modified.
+/// \param  index
+/// \param  position    Index of the genome in the population.
+//  ----------------------------------------------------------------------------
+void diversity_index_update(diversity_index_t * const index,
+                            int const position);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Find the genome of the population closest to a genome, in edit
+/// distance. Only the genomes sharing a bucket with it, at most a fixed
+/// number of them, and a few random ones are compared, so the result is
+/// close but not always the closest.
+/// \param  index
+/// \param  genome      Genome to find a neighbour of.
+/// \param  exclude     Index of a genome not to consider, -1 for none.
+/// \param  stream      Stream to draw the random genomes from.
+/// \param  distance    Output, distance to the neighbour. Can be NULL.
+/// \return Index of the neighbour in the population, -1 if there is none.
+//  ----------------------------------------------------------------------------
+int diversity_nearest_find(diversity_index_t const * const index,
+                           genome_t const * const genome, int const exclude,
+                           random_stream_t * const stream,
+                           int * const distance);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Count the genomes around each genome, itself included, for fitness
+/// sharing. Only the genomes sharing a bucket with it are counted, at most a
+/// fixed number of them.
+/// \param  index
+/// \param  radius      Largest edit distance counted.
+/// \param  counts      Output, count of each genome of the population.
+/// \param  nb_threads  Number of threads to use.
+//  ----------------------------------------------------------------------------
+void diversity_niche_counts_get(diversity_index_t const * const index,
+                                int const radius, int counts[],
+                                int const nb_threads);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Restricted tournament replacement: an offspring replaces the
+/// closest genome of the population, see diversity_nearest_find(), if it is
+/// at least as fit. New solutions then compete with similar ones only, which
+/// keeps different niches alive.
+/// \param  index       Index of population, updated.
+/// \param  population  Array of genomes. The replaced genome is destroyed.
+/// \param  fitness     Fitness of each genome, minimized. Updated.
+/// \param  offspring   Owned by the population if it replaces a genome.
+/// \param  offspring_fitness
+/// \param  stream      Stream to draw random genomes from.
+/// \return Index of the replaced genome, -1 if the offspring was rejected and
+/// is still owned by the caller.
+//  ----------------------------------------------------------------------------
+int diversity_crowding_replace(diversity_index_t * const index,
+                               genome_t *population[], double fitness[],
+                               genome_t * const offspring,
+                               double const offspring_fitness,
+                               random_stream_t * const stream);
+
+#endif // DIVERSITY_H_INCLUDED
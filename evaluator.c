@@ -0,0 +1,809 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+#include "evaluator.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "genome.h"
+#include "machine/machine.h"
+#include "parallel.h"
+#include "placement.h"
+
+//******************************************************************************
+// Type definitions
+//******************************************************************************
+// The cases are run by blocks of MACHINE_BLOCK_CASES. At each checkpoint, the
+// register files of every block are saved, before running the gene at the
+// position of the checkpoint.
+struct evaluator_trace_s {
+    int interval;
+    int nb_cases;
+    int nb_checkpoints;
+    int *positions;
+    int positions_capacity;
+    // Register files of the case block b at checkpoint k are in
+    // blocks[b * nb_checkpoints + k].
+    machine_block_t *blocks;
+    size_t blocks_capacity;
+};
+
+// Genome of a population, as a leaf of the trie of the genes.
+typedef struct {
+    command_t const *genes;
+    int size;
+    int index;
+} leaf_t;
+
+// Arguments of population_run(), run from several threads. The leaves are in
+// the order of their genes, so that their walk is a depth first walk of the
+// trie. Leaf i branches off leaf i - 1 at position branches[i]: the genes
+// before it are the same. The leaves are split in nb_chunks chunks, each one
+// walked on its own from the root, so that threads share the work even when
+// the cases are few. The outputs, the passes or both are written.
+typedef struct {
+    leaf_t const *leaves;
+    int const *branches;
+    int nb_leaves;
+    int nb_chunks;
+    int depth_max;
+    evaluator_cases_t const *cases;
+    register_value_t *outputs;
+    uint64_t *passes;
+    double epsilon;
+    int nb_blocks;
+    bool success;
+} population_run_t;
+
+struct evaluator_replicas_s {
+    placement_replicas_t *inputs;
+    placement_replicas_t *targets;
+};
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+// The register holding the result, see machine_result_get().
+#define EVALUATOR_OUTPUT_REGISTER   (reg_A)
+
+// The pass bits of a block of cases make one word.
+#if MACHINE_BLOCK_CASES != 64
+#error "Pass words expect blocks of 64 cases."
+#endif
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+static void run(genome_t const * const genome,
+                evaluator_cases_t const * const all_cases,
+                evaluator_trace_t const * const parent_trace,
+                int const resume,
+                evaluator_trace_t * const trace,
+                register_value_t outputs[]);
+static int checkpoint_find(evaluator_trace_t const * const trace,
+                           int const position);
+static bool trace_plan(evaluator_trace_t * const trace,
+                       command_t const * const genes, int const size,
+                       evaluator_trace_t const * const parent_trace,
+                       int const resume, int const nb_cases);
+static void block_load(machine_block_t * const block,
+                       evaluator_cases_t const * const cases,
+                       int const first_case, int const nb_cases);
+static bool population_trie_run(genome_t * const population[],
+                                int const nb_genomes,
+                                evaluator_cases_t const * const cases,
+                                register_value_t outputs[],
+                                uint64_t passes[], double const epsilon,
+                                int const nb_threads);
+static void population_run(void *context, int begin, int end);
+static uint64_t block_passes_get(machine_block_t const * const block,
+                                 evaluator_cases_t const * const cases,
+                                 int const first_case, int const nb_cases,
+                                 double const epsilon);
+static int leaf_order(void const *a, void const *b);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+//  ----------------------------------------------------------------------------
+/// \brief  Gather a subset of the fitness cases into compact arrays.
+/// \param  cases
+/// \param  indices
+/// \param  nb_indices
+/// \param  inputs
+/// \param  targets
+/// \param  subset
+//  ----------------------------------------------------------------------------
+void evaluator_cases_gather(evaluator_cases_t const * const cases,
+                            int const indices[], int const nb_indices,
+                            register_value_t inputs[],
+                            register_value_t targets[],
+                            evaluator_cases_t * const subset)
+{
+    assert(cases);
+    assert(indices || nb_indices == 0);
+    assert(subset);
+
+    int const nb_inputs = cases->nb_inputs;
+    for (int i = 0; i < nb_indices; i++) {
+        assert(indices[i] >= 0 && indices[i] < cases->nb_cases);
+        memcpy(&inputs[(size_t) i * nb_inputs],
+               &cases->inputs[(size_t) indices[i] * nb_inputs],
+               nb_inputs * sizeof *inputs);
+        if (cases->targets != NULL) {
+            targets[i] = cases->targets[indices[i]];
+        }
+    }
+
+    *subset = (evaluator_cases_t) {
+        .nb_cases = nb_indices,
+        .nb_inputs = nb_inputs,
+        .inputs = inputs,
+        .targets = cases->targets != NULL ? targets : NULL
+    };
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Copy the inputs and targets of fitness cases to each NUMA node.
+/// \param  cases
+/// \return Pointer to the new replicas, NULL on failure.
+//  ----------------------------------------------------------------------------
+evaluator_replicas_t *evaluator_cases_replicate(evaluator_cases_t const *
+                                                const cases)
+{
+    assert(cases);
+
+    evaluator_replicas_t *replicas = calloc(1, sizeof *replicas);
+    if (replicas == NULL) {
+        fprintf(stderr, "%s: could not allocate the replicas.\n", __func__);
+        return NULL;
+    }
+    replicas->inputs = placement_replicas_create(cases->inputs,
+                                                 (size_t) cases->nb_cases
+                                                 * cases->nb_inputs
+                                                 * sizeof *cases->inputs);
+    if (cases->targets != NULL) {
+        replicas->targets = placement_replicas_create(cases->targets,
+                                                      cases->nb_cases
+                                                      * sizeof *cases->targets);
+    }
+    if (replicas->inputs == NULL
+        || (cases->targets != NULL && replicas->targets == NULL)) {
+        fprintf(stderr, "%s: could not copy the cases.\n", __func__);
+        evaluator_replicas_destroy(&replicas);
+        return NULL;
+    }
+    return replicas;
+}
+
+
+void evaluator_replicas_destroy(evaluator_replicas_t **replicas)
+{
+    assert(replicas);
+    if (*replicas == NULL) {
+        return;
+    }
+    placement_replicas_destroy(&(*replicas)->inputs);
+    placement_replicas_destroy(&(*replicas)->targets);
+    free(*replicas);
+    *replicas = NULL;
+}
+
+
+void evaluator_cases_local_get(evaluator_cases_t const * const cases,
+                               evaluator_cases_t * const local)
+{
+    assert(cases);
+    assert(local);
+
+    *local = *cases;
+    local->replicas = NULL;
+    if (cases->replicas != NULL) {
+        local->inputs = placement_replica_get(cases->replicas->inputs);
+        if (cases->replicas->targets != NULL) {
+            local->targets = placement_replica_get(cases->replicas->targets);
+        }
+    }
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create an empty trace.
+/// \param  interval    Number of genes between two checkpoints, at least 1.
+/// \return Pointer to the new trace, NULL on failure.
+//  ----------------------------------------------------------------------------
+evaluator_trace_t *evaluator_trace_create(int const interval)
+{
+    if (interval < 1) {
+        fprintf(stderr, "%s: interval must be at least 1.\n", __func__);
+        return NULL;
+    }
+
+    evaluator_trace_t *trace = malloc(sizeof *trace);
+    if (trace == NULL) {
+        fprintf(stderr, "%s: could not allocate trace.\n", __func__);
+        return NULL;
+    }
+    *trace = (evaluator_trace_t) {
+        .interval = interval,
+    };
+    return trace;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Free a trace and its checkpoints.
+/// \param  trace
+//  ----------------------------------------------------------------------------
+void evaluator_trace_destroy(evaluator_trace_t **trace)
+{
+    if (*trace == NULL) {
+        return;
+    }
+    free((*trace)->positions);
+    free((*trace)->blocks);
+    free(*trace);
+    *trace = NULL;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Run a genome on all fitness cases, block after block.
+/// \param  genome
+/// \param  cases
+/// \param  outputs Output array of cases->nb_cases values.
+//  ----------------------------------------------------------------------------
+void evaluator_run(genome_t const * const genome,
+                   evaluator_cases_t const * const cases,
+                   register_value_t outputs[])
+{
+    assert(genome);
+    assert(cases);
+    assert(outputs || cases->nb_cases == 0);
+
+    run(genome, cases, NULL, -1, NULL, outputs);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Run a genome on all fitness cases and save its trace.
+/// \param  genome
+/// \param  cases
+/// \param  trace   Trace of genome on cases, overwritten.
+/// \param  outputs Output array of cases->nb_cases values.
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool evaluator_trace_run(genome_t const * const genome,
+                         evaluator_cases_t const * const cases,
+                         evaluator_trace_t * const trace,
+                         register_value_t outputs[])
+{
+    assert(genome);
+    assert(cases);
+    assert(trace);
+    assert(outputs || cases->nb_cases == 0);
+
+    if (!trace_plan(trace, genome_genes_get(genome), genome_size_get(genome),
+                    NULL, -1, cases->nb_cases)) {
+        run(genome, cases, NULL, -1, NULL, outputs);
+        return false;
+    }
+    run(genome, cases, NULL, -1, trace, outputs);
+    return true;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Run a genome derived from a parent, starting from the last
+/// checkpoint of the parent at or before the first differing gene. The genes
+/// before that checkpoint are the same in both, so are the register files.
+/// \param  genome      Genome to run.
+/// \param  cases       The cases the parent trace was saved on.
+/// \param  parent_trace    Trace of the parent.
+/// \param  first_diff  genome_diff_first() of the parent and the genome.
+/// \param  trace       Trace of genome, or NULL.
+/// \param  outputs     Output array of cases->nb_cases values.
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool evaluator_resume_run(genome_t const * const genome,
+                          evaluator_cases_t const * const cases,
+                          evaluator_trace_t const * const parent_trace,
+                          int const first_diff,
+                          evaluator_trace_t * const trace,
+                          register_value_t outputs[])
+{
+    assert(genome);
+    assert(cases);
+    assert(parent_trace);
+    assert(trace != parent_trace);
+    assert(outputs || cases->nb_cases == 0);
+
+    int const size = genome_size_get(genome);
+    int resume = -1;
+    if (parent_trace->nb_cases != cases->nb_cases) {
+        fprintf(stderr, "%s: trace saved on other cases, running from start.\n",
+                __func__);
+    } else {
+        // Equal genomes differ nowhere before the end.
+        resume = checkpoint_find(parent_trace,
+                                 first_diff < 0 ? size : first_diff);
+    }
+
+    bool success = true;
+    if (trace != NULL
+        && !trace_plan(trace, genome_genes_get(genome), size,
+                       parent_trace, resume, cases->nb_cases)) {
+        success = false;
+    }
+    run(genome, cases, parent_trace, resume, success ? trace : NULL, outputs);
+    return success;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Run all genomes of a population on all cases, see
+/// population_trie_run().
+/// \param  population
+/// \param  nb_genomes
+/// \param  cases
+/// \param  outputs
+/// \param  nb_threads
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool evaluator_population_run(genome_t * const population[],
+                              int const nb_genomes,
+                              evaluator_cases_t const * const cases,
+                              register_value_t outputs[],
+                              int const nb_threads)
+{
+    assert(outputs || nb_genomes == 0 || cases->nb_cases == 0);
+    return population_trie_run(population, nb_genomes, cases, outputs, NULL,
+                               0, nb_threads);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Run all genomes of a population on all cases and pack whether
+/// each output is within epsilon of its target, a word per block of cases.
+/// See population_trie_run().
+/// \param  population
+/// \param  nb_genomes
+/// \param  cases
+/// \param  epsilon
+/// \param  passes
+/// \param  nb_threads
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool evaluator_population_passes_run(genome_t * const population[],
+                                     int const nb_genomes,
+                                     evaluator_cases_t const * const cases,
+                                     double const epsilon, uint64_t passes[],
+                                     int const nb_threads)
+{
+    assert(cases);
+    assert(passes || nb_genomes == 0 || cases->nb_cases == 0);
+
+    if (cases->targets == NULL && cases->nb_cases > 0) {
+        fprintf(stderr, "%s: the cases have no targets.\n", __func__);
+        return false;
+    }
+    return population_trie_run(population, nb_genomes, cases, NULL, passes,
+                               epsilon, nb_threads);
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+//  ----------------------------------------------------------------------------
+/// \brief  Run all genomes of a population on all cases. The genomes are
+/// sorted by their genes, so that those sharing a prefix follow each other,
+/// and the branch position of each is the length of the prefix it shares with
+/// the previous one. It is moved back before any IF_LESS ending the prefix,
+/// whose skip is not part of the register files. Each thread then walks a
+/// chunk of the genomes on a block of cases at a time.
+/// \param  population
+/// \param  nb_genomes
+/// \param  cases
+/// \param  outputs     Output array of nb_cases values per genome, or NULL.
+/// \param  passes      Output array of a word per block of cases per genome,
+/// or NULL.
+/// \param  epsilon     Largest absolute error of a pass.
+/// \param  nb_threads
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+static bool population_trie_run(genome_t * const population[],
+                                int const nb_genomes,
+                                evaluator_cases_t const * const cases,
+                                register_value_t outputs[],
+                                uint64_t passes[], double const epsilon,
+                                int const nb_threads)
+{
+    assert(population || nb_genomes == 0);
+    assert(cases);
+
+    if (nb_genomes == 0 || cases->nb_cases == 0) {
+        return true;
+    }
+
+    leaf_t *leaves = malloc(nb_genomes * sizeof *leaves);
+    int *branches = malloc(nb_genomes * sizeof *branches);
+    if (leaves == NULL || branches == NULL) {
+        fprintf(stderr, "%s: could not allocate the trie.\n", __func__);
+        free(leaves);
+        free(branches);
+        return false;
+    }
+
+    for (int g = 0; g < nb_genomes; g++) {
+        leaves[g] = (leaf_t) {
+            .genes = genome_genes_get(population[g]),
+            .size = genome_size_get(population[g]),
+            .index = g
+        };
+    }
+    qsort(leaves, nb_genomes, sizeof *leaves, leaf_order);
+
+    // Saved register files are at increasing positions along a path of the
+    // trie, at most one per gene and one per leaf.
+    int size_max = 0;
+    branches[0] = 0;
+    for (int i = 0; i < nb_genomes; i++) {
+        if (leaves[i].size > size_max) {
+            size_max = leaves[i].size;
+        }
+        if (i == 0) {
+            continue;
+        }
+        int branch = genome_diff_first(population[leaves[i - 1].index],
+                                       population[leaves[i].index]);
+        if (branch < 0) {
+            branch = leaves[i].size;
+        }
+        while (branch > 0 && leaves[i].genes[branch - 1].op == IF_LESS) {
+            branch--;
+        }
+        branches[i] = branch;
+    }
+
+    int const nb_chunks = nb_threads > 1 ? nb_threads : 1;
+    int const nb_blocks =
+        (cases->nb_cases + MACHINE_BLOCK_CASES - 1) / MACHINE_BLOCK_CASES;
+    int const chunk_size_max = (nb_genomes + nb_chunks - 1) / nb_chunks;
+    population_run_t run = {
+        .leaves = leaves,
+        .branches = branches,
+        .nb_leaves = nb_genomes,
+        .nb_chunks = nb_chunks,
+        .depth_max = 1 + (size_max < chunk_size_max ? size_max
+                          : chunk_size_max),
+        .cases = cases,
+        .outputs = outputs,
+        .passes = passes,
+        .epsilon = epsilon,
+        .nb_blocks = nb_blocks,
+        .success = true
+    };
+    parallel_for(nb_blocks * nb_chunks, nb_threads, population_run, &run);
+
+    free(leaves);
+    free(branches);
+    return run.success;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Run a genome on all cases, optionally from a checkpoint of a parent
+/// and saving the checkpoints planned in a trace.
+/// \param  genome
+/// \param  all_cases   Read from the replicas on the node of the thread, if
+/// any.
+/// \param  parent_trace    Trace to resume from, used if resume >= 0.
+/// \param  resume      Index of the checkpoint in parent_trace, -1 to run from
+/// the start.
+/// \param  trace       Trace planned by trace_plan(), or NULL.
+/// \param  outputs
+//  ----------------------------------------------------------------------------
+static void run(genome_t const * const genome,
+                evaluator_cases_t const * const all_cases,
+                evaluator_trace_t const * const parent_trace,
+                int const resume,
+                evaluator_trace_t * const trace,
+                register_value_t outputs[])
+{
+    evaluator_cases_t local;
+    evaluator_cases_local_get(all_cases, &local);
+    evaluator_cases_t const *cases = &local;
+
+    command_t const *genes = genome_genes_get(genome);
+    int const size = genome_size_get(genome);
+    int const start = resume < 0 ? 0 : parent_trace->positions[resume];
+
+    for (int first_case = 0, b = 0;
+         first_case < cases->nb_cases;
+         first_case += MACHINE_BLOCK_CASES, b++) {
+        int nb_cases = cases->nb_cases - first_case;
+        if (nb_cases > MACHINE_BLOCK_CASES) {
+            nb_cases = MACHINE_BLOCK_CASES;
+        }
+
+        machine_block_t block;
+        if (resume < 0) {
+            block_load(&block, cases, first_case, nb_cases);
+        } else {
+            machine_block_t const *parent_blocks =
+                &parent_trace->blocks[b * parent_trace->nb_checkpoints];
+            block = parent_blocks[resume];
+        }
+
+        int position = start;
+        if (trace != NULL) {
+            machine_block_t *blocks = &trace->blocks[b * trace->nb_checkpoints];
+            // The checkpoints up to the resumed one are the parent's.
+            if (resume >= 0) {
+                memcpy(blocks,
+                       &parent_trace->blocks[b * parent_trace->nb_checkpoints],
+                       (resume + 1) * sizeof (machine_block_t));
+            }
+            for (int k = resume + 1; k < trace->nb_checkpoints; k++) {
+                machine_block_run(&block, nb_cases, &genes[position],
+                                  trace->positions[k] - position);
+                position = trace->positions[k];
+                blocks[k] = block;
+            }
+        }
+        machine_block_run(&block, nb_cases, &genes[position], size - position);
+
+        memcpy(&outputs[first_case], block.registers[EVALUATOR_OUTPUT_REGISTER],
+               nb_cases * sizeof (register_value_t));
+    }
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Find the last checkpoint of a trace at or before a position.
+/// \param  trace
+/// \param  position    Gene index.
+/// \return Index of the checkpoint, -1 if none.
+//  ----------------------------------------------------------------------------
+static int checkpoint_find(evaluator_trace_t const * const trace,
+                           int const position)
+{
+    int k = trace->nb_checkpoints - 1;
+    while (k >= 0 && trace->positions[k] > position) {
+        k--;
+    }
+    return k;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Choose the checkpoints of a trace and allocate them. The first ones
+/// are those of the parent up to the resumed one, then one every interval
+/// genes and one at the end. A checkpoint is never right after an IF_LESS,
+/// since resuming there would run the gene it may skip.
+/// \param  trace
+/// \param  genes       Genes of the genome of the trace.
+/// \param  size        Number of genes.
+/// \param  parent_trace    Trace resumed from, used if resume >= 0.
+/// \param  resume      Index of the resumed checkpoint, -1 if none.
+/// \param  nb_cases    Number of cases.
+/// \return True if no error. On failure, the trace is left empty.
+//  ----------------------------------------------------------------------------
+static bool trace_plan(evaluator_trace_t * const trace,
+                       command_t const * const genes, int const size,
+                       evaluator_trace_t const * const parent_trace,
+                       int const resume, int const nb_cases)
+{
+    int const start = resume < 0 ? 0 : parent_trace->positions[resume];
+    int const nb_blocks =
+        (nb_cases + MACHINE_BLOCK_CASES - 1) / MACHINE_BLOCK_CASES;
+    // The new positions are the multiples of the interval after start, some
+    // pushed past IF_LESS genes, and size: start is not a multiple when it
+    // was pushed itself, so there can be one more than whole intervals.
+    int const nb_max = resume + 1 + (size - start) / trace->interval + 2;
+
+    trace->nb_checkpoints = 0;
+    trace->nb_cases = nb_cases;
+
+    if (nb_max > trace->positions_capacity) {
+        int *positions = realloc(trace->positions, nb_max * sizeof *positions);
+        if (positions == NULL) {
+            fprintf(stderr, "%s: could not allocate positions.\n", __func__);
+            return false;
+        }
+        trace->positions = positions;
+        trace->positions_capacity = nb_max;
+    }
+
+    int nb_checkpoints = 0;
+    for (int k = 0; k <= resume; k++) {
+        trace->positions[nb_checkpoints++] = parent_trace->positions[k];
+    }
+    int last = start;
+    while (last < size) {
+        int position = (last / trace->interval + 1) * trace->interval;
+        if (position > size) {
+            position = size;
+        }
+        while (position < size && genes[position - 1].op == IF_LESS) {
+            position++;
+        }
+        if (genes[position - 1].op == IF_LESS) {
+            break;
+        }
+        trace->positions[nb_checkpoints++] = position;
+        last = position;
+    }
+
+    size_t const nb_saved = (size_t) nb_checkpoints * nb_blocks;
+    if (nb_saved > trace->blocks_capacity) {
+        machine_block_t *blocks = realloc(trace->blocks,
+                                          nb_saved * sizeof *blocks);
+        if (blocks == NULL) {
+            fprintf(stderr, "%s: could not allocate checkpoints.\n", __func__);
+            return false;
+        }
+        trace->blocks = blocks;
+        trace->blocks_capacity = nb_saved;
+    }
+
+    trace->nb_checkpoints = nb_checkpoints;
+    return true;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Load the inputs of a block of cases, the other registers at 0.
+/// \param  block
+/// \param  cases
+/// \param  first_case  Index of the first case of the block.
+/// \param  nb_cases    Number of cases in the block.
+//  ----------------------------------------------------------------------------
+static void block_load(machine_block_t * const block,
+                       evaluator_cases_t const * const cases,
+                       int const first_case, int const nb_cases)
+{
+    assert(cases->nb_inputs >= 0 && cases->nb_inputs <= NB_REGISTERS);
+
+    memset(block, 0, sizeof *block);
+    for (int c = 0; c < nb_cases; c++) {
+        register_value_t const *inputs =
+            &cases->inputs[(size_t) (first_case + c) * cases->nb_inputs];
+        for (int r = 0; r < cases->nb_inputs; r++) {
+            block->registers[r][c] = inputs[r];
+        }
+    }
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Walk chunks of the leaves on blocks of cases. parallel_work_t.
+/// The register files at the branch position of the next leaf are saved on a
+/// stack while running a leaf. A leaf starts from the deepest saved register
+/// files at or before its own branch position, the others belong to leaves
+/// already done.
+/// \param  context population_run_t.
+/// \param  begin   First item, an item being a chunk on a block of cases.
+/// \param  end     Item after the last.
+//  ----------------------------------------------------------------------------
+static void population_run(void *context, int begin, int end)
+{
+    population_run_t *run = context;
+    evaluator_cases_t local;
+    evaluator_cases_local_get(run->cases, &local);
+    evaluator_cases_t const *cases = &local;
+
+    machine_block_t *stack = malloc(run->depth_max * sizeof *stack);
+    int *positions = malloc(run->depth_max * sizeof *positions);
+    if (stack == NULL || positions == NULL) {
+        fprintf(stderr, "%s: could not allocate the stack.\n", __func__);
+        __atomic_store_n(&run->success, false, __ATOMIC_RELAXED);
+        free(stack);
+        free(positions);
+        return;
+    }
+
+    for (int item = begin; item < end; item++) {
+        int const chunk = item % run->nb_chunks;
+        int const first_case = item / run->nb_chunks * MACHINE_BLOCK_CASES;
+        int nb_cases = cases->nb_cases - first_case;
+        if (nb_cases > MACHINE_BLOCK_CASES) {
+            nb_cases = MACHINE_BLOCK_CASES;
+        }
+        int const first = (int) ((long) chunk * run->nb_leaves
+                                 / run->nb_chunks);
+        int const last = (int) ((long) (chunk + 1) * run->nb_leaves
+                                / run->nb_chunks);
+
+        block_load(&stack[0], cases, first_case, nb_cases);
+        positions[0] = 0;
+        int depth = 1;
+        for (int i = first; i < last; i++) {
+            leaf_t const *leaf = &run->leaves[i];
+            int const branch = i == first ? 0 : run->branches[i];
+            while (positions[depth - 1] > branch) {
+                depth--;
+            }
+
+            machine_block_t block = stack[depth - 1];
+            int position = positions[depth - 1];
+            int const next_branch = i + 1 < last ? run->branches[i + 1] : 0;
+            if (next_branch > position) {
+                machine_block_run(&block, nb_cases, &leaf->genes[position],
+                                  next_branch - position);
+                position = next_branch;
+                assert(depth < run->depth_max);
+                stack[depth] = block;
+                positions[depth] = position;
+                depth++;
+            }
+            machine_block_run(&block, nb_cases, &leaf->genes[position],
+                              leaf->size - position);
+
+            if (run->outputs != NULL) {
+                memcpy(&run->outputs[(size_t) leaf->index * cases->nb_cases
+                                     + first_case],
+                       block.registers[EVALUATOR_OUTPUT_REGISTER],
+                       nb_cases * sizeof (register_value_t));
+            }
+            if (run->passes != NULL) {
+                run->passes[(size_t) leaf->index * run->nb_blocks
+                            + first_case / MACHINE_BLOCK_CASES] =
+                    block_passes_get(&block, cases, first_case, nb_cases,
+                                     run->epsilon);
+            }
+        }
+    }
+
+    free(stack);
+    free(positions);
+}
+
+
+// Order leaves by their genes, a prefix first, then by index. qsort() order.
+static int leaf_order(void const *a, void const *b)
+{
+    leaf_t const *leaf_a = a;
+    leaf_t const *leaf_b = b;
+    int const common = leaf_a->size < leaf_b->size ? leaf_a->size
+                       : leaf_b->size;
+    int const order = common == 0 ? 0
+                      : memcmp(leaf_a->genes, leaf_b->genes,
+                               common * sizeof (command_t));
+    if (order != 0) {
+        return order;
+    }
+    if (leaf_a->size != leaf_b->size) {
+        return leaf_a->size < leaf_b->size ? -1 : 1;
+    }
+    return (leaf_a->index > leaf_b->index) - (leaf_a->index < leaf_b->index);
+}
+
+
+// Bit c of the word is set if the output of case first_case + c is within
+// epsilon of its target.
+static uint64_t block_passes_get(machine_block_t const * const block,
+                                 evaluator_cases_t const * const cases,
+                                 int const first_case, int const nb_cases,
+                                 double const epsilon)
+{
+    register_value_t const *outputs =
+        block->registers[EVALUATOR_OUTPUT_REGISTER];
+    register_value_t const *targets = &cases->targets[first_case];
+    uint64_t passes = 0;
+    for (int c = 0; c < nb_cases; c++) {
+        double const difference = (double) outputs[c] - targets[c];
+        double const error = difference < 0 ? -difference : difference;
+        passes |= (uint64_t) (error <= epsilon) << c;
+    }
+    return passes;
+}
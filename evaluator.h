@@ -0,0 +1,193 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+#ifndef EVALUATOR_H_INCLUDED
+#define EVALUATOR_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "genome.h"
+#include "machine/machine.h"
+#include "placement.h"
+
+// Copies of the inputs and targets of fitness cases on each NUMA node, see
+// evaluator_cases_replicate().
+typedef struct evaluator_replicas_s evaluator_replicas_t;
+
+// Fitness cases a genome is run on. The inputs of a case are loaded in the
+// first registers, the other registers start at 0. The output of a case is
+// reg_A after the run, see machine_result_get().
+typedef struct {
+    int nb_cases;
+    int nb_inputs;
+    // nb_inputs values per case, case after case.
+    register_value_t const *inputs;
+    // Expected output of each case, used to compute the fitness. Can be NULL
+    // if only the outputs are needed.
+    register_value_t const *targets;
+    // Copies of inputs and targets the threads read from, that of their node.
+    // Can be NULL to read inputs and targets.
+    evaluator_replicas_t const *replicas;
+} evaluator_cases_t;
+
+// Number of words of pass bits of a genome, see
+// evaluator_population_passes_run().
+#define EVALUATOR_PASS_WORDS(nb_cases)  (((nb_cases) + 63) / 64)
+
+//  ----------------------------------------------------------------------------
+/// \brief  Gather a subset of the fitness cases into compact arrays, so that
+/// running genomes on the subset only reads the cases it holds.
+/// \param  cases       All fitness cases.
+/// \param  indices     Indices of the cases of the subset, in cases.
+/// \param  nb_indices  Number of cases of the subset.
+/// \param  inputs      Output array of nb_inputs values per case of the
+/// subset.
+/// \param  targets     Output array of a value per case of the subset. Can be
+/// NULL if cases has no targets.
+/// \param  subset      Output, the cases of the subset, pointing to inputs
+/// and targets, without replicas: the caller replicates them if the runs are
+/// to read copies.
+//  ----------------------------------------------------------------------------
+void evaluator_cases_gather(evaluator_cases_t const * const cases,
+                            int const indices[], int const nb_indices,
+                            register_value_t inputs[],
+                            register_value_t targets[],
+                            evaluator_cases_t * const subset);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Copy the inputs and targets of fitness cases to each NUMA node,
+/// see placement_replicas_create(). The cases are not changed: the caller
+/// assigns the result to cases->replicas for the runs to read the copies,
+/// and destroys it with evaluator_replicas_destroy() once no run uses the
+/// cases any more.
+/// \param  cases   Must outlive the replicas.
+/// \return Pointer to the new replicas, NULL on failure.
+//  ----------------------------------------------------------------------------
+evaluator_replicas_t *evaluator_cases_replicate(evaluator_cases_t const *
+                                                const cases);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Free replicas and set the pointer to NULL.
+/// \param  replicas
+//  ----------------------------------------------------------------------------
+void evaluator_replicas_destroy(evaluator_replicas_t **replicas);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the fitness cases as read from the calling thread: from the
+/// replicas on its node if there are any.
+/// \param  cases
+/// \param  local   Output, the cases with inputs and targets on the node of
+/// the thread, and no replicas.
+//  ----------------------------------------------------------------------------
+void evaluator_cases_local_get(evaluator_cases_t const * const cases,
+                               evaluator_cases_t * const local);
+
+// Register files of all fitness cases saved at a few positions along the
+// genes of a genome, to resume a run from there.
+typedef struct evaluator_trace_s evaluator_trace_t;
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create an empty trace.
+/// \param  interval    Number of genes between two saved positions. Smaller
+/// intervals resume closer to a change but use more memory.
+/// \return Pointer to the new trace, NULL on failure.
+//  ----------------------------------------------------------------------------
+evaluator_trace_t *evaluator_trace_create(int const interval);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Free a trace and set the pointer to NULL.
+/// \param  trace
+//  ----------------------------------------------------------------------------
+void evaluator_trace_destroy(evaluator_trace_t **trace);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Run a genome on all fitness cases.
+/// \param  genome
+/// \param  cases
+/// \param  outputs Output array of cases->nb_cases values.
+//  ----------------------------------------------------------------------------
+void evaluator_run(genome_t const * const genome,
+                   evaluator_cases_t const * const cases,
+                   register_value_t outputs[]);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Run a genome on all fitness cases and save its trace, so that the
+/// genomes derived from it can be run with evaluator_resume_run().
+/// \param  genome
+/// \param  cases
+/// \param  trace   Trace of genome on cases, overwritten.
+/// \param  outputs Output array of cases->nb_cases values.
+/// \return True if no error. The outputs are valid even if the trace could not
+/// be saved.
+//  ----------------------------------------------------------------------------
+bool evaluator_trace_run(genome_t const * const genome,
+                         evaluator_cases_t const * const cases,
+                         evaluator_trace_t * const trace,
+                         register_value_t outputs[]);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Run a genome derived from a parent whose trace is known. The run
+/// starts from the last position saved before the first gene that differs
+/// from the parent, instead of from the first gene.
+/// \param  genome      Genome to run.
+/// \param  cases       The cases the parent trace was saved on.
+/// \param  parent_trace    Trace of the parent.
+/// \param  first_diff  genome_diff_first() of the parent and the genome.
+/// \param  trace       Trace of genome, overwritten. Can be NULL if not
+/// needed, must not be parent_trace.
+/// \param  outputs     Output array of cases->nb_cases values.
+/// \return True if no error. The outputs are valid even if the trace could not
+/// be saved.
+//  ----------------------------------------------------------------------------
+bool evaluator_resume_run(genome_t const * const genome,
+                          evaluator_cases_t const * const cases,
+                          evaluator_trace_t const * const parent_trace,
+                          int const first_diff,
+                          evaluator_trace_t * const trace,
+                          register_value_t outputs[]);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Run all genomes of a population on all fitness cases. The genomes
+/// are walked as a trie of their genes: the genes a genome shares with the
+/// previous genome in the walk are not run again, the run goes on from the
+/// register files saved at the end of the shared prefix. The outputs are the
+/// same as from evaluator_run() on each genome.
+/// \param  population  Array of genomes.
+/// \param  nb_genomes  Number of genomes.
+/// \param  cases
+/// \param  outputs     Output array of cases->nb_cases values per genome,
+/// genome after genome.
+/// \param  nb_threads  Number of threads to use.
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool evaluator_population_run(genome_t * const population[],
+                              int const nb_genomes,
+                              evaluator_cases_t const * const cases,
+                              register_value_t outputs[],
+                              int const nb_threads);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Run all genomes of a population on all fitness cases, as
+/// evaluator_population_run(), and pack the results as bits: a case is
+/// passed if the output is within epsilon of the target. Bit c % 64 of word
+/// c / 64 of a genome is set if case c is passed, the bits past the last
+/// case are clear.
+/// \param  population  Array of genomes.
+/// \param  nb_genomes  Number of genomes.
+/// \param  cases       Fitness cases, with targets.
+/// \param  epsilon     Largest absolute error of a passed case, 0 to only pass
+/// exact outputs.
+/// \param  passes      Output array of EVALUATOR_PASS_WORDS(nb_cases) words
+/// per genome, genome after genome.
+/// \param  nb_threads  Number of threads to use.
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool evaluator_population_passes_run(genome_t * const population[],
+                                     int const nb_genomes,
+                                     evaluator_cases_t const * const cases,
+                                     double const epsilon, uint64_t passes[],
+                                     int const nb_threads);
+
+#endif // EVALUATOR_H_INCLUDED
@@ -0,0 +1,431 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+#include "expression.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "machine/machine.h"
+#include "randomizer.h"
+
+//******************************************************************************
+// Type definitions
+//******************************************************************************
+struct expression_graph_s {
+    expression_node_t *nodes;
+    int nb_nodes;
+    int capacity;
+    // Open addressing table of node indices, -1 for empty slots.
+    int *table;
+    size_t table_size;
+    bool sorted;
+};
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+static int node_intern(expression_graph_t * const graph,
+                       expression_node_t const * const node);
+static int identity_reduce(expression_graph_t * const graph,
+                           operation_t const op, int const a, int const b);
+static uint64_t node_hash(expression_node_t const * const node);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+//  ----------------------------------------------------------------------------
+/// \brief  Create an empty graph. Each command adds at most an operation, a
+/// constant it reduces to and a select, or a condition, a select and a
+/// constant 1.
+/// \param  nb_commands
+/// \param  sorted
+/// \return Pointer to the new graph, NULL on failure.
+//  ----------------------------------------------------------------------------
+expression_graph_t *expression_graph_create(int const nb_commands,
+                                            bool const sorted)
+{
+    assert(nb_commands >= 0);
+
+    expression_graph_t *graph = malloc(sizeof *graph);
+    if (graph == NULL) {
+        fprintf(stderr, "%s: could not allocate the graph.\n", __func__);
+        return NULL;
+    }
+    graph->capacity = NB_REGISTERS + 4 + 3 * nb_commands;
+    graph->table_size = 1;
+    while (graph->table_size < 2 * (size_t) graph->capacity) {
+        graph->table_size *= 2;
+    }
+    graph->nodes = malloc(graph->capacity * sizeof *graph->nodes);
+    graph->table = malloc(graph->table_size * sizeof *graph->table);
+    if (graph->nodes == NULL || graph->table == NULL) {
+        fprintf(stderr, "%s: could not allocate the graph.\n", __func__);
+        expression_graph_destroy(&graph);
+        return NULL;
+    }
+    graph->nb_nodes = 0;
+    graph->sorted = sorted;
+    return graph;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Destroy a graph.
+/// \param  graph
+//  ----------------------------------------------------------------------------
+void expression_graph_destroy(expression_graph_t **graph)
+{
+    if (*graph == NULL) {
+        return;
+    }
+    free((*graph)->nodes);
+    free((*graph)->table);
+    free(*graph);
+    *graph = NULL;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Empty a graph and set the registers to their initial nodes.
+/// \param  graph
+/// \param  nb_inputs
+/// \param  registers
+//  ----------------------------------------------------------------------------
+void expression_graph_start(expression_graph_t * const graph,
+                            int const nb_inputs, int registers[NB_REGISTERS])
+{
+    assert(graph);
+
+    graph->nb_nodes = 0;
+    for (size_t i = 0; i < graph->table_size; i++) {
+        graph->table[i] = -1;
+    }
+
+    for (int r = 0; r < NB_REGISTERS; r++) {
+        expression_node_t const input = {
+            .kind = EXPRESSION_INPUT,
+            .op = r,
+            .operands = { -1, -1, -1 }
+        };
+        registers[r] = r < nb_inputs ? node_intern(graph, &input)
+                       : expression_constant_node(graph, 0);
+    }
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get a node.
+/// \param  graph
+/// \param  index
+/// \return Pointer to the node.
+//  ----------------------------------------------------------------------------
+expression_node_t const *expression_node_get(expression_graph_t const * const
+                                             graph, int const index)
+{
+    assert(index >= 0 && index < graph->nb_nodes);
+    return &graph->nodes[index];
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Tell if a node is the constant value, with the same bits.
+/// \param  graph
+/// \param  index
+/// \param  value
+/// \return True if so.
+//  ----------------------------------------------------------------------------
+bool expression_constant_is(expression_graph_t const * const graph,
+                            int const index, register_value_t const value)
+{
+    expression_node_t const *constant = &graph->nodes[index];
+    return constant->kind == EXPRESSION_CONSTANT
+        && memcmp(&constant->value, &value, sizeof value) == 0;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the node of a constant.
+/// \param  graph
+/// \param  value
+/// \return Index of the node.
+//  ----------------------------------------------------------------------------
+int expression_constant_node(expression_graph_t * const graph,
+                             register_value_t const value)
+{
+    expression_node_t const node = {
+        .kind = EXPRESSION_CONSTANT,
+        .operands = { -1, -1, -1 },
+        .value = value
+    };
+    return node_intern(graph, &node);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the node of an operation. Operations on constants are
+/// computed by the machine. Operations whose result is known without all
+/// operand values are reduced, see identity_reduce(). Operands of commutative
+/// operations are ordered if the graph is sorted.
+/// \param  graph
+/// \param  op
+/// \param  a
+/// \param  b
+/// \return Index of the node.
+//  ----------------------------------------------------------------------------
+int expression_operation_node(expression_graph_t * const graph,
+                              operation_t const op, int const a, int const b)
+{
+    expression_node_t const *node_a = &graph->nodes[a];
+    expression_node_t const *node_b = &graph->nodes[b];
+
+    if (node_a->kind == EXPRESSION_CONSTANT
+        && node_b->kind == EXPRESSION_CONSTANT) {
+        if (op == LESS) {
+            // Also the condition of IF_LESS, whatever the operations enabled.
+            return expression_constant_node(graph,
+                                            node_a->value < node_b->value);
+        }
+        // Two registers, unless there is only one, and then a == b.
+        register_value_t registers[NB_REGISTERS] = { 0 };
+        command_t const command = {
+            .dst = reg_A,
+            .op = op,
+            .src1 = reg_A,
+            .src2 = NB_REGISTERS > 1 ? reg_B : reg_A
+        };
+        registers[command.src1] = node_a->value;
+        registers[command.src2] = node_b->value;
+        machine_program_run(registers, &command, 1);
+        return expression_constant_node(graph, registers[reg_A]);
+    }
+
+    int const reduced = identity_reduce(graph, op, a, b);
+    if (reduced >= 0) {
+        return reduced;
+    }
+
+    // In floating point, min(-0, 0) is 0 but min(0, -0) is -0.
+#if defined(MACHINE_REGISTER_FLOAT)
+    bool const commutative = op == ADD || op == MUL || op == EQUAL;
+#else
+    bool const commutative = op == ADD || op == MUL || op == MIN || op == MAX
+                             || op == EQUAL || op == AND || op == OR
+                             || op == XOR;
+#endif
+    bool const swap = graph->sorted && commutative && b < a;
+    expression_node_t const node = {
+        .kind = EXPRESSION_OPERATION,
+        .op = op,
+        .operands = { swap ? b : a, swap ? a : b, -1 }
+    };
+    return node_intern(graph, &node);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the node of a choice between two values.
+/// \param  graph
+/// \param  condition
+/// \param  a
+/// \param  b
+/// \return Index of the node.
+//  ----------------------------------------------------------------------------
+int expression_select_node(expression_graph_t * const graph,
+                           int const condition, int const a, int const b)
+{
+    if (condition < 0 || a == b) {
+        return a;
+    }
+    expression_node_t const *node = &graph->nodes[condition];
+    if (node->kind == EXPRESSION_CONSTANT) {
+        return node->value != 0 ? a : b;
+    }
+
+    expression_node_t const select = {
+        .kind = EXPRESSION_SELECT,
+        .operands = { condition, a, b }
+    };
+    return node_intern(graph, &select);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the node of the value a command computes.
+/// \param  graph
+/// \param  registers
+/// \param  command
+/// \return Index of the node.
+//  ----------------------------------------------------------------------------
+int expression_command_node(expression_graph_t * const graph,
+                            int const registers[NB_REGISTERS],
+                            command_t const * const command)
+{
+    assert(command->op != IF_LESS);
+
+    if (command->op == LOAD) {
+        return expression_constant_node(graph,
+                                        machine_command_immediate_get(command));
+    }
+    return expression_operation_node(graph, command->op,
+                                     registers[command->src1],
+                                     registers[command->src2]);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the condition for the command after an IF_LESS to run.
+/// \param  graph
+/// \param  guard
+/// \param  registers
+/// \param  command
+/// \return Index of the node of the condition, -1 if it always holds.
+//  ----------------------------------------------------------------------------
+int expression_guard_node(expression_graph_t * const graph, int const guard,
+                          int const registers[NB_REGISTERS],
+                          command_t const * const command)
+{
+    assert(command->op == IF_LESS);
+
+    int const holds = expression_operation_node(graph, LESS,
+                                                registers[command->src1],
+                                                registers[command->src2]);
+    int const condition = guard < 0 ? holds
+        : expression_select_node(graph, guard, holds,
+                                 expression_constant_node(graph, 1));
+    expression_node_t const *node = &graph->nodes[condition];
+    if (node->kind == EXPRESSION_CONSTANT && node->value != 0) {
+        return -1;
+    }
+    return condition;
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+// Get the index of a node equal to node, adding it if there is none.
+static int node_intern(expression_graph_t * const graph,
+                       expression_node_t const * const node)
+{
+    size_t const mask = graph->table_size - 1;
+    size_t slot = node_hash(node) & mask;
+    while (graph->table[slot] >= 0) {
+        expression_node_t const *other = &graph->nodes[graph->table[slot]];
+        if (other->kind == node->kind && other->op == node->op
+            && memcmp(other->operands, node->operands,
+                      sizeof node->operands) == 0
+            && memcmp(&other->value, &node->value, sizeof node->value) == 0) {
+            return graph->table[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    assert(graph->nb_nodes < graph->capacity);
+    graph->nodes[graph->nb_nodes] = *node;
+    graph->table[slot] = graph->nb_nodes;
+    return graph->nb_nodes++;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Reduce an operation whose result is one of its operands, or a
+/// constant, whatever the value of the other operands. Only identities that
+/// hold exactly with clamping are used: x + 0 is x since x is in range, and
+/// x / 0 is x as the machine defines it. Those where the sign of a zero
+/// could change are left to integer registers.
+/// \param  graph
+/// \param  op
+/// \param  a
+/// \param  b
+/// \return Index of the node of the result, -1 if it is not reduced.
+//  ----------------------------------------------------------------------------
+static int identity_reduce(expression_graph_t * const graph,
+                           operation_t const op, int const a, int const b)
+{
+#if defined(MACHINE_REGISTER_FLOAT)
+    bool const integer = false;
+#else
+    bool const integer = true;
+#endif
+
+    if (a == b) {
+        switch (op) {
+        case MIN:
+        case MAX:
+        case AND:
+        case OR:
+            return a;
+        case SUB:
+        case LESS:
+        case XOR:
+            return expression_constant_node(graph, 0);
+        case EQUAL:
+            return expression_constant_node(graph, 1);
+        default:
+            return -1;
+        }
+    }
+
+    switch (op) {
+    case ADD:
+        // In floating point, -0 + 0 is 0.
+        if (!integer) {
+            return -1;
+        }
+        return expression_constant_is(graph, b, 0) ? a
+               : expression_constant_is(graph, a, 0) ? b : -1;
+    case SUB:
+        return expression_constant_is(graph, b, 0) ? a : -1;
+    case MUL:
+        if (integer && (expression_constant_is(graph, a, 0)
+                        || expression_constant_is(graph, b, 0))) {
+            return expression_constant_node(graph, 0);
+        }
+        return expression_constant_is(graph, b, 1) ? a
+               : expression_constant_is(graph, a, 1) ? b : -1;
+    case DIV:
+        if (integer && expression_constant_is(graph, a, 0)) {
+            return a;
+        }
+        return expression_constant_is(graph, b, 0)
+               || expression_constant_is(graph, b, 1) ? a : -1;
+    case MIN:
+        return expression_constant_is(graph, b, REGISTER_MAX) ? a
+               : expression_constant_is(graph, a, REGISTER_MAX) ? b : -1;
+    case MAX:
+        return expression_constant_is(graph, b, REGISTER_MIN) ? a
+               : expression_constant_is(graph, a, REGISTER_MIN) ? b : -1;
+    case AND:
+        if (expression_constant_is(graph, a, 0)
+            || expression_constant_is(graph, b, 0)) {
+            return expression_constant_node(graph, 0);
+        }
+        return expression_constant_is(graph, b, -1) ? a
+               : expression_constant_is(graph, a, -1) ? b : -1;
+    case OR:
+    case XOR:
+        return expression_constant_is(graph, b, 0) ? a
+               : expression_constant_is(graph, a, 0) ? b : -1;
+    default:
+        return -1;
+    }
+}
+
+
+static uint64_t node_hash(expression_node_t const * const node)
+{
+    uint64_t value_bits = 0;
+    memcpy(&value_bits, &node->value, sizeof node->value);
+
+    uint64_t hash = random_mix((uint64_t) node->kind << 8 | node->op);
+    for (int i = 0; i < 3; i++) {
+        hash = random_mix(hash ^ (uint32_t) node->operands[i]);
+    }
+    return random_mix(hash ^ value_bits);
+}
@@ -0,0 +1,138 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+#ifndef EXPRESSION_H_INCLUDED
+#define EXPRESSION_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "machine/machine.h"
+
+// Values of a program run symbolically: each register holds a node of a
+// graph instead of a value. Equal nodes are stored once, so that equal
+// values are recognized by their index. Operations on constants are computed
+// by the machine, so that clamping and division by zero behave as when the
+// program runs, and operations whose result is known without all operand
+// values are reduced. Used by the format and optimizer modules.
+
+typedef enum {
+    EXPRESSION_INPUT,       // Initial value of register op.
+    EXPRESSION_CONSTANT,
+    EXPRESSION_OPERATION,   // op applied to operands 0 and 1.
+    EXPRESSION_SELECT       // Operand 1 if operand 0 is not 0, else operand 2.
+} expression_kind_t;
+
+typedef struct {
+    uint8_t kind;
+    uint8_t op;
+    int operands[3];
+    register_value_t value;
+} expression_node_t;
+
+typedef struct expression_graph_s expression_graph_t;
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create an empty graph with room for a program.
+/// \param  nb_commands Number of commands of the longest program to run.
+/// \param  sorted      Order the operands of commutative operations, so that
+/// A + B and B + A are the same node. Otherwise operands are kept as written.
+/// \return Pointer to the new graph, NULL on failure.
+//  ----------------------------------------------------------------------------
+expression_graph_t *expression_graph_create(int const nb_commands,
+                                            bool const sorted);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Destroy a graph and set the pointer to NULL.
+/// \param  graph
+//  ----------------------------------------------------------------------------
+void expression_graph_destroy(expression_graph_t **graph);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Empty a graph, and set the registers to the nodes of their initial
+/// values, to run a program from its start.
+/// \param  graph
+/// \param  nb_inputs   Number of registers holding inputs. The other
+/// registers start at 0, as in the evaluator.
+/// \param  registers   Output, node of each register.
+//  ----------------------------------------------------------------------------
+void expression_graph_start(expression_graph_t * const graph,
+                            int const nb_inputs, int registers[NB_REGISTERS]);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get a node.
+/// \param  graph
+/// \param  index   Index of the node, as returned by the other functions.
+/// \return Pointer to the node, valid until the next node is added.
+//  ----------------------------------------------------------------------------
+expression_node_t const *expression_node_get(expression_graph_t const * const
+                                             graph, int const index);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Tell if a node is the constant value, with the same bits.
+/// \param  graph
+/// \param  index
+/// \param  value
+/// \return True if so.
+//  ----------------------------------------------------------------------------
+bool expression_constant_is(expression_graph_t const * const graph,
+                            int const index, register_value_t const value);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the node of a constant.
+/// \param  graph
+/// \param  value
+/// \return Index of the node.
+//  ----------------------------------------------------------------------------
+int expression_constant_node(expression_graph_t * const graph,
+                             register_value_t const value);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the node of an operation, computed or reduced if possible.
+/// \param  graph
+/// \param  op      Any operation but IF_LESS and LOAD.
+/// \param  a       Node of the first operand.
+/// \param  b       Node of the second operand.
+/// \return Index of the node.
+//  ----------------------------------------------------------------------------
+int expression_operation_node(expression_graph_t * const graph,
+                              operation_t const op, int const a, int const b);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the node of a choice between two values.
+/// \param  graph
+/// \param  condition   Node of the condition, -1 if it always holds.
+/// \param  a           Node of the value if the condition holds.
+/// \param  b           Node of the value otherwise.
+/// \return Index of the node.
+//  ----------------------------------------------------------------------------
+int expression_select_node(expression_graph_t * const graph,
+                           int const condition, int const a, int const b);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the node of the value a command other than IF_LESS computes.
+/// \param  graph
+/// \param  registers   Nodes of the registers before the command.
+/// \param  command
+/// \return Index of the node.
+//  ----------------------------------------------------------------------------
+int expression_command_node(expression_graph_t * const graph,
+                            int const registers[NB_REGISTERS],
+                            command_t const * const command);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the condition for the command after an IF_LESS to run. A
+/// skipped IF_LESS does not skip the next command, so after an IF_LESS
+/// guarded by g, the next command runs if !g or if the condition holds.
+/// \param  graph
+/// \param  guard       Condition for the IF_LESS to run, -1 if it always does.
+/// \param  registers   Nodes of the registers before the IF_LESS.
+/// \param  command     The IF_LESS.
+/// \return Index of the node of the condition, -1 if it always holds.
+//  ----------------------------------------------------------------------------
+int expression_guard_node(expression_graph_t * const graph, int const guard,
+                          int const registers[NB_REGISTERS],
+                          command_t const * const command);
+
+#endif // EXPRESSION_H_INCLUDED
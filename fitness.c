@@ -0,0 +1,842 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+#include "fitness.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "evaluator.h"
+#include "genome.h"
+#include "parallel.h"
+
+//******************************************************************************
+// Type definitions
+//******************************************************************************
+// Order of individuals, negative if a comes before b. Must be total, so that
+// sorting does not depend on how the work is split between threads.
+typedef int (*order_t)(void const *context, int const a, int const b);
+
+// Sort of the indices of individuals, by chunks sorted in parallel and then
+// merged pairwise.
+typedef struct {
+    order_t order;
+    void const *context;
+    int nb_items;
+    int nb_chunks;
+    int *indices;
+    int *buffer;
+    // Merging round: chunks [2 p width, 2 p width + width) are merged with the
+    // next width chunks, from src to dst.
+    int width;
+    int const *src;
+    int *dst;
+} sort_t;
+
+// Context of the orders.
+typedef struct {
+    double const *objectives;
+    int nb_objectives;
+    int const *ranks;
+    int objective;
+} individuals_t;
+
+// Members of a front whose last two objectives are not both matched or beaten
+// by another member, by increasing second objective, so decreasing third. With
+// three objectives, an individual sorted after the members is dominated by
+// the front if it is by the staircase step at or below its second objective.
+typedef struct {
+    int *members;
+    int nb_members;
+    int capacity;
+} staircase_t;
+
+// Arguments of fronts_search(), run from several threads on a block of the
+// individuals in lexicographic order, against the fronts of the individuals
+// before the block.
+typedef struct {
+    individuals_t const *individuals;
+    int const *order;
+    int first;                      // Position in order of the block.
+    int const *last;
+    staircase_t const *staircases;
+    int nb_fronts;
+    int *starts;                    // Output, first front of each individual.
+} search_t;
+
+// Arguments of population_evaluate(), run from several threads.
+typedef struct {
+    genome_t * const *population;
+    evaluator_cases_t const *cases;
+    register_value_t const *outputs;
+    double *objectives;
+} evaluate_t;
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+// Outputs of at most this many values are kept at a time: the genomes are run
+// by batches, each one as a trie.
+#define FITNESS_BATCH_VALUES    (1 << 22)
+
+// Ranges at most this long are sorted by insertion.
+#define FITNESS_INSERTION_SORT_MAX  (16)
+
+// Individuals searched in the fronts per thread before they are added to them,
+// see fitness_nondominated_sort().
+#define FITNESS_SORT_BLOCK  (1024)
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+static void population_evaluate(void *context, int begin, int end);
+static bool indices_sort(int indices[], int const nb_items, order_t order,
+                         void const *context, int const nb_threads);
+static void chunks_sort(void *context, int begin, int end);
+static void chunks_merge(void *context, int begin, int end);
+static int chunk_start(sort_t const * const sort, int const chunk);
+static void merge_sort(int items[], int buffer[], int const nb_items,
+                       sort_t const * const sort);
+static void merge(int const a[], int const nb_a, int const b[], int const nb_b,
+                  int out[], sort_t const * const sort);
+static int lexicographic_order(void const *context, int const a, int const b);
+static int front_order(void const *context, int const a, int const b);
+static void fronts_search(void *context, int begin, int end);
+static int front_find(individuals_t const * const individuals,
+                      int const last[], staircase_t const * const staircases,
+                      int low, int high, int const individual);
+static bool front_dominates(individuals_t const * const individuals,
+                            int const last,
+                            staircase_t const * const staircase,
+                            int const individual);
+static int staircase_find(individuals_t const * const individuals,
+                          staircase_t const * const staircase,
+                          double const value);
+static bool staircase_insert(individuals_t const * const individuals,
+                             staircase_t * const staircase,
+                             int const individual);
+static bool dominates(individuals_t const * const individuals,
+                      int const a, int const b);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+//  ----------------------------------------------------------------------------
+/// \brief  Compute the objectives of all genomes of a population. The genomes
+/// are run by batches with evaluator_population_run(), so that the genes they
+/// share are run once, then their objectives are computed from the outputs
+/// with fitness_outputs_evaluate().
+/// \param  population
+/// \param  nb_genomes
+/// \param  cases       Fitness cases, targets must not be NULL.
+/// \param  objectives  Output, FITNESS_NB_OBJECTIVES values per genome.
+/// \param  nb_threads
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool fitness_population_evaluate(genome_t * const population[],
+                                 int const nb_genomes,
+                                 evaluator_cases_t const * const cases,
+                                 double objectives[],
+                                 int const nb_threads)
+{
+    assert(population || nb_genomes == 0);
+    assert(cases);
+    assert(objectives || nb_genomes == 0);
+
+    if (cases->targets == NULL && cases->nb_cases > 0) {
+        fprintf(stderr, "%s: the cases have no targets.\n", __func__);
+        return false;
+    }
+
+    int batch_size = nb_genomes;
+    if (cases->nb_cases > 0
+        && batch_size > FITNESS_BATCH_VALUES / cases->nb_cases) {
+        batch_size = FITNESS_BATCH_VALUES / cases->nb_cases;
+        batch_size = batch_size > 0 ? batch_size : 1;
+    }
+    size_t const nb_values = (size_t) batch_size * cases->nb_cases;
+    register_value_t *outputs = malloc((nb_values > 0 ? nb_values : 1)
+                                       * sizeof *outputs);
+    if (outputs == NULL) {
+        fprintf(stderr, "%s: could not allocate outputs.\n", __func__);
+        return false;
+    }
+
+    bool success = true;
+    for (int first = 0; first < nb_genomes; first += batch_size) {
+        int const nb = nb_genomes - first < batch_size ? nb_genomes - first
+                       : batch_size;
+        if (!evaluator_population_run(&population[first], nb, cases, outputs,
+                                      nb_threads)
+            || !fitness_outputs_evaluate(&population[first], nb, cases,
+                                         outputs,
+                                         &objectives[(size_t) first
+                                                     * FITNESS_NB_OBJECTIVES],
+                                         nb_threads)) {
+            success = false;
+            break;
+        }
+    }
+
+    free(outputs);
+    return success;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Compute the objectives of the genomes of a population from their
+/// outputs, in parallel on ranges of genomes.
+/// \param  population
+/// \param  nb_genomes
+/// \param  cases       Fitness cases, targets must not be NULL.
+/// \param  outputs
+/// \param  objectives  Output, FITNESS_NB_OBJECTIVES values per genome.
+/// \param  nb_threads
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool fitness_outputs_evaluate(genome_t * const population[],
+                              int const nb_genomes,
+                              evaluator_cases_t const * const cases,
+                              register_value_t const outputs[],
+                              double objectives[],
+                              int const nb_threads)
+{
+    assert(population || nb_genomes == 0);
+    assert(cases);
+    assert(objectives || nb_genomes == 0);
+
+    if (cases->targets == NULL && cases->nb_cases > 0) {
+        fprintf(stderr, "%s: the cases have no targets.\n", __func__);
+        return false;
+    }
+
+    evaluate_t evaluate = {
+        .population = population,
+        .cases = cases,
+        .outputs = outputs,
+        .objectives = objectives
+    };
+    parallel_for(nb_genomes, nb_threads, population_evaluate, &evaluate);
+    return true;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Non-dominated sort by binary search of the fronts (ENS-BS). The
+/// individuals are sorted lexicographically, so that none can be dominated by
+/// a later one. Each is then put in the first front with no member dominating
+/// it, found by binary search since the fronts dominating it are the first
+/// ones. With two objectives, only the last member of a front needs to be
+/// checked, with three a staircase of each front is searched, which gives an
+/// O(N log N) class sort. More objectives are rejected.
+/// The individuals go through the fronts by blocks. The threads search the
+/// fronts of the individuals before the block, which are not changed meanwhile,
+/// for each individual of the block. The individuals are then added in order,
+/// each searching from the front found for it: only the members added from
+/// the block can push it further, most often they do not.
+/// \param  objectives
+/// \param  nb_individuals
+/// \param  nb_objectives   At most 3.
+/// \param  ranks       Output, front of each individual.
+/// \param  nb_threads
+/// \return Number of fronts, -1 on error.
+//  ----------------------------------------------------------------------------
+int fitness_nondominated_sort(double const objectives[],
+                              int const nb_individuals,
+                              int const nb_objectives,
+                              int ranks[],
+                              int const nb_threads)
+{
+    assert(objectives || nb_individuals == 0);
+    assert(ranks || nb_individuals == 0);
+
+    if (nb_objectives < 1 || nb_objectives > 3) {
+        fprintf(stderr, "%s: one to three objectives are supported.\n",
+                __func__);
+        return -1;
+    }
+    if (nb_individuals <= 0) {
+        return 0;
+    }
+
+    int block_size = FITNESS_SORT_BLOCK * (nb_threads > 1 ? nb_threads : 1);
+    block_size = block_size < nb_individuals ? block_size : nb_individuals;
+    int *order = malloc(nb_individuals * sizeof *order);
+    // Last member of each front.
+    int *last = malloc(nb_individuals * sizeof *last);
+    int *starts = malloc(block_size * sizeof *starts);
+    staircase_t *staircases = NULL;
+    if (nb_objectives == 3) {
+        staircases = calloc(nb_individuals, sizeof *staircases);
+    }
+    individuals_t const individuals = {
+        .objectives = objectives,
+        .nb_objectives = nb_objectives
+    };
+    int nb_fronts = 0;
+    if (order == NULL || last == NULL || starts == NULL
+        || (nb_objectives == 3 && staircases == NULL)
+        || !indices_sort(order, nb_individuals, lexicographic_order,
+                         &individuals, nb_threads)) {
+        nb_fronts = -1;
+    }
+
+    search_t search = {
+        .individuals = &individuals,
+        .order = order,
+        .last = last,
+        .staircases = staircases,
+        .starts = starts
+    };
+    for (int first = 0; first < nb_individuals && nb_fronts >= 0;
+         first += block_size) {
+        int const nb = nb_individuals - first < block_size
+                       ? nb_individuals - first : block_size;
+        search.first = first;
+        search.nb_fronts = nb_fronts;
+        if (nb_fronts > 0) {
+            parallel_for(nb, nb_threads, fronts_search, &search);
+        } else {
+            memset(starts, 0, nb * sizeof *starts);
+        }
+
+        for (int i = 0; i < nb && nb_fronts >= 0; i++) {
+            int const individual = order[first + i];
+            // The fronts before the start dominate the individual. Look for
+            // one that does not by doubling steps, then search between.
+            int low = starts[i];
+            int high = low;
+            for (int step = 1;
+                 high < nb_fronts
+                 && front_dominates(&individuals, last[high],
+                                    staircases ? &staircases[high] : NULL,
+                                    individual);
+                 step *= 2) {
+                low = high + 1;
+                high = low + step < nb_fronts ? low + step : nb_fronts;
+            }
+            int const front = front_find(&individuals, last, staircases, low,
+                                         high, individual);
+
+            if (front == nb_fronts) {
+                nb_fronts++;
+            }
+            last[front] = individual;
+            ranks[individual] = front;
+
+            if (staircases != NULL
+                && !staircase_insert(&individuals, &staircases[front],
+                                     individual)) {
+                nb_fronts = -1;
+            }
+        }
+    }
+    if (nb_fronts < 0) {
+        fprintf(stderr, "%s: could not allocate memory.\n", __func__);
+    }
+
+    if (staircases != NULL) {
+        for (int f = 0; f < nb_individuals; f++) {
+            free(staircases[f].members);
+        }
+    }
+    free(staircases);
+    free(order);
+    free(last);
+    free(starts);
+    return nb_fronts;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Compute the crowding distances. For each objective, the individuals
+/// are sorted by front and then by that objective, so that the neighbours of
+/// an individual in its front are next to it.
+/// \param  objectives
+/// \param  nb_individuals
+/// \param  nb_objectives
+/// \param  ranks
+/// \param  distances   Output, distance of each individual.
+/// \param  nb_threads
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool fitness_crowding_distance_compute(double const objectives[],
+                                       int const nb_individuals,
+                                       int const nb_objectives,
+                                       int const ranks[],
+                                       double distances[],
+                                       int const nb_threads)
+{
+    assert(objectives || nb_individuals == 0);
+    assert(ranks || nb_individuals == 0);
+    assert(distances || nb_individuals == 0);
+
+    if (nb_individuals <= 0) {
+        return true;
+    }
+
+    int *order = malloc(nb_individuals * sizeof *order);
+    if (order == NULL) {
+        fprintf(stderr, "%s: could not allocate memory.\n", __func__);
+        return false;
+    }
+
+    for (int i = 0; i < nb_individuals; i++) {
+        distances[i] = 0.0;
+    }
+
+    individuals_t individuals = {
+        .objectives = objectives,
+        .nb_objectives = nb_objectives,
+        .ranks = ranks
+    };
+    for (int m = 0; m < nb_objectives; m++) {
+        individuals.objective = m;
+        if (!indices_sort(order, nb_individuals, front_order, &individuals,
+                          nb_threads)) {
+            fprintf(stderr, "%s: could not allocate memory.\n", __func__);
+            free(order);
+            return false;
+        }
+
+        int front_start = 0;
+        while (front_start < nb_individuals) {
+            int front_end = front_start + 1;
+            while (front_end < nb_individuals
+                   && ranks[order[front_end]] == ranks[order[front_start]]) {
+                front_end++;
+            }
+
+            double const min = objectives[order[front_start] * nb_objectives
+                                          + m];
+            double const max = objectives[order[front_end - 1] * nb_objectives
+                                          + m];
+            distances[order[front_start]] = INFINITY;
+            distances[order[front_end - 1]] = INFINITY;
+            if (max > min) {
+                for (int i = front_start + 1; i < front_end - 1; i++) {
+                    double const before =
+                        objectives[order[i - 1] * nb_objectives + m];
+                    double const after =
+                        objectives[order[i + 1] * nb_objectives + m];
+                    distances[order[i]] += (after - before) / (max - min);
+                }
+            }
+            front_start = front_end;
+        }
+    }
+
+    free(order);
+    return true;
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+//  ----------------------------------------------------------------------------
+/// \brief  Compute the objectives of a range of genomes of a batch from their
+/// outputs. parallel_work_t.
+/// \param  context evaluate_t.
+/// \param  begin   First genome, in the batch.
+/// \param  end     Genome after the last.
+//  ----------------------------------------------------------------------------
+static void population_evaluate(void *context, int begin, int end)
+{
+    evaluate_t *evaluate = context;
+    evaluator_cases_t local;
+    evaluator_cases_local_get(evaluate->cases, &local);
+    evaluator_cases_t const *cases = &local;
+
+    for (int g = begin; g < end; g++) {
+        genome_t *genome = evaluate->population[g];
+        double *objectives = &evaluate->objectives[g * FITNESS_NB_OBJECTIVES];
+        register_value_t const *outputs =
+            &evaluate->outputs[(size_t) g * cases->nb_cases];
+
+        double error = 0.0;
+        for (int c = 0; c < cases->nb_cases; c++) {
+            double const difference = (double) outputs[c] - cases->targets[c];
+            error += difference < 0 ? -difference : difference;
+        }
+        objectives[FITNESS_ERROR] = error;
+        objectives[FITNESS_SIZE] = genome_size_get(genome);
+        objectives[FITNESS_EFFECTIVE] = genome_effective_size_get(genome);
+    }
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Sort the indices 0 to nb_items - 1. There is one chunk per thread,
+/// each sorted by its thread, then pairs of sorted chunks are merged until
+/// one is left.
+/// \param  indices     Output array of nb_items indices.
+/// \param  nb_items
+/// \param  order       Total order of the indices.
+/// \param  context     Passed to order.
+/// \param  nb_threads
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+static bool indices_sort(int indices[], int const nb_items, order_t order,
+                         void const *context, int const nb_threads)
+{
+    int *buffer = malloc(nb_items * sizeof *buffer);
+    if (buffer == NULL) {
+        return false;
+    }
+
+    for (int i = 0; i < nb_items; i++) {
+        indices[i] = i;
+    }
+
+    sort_t sort = {
+        .order = order,
+        .context = context,
+        .nb_items = nb_items,
+        .nb_chunks = nb_threads < 1 ? 1
+                     : nb_threads < nb_items ? nb_threads : nb_items,
+        .indices = indices,
+        .buffer = buffer,
+    };
+    parallel_for(sort.nb_chunks, nb_threads, chunks_sort, &sort);
+
+    sort.src = indices;
+    sort.dst = buffer;
+    for (sort.width = 1; sort.width < sort.nb_chunks; sort.width *= 2) {
+        int const nb_pairs = (sort.nb_chunks + 2 * sort.width - 1)
+                             / (2 * sort.width);
+        parallel_for(nb_pairs, nb_threads, chunks_merge, &sort);
+        int *swap = sort.dst;
+        sort.dst = (int *) sort.src;
+        sort.src = swap;
+    }
+    if (sort.src != indices) {
+        memcpy(indices, sort.src, nb_items * sizeof *indices);
+    }
+
+    free(buffer);
+    return true;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Sort a range of chunks in place. parallel_work_t.
+/// \param  context sort_t.
+/// \param  begin   First chunk.
+/// \param  end     Chunk after the last.
+//  ----------------------------------------------------------------------------
+static void chunks_sort(void *context, int begin, int end)
+{
+    sort_t const *sort = context;
+    for (int chunk = begin; chunk < end; chunk++) {
+        int const start = chunk_start(sort, chunk);
+        merge_sort(&sort->indices[start], &sort->buffer[start],
+                   chunk_start(sort, chunk + 1) - start, sort);
+    }
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Merge a range of pairs of sorted runs of chunks. parallel_work_t.
+/// \param  context sort_t.
+/// \param  begin   First pair.
+/// \param  end     Pair after the last.
+//  ----------------------------------------------------------------------------
+static void chunks_merge(void *context, int begin, int end)
+{
+    sort_t const *sort = context;
+    for (int pair = begin; pair < end; pair++) {
+        int left = 2 * pair * sort->width;
+        int middle = left + sort->width;
+        int right = middle + sort->width;
+        if (middle > sort->nb_chunks) {
+            middle = sort->nb_chunks;
+        }
+        if (right > sort->nb_chunks) {
+            right = sort->nb_chunks;
+        }
+
+        int const start = chunk_start(sort, left);
+        int const split = chunk_start(sort, middle);
+        merge(&sort->src[start], split - start,
+              &sort->src[split], chunk_start(sort, right) - split,
+              &sort->dst[start], sort);
+    }
+}
+
+
+static int chunk_start(sort_t const * const sort, int const chunk)
+{
+    return (int) ((long long) sort->nb_items * chunk / sort->nb_chunks);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Sort items in place, using a buffer of the same size.
+//  ----------------------------------------------------------------------------
+static void merge_sort(int items[], int buffer[], int const nb_items,
+                       sort_t const * const sort)
+{
+    if (nb_items <= FITNESS_INSERTION_SORT_MAX) {
+        for (int i = 1; i < nb_items; i++) {
+            int const item = items[i];
+            int j = i;
+            while (j > 0
+                   && sort->order(sort->context, items[j - 1], item) > 0) {
+                items[j] = items[j - 1];
+                j--;
+            }
+            items[j] = item;
+        }
+        return;
+    }
+
+    int const half = nb_items / 2;
+    merge_sort(items, buffer, half, sort);
+    merge_sort(&items[half], &buffer[half], nb_items - half, sort);
+    if (sort->order(sort->context, items[half - 1], items[half]) <= 0) {
+        return;
+    }
+    memcpy(buffer, items, nb_items * sizeof *buffer);
+    merge(buffer, half, &buffer[half], nb_items - half, items, sort);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Merge two sorted arrays into out, which must not overlap them.
+//  ----------------------------------------------------------------------------
+static void merge(int const a[], int const nb_a, int const b[], int const nb_b,
+                  int out[], sort_t const * const sort)
+{
+    int i = 0;
+    int j = 0;
+    while (i < nb_a && j < nb_b) {
+        if (sort->order(sort->context, a[i], b[j]) <= 0) {
+            *out++ = a[i++];
+        } else {
+            *out++ = b[j++];
+        }
+    }
+    memcpy(out, &a[i], (nb_a - i) * sizeof *out);
+    memcpy(out + nb_a - i, &b[j], (nb_b - j) * sizeof *out);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Order by the first objective, ties broken by the next ones and
+/// finally by index. order_t.
+//  ----------------------------------------------------------------------------
+static int lexicographic_order(void const *context, int const a, int const b)
+{
+    individuals_t const *individuals = context;
+    double const *objectives_a =
+        &individuals->objectives[a * individuals->nb_objectives];
+    double const *objectives_b =
+        &individuals->objectives[b * individuals->nb_objectives];
+
+    for (int m = 0; m < individuals->nb_objectives; m++) {
+        if (objectives_a[m] != objectives_b[m]) {
+            return objectives_a[m] < objectives_b[m] ? -1 : 1;
+        }
+    }
+    return a - b;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Order by front, then by the objective of the context, then by
+/// index. order_t.
+//  ----------------------------------------------------------------------------
+static int front_order(void const *context, int const a, int const b)
+{
+    individuals_t const *individuals = context;
+    if (individuals->ranks[a] != individuals->ranks[b]) {
+        return individuals->ranks[a] - individuals->ranks[b];
+    }
+
+    int const nb_objectives = individuals->nb_objectives;
+    int const m = individuals->objective;
+    double const value_a = individuals->objectives[a * nb_objectives + m];
+    double const value_b = individuals->objectives[b * nb_objectives + m];
+    if (value_a != value_b) {
+        return value_a < value_b ? -1 : 1;
+    }
+    return a - b;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Search the fronts for the individuals of a block. parallel_work_t.
+/// \param  context search_t.
+/// \param  begin   First individual, from the start of the block.
+/// \param  end     Individual after the last.
+//  ----------------------------------------------------------------------------
+static void fronts_search(void *context, int begin, int end)
+{
+    search_t const *search = context;
+    for (int i = begin; i < end; i++) {
+        search->starts[i] = front_find(search->individuals, search->last,
+                                       search->staircases, 0,
+                                       search->nb_fronts,
+                                       search->order[search->first + i]);
+    }
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Find the first front not dominating an individual, by binary
+/// search between fronts known to dominate it and one known not to.
+/// \param  individuals
+/// \param  last        Last member of each front.
+/// \param  staircases  Staircase of each front with three objectives, or
+/// NULL.
+/// \param  low         The fronts before low dominate the individual.
+/// \param  high        Front high does not, or is the number of fronts.
+/// \param  individual
+/// \return Index of the front.
+//  ----------------------------------------------------------------------------
+static int front_find(individuals_t const * const individuals,
+                      int const last[], staircase_t const * const staircases,
+                      int low, int high, int const individual)
+{
+    while (low < high) {
+        int const middle = low + (high - low) / 2;
+        if (front_dominates(individuals, last[middle],
+                            staircases ? &staircases[middle] : NULL,
+                            individual)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Check whether a member of a front dominates an individual, which
+/// comes after all of them in lexicographic order.
+/// \param  individuals
+/// \param  last        Last member of the front.
+/// \param  staircase   Staircase of the front with three objectives, or NULL.
+/// \param  individual
+/// \return True if the individual is dominated.
+//  ----------------------------------------------------------------------------
+static bool front_dominates(individuals_t const * const individuals,
+                            int const last,
+                            staircase_t const * const staircase,
+                            int const individual)
+{
+    // With two objectives, the last member has the lowest second objective.
+    if (staircase == NULL) {
+        return dominates(individuals, last, individual);
+    }
+
+    double const value = individuals->objectives[individual * 3 + 1];
+    int const step = staircase_find(individuals, staircase, value) - 1;
+    return step >= 0
+           && dominates(individuals, staircase->members[step], individual);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Find where a second objective value goes in a staircase.
+/// \return Index of the first step above value.
+//  ----------------------------------------------------------------------------
+static int staircase_find(individuals_t const * const individuals,
+                          staircase_t const * const staircase,
+                          double const value)
+{
+    int low = 0;
+    int high = staircase->nb_members;
+    while (low < high) {
+        int const middle = low + (high - low) / 2;
+        if (individuals->objectives[staircase->members[middle] * 3 + 1]
+            <= value) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Add a new member to the staircase of its front. The steps it
+/// matches or beats in the last two objectives are removed: an individual
+/// sorted after both and dominated by them is dominated by it too.
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+static bool staircase_insert(individuals_t const * const individuals,
+                             staircase_t * const staircase,
+                             int const individual)
+{
+    double const *objectives = individuals->objectives;
+    double const second = objectives[individual * 3 + 1];
+    double const third = objectives[individual * 3 + 2];
+
+    // An equal step is kept, the new member was not dominated by it so equals
+    // it.
+    int position = staircase_find(individuals, staircase, second);
+    if (position > 0
+        && objectives[staircase->members[position - 1] * 3 + 1] == second
+        && objectives[staircase->members[position - 1] * 3 + 2] <= third) {
+        return true;
+    }
+    if (position > 0
+        && objectives[staircase->members[position - 1] * 3 + 1] == second) {
+        position--;
+    }
+    int end = position;
+    while (end < staircase->nb_members
+           && objectives[staircase->members[end] * 3 + 2] >= third) {
+        end++;
+    }
+
+    if (end == position && staircase->nb_members == staircase->capacity) {
+        int capacity = staircase->capacity ? 2 * staircase->capacity : 8;
+        int *members = realloc(staircase->members,
+                               capacity * sizeof *members);
+        if (members == NULL) {
+            return false;
+        }
+        staircase->members = members;
+        staircase->capacity = capacity;
+    }
+
+    // Replace the steps [position, end) by the new one.
+    memmove(&staircase->members[position + 1], &staircase->members[end],
+            (staircase->nb_members - end) * sizeof *staircase->members);
+    staircase->members[position] = individual;
+    staircase->nb_members += position + 1 - end;
+    return true;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Check whether a dominates b, knowing that a comes before b in
+/// lexicographic order: a is no worse in any objective, and differs from b.
+//  ----------------------------------------------------------------------------
+static bool dominates(individuals_t const * const individuals,
+                      int const a, int const b)
+{
+    double const *objectives_a =
+        &individuals->objectives[a * individuals->nb_objectives];
+    double const *objectives_b =
+        &individuals->objectives[b * individuals->nb_objectives];
+
+    bool better = objectives_a[0] < objectives_b[0];
+    for (int m = 1; m < individuals->nb_objectives; m++) {
+        if (objectives_a[m] > objectives_b[m]) {
+            return false;
+        }
+        better |= objectives_a[m] < objectives_b[m];
+    }
+    return better;
+}
@@ -0,0 +1,94 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+#ifndef FITNESS_H_INCLUDED
+#define FITNESS_H_INCLUDED
+
+#include <stdbool.h>
+
+#include "evaluator.h"
+#include "genome.h"
+
+// Objectives computed by fitness_population_evaluate(), all minimized.
+typedef enum {
+    FITNESS_ERROR,      // Sum of the absolute errors over the cases.
+    FITNESS_SIZE,       // Number of genes.
+    FITNESS_EFFECTIVE,  // Number of effective genes.
+    FITNESS_NB_OBJECTIVES
+} fitness_objective_t;
+
+//  ----------------------------------------------------------------------------
+/// \brief  Compute the objectives of all genomes of a population.
+/// \param  population  Array of genomes.
+/// \param  nb_genomes  Number of genomes.
+/// \param  cases       Fitness cases, with targets.
+/// \param  objectives  Output array of FITNESS_NB_OBJECTIVES values per
+/// genome, genome after genome.
+/// \param  nb_threads  Number of threads to use.
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool fitness_population_evaluate(genome_t * const population[],
+                                 int const nb_genomes,
+                                 evaluator_cases_t const * const cases,
+                                 double objectives[],
+                                 int const nb_threads);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Compute the objectives of the genomes of a population from the
+/// outputs of a run, as fitness_population_evaluate() does after running them.
+/// \param  population  Array of genomes.
+/// \param  nb_genomes  Number of genomes.
+/// \param  cases       Fitness cases the genomes were run on, with targets.
+/// \param  outputs     cases->nb_cases values per genome, genome after
+/// genome, see evaluator_population_run().
+/// \param  objectives  Output array of FITNESS_NB_OBJECTIVES values per
+/// genome, genome after genome.
+/// \param  nb_threads  Number of threads to use.
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool fitness_outputs_evaluate(genome_t * const population[],
+                              int const nb_genomes,
+                              evaluator_cases_t const * const cases,
+                              register_value_t const outputs[],
+                              double objectives[],
+                              int const nb_threads);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Sort individuals into non-dominated fronts. Front 0 holds the
+/// individuals no other dominates, front 1 those only dominated by front 0,
+/// and so on. All objectives are minimized, and must not be NaN.
+/// \param  objectives  nb_objectives values per individual, individual after
+/// individual.
+/// \param  nb_individuals  Number of individuals.
+/// \param  nb_objectives   Number of objectives per individual, from 1 to 3.
+/// \param  ranks       Output array, front of each individual.
+/// \param  nb_threads  Number of threads to use.
+/// \return Number of fronts, -1 on error.
+//  ----------------------------------------------------------------------------
+int fitness_nondominated_sort(double const objectives[],
+                              int const nb_individuals,
+                              int const nb_objectives,
+                              int ranks[],
+                              int const nb_threads);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Compute the crowding distance of each individual within its front:
+/// the sum over the objectives of the normalized distance between its two
+/// neighbours. The extremes of a front are at infinite distance.
+/// \param  objectives  As for fitness_nondominated_sort().
+/// \param  nb_individuals  Number of individuals.
+/// \param  nb_objectives   Number of objectives per individual.
+/// \param  ranks       Fronts from fitness_nondominated_sort().
+/// \param  distances   Output array, distance of each individual.
+/// \param  nb_threads  Number of threads to use.
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool fitness_crowding_distance_compute(double const objectives[],
+                                       int const nb_individuals,
+                                       int const nb_objectives,
+                                       int const ranks[],
+                                       double distances[],
+                                       int const nb_threads);
+
+#endif // FITNESS_H_INCLUDED
@@ -0,0 +1,246 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+#include "format.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "expression.h"
+#include "genome.h"
+#include "machine/machine.h"
+
+//******************************************************************************
+// Type definitions
+//******************************************************************************
+// Output of node_render(), which stops writing once the buffer is full.
+typedef struct {
+    char *buffer;
+    size_t capacity;
+    size_t length;
+    bool full;
+} writer_t;
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+// Text of the population is written to file by chunks of about this size.
+#define FORMAT_CHUNK_SIZE   (1 << 16)
+
+// Longest index line of format_population_write(), null included.
+#define FORMAT_INDEX_MAX    (32)
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+static void node_render(writer_t * const writer,
+                        expression_graph_t const * const graph,
+                        int const node);
+static void text_write(writer_t * const writer, char const * const text);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+//  ----------------------------------------------------------------------------
+/// \brief  Write genomes to a file. Each genome is formatted into a chunk,
+/// which is written when the next genome does not fit. The chunk grows for a
+/// genome bigger than it.
+/// \param  file
+/// \param  population
+/// \param  nb_genomes
+/// \param  effective_only
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool format_population_write(FILE * const file,
+                             genome_t * const population[],
+                             int const nb_genomes,
+                             bool const effective_only)
+{
+    assert(file);
+    assert(population || nb_genomes == 0);
+
+    size_t capacity = FORMAT_CHUNK_SIZE;
+    char *chunk = malloc(capacity);
+    if (chunk == NULL) {
+        fprintf(stderr, "%s: could not allocate chunk.\n", __func__);
+        return false;
+    }
+
+    bool success = true;
+    size_t length = 0;
+    for (int i = 0; i < nb_genomes && success; i++) {
+        size_t const size = FORMAT_INDEX_MAX
+            + genome_format_capacity_get(population[i]);
+        if (size > capacity - length) {
+            success = fwrite(chunk, 1, length, file) == length;
+            length = 0;
+        }
+        if (size > capacity) {
+            char *bigger = malloc(size);
+            if (bigger == NULL) {
+                fprintf(stderr, "%s: could not allocate chunk.\n", __func__);
+                success = false;
+                break;
+            }
+            free(chunk);
+            chunk = bigger;
+            capacity = size;
+        }
+
+        length += snprintf(&chunk[length], FORMAT_INDEX_MAX, "Genome %i\n",
+                           i);
+        size_t const genome_length = genome_format(population[i],
+                                                   effective_only,
+                                                   &chunk[length],
+                                                   capacity - length);
+        success = success && genome_length > 0;
+        length += genome_length;
+    }
+    if (success) {
+        success = fwrite(chunk, 1, length, file) == length;
+    }
+    if (!success) {
+        fprintf(stderr, "%s: could not write the population.\n", __func__);
+    }
+    free(chunk);
+    return success;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Format the expression of reg_A. The genes are run symbolically:
+/// each register holds a node of the graph instead of a value.
+/// \param  genome
+/// \param  nb_inputs
+/// \param  buffer
+/// \param  capacity
+/// \return Number of characters written, 0 on failure.
+//  ----------------------------------------------------------------------------
+size_t format_expression(genome_t const * const genome, int const nb_inputs,
+                         char buffer[], size_t const capacity)
+{
+    assert(genome);
+    assert(buffer || capacity == 0);
+
+    int const size = genome_size_get(genome);
+    command_t const *genes = genome_genes_get(genome);
+
+    // Operands are kept in the order they are written.
+    expression_graph_t *graph = expression_graph_create(size, false);
+    if (graph == NULL) {
+        return 0;
+    }
+    int registers[NB_REGISTERS];
+    expression_graph_start(graph, nb_inputs, registers);
+
+    // Condition for the current command to run, -1 if it always does.
+    int guard = -1;
+    for (int i = 0; i < size; i++) {
+        command_t const *gene = &genes[i];
+        int const condition = guard;
+        guard = -1;
+
+        if (gene->op == IF_LESS) {
+            guard = expression_guard_node(graph, condition, registers, gene);
+            continue;
+        }
+        int const value = expression_command_node(graph, registers, gene);
+        registers[gene->dst] = expression_select_node(graph, condition, value,
+                                                      registers[gene->dst]);
+    }
+
+    writer_t writer = {
+        .buffer = buffer,
+        .capacity = capacity
+    };
+    node_render(&writer, graph, registers[reg_A]);
+    expression_graph_destroy(&graph);
+
+    if (writer.full) {
+        if (capacity > 0) {
+            buffer[0] = '\0';
+        }
+        return 0;
+    }
+    buffer[writer.length] = '\0';
+    return writer.length;
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+// Write a node, with its operands, in infix form.
+static void node_render(writer_t * const writer,
+                        expression_graph_t const * const graph,
+                        int const index)
+{
+    static char const *const operators[NB_OPERATION_TYPES] = {
+        [ADD] = " + ", [SUB] = " - ", [MUL] = " * ", [DIV] = " / ",
+        [MIN] = "min(", [MAX] = "max(", [LESS] = " < ", [EQUAL] = " == ",
+        [AND] = " & ", [OR] = " | ", [XOR] = " ^ "
+    };
+
+    if (writer->full) {
+        return;
+    }
+    expression_node_t const *node = expression_node_get(graph, index);
+    switch (node->kind) {
+    case EXPRESSION_INPUT:
+        text_write(writer, machine_register_name_get(node->op));
+        break;
+    case EXPRESSION_CONSTANT: {
+        char text[32];
+#if defined(MACHINE_REGISTER_FLOAT)
+        snprintf(text, sizeof text, "%g", node->value);
+#else
+        snprintf(text, sizeof text, "%li", (long) node->value);
+#endif
+        text_write(writer, text);
+        break;
+    }
+    case EXPRESSION_OPERATION:
+        if (node->op == MIN || node->op == MAX) {
+            text_write(writer, operators[node->op]);
+            node_render(writer, graph, node->operands[0]);
+            text_write(writer, ", ");
+            node_render(writer, graph, node->operands[1]);
+            text_write(writer, ")");
+        } else {
+            text_write(writer, "(");
+            node_render(writer, graph, node->operands[0]);
+            text_write(writer, operators[node->op]);
+            node_render(writer, graph, node->operands[1]);
+            text_write(writer, ")");
+        }
+        break;
+    case EXPRESSION_SELECT:
+        text_write(writer, "(");
+        node_render(writer, graph, node->operands[0]);
+        text_write(writer, " ? ");
+        node_render(writer, graph, node->operands[1]);
+        text_write(writer, " : ");
+        node_render(writer, graph, node->operands[2]);
+        text_write(writer, ")");
+        break;
+    }
+}
+
+
+// Append text, or mark the writer full if it does not fit with a null.
+static void text_write(writer_t * const writer, char const * const text)
+{
+    size_t const length = strlen(text);
+    if (writer->full || length >= writer->capacity - writer->length) {
+        writer->full = true;
+        return;
+    }
+    memcpy(&writer->buffer[writer->length], text, length);
+    writer->length += length;
+}
+
@@ -0,0 +1,50 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+#ifndef FORMAT_H_INCLUDED
+#define FORMAT_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "genome.h"
+
+// Text forms of genomes for logs and analysis, built in memory and written
+// in large chunks. See genome_format() for a single genome.
+
+//  ----------------------------------------------------------------------------
+/// \brief  Write genomes to a file in the form of genome_format(), one after
+/// the other, each preceded by a line with its index.
+/// \param  file
+/// \param  population  Array of genomes.
+/// \param  nb_genomes  Number of genomes.
+/// \param  effective_only  Only write the effective genes.
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool format_population_write(FILE * const file,
+                             genome_t * const population[],
+                             int const nb_genomes,
+                             bool const effective_only);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Format the value a genome leaves in reg_A as a single expression
+/// of the initial register values, for example "min((A + 3), B)". Constant
+/// parts are computed, with the machine's own operations, and trivial ones
+/// such as max(x, x) are reduced. A command guarded by an IF_LESS becomes
+/// "(condition ? new value : old value)". Parts used several times are
+/// repeated, so the text can be much longer than the genome.
+/// \param  genome
+/// \param  nb_inputs   Number of registers holding inputs, named by their
+/// register in the expression. The other registers start at 0, as in the
+/// evaluator.
+/// \param  buffer      Output, null terminated.
+/// \param  capacity    Size of buffer.
+/// \return Number of characters written, null excluded. 0 if buffer is too
+/// small or on error.
+//  ----------------------------------------------------------------------------
+size_t format_expression(genome_t const * const genome, int const nb_inputs,
+                         char buffer[], size_t const capacity);
+
+#endif // FORMAT_H_INCLUDED
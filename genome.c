@@ -4,54 +4,155 @@ Copyright (c) 2013 Gauthier Fleutot Östervall
 #include "genome.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <malloc.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
-#include "linkedlist/linkedlist.h"
 #include "machine/machine.h"
+#include "parallel.h"
+#include "placement.h"
 #include "randomizer.h"
 
 //******************************************************************************
 // Type definitions
 //******************************************************************************
+// Genes of one genome, or of several genomes created at once, allocated as one
+// block. Copies of a genome share its block. The block is freed when the last
+// genome using it stops doing so. The block of a population can be placed,
+// see population_block_create(), the others come from malloc().
+typedef struct {
+    int nb_users;
+    bool placed;
+    command_t genes[];
+} gene_block_t;
+
+// Genes are stored contiguously, so that whole genomes can be compared, hashed
+// and copied as blocks of memory.
 struct genome_s {
-    linkedlist_t *genes;
+    command_t *genes;
+    int size;
+    int capacity;
+    // Block the genes are in, NULL if there are none yet. Genes in a block
+    // that other genomes use are read only, the genome gets a block of its own
+    // before modifying them. capacity is the number of genes the genome can
+    // write from genes once the block is its own, 0 in a population block.
+    gene_block_t *block;
+    // Effective genes relative to GENOME_OUTPUT_REGISTER, computed on demand.
+    // Must be invalidated whenever the genes change.
+    bool *effective;
+    int effective_capacity;
+    int nb_effective;
+    bool effective_valid;
 };
 
-//******************************************************************************
-// Globals
-//******************************************************************************
-// sizeof(genome_t) is needed but not available externally since it is an
-// incomplete type. Make the size available through this global.
-const size_t sizeof_genome = sizeof(genome_t);
+// Arguments of population_genes_decode(), run from several threads. valid is
+// cleared by any thread finding an invalid gene.
+typedef struct {
+    genome_t **population;
+    uint8_t const *buffer;
+    gene_block_t *block;
+    size_t const *offsets;
+    bool valid;
+} population_decode_t;
+
+// Arguments of population_genes_fill(), run from several threads.
+typedef struct {
+    genome_t **population;
+    genome_size_distribution_t const *distribution;
+    uint64_t seed;
+    gene_block_t *block;
+    size_t const *offsets;
+} population_fill_t;
 
 //******************************************************************************
 // Module constants
 //******************************************************************************
 #define GENOME_START_SIZE_MAX   (255U)
 
+// Number of genes compared with a single memcmp() when looking for the first
+// difference between two genomes.
+#define GENOME_COMPARE_BLOCK    (16)
+
+// Number of random words drawn at once when filling genes.
+#define GENOME_FILL_BLOCK       (64)
+
+// The register holding the result, see machine_result_get().
+#define GENOME_OUTPUT_REGISTER  (reg_A)
+
+// Longest header line of genome_format(), null included.
+#define GENOME_FORMAT_HEADER_MAX    (48)
+
+// Bytes of the serialized form: the number of genes, then each gene.
+#define GENOME_SERIAL_HEADER    (4)
+#define GENOME_SERIAL_GENE      (4)
+
 //******************************************************************************
-// Module variables
+// Globals
 //******************************************************************************
-// Must be initialized to true before checking for genome validity.
-static bool gene_was_valid = false;
+// sizeof(genome_t) is needed but not available externally since it is an
+// incomplete type. Make the size available through this global.
+const size_t sizeof_genome = sizeof(genome_t);
+
+// The distribution of genome_random_create().
+const genome_size_distribution_t genome_size_distribution_default = {
+    .size_min = 0,
+    .size_max = GENOME_START_SIZE_MAX - 1,
+    .nb_ramps = 0
+};
 
 //******************************************************************************
 // Function prototypes
 //******************************************************************************
-static void gene_display(void const * const data);
-static void gene_valid_check(void const * const data);
+static bool genes_reserve(genome_t * const genome, int const capacity);
+static bool genes_shared(genome_t const * const genome);
+static gene_block_t *gene_block_create(int const nb_genes);
+static gene_block_t *population_block_create(size_t const offsets[],
+                                             int const nb_genomes);
+static void gene_block_free(gene_block_t * const block);
+static void gene_block_release(gene_block_t * const block);
+static int size_draw(random_stream_t * const stream,
+                     genome_size_distribution_t const * const distribution,
+                     int const index);
+static void population_genes_fill(void *context, int begin, int end);
+static void population_genes_decode(void *context, int begin, int end);
+static bool genes_decode(uint8_t const data[], command_t genes[],
+                         int const nb_genes);
+static bool effective_update(genome_t * const genome);
+static int effective_position_draw(genome_t * const genome,
+                                   random_stream_t * const stream);
+static command_t *effective_genes_copy(genome_t * const genome,
+                                       int * const nb_genes);
+static bool effective_genes_equal(genome_t * const genome,
+                                  command_t const * const genes,
+                                  int const nb_genes);
+static void genes_tail_swap(genome_t * const genome1, int const place1,
+                            genome_t * const genome2, int const place2);
+static uint64_t hash_mix(uint64_t hash, uint64_t const word);
 
 //******************************************************************************
 // Function definitions
 //******************************************************************************
 //  ----------------------------------------------------------------------------
-/// \brief  Create a genome with random commands.
+/// \brief  Create a genome with random commands, from the default random
+/// stream.
 /// \return Pointer to the newly allocated genome.
 //  ----------------------------------------------------------------------------
 genome_t *genome_random_create(void)
+{
+    return genome_random_create_r(random_default_stream_get());
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create a genome with random commands, drawn from stream.
+/// \param  stream  Random stream to draw from.
+/// \return Pointer to the newly allocated genome.
+//  ----------------------------------------------------------------------------
+genome_t *genome_random_create_r(random_stream_t * const stream)
 {
     genome_t *new_genome_p = genome_create();
     if (new_genome_p == NULL) {
@@ -59,17 +160,18 @@ genome_t *genome_random_create(void)
         return NULL;
     }
 
-    int genome_size = random_get(GENOME_START_SIZE_MAX);
+    int genome_size = size_draw(stream, &genome_size_distribution_default, 0);
+    if (!genes_reserve(new_genome_p, genome_size)) {
+        fprintf(stderr, "%s: could not allocate genes.\n", __func__);
+        genome_destroy(&new_genome_p);
+        return NULL;
+    }
 
     for (int i = 0; i < genome_size; i++) {
-        command_t *new_command_p = machine_command_random_create();
-        if (new_command_p == NULL) {
-            fprintf(stderr, "%s: new_command_p is NULL.\n", __func__);
-            genome_destroy(&new_genome_p);
-            return NULL;
-        }
-        linkedlist_add(new_genome_p->genes, new_command_p);
+        machine_command_random_set(&new_genome_p->genes[i],
+                                   random_stream_next(stream));
     }
+    new_genome_p->size = genome_size;
 
     if (!genome_sanity_check(new_genome_p)) {
         fprintf(stderr, "%s: new genome is corrupt.\n", __func__);
@@ -80,7 +182,79 @@ genome_t *genome_random_create(void)
 
 
 //  ----------------------------------------------------------------------------
-/// \brief  Create a new genome object, including a linkedlist object (no data).
+/// \brief  Create a population of random genomes at once. The sizes are drawn
+/// first, then the genes of all genomes are allocated as one block and filled
+/// from several threads. Genome i is the genome that genome_random_create_r()
+/// would create from the stream (seed, 0, i) with the same distribution, so
+/// the result does not depend on the number of threads. The genes are valid by
+/// construction and are not checked.
+/// \param  population  Output array of nb_genomes genomes.
+/// \param  nb_genomes  Number of genomes to create.
+/// \param  distribution    Distribution of the genome sizes.
+/// \param  seed        Seed of the random streams.
+/// \param  nb_threads  Number of threads to fill the genes from.
+/// \return True if the population could be allocated.
+//  ----------------------------------------------------------------------------
+bool genome_population_random_create(genome_t *population[],
+                                     int const nb_genomes,
+                                     genome_size_distribution_t const *
+                                     const distribution,
+                                     uint64_t const seed,
+                                     int const nb_threads)
+{
+    assert(population);
+    assert(distribution);
+
+    size_t *offsets = malloc((nb_genomes + 1) * sizeof *offsets);
+    if (offsets == NULL) {
+        fprintf(stderr, "%s: could not allocate offsets.\n", __func__);
+        return false;
+    }
+    offsets[0] = 0;
+    for (int i = 0; i < nb_genomes; i++) {
+        random_stream_t stream;
+        random_stream_init(&stream, seed, 0, i);
+        offsets[i + 1] = offsets[i] + size_draw(&stream, distribution, i);
+    }
+
+    gene_block_t *block = population_block_create(offsets, nb_genomes);
+    if (block == NULL) {
+        fprintf(stderr, "%s: could not allocate genes.\n", __func__);
+        free(offsets);
+        return false;
+    }
+
+    for (int i = 0; i < nb_genomes; i++) {
+        population[i] = genome_create();
+        if (population[i] == NULL) {
+            for (int j = 0; j < i; j++) {
+                genome_destroy(&population[j]);
+            }
+            gene_block_free(block);
+            free(offsets);
+            return false;
+        }
+    }
+
+    population_fill_t fill = {
+        .population = population,
+        .distribution = distribution,
+        .seed = seed,
+        .block = block,
+        .offsets = offsets
+    };
+    parallel_for(nb_genomes, nb_threads, population_genes_fill, &fill);
+
+    if (nb_genomes == 0) {
+        gene_block_free(block);
+    }
+    free(offsets);
+    return true;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create a new genome object, with no genes.
 /// \return Pointer to the newly created genome object.
 //  ----------------------------------------------------------------------------
 genome_t *genome_create(void)
@@ -91,13 +265,45 @@ genome_t *genome_create(void)
         return NULL;
     }
 
-    new_genome_p->genes = linkedlist_create();
-    if (new_genome_p->genes == NULL) {
-        fprintf(stderr, "%s: linked list is NULL.\n", __func__);
-        free(new_genome_p);
+    *new_genome_p = (genome_t) {
+        .genes = NULL,
+        .size = 0,
+        .capacity = 0,
+        .block = NULL,
+        .effective = NULL,
+        .effective_capacity = 0,
+        .nb_effective = 0,
+        .effective_valid = false
+    };
+    return new_genome_p;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create a new genome holding a copy of the given genes.
+/// \param  genes       Array of valid commands.
+/// \param  nb_genes    Number of genes.
+/// \return Pointer to the new genome, NULL on failure.
+//  ----------------------------------------------------------------------------
+genome_t *genome_genes_create(command_t const genes[], int const nb_genes)
+{
+    assert(genes || nb_genes == 0);
+    assert(nb_genes >= 0);
+
+    genome_t *genome = genome_create();
+    if (genome == NULL) {
         return NULL;
     }
-    return new_genome_p;
+    if (!genes_reserve(genome, nb_genes)) {
+        fprintf(stderr, "%s: could not allocate genes.\n", __func__);
+        genome_destroy(&genome);
+        return NULL;
+    }
+    if (nb_genes > 0) {
+        memcpy(genome->genes, genes, nb_genes * sizeof *genes);
+    }
+    genome->size = nb_genes;
+    return genome;
 }
 
 //  ----------------------------------------------------------------------------
@@ -112,14 +318,22 @@ bool genome_sanity_check(genome_t const * const genome)
         fprintf(stderr, "%s: genome is NULL.\n", __func__);
         return false;
     }
-    gene_was_valid = true;
-    linkedlist_run_for_all(genome->genes, gene_valid_check);
-    return gene_was_valid;
+
+    bool genes_valid = true;
+    for (int i = 0; i < genome->size; i++) {
+        if (!machine_command_valid_check(&genome->genes[i])) {
+            fprintf(stderr, "%s: invalid gene at %i.\n", __func__, i);
+            genes_valid = false;
+        }
+    }
+    return genes_valid;
 }
 
 
 //  ----------------------------------------------------------------------------
-/// \brief  Copy a genome to another. Data objects are duplicated.
+/// \brief  Copy a genome to another. The genes are not duplicated: the copy
+/// uses the block of src, and either genome gets a block of its own when it
+/// is modified. The effective map is copied if it is up to date.
 /// \param  dst
 /// \param  src
 //  ----------------------------------------------------------------------------
@@ -129,24 +343,188 @@ void genome_copy(genome_t ** const dst, genome_t const * const src)
         fprintf(stderr, "%s: src is NULL.\n", __func__);
         return;
     }
+    if (*dst == src) {
+        return;
+    }
+
+    if (*dst == NULL) {
+        *dst = genome_create();
+        if (*dst == NULL) {
+            return;
+        }
+    }
+    genome_t *copy = *dst;
 
-    if (*dst != NULL) {
-        genome_destroy(dst);
+    // Join the block of src before leaving the old one, which may be the same.
+    if (src->block != NULL) {
+        __atomic_add_fetch(&src->block->nb_users, 1, __ATOMIC_RELAXED);
+    }
+    if (copy->block != NULL) {
+        gene_block_release(copy->block);
+    }
+    copy->block = src->block;
+    copy->genes = src->genes;
+    copy->size = src->size;
+    copy->capacity = src->capacity;
+
+    copy->effective_valid = false;
+    if (src->effective_valid && src->size <= copy->effective_capacity) {
+        memcpy(copy->effective, src->effective,
+               src->size * sizeof *copy->effective);
+        copy->nb_effective = src->nb_effective;
+        copy->effective_valid = true;
     }
-    *dst = genome_create();
-    linkedlist_copy((*dst)->genes, src->genes, sizeof_machine_command);
 }
 
 
 //  ----------------------------------------------------------------------------
-/// \brief  Compare two genomes.
+/// \brief  Compare two genomes. The sizes are compared first, the genes are
+/// then compared as one block of memory.
 //  ----------------------------------------------------------------------------
 bool genome_compare(genome_t * const gen1, genome_t * const gen2)
 {
     assert(gen1);
     assert(gen2);
 
-    return linkedlist_compare(gen1->genes, gen2->genes, sizeof_machine_command);
+    if (gen1->size != gen2->size) {
+        return false;
+    }
+    if (gen1->size == 0) {
+        return true;
+    }
+    return memcmp(gen1->genes, gen2->genes,
+                  gen1->size * sizeof (command_t)) == 0;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Find the first gene that differs between two genomes. Blocks of
+/// genes are compared at once, and only the block containing a difference is
+/// searched gene by gene.
+/// \param  gen1
+/// \param  gen2
+/// \return Index of the first differing gene, or -1 if the genomes are equal.
+/// If one genome is a prefix of the other, the size of the shorter is returned.
+//  ----------------------------------------------------------------------------
+int genome_diff_first(genome_t const * const gen1, genome_t const * const gen2)
+{
+    assert(gen1);
+    assert(gen2);
+
+    int common_size = gen1->size < gen2->size ? gen1->size : gen2->size;
+
+    int block_start = 0;
+    while (block_start < common_size) {
+        int block_size = common_size - block_start;
+        if (block_size > GENOME_COMPARE_BLOCK) {
+            block_size = GENOME_COMPARE_BLOCK;
+        }
+
+        if (memcmp(&gen1->genes[block_start], &gen2->genes[block_start],
+                   block_size * sizeof (command_t)) != 0) {
+            for (int i = block_start; i < block_start + block_size; i++) {
+                if (memcmp(&gen1->genes[i], &gen2->genes[i],
+                           sizeof (command_t)) != 0) {
+                    return i;
+                }
+            }
+        }
+        block_start += block_size;
+    }
+
+    if (gen1->size != gen2->size) {
+        return common_size;
+    }
+    return -1;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Compute a hash of the genes of a genome. Equal genomes have equal
+/// hashes, different genomes have different hashes with high probability.
+/// \param  genome
+/// \return The hash value.
+//  ----------------------------------------------------------------------------
+uint64_t genome_hash(genome_t const * const genome)
+{
+    assert(genome);
+
+    unsigned char const *bytes = (unsigned char const *) genome->genes;
+    size_t nb_bytes = genome->size * sizeof (command_t);
+    uint64_t hash = hash_mix(0, nb_bytes);
+    uint64_t word;
+
+    size_t i = 0;
+    for (; i + sizeof word <= nb_bytes; i += sizeof word) {
+        memcpy(&word, &bytes[i], sizeof word);
+        hash = hash_mix(hash, word);
+    }
+    if (i < nb_bytes) {
+        word = 0;
+        memcpy(&word, &bytes[i], nb_bytes - i);
+        hash = hash_mix(hash, word);
+    }
+    return hash;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Find exact duplicates in a population. Genomes are hashed into an
+/// open addressing table, so that only genomes with equal hashes are compared.
+/// \param  population  Array of genomes.
+/// \param  nb_genomes  Number of genomes in population.
+/// \param  duplicate_of    Output array of nb_genomes elements. Element i is
+/// set to the index of the first genome equal to population[i], or -1 if
+/// population[i] is the first of its kind.
+/// \return Number of duplicates found, or -1 on allocation failure.
+//  ----------------------------------------------------------------------------
+int genome_duplicates_find(genome_t * const population[], int const nb_genomes,
+                           int duplicate_of[])
+{
+    assert(population);
+    assert(duplicate_of);
+
+    size_t table_size = 1;
+    while (table_size < 2 * (size_t) nb_genomes) {
+        table_size *= 2;
+    }
+
+    int *table = malloc(table_size * sizeof *table);
+    uint64_t *hashes = malloc(nb_genomes * sizeof *hashes);
+    if (table == NULL || hashes == NULL) {
+        fprintf(stderr, "%s: could not allocate hash table.\n", __func__);
+        free(table);
+        free(hashes);
+        return -1;
+    }
+    for (size_t i = 0; i < table_size; i++) {
+        table[i] = -1;
+    }
+
+    int nb_duplicates = 0;
+    for (int i = 0; i < nb_genomes; i++) {
+        hashes[i] = genome_hash(population[i]);
+        duplicate_of[i] = -1;
+
+        size_t slot = hashes[i] & (table_size - 1);
+        while (table[slot] != -1) {
+            int other = table[slot];
+            if (hashes[other] == hashes[i]
+                && genome_compare(population[other], population[i])) {
+                duplicate_of[i] = other;
+                nb_duplicates++;
+                break;
+            }
+            slot = (slot + 1) & (table_size - 1);
+        }
+        if (duplicate_of[i] == -1) {
+            table[slot] = i;
+        }
+    }
+
+    free(table);
+    free(hashes);
+    return nb_duplicates;
 }
 
 
@@ -157,8 +535,276 @@ bool genome_compare(genome_t * const gen1, genome_t * const gen2)
 void genome_display(genome_t const * const genome)
 {
     assert(genome);
-    printf("Genome size: %i\n", linkedlist_size_get(genome->genes));
-    linkedlist_run_for_all(genome->genes, machine_command_print);
+
+    size_t const capacity = genome_format_capacity_get(genome);
+    char *text = malloc(capacity);
+    if (text == NULL || genome_format(genome, false, text, capacity) == 0) {
+        printf("Genome size: %i\n", genome->size);
+        for (int i = 0; i < genome->size; i++) {
+            machine_command_print(&genome->genes[i]);
+        }
+    } else {
+        fputs(text, stdout);
+    }
+    free(text);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the buffer size genome_format() needs at most.
+/// \param  genome
+/// \return Number of characters, null included.
+//  ----------------------------------------------------------------------------
+size_t genome_format_capacity_get(genome_t const * const genome)
+{
+    assert(genome);
+    return GENOME_FORMAT_HEADER_MAX
+           + (size_t) genome->size * (MACHINE_COMMAND_FORMAT_MAX - 1) + 1;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Format a genome as genome_display() prints it, one command per
+/// line after a header line.
+/// \param  genome
+/// \param  effective_only  Only format the effective genes.
+/// \param  buffer
+/// \param  capacity
+/// \return Number of characters written, 0 if buffer is too small.
+//  ----------------------------------------------------------------------------
+size_t genome_format(genome_t const * const genome, bool const effective_only,
+                     char buffer[], size_t const capacity)
+{
+    assert(genome);
+    assert(buffer || capacity == 0);
+
+    bool const *effective = NULL;
+    if (effective_only) {
+        effective = genome_effective_map_get(genome);
+        if (effective == NULL && genome->size > 0) {
+            return 0;
+        }
+    }
+
+    char header[GENOME_FORMAT_HEADER_MAX];
+    int const header_length = effective_only
+        ? snprintf(header, sizeof header, "Genome size: %i, effective: %i\n",
+                   genome->size, genome->nb_effective)
+        : snprintf(header, sizeof header, "Genome size: %i\n", genome->size);
+    if ((size_t) header_length >= capacity) {
+        return 0;
+    }
+    memcpy(buffer, header, header_length + 1);
+
+    size_t length = header_length;
+    for (int i = 0; i < genome->size; i++) {
+        if (effective_only && !effective[i]) {
+            continue;
+        }
+        size_t const line_length = machine_command_format(
+            &genome->genes[i], &buffer[length], capacity - length);
+        if (line_length == 0) {
+            return 0;
+        }
+        length += line_length;
+    }
+    return length;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the size of the serialized form of a genome.
+/// \param  genome
+/// \return Number of bytes.
+//  ----------------------------------------------------------------------------
+size_t genome_serialized_size_get(genome_t const * const genome)
+{
+    assert(genome);
+    return GENOME_SERIAL_HEADER + (size_t) genome->size * GENOME_SERIAL_GENE;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Serialize a genome. The fields of the commands are written one by
+/// one, so that the form does not depend on the layout of command_t.
+/// \param  genome
+/// \param  buffer
+/// \param  capacity
+/// \return Number of bytes written, 0 on failure.
+//  ----------------------------------------------------------------------------
+size_t genome_serialize(genome_t const * const genome, uint8_t buffer[],
+                        size_t const capacity)
+{
+    assert(genome);
+    assert(buffer || capacity == 0);
+
+    size_t const size = genome_serialized_size_get(genome);
+    if (size > capacity) {
+        fprintf(stderr, "%s: buffer too small.\n", __func__);
+        return 0;
+    }
+
+    uint32_t const nb_genes = (uint32_t) genome->size;
+    for (int i = 0; i < GENOME_SERIAL_HEADER; i++) {
+        *buffer++ = (uint8_t) (nb_genes >> (8 * i));
+    }
+    for (int i = 0; i < genome->size; i++) {
+        command_t const *gene = &genome->genes[i];
+        *buffer++ = gene->dst;
+        *buffer++ = gene->op;
+        *buffer++ = gene->src1;
+        *buffer++ = gene->src2;
+    }
+    return size;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create a genome from its serialized form.
+/// \param  buffer
+/// \param  size    Number of bytes available.
+/// \param  nb_read Output, number of bytes read, or NULL.
+/// \return Pointer to the new genome, NULL on failure.
+//  ----------------------------------------------------------------------------
+genome_t *genome_deserialize(uint8_t const buffer[], size_t const size,
+                             size_t * const nb_read)
+{
+    assert(buffer || size == 0);
+
+    if (size < GENOME_SERIAL_HEADER) {
+        fprintf(stderr, "%s: data too short.\n", __func__);
+        return NULL;
+    }
+    uint32_t nb_genes = 0;
+    for (int i = 0; i < GENOME_SERIAL_HEADER; i++) {
+        nb_genes |= (uint32_t) buffer[i] << (8 * i);
+    }
+    if (nb_genes > (size - GENOME_SERIAL_HEADER) / GENOME_SERIAL_GENE
+        || nb_genes > INT_MAX) {
+        fprintf(stderr, "%s: data too short.\n", __func__);
+        return NULL;
+    }
+
+    genome_t *genome = genome_create();
+    if (genome == NULL) {
+        return NULL;
+    }
+    if (!genes_reserve(genome, (int) nb_genes)) {
+        fprintf(stderr, "%s: could not allocate genes.\n", __func__);
+        genome_destroy(&genome);
+        return NULL;
+    }
+
+    if (!genes_decode(&buffer[GENOME_SERIAL_HEADER], genome->genes,
+                      (int) nb_genes)) {
+        fprintf(stderr, "%s: invalid gene.\n", __func__);
+        genome_destroy(&genome);
+        return NULL;
+    }
+    genome->size = (int) nb_genes;
+
+    if (nb_read != NULL) {
+        *nb_read = genome_serialized_size_get(genome);
+    }
+    return genome;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create genomes from their serialized forms, written one after the
+/// other. The sizes are read first, then the genes of all genomes are
+/// allocated as one block, as in genome_population_random_create(), and
+/// decoded from several threads.
+/// \param  buffer
+/// \param  size        Number of bytes available.
+/// \param  population  Output array of nb_genomes genomes.
+/// \param  nb_genomes  Number of genomes to read.
+/// \param  nb_read     Output, number of bytes read, or NULL.
+/// \param  nb_threads  Number of threads to decode the genes from.
+/// \return True on success. On failure no genome is left allocated.
+//  ----------------------------------------------------------------------------
+bool genome_population_deserialize(uint8_t const buffer[], size_t const size,
+                                   genome_t *population[],
+                                   int const nb_genomes,
+                                   size_t * const nb_read,
+                                   int const nb_threads)
+{
+    assert(buffer || size == 0);
+    assert(population || nb_genomes == 0);
+
+    // Gene offsets of the genomes. Genome i starts at byte
+    // i * GENOME_SERIAL_HEADER + offsets[i] * GENOME_SERIAL_GENE.
+    size_t *offsets = malloc((nb_genomes + 1) * sizeof *offsets);
+    if (offsets == NULL) {
+        fprintf(stderr, "%s: could not allocate offsets.\n", __func__);
+        return false;
+    }
+    offsets[0] = 0;
+    size_t position = 0;
+    for (int i = 0; i < nb_genomes; i++) {
+        if (size - position < GENOME_SERIAL_HEADER) {
+            fprintf(stderr, "%s: data too short.\n", __func__);
+            free(offsets);
+            return false;
+        }
+        uint32_t nb_genes = 0;
+        for (int k = 0; k < GENOME_SERIAL_HEADER; k++) {
+            nb_genes |= (uint32_t) buffer[position + k] << (8 * k);
+        }
+        position += GENOME_SERIAL_HEADER;
+        if (nb_genes > (size - position) / GENOME_SERIAL_GENE
+            || nb_genes > INT_MAX) {
+            fprintf(stderr, "%s: data too short.\n", __func__);
+            free(offsets);
+            return false;
+        }
+        position += (size_t) nb_genes * GENOME_SERIAL_GENE;
+        offsets[i + 1] = offsets[i] + nb_genes;
+    }
+
+    gene_block_t *block = population_block_create(offsets, nb_genomes);
+    if (block == NULL) {
+        fprintf(stderr, "%s: could not allocate genes.\n", __func__);
+        free(offsets);
+        return false;
+    }
+
+    for (int i = 0; i < nb_genomes; i++) {
+        population[i] = genome_create();
+        if (population[i] == NULL) {
+            for (int j = 0; j < i; j++) {
+                genome_destroy(&population[j]);
+            }
+            gene_block_free(block);
+            free(offsets);
+            return false;
+        }
+    }
+
+    population_decode_t decode = {
+        .population = population,
+        .buffer = buffer,
+        .block = block,
+        .offsets = offsets,
+        .valid = true
+    };
+    parallel_for(nb_genomes, nb_threads, population_genes_decode, &decode);
+    free(offsets);
+
+    if (nb_genomes == 0) {
+        gene_block_free(block);
+    }
+    if (!decode.valid) {
+        fprintf(stderr, "%s: invalid gene.\n", __func__);
+        for (int i = 0; i < nb_genomes; i++) {
+            genome_destroy(&population[i]);
+        }
+        return false;
+    }
+    if (nb_read != NULL) {
+        *nb_read = position;
+    }
+    return true;
 }
 
 
@@ -170,25 +816,37 @@ void genome_display(genome_t const * const genome)
 //  ----------------------------------------------------------------------------
 void genome_crossover(genome_t const * const genome1,
                       genome_t const * const genome2)
+{
+    genome_crossover_r(genome1, genome2, random_default_stream_get());
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Same as genome_crossover(), with the cut places drawn from stream.
+/// \param  genome1 Pointer to a genome
+/// \param  genome2 Pointer to a genome
+/// \param  stream  Random stream to draw from.
+//  ----------------------------------------------------------------------------
+void genome_crossover_r(genome_t const * const genome1,
+                        genome_t const * const genome2,
+                        random_stream_t * const stream)
 {
     assert(genome1);
     assert(genome2);
 
-    int cut_genome1_place1 =
-        random_get(linkedlist_size_get(genome1->genes));
-    int cut_genome2_place1 =
-        random_get(linkedlist_size_get(genome2->genes));
+    // The genome handles are const, the genes they own are not.
+    genome_t *g1 = (genome_t *) genome1;
+    genome_t *g2 = (genome_t *) genome2;
+
+    int cut_genome1_place1 = random_stream_get(stream, g1->size);
+    int cut_genome2_place1 = random_stream_get(stream, g2->size);
 
-    linkedlist_cross(genome1->genes, cut_genome1_place1,
-                     genome2->genes, cut_genome2_place1);
+    genes_tail_swap(g1, cut_genome1_place1, g2, cut_genome2_place1);
 
-    int cut_genome1_place2 =
-        random_get(linkedlist_size_get(genome1->genes));
-    int cut_genome2_place2 =
-        random_get(linkedlist_size_get(genome2->genes));
+    int cut_genome1_place2 = random_stream_get(stream, g1->size);
+    int cut_genome2_place2 = random_stream_get(stream, g2->size);
 
-    linkedlist_cross(genome1->genes, cut_genome1_place2,
-                     genome2->genes, cut_genome2_place2);
+    genes_tail_swap(g1, cut_genome1_place2, g2, cut_genome2_place2);
 }
 
 
@@ -197,17 +855,168 @@ void genome_crossover(genome_t const * const genome1,
 /// \param  genome  The genome to mutate.
 //  ----------------------------------------------------------------------------
 void genome_mutate(genome_t const * const genome)
+{
+    genome_mutate_r(genome, random_default_stream_get());
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Same as genome_mutate(), with the gene and the new gene drawn from
+/// stream. An empty genome is left as is.
+/// \param  genome  The genome to mutate.
+/// \param  stream  Random stream to draw from.
+//  ----------------------------------------------------------------------------
+void genome_mutate_r(genome_t const * const genome,
+                     random_stream_t * const stream)
+{
+    assert(genome);
+
+    if (genome->size == 0) {
+        return;
+    }
+    // The genome handle is const, the genes it owns are not.
+    if (!genes_reserve((genome_t *) genome, genome->size)) {
+        fprintf(stderr, "%s: could not allocate genes.\n", __func__);
+        return;
+    }
+
+    int pos = random_stream_get(stream, genome->size);
+    machine_command_random_set(&genome->genes[pos], random_stream_next(stream));
+    ((genome_t *) genome)->effective_valid = false;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Mutate a random effective gene of the genome, or a random gene if
+/// none is effective. Tells whether the effective genes of the offspring are
+/// the same as the parent's, in which case it computes the same result.
+/// \param  genome  The genome to mutate.
+/// \param  stream  Random stream to draw from.
+/// \return True if the offspring is neutral. False if it is not, or if that
+/// could not be determined.
+//  ----------------------------------------------------------------------------
+bool genome_mutate_effective_r(genome_t const * const genome,
+                               random_stream_t * const stream)
 {
     assert(genome);
 
-    int pos = random_get(linkedlist_size_get(genome->genes));
+    // The genome handle is const, the genes it owns are not.
+    genome_t *g = (genome_t *) genome;
+    if (g->size == 0) {
+        return true;
+    }
+    if (!genes_reserve(g, g->size)) {
+        fprintf(stderr, "%s: could not allocate genes.\n", __func__);
+        return false;
+    }
+
+    int nb_parent_genes;
+    command_t *parent_genes = effective_genes_copy(g, &nb_parent_genes);
+
+    int pos = effective_position_draw(g, stream);
+    machine_command_random_set(&g->genes[pos], random_stream_next(stream));
+    g->effective_valid = false;
 
-    command_t *gene_to_mutate = linkedlist_data_handle_get(genome->genes, pos);
-    command_t *new_gene = machine_command_random_create();
+    bool neutral = parent_genes != NULL
+        && effective_genes_equal(g, parent_genes, nb_parent_genes);
+    free(parent_genes);
+    return neutral;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Cross over two genomes by swapping a fragment of each. Each fragment
+/// starts at a random effective gene if there is one. Tells for each offspring
+/// whether its effective genes are the same as its parent's.
+/// \param  genome1 Pointer to a genome
+/// \param  genome2 Pointer to a genome
+/// \param  stream  Random stream to draw from.
+/// \param  neutral1    Output, true if genome1 computes the same as before.
+/// \param  neutral2    Output, true if genome2 computes the same as before.
+//  ----------------------------------------------------------------------------
+void genome_crossover_effective_r(genome_t const * const genome1,
+                                  genome_t const * const genome2,
+                                  random_stream_t * const stream,
+                                  bool * const neutral1,
+                                  bool * const neutral2)
+{
+    assert(genome1);
+    assert(genome2);
+    assert(neutral1);
+    assert(neutral2);
+
+    // The genome handles are const, the genes they own are not.
+    genome_t *g1 = (genome_t *) genome1;
+    genome_t *g2 = (genome_t *) genome2;
+
+    int nb_parent1_genes;
+    int nb_parent2_genes;
+    command_t *parent1_genes = effective_genes_copy(g1, &nb_parent1_genes);
+    command_t *parent2_genes = effective_genes_copy(g2, &nb_parent2_genes);
+
+    int start1 = effective_position_draw(g1, stream);
+    int end1 = start1 + (g1->size > 0)
+        + random_stream_get(stream, g1->size - start1);
+    int start2 = effective_position_draw(g2, stream);
+    int end2 = start2 + (g2->size > 0)
+        + random_stream_get(stream, g2->size - start2);
+
+    // Swapping the tails twice swaps the fragments [start, end).
+    genes_tail_swap(g1, start1, g2, start2);
+    genes_tail_swap(g1, start1 + (end2 - start2), g2, start2 + (end1 - start1));
+
+    *neutral1 = parent1_genes != NULL
+        && effective_genes_equal(g1, parent1_genes, nb_parent1_genes);
+    *neutral2 = parent2_genes != NULL
+        && effective_genes_equal(g2, parent2_genes, nb_parent2_genes);
+    free(parent1_genes);
+    free(parent2_genes);
+}
 
-    machine_command_copy(gene_to_mutate, new_gene);
 
-    machine_command_destroy(new_gene);
+//  ----------------------------------------------------------------------------
+/// \brief  Get the number of effective genes of a genome, the genes that can
+/// influence the result in GENOME_OUTPUT_REGISTER. Computed on first use after
+/// a change of the genes.
+/// \param  genome
+/// \return Number of effective genes, -1 on allocation failure.
+//  ----------------------------------------------------------------------------
+int genome_effective_size_get(genome_t const * const genome)
+{
+    assert(genome);
+    if (!effective_update((genome_t *) genome)) {
+        return -1;
+    }
+    return genome->nb_effective;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the effective map of a genome, one flag per gene.
+/// \param  genome
+/// \return Pointer to the map, valid until the genome is modified. NULL on
+/// allocation failure.
+//  ----------------------------------------------------------------------------
+bool const *genome_effective_map_get(genome_t const * const genome)
+{
+    assert(genome);
+    if (!effective_update((genome_t *) genome)) {
+        return NULL;
+    }
+    return genome->effective;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Run the genes of a genome on a register file.
+/// \param  genome
+/// \param  registers   Register file, modified in place. The result is in
+/// reg_A.
+//  ----------------------------------------------------------------------------
+void genome_run(genome_t const * const genome, register_value_t registers[])
+{
+    assert(genome);
+    machine_program_run(registers, genome->genes, genome->size);
 }
 
 
@@ -219,15 +1028,25 @@ void genome_mutate(genome_t const * const genome)
 int genome_size_get(genome_t const * const genome)
 {
     assert(genome);
-    assert(genome->genes);
-    return (linkedlist_size_get(genome->genes));
+    return genome->size;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the genes of a genome, read only.
+/// \param  genome
+/// \return Genes of the genome.
+//  ----------------------------------------------------------------------------
+command_t const *genome_genes_get(genome_t const * const genome)
+{
+    assert(genome);
+    return genome->genes;
 }
 
 
 //  ----------------------------------------------------------------------------
-/// \brief  Free the memory allocated for genome. All commands are deallocated,
-/// so it will break any other genome sharing data elements (don't share data
-/// elements, copy them).
+/// \brief  Free the memory allocated for genome. Its genes are deallocated
+/// with it, unless they are in a block still used by other genomes.
 /// \param  genome The genome to free.
 //  ----------------------------------------------------------------------------
 void genome_destroy(genome_t **genome)
@@ -235,7 +1054,10 @@ void genome_destroy(genome_t **genome)
     if ((genome == NULL) || (*genome == NULL)) {
         fprintf(stderr, "%s: genome is NULL.\n", __func__);
     } else {
-        linkedlist_destroy((*genome)->genes);
+        if ((*genome)->block != NULL) {
+            gene_block_release((*genome)->block);
+        }
+        free((*genome)->effective);
         free(*genome);
         // When making e.g. copy of genomes, if the destination is already
         // allocated it needs to be freed. Assign NULL to flag that there is no
@@ -249,19 +1071,443 @@ void genome_destroy(genome_t **genome)
 // Internal functions
 //******************************************************************************
 //  ----------------------------------------------------------------------------
-/// \brief  Check if the gene passed as parameter seems valid. So far it just
-/// checks if operation and operands are in range. To be used as callback to
-/// linkedlist_run_for_all().
-/// \param  data Pointer to the gene to check.
-/// \return The result is stored in the module variable gene_was_valid, which
-/// needs to be reset to true before checking a new genome.
+/// \brief  Make sure that the genome can modify its genes, and hold at least
+/// capacity genes. Genes in a block used by other genomes are copied to a
+/// block of its own, a block of its own is grown in place.
+/// \param  genome
+/// \param  capacity    Number of genes needed.
+/// \return True if the genes could be allocated.
+//  ----------------------------------------------------------------------------
+static bool genes_reserve(genome_t * const genome, int const capacity)
+{
+    gene_block_t *block = genome->block;
+    if (block == NULL && capacity == 0) {
+        return true;
+    }
+    bool const shared = genes_shared(genome);
+    if (block != NULL && !shared && capacity <= genome->capacity) {
+        return true;
+    }
+
+    int const new_capacity = capacity > genome->size ? capacity : genome->size;
+    if (block != NULL && !shared && genome->genes == block->genes
+        && !block->placed) {
+        gene_block_t *larger = realloc(block, sizeof (gene_block_t)
+                                       + new_capacity * sizeof (command_t));
+        if (larger == NULL) {
+            return false;
+        }
+        genome->block = larger;
+        genome->genes = larger->genes;
+        genome->capacity = new_capacity;
+        return true;
+    }
+
+    gene_block_t *copy = gene_block_create(new_capacity);
+    if (copy == NULL) {
+        return false;
+    }
+    if (genome->size > 0) {
+        memcpy(copy->genes, genome->genes, genome->size * sizeof (command_t));
+    }
+    if (block != NULL) {
+        gene_block_release(block);
+    }
+    genome->block = copy;
+    genome->genes = copy->genes;
+    genome->capacity = new_capacity;
+    return true;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Tell if the block of a genome is used by other genomes. Only the
+/// genome itself can then make it its own, by being destroyed or modified,
+/// so the answer stays valid while the caller modifies it.
+//  ----------------------------------------------------------------------------
+static bool genes_shared(genome_t const * const genome)
+{
+    return genome->block != NULL
+        && __atomic_load_n(&genome->block->nb_users, __ATOMIC_ACQUIRE) > 1;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Allocate a block for nb_genes genes, used by one genome.
+//  ----------------------------------------------------------------------------
+static gene_block_t *gene_block_create(int const nb_genes)
+{
+    gene_block_t *block = malloc(sizeof (gene_block_t)
+                                 + nb_genes * sizeof (command_t));
+    if (block != NULL) {
+        block->nb_users = 1;
+        block->placed = false;
+    }
+    return block;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Allocate the block of a population, used by all its genomes. A
+/// large block is placed, see placement_wanted(): the genes of the genomes
+/// are split in parts over the nodes as parallel_for() splits the genomes
+/// over its threads, so a pinned thread finds its genomes on its node.
+/// \param  offsets     Gene offset of each genome, and the number of genes.
+/// \param  nb_genomes
+/// \return Pointer to the block, NULL on failure.
+//  ----------------------------------------------------------------------------
+static gene_block_t *population_block_create(size_t const offsets[],
+                                             int const nb_genomes)
+{
+    size_t const size = sizeof (gene_block_t)
+                        + offsets[nb_genomes] * sizeof (command_t);
+    bool const placed = placement_wanted(size);
+    gene_block_t *block = NULL;
+    if (placed) {
+        int const nb_parts = placement_nb_nodes_get();
+        size_t *ends = malloc(nb_parts * sizeof *ends);
+        if (ends == NULL) {
+            return NULL;
+        }
+        for (int p = 0; p < nb_parts; p++) {
+            int const end = (int) ((long long) nb_genomes * (p + 1)
+                                   / nb_parts);
+            ends[p] = sizeof (gene_block_t) + offsets[end] * sizeof (command_t);
+        }
+        block = placement_split_alloc(ends, nb_parts);
+        free(ends);
+    } else {
+        block = malloc(size);
+    }
+    if (block != NULL) {
+        block->nb_users = nb_genomes;
+        block->placed = placed;
+    }
+    return block;
+}
+
+
+static void gene_block_free(gene_block_t * const block)
+{
+    if (block->placed) {
+        placement_free(block);
+    } else {
+        free(block);
+    }
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Stop using a gene block, free it if it was the last user. Genomes
+/// of a block may be destroyed from different threads.
+//  ----------------------------------------------------------------------------
+static void gene_block_release(gene_block_t * const block)
+{
+    if (__atomic_sub_fetch(&block->nb_users, 1, __ATOMIC_ACQ_REL) == 0) {
+        gene_block_free(block);
+    }
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Draw the size of a genome. With ramps, genome index draws from the
+/// lower (index % nb_ramps + 1) / nb_ramps part of the range, so that the
+/// population covers small and large genomes evenly.
+/// \param  stream
+/// \param  distribution
+/// \param  index   Index of the genome in the population.
+/// \return The size.
+//  ----------------------------------------------------------------------------
+static int size_draw(random_stream_t * const stream,
+                     genome_size_distribution_t const * const distribution,
+                     int const index)
+{
+    int size_min = distribution->size_min;
+    int size_max = distribution->size_max;
+    if (distribution->nb_ramps > 1) {
+        int ramp = index % distribution->nb_ramps;
+        size_max = size_min + (size_max - size_min) * (ramp + 1)
+            / distribution->nb_ramps;
+    }
+    return size_min + random_stream_get(stream, size_max - size_min + 1);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Fill the genes of the genomes [begin, end) of a population being
+/// created. To be used with parallel_for().
+/// \param  context Pointer to a population_fill_t.
+/// \param  begin
+/// \param  end
+//  ----------------------------------------------------------------------------
+static void population_genes_fill(void *context, int begin, int end)
+{
+    population_fill_t const *fill = context;
+    uint64_t words[GENOME_FILL_BLOCK];
+
+    for (int i = begin; i < end; i++) {
+        genome_t *genome = fill->population[i];
+        int size = (int) (fill->offsets[i + 1] - fill->offsets[i]);
+
+        genome->genes = &fill->block->genes[fill->offsets[i]];
+        genome->size = size;
+        genome->capacity = 0;
+        genome->block = fill->block;
+
+        // Same draws as genome_random_create_r(): the size, then the genes.
+        random_stream_t stream;
+        random_stream_init(&stream, fill->seed, 0, i);
+        random_stream_next(&stream);
+
+        for (int k = 0; k < size; k += GENOME_FILL_BLOCK) {
+            int nb_words = size - k < GENOME_FILL_BLOCK
+                ? size - k : GENOME_FILL_BLOCK;
+            random_stream_fill(&stream, words, nb_words);
+            for (int w = 0; w < nb_words; w++) {
+                machine_command_random_set(&genome->genes[k + w], words[w]);
+            }
+        }
+    }
+}
+
+// Decode the genes of the genomes [begin, end) into their part of the block.
+static void population_genes_decode(void *context, int begin, int end)
+{
+    population_decode_t *decode = context;
+
+    for (int i = begin; i < end; i++) {
+        genome_t *genome = decode->population[i];
+        int size = (int) (decode->offsets[i + 1] - decode->offsets[i]);
+
+        genome->genes = &decode->block->genes[decode->offsets[i]];
+        genome->size = size;
+        genome->capacity = 0;
+        genome->block = decode->block;
+
+        size_t const position = (size_t) (i + 1) * GENOME_SERIAL_HEADER
+            + decode->offsets[i] * GENOME_SERIAL_GENE;
+        if (!genes_decode(&decode->buffer[position], genome->genes, size)) {
+            __atomic_store_n(&decode->valid, false, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Decode serialized genes, see genome_serialize().
+/// \param  data
+/// \param  genes       Output array.
+/// \param  nb_genes
+/// \return False if a gene is not a valid command.
+//  ----------------------------------------------------------------------------
+static bool genes_decode(uint8_t const data[], command_t genes[],
+                         int const nb_genes)
+{
+    for (int i = 0; i < nb_genes; i++) {
+        genes[i] = (command_t) {
+            .dst = data[0],
+            .op = data[1],
+            .src1 = data[2],
+            .src2 = data[3]
+        };
+        if (!machine_command_valid_check(&genes[i])) {
+            return false;
+        }
+        data += GENOME_SERIAL_GENE;
+    }
+    return true;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Swap the tails of two genomes. The genes of genome1 from place1 on
+/// are swapped with the genes of genome2 from place2 on. If either genome
+/// shares its genes, as offspring just copied from their parents do, both
+/// offspring are spliced into new blocks from the head of one and the tail of
+/// the other. Otherwise the tails are swapped in place.
+/// \param  genome1
+/// \param  place1  Index of the first gene of the tail of genome1.
+/// \param  genome2
+/// \param  place2  Index of the first gene of the tail of genome2.
 //  ----------------------------------------------------------------------------
-static void gene_valid_check(void const * const data)
+static void genes_tail_swap(genome_t * const genome1, int const place1,
+                            genome_t * const genome2, int const place2)
 {
-    command_t *command = (command_t *) data;
+    int tail1_size = genome1->size - place1;
+    int tail2_size = genome2->size - place2;
+    int new_size1 = place1 + tail2_size;
+    int new_size2 = place2 + tail1_size;
+
+    if (genes_shared(genome1) || genes_shared(genome2)) {
+        gene_block_t *block1 = gene_block_create(new_size1);
+        gene_block_t *block2 = gene_block_create(new_size2);
+        if (block1 == NULL || block2 == NULL) {
+            fprintf(stderr, "%s: could not allocate genes.\n", __func__);
+            free(block1);
+            free(block2);
+            return;
+        }
+        memcpy(block1->genes, genome1->genes, place1 * sizeof (command_t));
+        memcpy(&block1->genes[place1], &genome2->genes[place2],
+               tail2_size * sizeof (command_t));
+        memcpy(block2->genes, genome2->genes, place2 * sizeof (command_t));
+        memcpy(&block2->genes[place2], &genome1->genes[place1],
+               tail1_size * sizeof (command_t));
 
-    if (!machine_command_valid_check(command)) {
-        fprintf(stderr, "%s: invalid check.\n", __func__);
-        gene_was_valid = false;
+        gene_block_t *blocks[2] = { block1, block2 };
+        genome_t *genomes[2] = { genome1, genome2 };
+        int const new_sizes[2] = { new_size1, new_size2 };
+        for (int i = 0; i < 2; i++) {
+            if (genomes[i]->block != NULL) {
+                gene_block_release(genomes[i]->block);
+            }
+            genomes[i]->block = blocks[i];
+            genomes[i]->genes = blocks[i]->genes;
+            genomes[i]->size = new_sizes[i];
+            genomes[i]->capacity = new_sizes[i];
+            genomes[i]->effective_valid = false;
+        }
+        return;
+    }
+
+    command_t *tail1 = malloc(tail1_size * sizeof (command_t));
+    if ((tail1 == NULL && tail1_size > 0)
+        || !genes_reserve(genome1, new_size1)
+        || !genes_reserve(genome2, new_size2)) {
+        fprintf(stderr, "%s: could not allocate genes.\n", __func__);
+        free(tail1);
+        return;
+    }
+
+    memcpy(tail1, &genome1->genes[place1], tail1_size * sizeof (command_t));
+    memcpy(&genome1->genes[place1], &genome2->genes[place2],
+           tail2_size * sizeof (command_t));
+    memcpy(&genome2->genes[place2], tail1, tail1_size * sizeof (command_t));
+    genome1->size = new_size1;
+    genome2->size = new_size2;
+    genome1->effective_valid = false;
+    genome2->effective_valid = false;
+
+    free(tail1);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Mix one 64 bit word into a hash value, with the finalizer of the
+/// randomizer.
+//  ----------------------------------------------------------------------------
+static uint64_t hash_mix(uint64_t hash, uint64_t const word)
+{
+    return random_mix(hash ^ word);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Compute the effective map of a genome if it is not up to date.
+/// \param  genome
+/// \return False on allocation failure.
+//  ----------------------------------------------------------------------------
+static bool effective_update(genome_t * const genome)
+{
+    if (genome->effective_valid) {
+        return true;
+    }
+
+    if (genome->size > genome->effective_capacity) {
+        bool *effective = realloc(genome->effective,
+                                  genome->size * sizeof *effective);
+        if (effective == NULL) {
+            fprintf(stderr, "%s: could not allocate map.\n", __func__);
+            return false;
+        }
+        genome->effective = effective;
+        genome->effective_capacity = genome->size;
+    }
+
+    genome->nb_effective =
+        machine_program_effective_mark(genome->genes, genome->size,
+                                       GENOME_OUTPUT_REGISTER,
+                                       genome->effective);
+    genome->effective_valid = true;
+    return true;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Draw the position of a random effective gene.
+/// \param  genome
+/// \param  stream
+/// \return Position of an effective gene. A random position if no gene is
+/// effective, 0 if the genome is empty.
+//  ----------------------------------------------------------------------------
+static int effective_position_draw(genome_t * const genome,
+                                   random_stream_t * const stream)
+{
+    if (!effective_update(genome) || genome->nb_effective == 0) {
+        return random_stream_get(stream, genome->size);
+    }
+
+    int k = random_stream_get(stream, genome->nb_effective);
+    for (int i = 0; i < genome->size; i++) {
+        if (genome->effective[i] && k-- == 0) {
+            return i;
+        }
+    }
+    assert(false);
+    return 0;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Copy the effective genes of a genome, in order.
+/// \param  genome
+/// \param  nb_genes    Output, number of effective genes.
+/// \return Newly allocated array of genes, NULL on allocation failure.
+//  ----------------------------------------------------------------------------
+static command_t *effective_genes_copy(genome_t * const genome,
+                                       int * const nb_genes)
+{
+    if (!effective_update(genome)) {
+        return NULL;
+    }
+
+    // One more than needed, so that no effective gene is not a failure.
+    command_t *genes = malloc((genome->nb_effective + 1) * sizeof *genes);
+    if (genes == NULL) {
+        return NULL;
+    }
+    int k = 0;
+    for (int i = 0; i < genome->size; i++) {
+        if (genome->effective[i]) {
+            genes[k++] = genome->genes[i];
+        }
+    }
+    *nb_genes = k;
+    return genes;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Compare the effective genes of a genome to an array of genes.
+/// \param  genome
+/// \param  genes
+/// \param  nb_genes
+/// \return True if equal, false if not or on allocation failure.
+//  ----------------------------------------------------------------------------
+static bool effective_genes_equal(genome_t * const genome,
+                                  command_t const * const genes,
+                                  int const nb_genes)
+{
+    if (!effective_update(genome) || genome->nb_effective != nb_genes) {
+        return false;
+    }
+
+    int k = 0;
+    for (int i = 0; i < genome->size; i++) {
+        if (genome->effective[i]
+            && memcmp(&genome->genes[i], &genes[k++], sizeof (command_t))) {
+            return false;
+        }
     }
+    return true;
 }
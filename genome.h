@@ -7,23 +7,74 @@ Copyright (c) 2013 Gauthier Fleutot Östervall
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#include "machine/machine.h"
+#include "randomizer.h"
 
 typedef struct genome_s genome_t;
 // Use this instead of sizeof(genome_t), since genome_t is an incomplete type.
 extern const size_t sizeof_genome;
 
+// Distribution of the sizes of random genomes. Sizes are drawn uniformly in
+// [size_min, size_max]. With nb_ramps greater than 1, genome i of a population
+// draws from the lower (i % nb_ramps + 1) / nb_ramps part of that range.
+typedef struct {
+    int size_min;
+    int size_max;
+    int nb_ramps;
+} genome_size_distribution_t;
+
+// The distribution used by genome_random_create().
+extern const genome_size_distribution_t genome_size_distribution_default;
+
 //  ----------------------------------------------------------------------------
 /// \brief  Create a new genome of random size and random genes.
 /// \return Pointer to the new random genome.
 //  ----------------------------------------------------------------------------
 genome_t *genome_random_create(void);
 
+//  ----------------------------------------------------------------------------
+/// \brief  Create a new genome of random size and random genes, drawn from a
+/// given random stream. Reentrant version of genome_random_create().
+/// \param  stream  Random stream to draw from.
+/// \return Pointer to the new random genome.
+//  ----------------------------------------------------------------------------
+genome_t *genome_random_create_r(random_stream_t * const stream);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create a population of random genomes at once, with the genes of
+/// all genomes in one allocation. Genome i is the same as the one created by
+/// genome_random_create_r() from the stream (seed, 0, i), whatever the number
+/// of threads.
+/// \param  population  Output array of nb_genomes genome pointers.
+/// \param  nb_genomes  Number of genomes to create.
+/// \param  distribution    Distribution of the genome sizes.
+/// \param  seed        Seed of the random streams.
+/// \param  nb_threads  Number of threads to use.
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool genome_population_random_create(genome_t *population[],
+                                     int const nb_genomes,
+                                     genome_size_distribution_t const *
+                                     const distribution,
+                                     uint64_t const seed,
+                                     int const nb_threads);
+
 //  ----------------------------------------------------------------------------
 /// \brief  Create a new empty genome.
 /// \return Pointer to the newly created genome.
 //  ----------------------------------------------------------------------------
 genome_t *genome_create(void);
 
+//  ----------------------------------------------------------------------------
+/// \brief  Create a new genome holding a copy of the given genes.
+/// \param  genes       Array of valid commands.
+/// \param  nb_genes    Number of genes.
+/// \return Pointer to the new genome, NULL on failure.
+//  ----------------------------------------------------------------------------
+genome_t *genome_genes_create(command_t const genes[], int const nb_genes);
+
 //  ----------------------------------------------------------------------------
 /// \brief  Free the memory allocated for genome.
 /// \param  genome The genome to free (pointer to pointer, sets to NULL).
@@ -37,8 +88,10 @@ void genome_destroy(genome_t **genome);
 bool genome_sanity_check(genome_t const * const genome);
 
 //  ----------------------------------------------------------------------------
-/// \brief  Copy a genome to another.
-/// \param  dst Destination genome. First destroyed if not already empty.
+/// \brief  Copy a genome to another. The genes are shared, not duplicated,
+/// until either genome is modified, so copies are cheap and the genomes of a
+/// population take the memory of their distinct genes only.
+/// \param  dst Destination genome, reused if not NULL.
 /// \param  src Source genome.
 //  ----------------------------------------------------------------------------
 void genome_copy(genome_t ** const dst, genome_t const * const src);
@@ -50,6 +103,14 @@ void genome_copy(genome_t ** const dst, genome_t const * const src);
 //  ----------------------------------------------------------------------------
 int genome_size_get(genome_t const * const genome);
 
+//  ----------------------------------------------------------------------------
+/// \brief  Get the genes of a genome, to run or inspect them.
+/// \param  genome  Pointer to the genome.
+/// \return Array of genome_size_get() genes, valid until the genome is
+/// modified or destroyed.
+//  ----------------------------------------------------------------------------
+command_t const *genome_genes_get(genome_t const * const genome);
+
 //  ----------------------------------------------------------------------------
 /// \brief  Compare two genomes
 /// \param  gen1
@@ -58,6 +119,34 @@ int genome_size_get(genome_t const * const genome);
 //  ----------------------------------------------------------------------------
 bool genome_compare(genome_t * const gen1, genome_t * const gen2);
 
+//  ----------------------------------------------------------------------------
+/// \brief  Find the first gene that differs between two genomes.
+/// \param  gen1
+/// \param  gen2
+/// \return Index of the first differing gene, -1 if the genomes are equal. If
+/// one genome is a prefix of the other, the size of the shorter one.
+//  ----------------------------------------------------------------------------
+int genome_diff_first(genome_t const * const gen1, genome_t const * const gen2);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Compute a hash of the genes of a genome.
+/// \param  genome
+/// \return Hash value, equal for equal genomes.
+//  ----------------------------------------------------------------------------
+uint64_t genome_hash(genome_t const * const genome);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Find genomes that are exact duplicates of another genome in the
+/// population, in linear time.
+/// \param  population  Array of genomes.
+/// \param  nb_genomes  Number of genomes in population.
+/// \param  duplicate_of    Output, nb_genomes elements. Index of the first
+/// genome equal to population[i], or -1 if there is none before it.
+/// \return Number of duplicates, -1 on error.
+//  ----------------------------------------------------------------------------
+int genome_duplicates_find(genome_t * const population[], int const nb_genomes,
+                           int duplicate_of[]);
+
 
 //  ----------------------------------------------------------------------------
 /// \brief  Print out the size and all data in the genome.
@@ -65,6 +154,76 @@ bool genome_compare(genome_t * const gen1, genome_t * const gen2);
 //  ----------------------------------------------------------------------------
 void genome_display(genome_t const * const genome);
 
+//  ----------------------------------------------------------------------------
+/// \brief  Get a buffer size that is always enough for genome_format().
+/// \param  genome
+/// \return Number of characters, null included.
+//  ----------------------------------------------------------------------------
+size_t genome_format_capacity_get(genome_t const * const genome);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Format a genome into a buffer, the way genome_display() prints it,
+/// without going through stdio for each gene.
+/// \param  genome
+/// \param  effective_only  Only format the effective genes, and their number
+/// in the header.
+/// \param  buffer  Output, null terminated.
+/// \param  capacity    Size of buffer.
+/// \return Number of characters written, null excluded. 0 if buffer is too
+/// small.
+//  ----------------------------------------------------------------------------
+size_t genome_format(genome_t const * const genome, bool const effective_only,
+                     char buffer[], size_t const capacity);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the number of bytes genome_serialize() writes for a genome.
+/// \param  genome
+/// \return Number of bytes.
+//  ----------------------------------------------------------------------------
+size_t genome_serialized_size_get(genome_t const * const genome);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Write a genome in a compact binary form, independent of the host:
+/// the number of genes as 4 bytes little endian, then the 4 bytes of each
+/// command.
+/// \param  genome
+/// \param  buffer  Output buffer.
+/// \param  capacity    Size of buffer.
+/// \return Number of bytes written, 0 if buffer is too small.
+//  ----------------------------------------------------------------------------
+size_t genome_serialize(genome_t const * const genome, uint8_t buffer[],
+                        size_t const capacity);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create a genome from its genome_serialize() form. The commands are
+/// checked, so that the data can come from elsewhere.
+/// \param  buffer
+/// \param  size    Number of bytes available in buffer.
+/// \param  nb_read Output, number of bytes read. Can be NULL.
+/// \return Pointer to the new genome, NULL if the data is invalid.
+//  ----------------------------------------------------------------------------
+genome_t *genome_deserialize(uint8_t const buffer[], size_t const size,
+                             size_t * const nb_read);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create nb_genomes genomes from their genome_serialize() forms,
+/// written one after the other. Faster than genome_deserialize() on each:
+/// the genes of all genomes are allocated at once and decoded from several
+/// threads. The commands are checked.
+/// \param  buffer
+/// \param  size        Number of bytes available in buffer.
+/// \param  population  Output array of nb_genomes genomes.
+/// \param  nb_genomes
+/// \param  nb_read     Output, number of bytes read. Can be NULL.
+/// \param  nb_threads  Number of threads to use.
+/// \return True on success, false if the data is invalid.
+//  ----------------------------------------------------------------------------
+bool genome_population_deserialize(uint8_t const buffer[], size_t const size,
+                                   genome_t *population[],
+                                   int const nb_genomes,
+                                   size_t * const nb_read,
+                                   int const nb_threads);
+
 
 //  ----------------------------------------------------------------------------
 /// \brief  Crossover two genomes, resulting in a blend of the two
@@ -75,6 +234,17 @@ void genome_display(genome_t const * const genome);
 void genome_crossover(genome_t const * const genome1,
                       genome_t const * const genome2);
 
+//  ----------------------------------------------------------------------------
+/// \brief  Crossover two genomes, drawing from a given random stream.
+/// Reentrant version of genome_crossover().
+/// \param  genome1 First genome to blend.
+/// \param  genome2 Second genome to blend.
+/// \param  stream  Random stream to draw from.
+//  ----------------------------------------------------------------------------
+void genome_crossover_r(genome_t const * const genome1,
+                        genome_t const * const genome2,
+                        random_stream_t * const stream);
+
 //  ----------------------------------------------------------------------------
 /// \brief  Mutate a genome. Take a random gene and replace it by a randomly
 /// generated one.
@@ -82,4 +252,63 @@ void genome_crossover(genome_t const * const genome1,
 //  ----------------------------------------------------------------------------
 void genome_mutate(genome_t const * const genome);
 
+//  ----------------------------------------------------------------------------
+/// \brief  Mutate a genome, drawing from a given random stream. Reentrant
+/// version of genome_mutate().
+/// \param  genome  The genome to mutate.
+/// \param  stream  Random stream to draw from.
+//  ----------------------------------------------------------------------------
+void genome_mutate_r(genome_t const * const genome,
+                     random_stream_t * const stream);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Mutate an effective gene of a genome, one that influences the
+/// result, drawing from a given random stream.
+/// \param  genome  The genome to mutate.
+/// \param  stream  Random stream to draw from.
+/// \return True if the offspring is neutral: its effective genes are the same
+/// as before, it computes the same result and needs no new evaluation.
+//  ----------------------------------------------------------------------------
+bool genome_mutate_effective_r(genome_t const * const genome,
+                               random_stream_t * const stream);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Crossover two genomes, swapping fragments that start at effective
+/// genes, drawing from a given random stream.
+/// \param  genome1 First genome to blend.
+/// \param  genome2 Second genome to blend.
+/// \param  stream  Random stream to draw from.
+/// \param  neutral1    Output, true if genome1 computes the same as before.
+/// \param  neutral2    Output, true if genome2 computes the same as before.
+//  ----------------------------------------------------------------------------
+void genome_crossover_effective_r(genome_t const * const genome1,
+                                  genome_t const * const genome2,
+                                  random_stream_t * const stream,
+                                  bool * const neutral1,
+                                  bool * const neutral2);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the number of effective genes of a genome, the genes that
+/// influence the result in reg_A.
+/// \param  genome
+/// \return Number of effective genes, -1 on error.
+//  ----------------------------------------------------------------------------
+int genome_effective_size_get(genome_t const * const genome);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the effective map of a genome, cached until it is modified.
+/// Not to be called on the same genome from several threads at once.
+/// \param  genome
+/// \return One flag per gene, true for effective genes. NULL on error.
+//  ----------------------------------------------------------------------------
+bool const *genome_effective_map_get(genome_t const * const genome);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Run the genes of a genome on a register file.
+/// \param  genome
+/// \param  registers   Register file of NB_REGISTERS values, modified in
+/// place. The result is in reg_A.
+//  ----------------------------------------------------------------------------
+void genome_run(genome_t const * const genome, register_value_t registers[]);
+
 #endif // GENOME_H_INCLUDED
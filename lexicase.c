@@ -0,0 +1,496 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+#include "lexicase.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "evaluator.h"
+#include "parallel.h"
+#include "randomizer.h"
+
+//******************************************************************************
+// Type definitions
+//******************************************************************************
+// Genomes passing the same cases are grouped in classes, which are selected
+// as one: class k is made of the genomes members[starts[k]] to
+// members[starts[k + 1] - 1]. Bit k % 64 of rows[c * nb_words + k / 64] is
+// set if class k passes case c of those kept. The bits past the last class
+// are clear.
+struct lexicase_s {
+    int nb_classes;
+    int *starts;
+    int *members;
+    int nb_words;
+    int nb_cases;
+    uint64_t *rows;
+};
+
+// Pass bits of a genome, for sorting.
+typedef struct {
+    uint64_t const *passes;
+    int nb_words;
+    int genome;
+} member_t;
+
+// Arguments of parents_select(), run from several threads.
+typedef struct {
+    lexicase_t const *lexicase;
+    uint64_t seed;
+    uint64_t generation;
+    int *parents;
+    bool success;
+} select_t;
+
+// Arguments of epsilon_passes_compute(), run from several threads.
+typedef struct {
+    register_value_t const *outputs;
+    int nb_genomes;
+    evaluator_cases_t const *cases;
+    uint64_t *passes;
+    bool success;
+} epsilon_t;
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+static int member_order(void const *a, void const *b);
+static void parents_select(void *context, int begin, int end);
+static int parent_select(lexicase_t const * const lexicase,
+                         uint64_t candidates[], int order[], int picks[],
+                         random_stream_t * const stream);
+static void epsilon_passes_compute(void *context, int begin, int end);
+static double rank_select(double values[], int const nb_values, int const k);
+static void bits_transpose(uint64_t words[64]);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+//  ----------------------------------------------------------------------------
+/// \brief  Prepare the selection from the pass bits of a population. The
+/// genomes are sorted by their bits to make the classes. The bits of the
+/// classes are turned around by tiles of 64 classes by 64 cases, then the
+/// rows of the cases that do not filter are removed.
+//  ----------------------------------------------------------------------------
+lexicase_t *lexicase_create(uint64_t const passes[], int const nb_genomes,
+                            int const nb_cases)
+{
+    assert(passes || nb_genomes == 0 || nb_cases == 0);
+
+    if (nb_genomes < 1 || nb_cases < 0) {
+        fprintf(stderr, "%s: invalid population.\n", __func__);
+        return NULL;
+    }
+
+    int const nb_case_words = EVALUATOR_PASS_WORDS(nb_cases);
+    lexicase_t *lexicase = calloc(1, sizeof *lexicase);
+    member_t *sorted = malloc(nb_genomes * sizeof *sorted);
+    if (lexicase == NULL || sorted == NULL) {
+        fprintf(stderr, "%s: could not allocate the classes.\n", __func__);
+        free(lexicase);
+        free(sorted);
+        return NULL;
+    }
+    lexicase->starts = malloc((nb_genomes + 1) * sizeof *lexicase->starts);
+    lexicase->members = malloc(nb_genomes * sizeof *lexicase->members);
+    if (lexicase->starts == NULL || lexicase->members == NULL) {
+        fprintf(stderr, "%s: could not allocate the classes.\n", __func__);
+        free(sorted);
+        lexicase_destroy(&lexicase);
+        return NULL;
+    }
+
+    for (int g = 0; g < nb_genomes; g++) {
+        sorted[g] = (member_t) {
+            .passes = &passes[(size_t) g * nb_case_words],
+            .nb_words = nb_case_words,
+            .genome = g
+        };
+    }
+    qsort(sorted, nb_genomes, sizeof *sorted, member_order);
+    int nb_classes = 0;
+    for (int i = 0; i < nb_genomes; i++) {
+        if (i == 0 || (nb_case_words > 0
+                       && memcmp(sorted[i - 1].passes, sorted[i].passes,
+                                 nb_case_words * sizeof *passes) != 0)) {
+            lexicase->starts[nb_classes++] = i;
+        }
+        lexicase->members[i] = sorted[i].genome;
+    }
+    lexicase->starts[nb_classes] = nb_genomes;
+
+    int const nb_words = (nb_classes + 63) / 64;
+    size_t const nb_row_words = (size_t) nb_cases * nb_words;
+    uint64_t *rows = malloc((nb_row_words > 0 ? nb_row_words : 1)
+                            * sizeof *rows);
+    if (rows == NULL) {
+        fprintf(stderr, "%s: could not allocate the rows.\n", __func__);
+        free(sorted);
+        lexicase_destroy(&lexicase);
+        return NULL;
+    }
+
+    uint64_t tile[64];
+    for (int w = 0; w < nb_words; w++) {
+        for (int b = 0; b < nb_case_words; b++) {
+            for (int i = 0; i < 64; i++) {
+                int const class = w * 64 + i;
+                tile[i] = class < nb_classes ?
+                          sorted[lexicase->starts[class]].passes[b] : 0;
+            }
+            bits_transpose(tile);
+            for (int i = 0; i < 64 && b * 64 + i < nb_cases; i++) {
+                rows[(size_t) (b * 64 + i) * nb_words + w] = tile[i];
+            }
+        }
+    }
+    free(sorted);
+
+    int nb_kept = 0;
+    for (int c = 0; c < nb_cases; c++) {
+        uint64_t const *row = &rows[(size_t) c * nb_words];
+        int count = 0;
+        for (int w = 0; w < nb_words; w++) {
+            count += __builtin_popcountll(row[w]);
+        }
+        if (count == 0 || count == nb_classes) {
+            continue;
+        }
+        memmove(&rows[(size_t) nb_kept * nb_words], row,
+                nb_words * sizeof *rows);
+        nb_kept++;
+    }
+
+    lexicase->nb_classes = nb_classes;
+    lexicase->nb_words = nb_words;
+    lexicase->nb_cases = nb_kept;
+    lexicase->rows = rows;
+    return lexicase;
+}
+
+
+void lexicase_destroy(lexicase_t **lexicase)
+{
+    assert(lexicase);
+    if (*lexicase == NULL) {
+        return;
+    }
+    free((*lexicase)->starts);
+    free((*lexicase)->members);
+    free((*lexicase)->rows);
+    free(*lexicase);
+    *lexicase = NULL;
+}
+
+
+int lexicase_nb_cases_get(lexicase_t const * const lexicase)
+{
+    assert(lexicase);
+    return lexicase->nb_cases;
+}
+
+
+bool lexicase_parents_select(lexicase_t const * const lexicase,
+                             int const nb_parents, uint64_t const seed,
+                             uint64_t const generation, int parents[],
+                             int const nb_threads)
+{
+    assert(lexicase);
+    assert(parents || nb_parents == 0);
+
+    select_t select = {
+        .lexicase = lexicase,
+        .seed = seed,
+        .generation = generation,
+        .parents = parents,
+        .success = true
+    };
+    parallel_for(nb_parents, nb_threads, parents_select, &select);
+    return select.success;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Compute the pass bits of epsilon lexicase, in parallel on blocks of
+/// 64 cases, each making one word of every genome.
+//  ----------------------------------------------------------------------------
+bool lexicase_epsilon_passes_compute(register_value_t const outputs[],
+                                     int const nb_genomes,
+                                     evaluator_cases_t const * const cases,
+                                     uint64_t passes[],
+                                     int const nb_threads)
+{
+    assert(cases);
+    assert((outputs && passes) || nb_genomes == 0 || cases->nb_cases == 0);
+
+    if (cases->targets == NULL && cases->nb_cases > 0) {
+        fprintf(stderr, "%s: the cases have no targets.\n", __func__);
+        return false;
+    }
+
+    epsilon_t epsilon = {
+        .outputs = outputs,
+        .nb_genomes = nb_genomes,
+        .cases = cases,
+        .passes = passes,
+        .success = true
+    };
+    parallel_for(nb_genomes > 0 ? EVALUATOR_PASS_WORDS(cases->nb_cases) : 0,
+                 nb_threads, epsilon_passes_compute, &epsilon);
+    return epsilon.success;
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+//  ----------------------------------------------------------------------------
+/// \brief  Select a range of parents. parallel_work_t.
+/// \param  context select_t.
+/// \param  begin   First parent.
+/// \param  end     Parent after the last.
+//  ----------------------------------------------------------------------------
+static void parents_select(void *context, int begin, int end)
+{
+    select_t *select = context;
+    lexicase_t const *lexicase = select->lexicase;
+
+    uint64_t *candidates = malloc(lexicase->nb_words * sizeof *candidates);
+    int *order = malloc((lexicase->nb_cases + 1) * sizeof *order);
+    int *picks = malloc((lexicase->nb_cases + 1) * sizeof *picks);
+    if (candidates == NULL || order == NULL || picks == NULL) {
+        fprintf(stderr, "%s: could not allocate the candidates.\n", __func__);
+        __atomic_store_n(&select->success, false, __ATOMIC_RELAXED);
+        free(candidates);
+        free(order);
+        free(picks);
+        return;
+    }
+
+    for (int k = 0; k < lexicase->nb_cases; k++) {
+        order[k] = k;
+    }
+    for (int i = begin; i < end; i++) {
+        random_stream_t stream;
+        random_stream_init(&stream, select->seed, select->generation, i);
+        select->parents[i] = parent_select(lexicase, candidates, order, picks,
+                                           &stream);
+    }
+
+    free(candidates);
+    free(order);
+    free(picks);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Select one parent. The cases are shuffled as they are gone
+/// through, by swaps that are undone before returning, so that order starts
+/// as the identity for every parent. The candidate classes shrink to a range
+/// of words with bits set, until one is left: any two classes differ on a
+/// case that is kept. The parent is then drawn from the members of the
+/// class, as if the genomes had been the candidates.
+/// \param  lexicase
+/// \param  candidates  Room for nb_words words.
+/// \param  order       Identity permutation of the cases, restored.
+/// \param  picks       Room for nb_cases indices.
+/// \param  stream
+/// \return Index of the parent.
+//  ----------------------------------------------------------------------------
+static int parent_select(lexicase_t const * const lexicase,
+                         uint64_t candidates[], int order[], int picks[],
+                         random_stream_t * const stream)
+{
+    int const nb_words = lexicase->nb_words;
+    int const nb_cases = lexicase->nb_cases;
+
+    for (int w = 0; w < nb_words; w++) {
+        candidates[w] = ~(uint64_t) 0;
+    }
+    if (lexicase->nb_classes % 64 != 0) {
+        candidates[nb_words - 1] =
+            ((uint64_t) 1 << lexicase->nb_classes % 64) - 1;
+    }
+    int first = 0;
+    int last = nb_words;
+    int nb_candidates = lexicase->nb_classes;
+
+    int step = 0;
+    for (; step < nb_cases && nb_candidates > 1; step++) {
+        int const pick = step + random_stream_get(stream, nb_cases - step);
+        picks[step] = pick;
+        int const swap = order[step];
+        order[step] = order[pick];
+        order[pick] = swap;
+
+        uint64_t const *row = &lexicase->rows[(size_t) order[step]
+                                              * nb_words];
+        int count = 0;
+        for (int w = first; w < last; w++) {
+            count += __builtin_popcountll(candidates[w] & row[w]);
+        }
+        if (count == 0 || count == nb_candidates) {
+            continue;
+        }
+        for (int w = first; w < last; w++) {
+            candidates[w] &= row[w];
+        }
+        nb_candidates = count;
+        while (candidates[first] == 0) {
+            first++;
+        }
+        while (candidates[last - 1] == 0) {
+            last--;
+        }
+    }
+
+    while (step-- > 0) {
+        int const swap = order[step];
+        order[step] = order[picks[step]];
+        order[picks[step]] = swap;
+    }
+
+    assert(nb_candidates == 1);
+    int const class = first * 64 + __builtin_ctzll(candidates[first]);
+    int const start = lexicase->starts[class];
+    int const nb_members = lexicase->starts[class + 1] - start;
+    return lexicase->members[start + random_stream_get(stream, nb_members)];
+}
+
+
+// Order of genomes by their pass bits, then by index. qsort() order.
+static int member_order(void const *a, void const *b)
+{
+    member_t const *member_a = a;
+    member_t const *member_b = b;
+    int const order = member_a->nb_words == 0 ? 0
+                      : memcmp(member_a->passes, member_b->passes,
+                               member_a->nb_words * sizeof (uint64_t));
+    if (order != 0) {
+        return order;
+    }
+    return (member_a->genome > member_b->genome)
+           - (member_a->genome < member_b->genome);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Compute the epsilon pass bits of a range of blocks of 64 cases.
+/// parallel_work_t.
+/// \param  context epsilon_t.
+/// \param  begin   First block.
+/// \param  end     Block after the last.
+//  ----------------------------------------------------------------------------
+static void epsilon_passes_compute(void *context, int begin, int end)
+{
+    epsilon_t *epsilon = context;
+    evaluator_cases_t local;
+    evaluator_cases_local_get(epsilon->cases, &local);
+    evaluator_cases_t const *cases = &local;
+    int const nb_genomes = epsilon->nb_genomes;
+    int const nb_words = EVALUATOR_PASS_WORDS(cases->nb_cases);
+
+    double *errors = malloc(nb_genomes * sizeof *errors);
+    double *values = malloc(nb_genomes * sizeof *values);
+    if (errors == NULL || values == NULL) {
+        fprintf(stderr, "%s: could not allocate the errors.\n", __func__);
+        __atomic_store_n(&epsilon->success, false, __ATOMIC_RELAXED);
+        free(errors);
+        free(values);
+        return;
+    }
+
+    for (int b = begin; b < end; b++) {
+        for (int g = 0; g < nb_genomes; g++) {
+            epsilon->passes[(size_t) g * nb_words + b] = 0;
+        }
+        for (int c = b * 64; c < cases->nb_cases && c < (b + 1) * 64; c++) {
+            double best = 0;
+            for (int g = 0; g < nb_genomes; g++) {
+                double const difference = (double) epsilon->outputs[
+                    (size_t) g * cases->nb_cases + c] - cases->targets[c];
+                errors[g] = difference < 0 ? -difference : difference;
+                values[g] = errors[g];
+                best = g == 0 || errors[g] < best ? errors[g] : best;
+            }
+            double const median = rank_select(values, nb_genomes,
+                                              nb_genomes / 2);
+            for (int g = 0; g < nb_genomes; g++) {
+                double const deviation = errors[g] - median;
+                values[g] = deviation < 0 ? -deviation : deviation;
+            }
+            double const threshold = best + rank_select(values, nb_genomes,
+                                                        nb_genomes / 2);
+            for (int g = 0; g < nb_genomes; g++) {
+                epsilon->passes[(size_t) g * nb_words + b] |=
+                    (uint64_t) (errors[g] <= threshold) << (c % 64);
+            }
+        }
+    }
+
+    free(errors);
+    free(values);
+}
+
+
+// Value of rank k of an array, as if it were sorted. The values are
+// reordered.
+static double rank_select(double values[], int const nb_values, int const k)
+{
+    assert(k >= 0 && k < nb_values);
+
+    int left = 0;
+    int right = nb_values - 1;
+    while (left < right) {
+        double const pivot = values[left + (right - left) / 2];
+        int i = left;
+        int j = right;
+        while (i <= j) {
+            while (values[i] < pivot) {
+                i++;
+            }
+            while (values[j] > pivot) {
+                j--;
+            }
+            if (i <= j) {
+                double const swap = values[i];
+                values[i] = values[j];
+                values[j] = swap;
+                i++;
+                j--;
+            }
+        }
+        if (k <= j) {
+            right = j;
+        } else if (k >= i) {
+            left = i;
+        } else {
+            break;
+        }
+    }
+    return values[k];
+}
+
+
+// Transpose a 64 by 64 matrix of bits, bit j of words[i] being row i, column
+// j: blocks are swapped across the diagonal, halving their size each round.
+static void bits_transpose(uint64_t words[64])
+{
+    uint64_t mask = 0x00000000ffffffffull;
+    for (int width = 32; width != 0; width >>= 1,
+         mask ^= mask << width) {
+        for (int k = 0; k < 64; k = ((k | width) + 1) & ~width) {
+            uint64_t const swap = ((words[k] >> width) ^ words[k | width])
+                                  & mask;
+            words[k] ^= swap << width;
+            words[k | width] ^= swap;
+        }
+    }
+}
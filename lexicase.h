@@ -0,0 +1,87 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+#ifndef LEXICASE_H_INCLUDED
+#define LEXICASE_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "evaluator.h"
+
+// Lexicase selection on pass bits: a parent is picked by going through the
+// cases in random order and keeping, at each case, only the candidates that
+// pass it, if any does. The pass bits of a population are those of
+// evaluator_population_passes_run(), a row of words per genome. They are
+// turned around into a row of words per case, over the genomes, so that
+// filtering the candidates on a case is an AND and a popcount per word of
+// 64 genomes. Genomes passing the same cases are filtered as one, and cases
+// passed by all genomes or by none never filter and are left out, so a
+// converged population is quick to select from.
+typedef struct lexicase_s lexicase_t;
+
+//  ----------------------------------------------------------------------------
+/// \brief  Prepare the selection from the pass bits of a population.
+/// \param  passes      EVALUATOR_PASS_WORDS(nb_cases) words per genome,
+/// genome after genome, see evaluator_population_passes_run().
+/// \param  nb_genomes  Number of genomes, at least 1.
+/// \param  nb_cases    Number of cases.
+/// \return Pointer to the new selection, NULL on failure.
+//  ----------------------------------------------------------------------------
+lexicase_t *lexicase_create(uint64_t const passes[], int const nb_genomes,
+                            int const nb_cases);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Free a selection and set the pointer to NULL.
+/// \param  lexicase
+//  ----------------------------------------------------------------------------
+void lexicase_destroy(lexicase_t **lexicase);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the number of cases that tell genomes apart, passed by some
+/// genomes but not all.
+/// \param  lexicase
+/// \return Number of cases.
+//  ----------------------------------------------------------------------------
+int lexicase_nb_cases_get(lexicase_t const * const lexicase);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Select parents. Parent i is drawn from the stream of index i of the
+/// generation, so the parents do not depend on the number of threads. Ties
+/// left once all cases are gone through are broken at random.
+/// \param  lexicase
+/// \param  nb_parents  Number of parents to select.
+/// \param  seed
+/// \param  generation
+/// \param  parents     Output, index of each parent in the population.
+/// \param  nb_threads  Number of threads to use.
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool lexicase_parents_select(lexicase_t const * const lexicase,
+                             int const nb_parents, uint64_t const seed,
+                             uint64_t const generation, int parents[],
+                             int const nb_threads);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Compute the pass bits of epsilon lexicase from the outputs of a
+/// population: a genome passes a case if its error is at most the smallest
+/// error on the case plus epsilon, the median absolute deviation of the
+/// errors on the case. Epsilon adapts to each case, so that lexicase works on
+/// continuous errors where few outputs are exact.
+/// \param  outputs     nb_cases values per genome, genome after genome, see
+/// evaluator_population_run().
+/// \param  nb_genomes  Number of genomes.
+/// \param  cases       Fitness cases, with targets.
+/// \param  passes      Output, EVALUATOR_PASS_WORDS(nb_cases) words per
+/// genome, genome after genome.
+/// \param  nb_threads  Number of threads to use.
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool lexicase_epsilon_passes_compute(register_value_t const outputs[],
+                                     int const nb_genomes,
+                                     evaluator_cases_t const * const cases,
+                                     uint64_t passes[],
+                                     int const nb_threads);
+
+#endif // LEXICASE_H_INCLUDED
@@ -6,22 +6,33 @@ Copyright (c) 2013 Gauthier Fleutot Östervall
 
 #include <assert.h>
 #include <malloc.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "../randomizer.h"
+
+// MACHINE_OPERATION_TABLES: define to compute MUL and DIV by table lookup
+// instead of arithmetic. Only for 8 bit registers, where the tables are small.
+#if defined(MACHINE_OPERATION_TABLES) \
+    && (defined(MACHINE_REGISTER_FLOAT) || MACHINE_REGISTER_WIDTH != 8)
+#error "MACHINE_OPERATION_TABLES requires 8 bit integer registers."
+#endif
+
 // This must be larger than register_value_t, in order to accomodate for
 // operations with boundaries (for example add with ceiling).
+#if defined(MACHINE_REGISTER_FLOAT)
+typedef double large_register_value_t;
+#elif MACHINE_REGISTER_WIDTH == 8
 typedef int16_t large_register_value_t;
-
-struct command_s {
-    register_t dst;
-    operation_t op;
-    register_t src1;
-    register_t src2;
-};
+#elif MACHINE_REGISTER_WIDTH == 16
+typedef int32_t large_register_value_t;
+#elif MACHINE_REGISTER_WIDTH == 32
+typedef int64_t large_register_value_t;
+#endif
 
 //******************************************************************************
 // Globals
@@ -33,32 +44,133 @@ const size_t sizeof_machine_command = sizeof(command_t);
 //******************************************************************************
 static register_value_t regs[NB_REGISTERS];
 
+// Names used when formatting commands.
+static char const *const register_names[NB_REGISTER_NAMES] = {
+    [reg_A] = "A", [reg_B] = "B", [reg_C] = "C", [reg_D] = "D",
+    [reg_E] = "E", [reg_F] = "F", [reg_G] = "G", [reg_H] = "H",
+    [reg_I] = "I", [reg_J] = "J", [reg_K] = "K", [reg_L] = "L",
+    [reg_M] = "M", [reg_N] = "N", [reg_O] = "O", [reg_P] = "P"
+};
+
+static char const *const operation_names[NB_OPERATION_TYPES] = {
+    [ADD] = "+", [SUB] = "-", [MUL] = "*", [DIV] = "/",
+    [MIN] = "min", [MAX] = "max", [LESS] = "<", [EQUAL] = "==",
+    [IF_LESS] = "<", [AND] = "&", [OR] = "|", [XOR] = "^",
+    [LOAD] = "#"
+};
+
+// Set by an IF_LESS command whose condition was false.
+static bool skip_next_command = false;
+
+// Number of enabled operations below op, and the entry of op in
+// enabled_operations[].
+#define ENABLED_BELOW(op, other)                                        \
+    ((other) < (op) ? MACHINE_OPERATION_ENABLED(other) : 0U)
+#define NB_ENABLED_OPERATIONS_BEFORE(op)                                \
+    (ENABLED_BELOW(op, ADD) + ENABLED_BELOW(op, SUB)                    \
+     + ENABLED_BELOW(op, MUL) + ENABLED_BELOW(op, DIV)                  \
+     + ENABLED_BELOW(op, MIN) + ENABLED_BELOW(op, MAX)                  \
+     + ENABLED_BELOW(op, LESS) + ENABLED_BELOW(op, EQUAL)               \
+     + ENABLED_BELOW(op, IF_LESS) + ENABLED_BELOW(op, AND)              \
+     + ENABLED_BELOW(op, OR) + ENABLED_BELOW(op, XOR)                   \
+     + ENABLED_BELOW(op, LOAD))
+#define ENABLED_OPERATION_ENTRY(op)                                     \
+    [MACHINE_OPERATION_ENABLED(op) ? NB_ENABLED_OPERATIONS_BEFORE(op)   \
+     : NB_OPERATION_TYPES] = (op)
+
+// Enabled operations, to draw random operations from. Built at compile time
+// so that threads drawing commands share it without initialization. The
+// slot past the end collects the disabled operations.
+static uint8_t const enabled_operations[NB_OPERATION_TYPES + 1] = {
+    ENABLED_OPERATION_ENTRY(ADD), ENABLED_OPERATION_ENTRY(SUB),
+    ENABLED_OPERATION_ENTRY(MUL), ENABLED_OPERATION_ENTRY(DIV),
+    ENABLED_OPERATION_ENTRY(MIN), ENABLED_OPERATION_ENTRY(MAX),
+    ENABLED_OPERATION_ENTRY(LESS), ENABLED_OPERATION_ENTRY(EQUAL),
+    ENABLED_OPERATION_ENTRY(IF_LESS), ENABLED_OPERATION_ENTRY(AND),
+    ENABLED_OPERATION_ENTRY(OR), ENABLED_OPERATION_ENTRY(XOR),
+    ENABLED_OPERATION_ENTRY(LOAD)
+};
+static int const nb_enabled_operations =
+    NB_ENABLED_OPERATIONS_BEFORE(NB_OPERATION_TYPES);
+
+#if defined(MACHINE_OPERATION_TABLES)
+// Results of MUL and DIV for all pairs of 8 bit operands, indexed by the
+// operands as unsigned bytes. 64 KiB each.
+static register_value_t mul_table[UINT8_MAX + 1][UINT8_MAX + 1];
+static register_value_t div_table[UINT8_MAX + 1][UINT8_MAX + 1];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+#endif
+
 
 //******************************************************************************
 // Function prototypes
 //******************************************************************************
 static void registers_init(void);
-static register_value_t operation_add(register_value_t const a,
-                                      register_value_t const b);
-static register_value_t operation_sub(register_value_t const a,
-                                      register_value_t const b);
-static register_value_t operation_mul(register_value_t const a,
-                                      register_value_t const b);
-static register_value_t operation_div(register_value_t const a,
-                                      register_value_t const b);
-static large_register_value_t clamp(large_register_value_t const value);
+static char *text_append(char *end, char const *text);
+static char *integer_append(char *end, int value);
+static inline register_value_t operation_add(register_value_t const a,
+                                             register_value_t const b);
+static inline register_value_t operation_sub(register_value_t const a,
+                                             register_value_t const b);
+static inline register_value_t operation_mul(register_value_t const a,
+                                             register_value_t const b);
+static inline register_value_t operation_div(register_value_t const a,
+                                             register_value_t const b);
+static inline register_value_t operation_min(register_value_t const a,
+                                             register_value_t const b);
+static inline register_value_t operation_max(register_value_t const a,
+                                             register_value_t const b);
+static inline register_value_t operation_less(register_value_t const a,
+                                              register_value_t const b);
+static inline register_value_t operation_equal(register_value_t const a,
+                                               register_value_t const b);
+#if !defined(MACHINE_REGISTER_FLOAT)
+static inline register_value_t operation_and(register_value_t const a,
+                                             register_value_t const b);
+static inline register_value_t operation_or(register_value_t const a,
+                                            register_value_t const b);
+static inline register_value_t operation_xor(register_value_t const a,
+                                             register_value_t const b);
+#endif
+static inline register_value_t operation_apply(unsigned int const op,
+                                               register_value_t const a,
+                                               register_value_t const b);
+static inline void block_operation_apply(unsigned int const op,
+                                         register_value_t * const result,
+                                         register_value_t const * const a,
+                                         register_value_t const * const b,
+                                         int const nb_cases);
+static inline register_value_t mul_compute(register_value_t const a,
+                                           register_value_t const b);
+static inline register_value_t div_compute(register_value_t const a,
+                                           register_value_t const b);
+static inline register_value_t clamp(large_register_value_t const value);
+static inline void tables_init(void);
+#if defined(MACHINE_OPERATION_TABLES)
+static void tables_fill(void);
+#endif
 
 
 //******************************************************************************
 // Module constants
 //******************************************************************************
-register_value_t (*operation[NB_OPERATION_TYPES]) (register_value_t const a,
-                                                   register_value_t const b) = {
-    [ADD] = operation_add,
-    [SUB] = operation_sub,
-    [MUL] = operation_mul,
-    [DIV] = operation_div
-};
+// Case of block_operation_apply(), applying an operation to all cases.
+#define BLOCK_OPERATION_CASE(op, function)              \
+    case op:                                            \
+        if (MACHINE_OPERATION_ENABLED(op)) {            \
+            for (int c = 0; c < nb_cases; c++) {        \
+                result[c] = function(a[c], b[c]);       \
+            }                                           \
+            return;                                     \
+        }                                               \
+        break
+
+// Result of one operation in operation_apply(), compiled out when the
+// operation is disabled.
+#define OPERATION_RESULT(op, function)          \
+    if (MACHINE_OPERATION_ENABLED(op)) {        \
+        results[op] = function(a, b);           \
+    }
 
 
 //******************************************************************************
@@ -66,7 +178,9 @@ register_value_t (*operation[NB_OPERATION_TYPES]) (register_value_t const a,
 //******************************************************************************
 //  ----------------------------------------------------------------------------
 /// \brief  Initialize the machine's registers to the data passed as
-/// parameter. Default to zero if not all registers are given a value.
+/// parameter. Default to zero if not all registers are given a value. This
+/// starts a new program: a skip left by an IF_LESS ending the previous one is
+/// cleared, even if the registers cannot be initialized.
 /// \param  initial_data Pointer to an array of initial values.
 /// \param  nb_initial_regs Number of elements in the array.
 /// \return True if the number of init values was not too large.
@@ -74,10 +188,12 @@ register_value_t (*operation[NB_OPERATION_TYPES]) (register_value_t const a,
 bool machine_init(register_value_t *const initial_data,
                   unsigned int const nb_initial_regs)
 {
+    skip_next_command = false;
     if (nb_initial_regs > NB_REGISTERS) {
         return false;
     }
 
+    tables_init();
     registers_init();   // Default init.
     for (unsigned int i = 0; i < nb_initial_regs; i++) {
         regs[i] = initial_data[i];
@@ -114,24 +230,79 @@ command_t *machine_command_create(register_t out, operation_t op,
 }
 
 
+//  ----------------------------------------------------------------------------
+/// \brief  Create a new LOAD command. The immediate value is stored in src2.
+/// \param  out     The output register index.
+/// \param  value   The value to load into out.
+/// \return Pointer to the created command.
+//  ----------------------------------------------------------------------------
+command_t *machine_command_load_create(register_t out, int8_t value)
+{
+    return machine_command_create(out, LOAD, reg_A, (uint8_t) value);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the immediate value of a LOAD command, stored in src2.
+/// \param  command Pointer to a LOAD command.
+/// \return The immediate value.
+//  ----------------------------------------------------------------------------
+int8_t machine_command_immediate_get(command_t const * const command)
+{
+    assert(command);
+    return (int8_t) command->src2;
+}
+
+
 //  ----------------------------------------------------------------------------
 /// \brief  Create a new object command with random content (registers and
-/// operation).
+/// operation), drawn from the default random stream. The default stream is
+/// not to be shared between threads.
 /// \return Pointer to the created command.
-/// \pre    The random number generator is already seeded.
+/// \pre    random_seed_set() is already called, for reproducible commands.
 //  ----------------------------------------------------------------------------
 command_t *machine_command_random_create(void)
 {
+    command_t *new_command_p = machine_command_create(reg_A, ADD, reg_A, reg_A);
+    if (new_command_p == NULL) {
+        return NULL;
+    }
+
+    machine_command_random_set(new_command_p,
+                               random_stream_next(random_default_stream_get()));
+    return new_command_p;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Set a command from random bits: one byte for each register index,
+/// the immediate value of LOAD and the upper 32 bits for the operation.
+/// \param  command     Pointer to the command to set.
+/// \param  random_bits 64 random bits.
+//  ----------------------------------------------------------------------------
+void machine_command_random_set(command_t * const command,
+                                uint64_t const random_bits)
+{
+    assert(command);
+
     // Modulo of a random number with a number that is not a power of two is
     // no uniformly random, but that is not very important for this
-    // application.
-    register_t dst = (register_t) rand() % NB_REGISTERS;
-    operation_t op  = (operation_t) rand() % NB_OPERATION_TYPES;
-    register_t src1 = (register_t) rand() % NB_REGISTERS;
-    register_t src2 = (register_t) rand() % NB_REGISTERS;
+    // application. The operation is drawn by scaling the upper 32 bits, which
+    // avoids a division.
+    uint64_t const op_index =
+        ((random_bits >> 32) * nb_enabled_operations) >> 32;
+    uint8_t op = enabled_operations[op_index];
+    *command = (command_t) {
+        .dst = (uint8_t) (random_bits % NB_REGISTERS),
+        .op = op,
+        .src1 = (uint8_t) ((random_bits >> 8) % NB_REGISTERS),
+        .src2 = (uint8_t) ((random_bits >> 16) % NB_REGISTERS)
+    };
 
-    command_t *new_command_p = machine_command_create(dst, op, src1, src2);
-    return new_command_p;
+    if (op == LOAD) {
+        command->src1 = reg_A;
+        command->src2 = (uint8_t) (random_bits >> 24);
+    }
 }
 
 
@@ -156,18 +327,172 @@ void machine_command_run(command_t const * const command)
         return;
     }
 
-    if (command->op >= NB_OPERATION_TYPES
-        || command->dst >= NB_REGISTERS
-        || command->src1 >= NB_REGISTERS
-        || command->src2 >= NB_REGISTERS
-        ) {
+    if (!machine_command_valid_check(command)) {
         fprintf(stderr, "%s, command is erroneous.\n", __func__);
         machine_command_print(command);
         return;
     }
 
-    regs[command->dst] = operation[command->op](regs[command->src1],
-                                                regs[command->src2]);
+    if (skip_next_command) {
+        skip_next_command = false;
+        return;
+    }
+
+    tables_init();
+    if (command->op == IF_LESS) {
+        skip_next_command = !(regs[command->src1] < regs[command->src2]);
+    } else if (command->op == LOAD) {
+        regs[command->dst] = machine_command_immediate_get(command);
+    } else {
+        regs[command->dst] = operation_apply(command->op,
+                                             regs[command->src1],
+                                             regs[command->src2]);
+    }
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Run a sequence of commands on the register file passed as
+/// parameter. The operations are dispatched by operation_apply(), which is
+/// inlined here, so the loop is specialized for the configured machine. An
+/// IF_LESS as last command has nothing to skip.
+/// \param  registers   Register file, modified in place.
+/// \param  program     Array of valid commands.
+/// \param  nb_commands Number of commands in program.
+//  ----------------------------------------------------------------------------
+void machine_program_run(register_value_t * const registers,
+                         command_t const * const program,
+                         int const nb_commands)
+{
+    assert(registers);
+    assert(program || nb_commands == 0);
+
+    tables_init();
+    for (int i = 0; i < nb_commands; i++) {
+        command_t const command = program[i];
+
+        // src2 of LOAD is not a register index, do not read through it.
+        if (command.op == LOAD) {
+            registers[command.dst] = (int8_t) command.src2;
+            continue;
+        }
+
+        register_value_t const a = registers[command.src1];
+        register_value_t const b = registers[command.src2];
+        if (command.op == IF_LESS) {
+            i += !(a < b);
+        } else {
+            registers[command.dst] = operation_apply(command.op, a, b);
+        }
+    }
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Run a sequence of commands on a block of register files. Each
+/// command is dispatched once for the whole block. Commands guarded by an
+/// IF_LESS only write the cases whose condition was true.
+/// \param  block       Register files, modified in place.
+/// \param  nb_cases    Number of cases used in the block.
+/// \param  program     Array of valid commands.
+/// \param  nb_commands Number of commands in program.
+//  ----------------------------------------------------------------------------
+void machine_block_run(machine_block_t * const block, int const nb_cases,
+                       command_t const * const program,
+                       int const nb_commands)
+{
+    assert(block);
+    assert(program || nb_commands == 0);
+    assert(nb_cases >= 0 && nb_cases <= MACHINE_BLOCK_CASES);
+
+    // Cases in which the current command is skipped, set by an IF_LESS.
+    bool skip[MACHINE_BLOCK_CASES];
+    bool skipping = false;
+
+    tables_init();
+    for (int i = 0; i < nb_commands; i++) {
+        command_t const command = program[i];
+        register_value_t result[MACHINE_BLOCK_CASES];
+        register_value_t *dst = block->registers[command.dst];
+
+        if (command.op == LOAD) {
+            for (int c = 0; c < nb_cases; c++) {
+                result[c] = (int8_t) command.src2;
+            }
+        } else if (command.op == IF_LESS) {
+            register_value_t const *a = block->registers[command.src1];
+            register_value_t const *b = block->registers[command.src2];
+            // A skipped IF_LESS does not skip the next command.
+            for (int c = 0; c < nb_cases; c++) {
+                skip[c] = !(a[c] < b[c]) && !(skipping && skip[c]);
+            }
+            skipping = true;
+            continue;
+        } else {
+            block_operation_apply(command.op, result,
+                                  block->registers[command.src1],
+                                  block->registers[command.src2],
+                                  nb_cases);
+        }
+
+        if (skipping) {
+            for (int c = 0; c < nb_cases; c++) {
+                dst[c] = skip[c] ? dst[c] : result[c];
+            }
+            skipping = false;
+        } else {
+            memcpy(dst, result, nb_cases * sizeof (register_value_t));
+        }
+    }
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Mark the effective commands of a program by register liveness,
+/// going backwards from the end where only the output register is live. A
+/// command is effective if it writes a live register, which is then not live
+/// before it and its sources are. A command guarded by an IF_LESS may not run,
+/// so it does not end the liveness of its destination. An IF_LESS is effective
+/// if the command it guards is.
+/// \param  program     Array of valid commands.
+/// \param  nb_commands Number of commands in program.
+/// \param  output      The output register.
+/// \param  effective   Output array of flags.
+/// \return Number of effective commands.
+//  ----------------------------------------------------------------------------
+int machine_program_effective_mark(command_t const * const program,
+                                   int const nb_commands,
+                                   register_t const output,
+                                   bool effective[])
+{
+    assert(program || nb_commands == 0);
+    assert(effective || nb_commands == 0);
+
+    uint32_t live = 1U << output;
+    int nb_effective = 0;
+
+    for (int i = nb_commands - 1; i >= 0; i--) {
+        command_t const command = program[i];
+        bool const guarded = i > 0 && program[i - 1].op == IF_LESS;
+
+        if (command.op == IF_LESS) {
+            effective[i] = i + 1 < nb_commands && effective[i + 1];
+        } else {
+            effective[i] = (live >> command.dst) & 1U;
+        }
+        if (!effective[i]) {
+            continue;
+        }
+
+        nb_effective++;
+        if (command.op != IF_LESS && !guarded) {
+            live &= ~(1U << command.dst);
+        }
+        if (command.op != LOAD) {
+            live |= (1U << command.src1) | (1U << command.src2);
+        }
+    }
+    return nb_effective;
 }
 
 
@@ -180,25 +505,72 @@ void machine_command_run(command_t const * const command)
 //  ----------------------------------------------------------------------------
 void machine_command_print(void const * const command)
 {
-    static const char *reg_to_string[NB_REGISTERS] = {
-        [reg_A] = "A", [reg_B] = "B", [reg_C] = "C", [reg_D] = "D",
-        [reg_E] = "E", [reg_F] = "F", [reg_G] = "G", [reg_H] = "H",
-        [reg_I] = "I", [reg_J] = "J", [reg_K] = "K", [reg_L] = "L",
-        [reg_M] = "M", [reg_N] = "N", [reg_O] = "O", [reg_P] = "P"
-    };
+    char line[MACHINE_COMMAND_FORMAT_MAX];
+    if (machine_command_format(command, line, sizeof line) > 0) {
+        fputs(line, stdout);
+    }
+}
 
-    static const char *op_to_string[NB_OPERATION_TYPES] = {
-        [ADD] = "+", [SUB] = "-", [MUL] = "*", [DIV] = "/"
-    };
 
-    command_t *cmd = (command_t *) command;
+//  ----------------------------------------------------------------------------
+/// \brief  Format a command as machine_command_print() prints it. The line is
+/// built from the name tables without going through printf().
+/// \param  command
+/// \param  buffer
+/// \param  capacity
+/// \return Number of characters written, 0 if buffer is too small.
+//  ----------------------------------------------------------------------------
+size_t machine_command_format(command_t const * const command, char buffer[],
+                              size_t const capacity)
+{
+    assert(command);
+    assert(buffer || capacity == 0);
+
+    char line[MACHINE_COMMAND_FORMAT_MAX];
+    char *end = line;
+
+    if (command->op == LOAD) {
+        end = text_append(end, register_names[command->dst]);
+        end = text_append(end, " = ");
+        end = integer_append(end, machine_command_immediate_get(command));
+    } else if (command->op == IF_LESS) {
+        end = text_append(end, "if (");
+        end = text_append(end, operation_names[command->op]);
+        end = text_append(end, " ");
+        end = text_append(end, register_names[command->src1]);
+        end = text_append(end, " ");
+        end = text_append(end, register_names[command->src2]);
+        end = text_append(end, ")");
+    } else {
+        end = text_append(end, register_names[command->dst]);
+        end = text_append(end, " = (");
+        end = text_append(end, operation_names[command->op]);
+        end = text_append(end, " ");
+        end = text_append(end, register_names[command->src1]);
+        end = text_append(end, " ");
+        end = text_append(end, register_names[command->src2]);
+        end = text_append(end, ")");
+    }
+    *end++ = '\n';
+
+    size_t const length = end - line;
+    if (length >= capacity) {
+        return 0;
+    }
+    memcpy(buffer, line, length);
+    buffer[length] = '\0';
+    return length;
+}
+
 
-    printf("%s = (%s %s %s)\n",
-           reg_to_string[cmd->dst],
-           op_to_string[cmd->op],
-           reg_to_string[cmd->src1],
-           reg_to_string[cmd->src2]
-        );
+//  ----------------------------------------------------------------------------
+/// \brief  Get the name of a register.
+/// \param  reg
+/// \return Name, "?" for an invalid register.
+//  ----------------------------------------------------------------------------
+char const *machine_register_name_get(register_t const reg)
+{
+    return (unsigned) reg < NB_REGISTER_NAMES ? register_names[reg] : "?";
 }
 
 
@@ -209,10 +581,16 @@ void machine_command_print(void const * const command)
 //  ----------------------------------------------------------------------------
 bool machine_command_valid_check(command_t const * const command)
 {
-    return command->dst >= 0 && command->dst < NB_REGISTERS
-        && command->op >= 0 && command->op < NB_OPERATION_TYPES
-        && command->src1 >= 0 && command->src1 < NB_REGISTERS
-        && command->src2 >= 0 && command->src2 < NB_REGISTERS
+    if (command->op == LOAD) {
+        // src2 holds an immediate value, any value is valid.
+        return command->dst < NB_REGISTERS
+            && MACHINE_OPERATION_ENABLED(LOAD);
+    }
+    return command->dst < NB_REGISTERS
+        && command->op < NB_OPERATION_TYPES
+        && MACHINE_OPERATION_ENABLED(command->op)
+        && command->src1 < NB_REGISTERS
+        && command->src2 < NB_REGISTERS
         ;
 }
 
@@ -240,6 +618,23 @@ register_value_t machine_result_get(void)
 }
 
 
+//  ----------------------------------------------------------------------------
+/// \brief  Get the fingerprint of the machine configuration.
+/// \param  config  Output.
+//  ----------------------------------------------------------------------------
+void machine_config_get(uint32_t config[MACHINE_CONFIG_SIZE])
+{
+    config[0] = sizeof (register_value_t);
+#if defined(MACHINE_REGISTER_FLOAT)
+    config[1] = 1;
+#else
+    config[1] = 0;
+#endif
+    config[2] = NB_REGISTERS;
+    config[3] = (MACHINE_OPERATIONS) & MACHINE_OPERATIONS_SUPPORTED;
+}
+
+
 //******************************************************************************
 // Internal functions
 //******************************************************************************
@@ -251,51 +646,241 @@ static void registers_init(void)
 }
 
 //  ----------------------------------------------------------------------------
-/// \brief  Definition of command operations.
+/// \brief  Definition of command operations. They are all small enough to be
+/// inlined into the interpreter loops, and free of branches: the selections in
+/// clamp() and the comparisons compile to conditional moves.
 //  ----------------------------------------------------------------------------
-static register_value_t operation_add(register_value_t const a,
-                                      register_value_t const b)
+static inline register_value_t operation_add(register_value_t const a,
+                                             register_value_t const b)
 {
-    large_register_value_t result = (large_register_value_t) a + b;
-    result = clamp(result);
-    return (register_value_t) result;
+    return clamp((large_register_value_t) a + b);
 }
 
 
-static register_value_t operation_sub(register_value_t const a,
-                                      register_value_t const b)
+static inline register_value_t operation_sub(register_value_t const a,
+                                             register_value_t const b)
 {
-    large_register_value_t result = (large_register_value_t) a - b;
-    result = clamp(result);
-    return (register_value_t) result;
+    return clamp((large_register_value_t) a - b);
+}
+
+
+static inline register_value_t operation_mul(register_value_t const a,
+                                             register_value_t const b)
+{
+#if defined(MACHINE_OPERATION_TABLES)
+    return mul_table[(uint8_t) a][(uint8_t) b];
+#else
+    return mul_compute(a, b);
+#endif
+}
+
+
+static inline register_value_t operation_div(register_value_t const a,
+                                             register_value_t const b)
+{
+#if defined(MACHINE_OPERATION_TABLES)
+    return div_table[(uint8_t) a][(uint8_t) b];
+#else
+    return div_compute(a, b);
+#endif
+}
+
+
+static inline register_value_t operation_min(register_value_t const a,
+                                             register_value_t const b)
+{
+    return a < b ? a : b;
+}
+
+
+static inline register_value_t operation_max(register_value_t const a,
+                                             register_value_t const b)
+{
+    return a > b ? a : b;
+}
+
+
+static inline register_value_t operation_less(register_value_t const a,
+                                              register_value_t const b)
+{
+    return a < b;
+}
+
+
+static inline register_value_t operation_equal(register_value_t const a,
+                                               register_value_t const b)
+{
+    return a == b;
+}
+
+
+#if !defined(MACHINE_REGISTER_FLOAT)
+static inline register_value_t operation_and(register_value_t const a,
+                                             register_value_t const b)
+{
+    return a & b;
+}
+
+
+static inline register_value_t operation_or(register_value_t const a,
+                                            register_value_t const b)
+{
+    return a | b;
+}
+
+
+static inline register_value_t operation_xor(register_value_t const a,
+                                             register_value_t const b)
+{
+    return a ^ b;
+}
+#endif
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Apply an operation to two operands. All enabled operations are
+/// computed and the result of op is selected, so that there is no branch on
+/// the operation: the operations are cheap compared to a mispredicted branch
+/// on a random operation. Disabled operations are known at compile time and
+/// give the first operand, as do IF_LESS and LOAD, handled by the caller.
+//  ----------------------------------------------------------------------------
+static inline register_value_t operation_apply(unsigned int const op,
+                                               register_value_t const a,
+                                               register_value_t const b)
+{
+    register_value_t results[NB_OPERATION_TYPES];
+    for (int i = 0; i < NB_OPERATION_TYPES; i++) {
+        results[i] = a;
+    }
+    OPERATION_RESULT(ADD, operation_add);
+    OPERATION_RESULT(SUB, operation_sub);
+    OPERATION_RESULT(MUL, operation_mul);
+    OPERATION_RESULT(DIV, operation_div);
+    OPERATION_RESULT(MIN, operation_min);
+    OPERATION_RESULT(MAX, operation_max);
+    OPERATION_RESULT(LESS, operation_less);
+    OPERATION_RESULT(EQUAL, operation_equal);
+#if !defined(MACHINE_REGISTER_FLOAT)
+    OPERATION_RESULT(AND, operation_and);
+    OPERATION_RESULT(OR, operation_or);
+    OPERATION_RESULT(XOR, operation_xor);
+#endif
+    return results[op];
+}
+
+//  ----------------------------------------------------------------------------
+/// \brief  Apply an operation to the operands of all cases of a block. The
+/// switch is on the operation of the whole block, the loops vectorize.
+//  ----------------------------------------------------------------------------
+static inline void block_operation_apply(unsigned int const op,
+                                         register_value_t * const result,
+                                         register_value_t const * const a,
+                                         register_value_t const * const b,
+                                         int const nb_cases)
+{
+    switch (op) {
+        BLOCK_OPERATION_CASE(ADD, operation_add);
+        BLOCK_OPERATION_CASE(SUB, operation_sub);
+        BLOCK_OPERATION_CASE(MUL, operation_mul);
+        BLOCK_OPERATION_CASE(DIV, operation_div);
+        BLOCK_OPERATION_CASE(MIN, operation_min);
+        BLOCK_OPERATION_CASE(MAX, operation_max);
+        BLOCK_OPERATION_CASE(LESS, operation_less);
+        BLOCK_OPERATION_CASE(EQUAL, operation_equal);
+#if !defined(MACHINE_REGISTER_FLOAT)
+        BLOCK_OPERATION_CASE(AND, operation_and);
+        BLOCK_OPERATION_CASE(OR, operation_or);
+        BLOCK_OPERATION_CASE(XOR, operation_xor);
+#endif
+    default:
+        break;
+    }
+    // Disabled operation: first operand, as operation_apply().
+    memcpy(result, a, nb_cases * sizeof (register_value_t));
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Arithmetic MUL and DIV, used directly or to fill the tables.
+//  ----------------------------------------------------------------------------
+static inline register_value_t mul_compute(register_value_t const a,
+                                           register_value_t const b)
+{
+    return clamp((large_register_value_t) a * b);
+}
+
+
+static inline register_value_t div_compute(register_value_t const a,
+                                           register_value_t const b)
+{
+    // Dividing by 1 instead of 0 gives a, which is the result wanted for a
+    // division by zero, without a branch. The division is done in the large
+    // type since REGISTER_MIN / -1 does not fit in a register.
+    register_value_t const divisor = b + (b == 0);
+    return clamp((large_register_value_t) a / divisor);
 }
 
 
-static register_value_t operation_mul(register_value_t const a,
-                                      register_value_t const b)
+static inline register_value_t clamp(large_register_value_t const value)
 {
-    large_register_value_t result = (large_register_value_t) a * b;
-    result = clamp(result);
+    large_register_value_t result = value;
+    result = result > REGISTER_MAX ? REGISTER_MAX : result;
+    result = result < REGISTER_MIN ? REGISTER_MIN : result;
     return (register_value_t) result;
 }
 
 
-static register_value_t operation_div(register_value_t const a,
-                                      register_value_t const b)
+//  ----------------------------------------------------------------------------
+/// \brief  Fill the MUL and DIV tables on first use, if they are enabled.
+/// Safe to call from several threads at once.
+//  ----------------------------------------------------------------------------
+static inline void tables_init(void)
+{
+#if defined(MACHINE_OPERATION_TABLES)
+    pthread_once(&tables_once, tables_fill);
+#endif
+}
+
+
+#if defined(MACHINE_OPERATION_TABLES)
+static void tables_fill(void)
 {
-    if (b == 0) {
-        return a;
+    for (int a = INT8_MIN; a <= INT8_MAX; a++) {
+        for (int b = INT8_MIN; b <= INT8_MAX; b++) {
+            mul_table[(uint8_t) a][(uint8_t) b] = mul_compute(a, b);
+            div_table[(uint8_t) a][(uint8_t) b] = div_compute(a, b);
+        }
     }
-    return a / b;
 }
+#endif
+
 
-static large_register_value_t clamp(large_register_value_t const value)
+// Copy text, without its terminating null, and return the new end.
+static char *text_append(char *end, char const *text)
 {
-    if (value > REGISTER_MAX) {
-        return REGISTER_MAX;
-    } else if (value < REGISTER_MIN) {
-        return REGISTER_MIN;
+    while (*text != '\0') {
+        *end++ = *text++;
     }
+    return end;
+}
+
 
-    return value;
+// Write value in decimal and return the new end.
+static char *integer_append(char *end, int value)
+{
+    char digits[12];
+    int nb_digits = 0;
+    unsigned magnitude = value < 0 ? 0U - (unsigned) value : (unsigned) value;
+
+    do {
+        digits[nb_digits++] = (char) ('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) {
+        *end++ = '-';
+    }
+    while (nb_digits > 0) {
+        *end++ = digits[--nb_digits];
+    }
+    return end;
 }
@@ -4,31 +4,126 @@ Copyright (c) 2013 Gauthier Fleutot Östervall
 #ifndef MACHINE_H_INCLUDED
 #define MACHINE_H_INCLUDED
 
+#include <float.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+//******************************************************************************
+// Machine configuration
+//******************************************************************************
+// The shape of the machine is selected at compile time, so that the
+// interpreter is specialized for it. Override on the command line, e.g.
+// -DMACHINE_REGISTER_WIDTH=16 -DMACHINE_NB_REGISTERS=8.
+//
+// MACHINE_REGISTER_WIDTH   Width of the signed integer registers: 8, 16 or 32.
+// MACHINE_REGISTER_FLOAT   Define to use float registers instead of integers.
+// MACHINE_NB_REGISTERS     Number of registers, 1 to 16.
+// MACHINE_OPERATIONS       Bit mask of the enabled operations, bit n set for
+//                          operation n of operation_t. Operations that are not
+//                          supported by the register type (bitwise operations
+//                          on float) are always disabled.
+#ifndef MACHINE_REGISTER_WIDTH
+#define MACHINE_REGISTER_WIDTH  (8)
+#endif
+
+#ifndef MACHINE_NB_REGISTERS
+#define MACHINE_NB_REGISTERS    (16)
+#endif
+
+#ifndef MACHINE_OPERATIONS
+#define MACHINE_OPERATIONS      ((1U << NB_OPERATION_TYPES) - 1)
+#endif
+
 // Type definitions for commands.
+// Apart from the arithmetic operations:
+// - MIN, MAX, LESS, EQUAL: dst = min(src1, src2), ..., dst = (src1 == src2).
+//   Comparisons give 1 or 0.
+// - IF_LESS: the next command is run only if src1 < src2. dst is unused.
+// - AND, OR, XOR: bitwise operations, integer registers only.
+// - LOAD: dst = immediate value, stored in src2 as an int8_t. src1 is unused.
 typedef enum {
     ADD, SUB, MUL, DIV,
+    MIN, MAX, LESS, EQUAL, IF_LESS,
+    AND, OR, XOR,
+    LOAD,
     NB_OPERATION_TYPES  // Must be last.
 } operation_t;
 
 typedef enum {
     reg_A, reg_B, reg_C, reg_D, reg_E, reg_F, reg_G, reg_H, reg_I, reg_J, reg_K,
     reg_L, reg_M, reg_N, reg_O, reg_P,
-    NB_REGISTERS    // Must be last.
+    NB_REGISTER_NAMES   // Must be last.
 } register_t;
 
-typedef struct command_s command_t;
-// Use this instead of sizeof(command_t), since command_t is an incomplete type.
+#if MACHINE_NB_REGISTERS < 1 || MACHINE_NB_REGISTERS > 16
+#error "MACHINE_NB_REGISTERS must be in 1..16."
+#endif
+#define NB_REGISTERS    (MACHINE_NB_REGISTERS)
+
+#if defined(MACHINE_REGISTER_FLOAT)
+#define MACHINE_OPERATIONS_SUPPORTED                                    \
+    (((1U << NB_OPERATION_TYPES) - 1)                                   \
+     & ~((1U << AND) | (1U << OR) | (1U << XOR)))
+#else
+#define MACHINE_OPERATIONS_SUPPORTED    ((1U << NB_OPERATION_TYPES) - 1)
+#endif
+
+// Fails to compile if MACHINE_OPERATIONS enables no operation supported by the
+// registers. Not an #error: the operations are enumerators, which the
+// preprocessor does not see.
+typedef char machine_operations_none_enabled_check
+    [((MACHINE_OPERATIONS) & MACHINE_OPERATIONS_SUPPORTED) != 0 ? 1 : -1];
+
+// Compile time constant, lets the compiler drop disabled operations.
+#define MACHINE_OPERATION_ENABLED(op)                                   \
+    (((MACHINE_OPERATIONS) & MACHINE_OPERATIONS_SUPPORTED) >> (op) & 1U)
+
+// Commands are kept small and free of padding so that sequences of them can be
+// stored contiguously and compared or hashed as plain memory.
+typedef struct command_s {
+    uint8_t dst;    // register_t
+    uint8_t op;     // operation_t
+    uint8_t src1;   // register_t
+    uint8_t src2;   // register_t
+} command_t;
 extern const size_t sizeof_machine_command;
 
 // Signed value allows for easy fair interpretation of register value as
 // boolean.
+#if defined(MACHINE_REGISTER_FLOAT)
+typedef float register_value_t;
+#define REGISTER_MAX    (FLT_MAX)
+#define REGISTER_MIN    (-FLT_MAX)
+#elif MACHINE_REGISTER_WIDTH == 8
 typedef int8_t register_value_t;
 #define REGISTER_MAX    (INT8_MAX)
 #define REGISTER_MIN    (INT8_MIN)
+#elif MACHINE_REGISTER_WIDTH == 16
+typedef int16_t register_value_t;
+#define REGISTER_MAX    (INT16_MAX)
+#define REGISTER_MIN    (INT16_MIN)
+#elif MACHINE_REGISTER_WIDTH == 32
+typedef int32_t register_value_t;
+#define REGISTER_MAX    (INT32_MAX)
+#define REGISTER_MIN    (INT32_MIN)
+#else
+#error "MACHINE_REGISTER_WIDTH must be 8, 16 or 32."
+#endif
+
+// Number of words of machine_config_get().
+#define MACHINE_CONFIG_SIZE     (4)
+
+// Longest line of machine_command_format(), newline and null included.
+#define MACHINE_COMMAND_FORMAT_MAX  (16)
+
+// Register files of a block of fitness cases, stored register major so that
+// a command is applied to all cases of the block in one vectorizable loop:
+// registers[r][c] is register r of case c.
+#define MACHINE_BLOCK_CASES     (64)
+typedef struct {
+    register_value_t registers[NB_REGISTERS][MACHINE_BLOCK_CASES];
+} machine_block_t;
 
 //  ----------------------------------------------------------------------------
 /// \brief  Initialize the machine's registers to initial data.
@@ -51,12 +146,37 @@ command_t *machine_command_create(register_t out, operation_t op,
                                   register_t in1,register_t in2);
 
 //  ----------------------------------------------------------------------------
-/// \brief  Create a new command with random content.
+/// \brief  Create a new LOAD command, setting a register to a constant.
+/// \param  out     Output register index.
+/// \param  value   Immediate value to load.
 /// \return Pointer to the newly created command.
-/// \pre    rand() is already seeded.
+//  ----------------------------------------------------------------------------
+command_t *machine_command_load_create(register_t out, int8_t value);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the immediate value of a LOAD command.
+/// \param  command Pointer to the command.
+/// \return The immediate value.
+//  ----------------------------------------------------------------------------
+int8_t machine_command_immediate_get(command_t const * const command);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create a new command with random content, drawn from the default
+/// random stream of randomizer.h.
+/// \return Pointer to the newly created command.
+/// \pre    random_seed_set() is already called, for reproducible commands.
 //  ----------------------------------------------------------------------------
 command_t *machine_command_random_create(void);
 
+//  ----------------------------------------------------------------------------
+/// \brief  Set the content of a command from random bits. The command is a
+/// pure function of the bits, which lets the caller choose the generator.
+/// \param  command     Pointer to the command to set.
+/// \param  random_bits 64 random bits.
+//  ----------------------------------------------------------------------------
+void machine_command_random_set(command_t * const command,
+                                uint64_t const random_bits);
+
 //  ----------------------------------------------------------------------------
 /// \brief  Destroy the command passed as parameter.
 /// \param  command Pointer to the command to destroy.
@@ -64,17 +184,78 @@ command_t *machine_command_random_create(void);
 void machine_command_destroy(command_t *command);
 
 //  ----------------------------------------------------------------------------
-/// \brief  Run the command passed as parameter.
+/// \brief  Run the command passed as parameter. If the command is an IF_LESS
+/// whose condition is false, the next command run is skipped. The skip does
+/// not carry over to the next program: machine_init() clears it.
 /// \param  command Pointer to the command to run.
 //  ----------------------------------------------------------------------------
 void machine_command_run(command_t const * const command);
 
+//  ----------------------------------------------------------------------------
+/// \brief  Run a sequence of commands on a register file. The register file is
+/// the caller's, so that several programs or fitness cases can be run without
+/// touching the machine's own registers.
+/// \param  registers   Register file of NB_REGISTERS values, modified in place.
+/// \param  program     Array of commands, assumed valid.
+/// \param  nb_commands Number of commands in program.
+//  ----------------------------------------------------------------------------
+void machine_program_run(register_value_t * const registers,
+                         command_t const * const program,
+                         int const nb_commands);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Run a sequence of commands on a block of register files, one per
+/// fitness case. Same result as machine_program_run() on each register file.
+/// \param  block       Register files, modified in place.
+/// \param  nb_cases    Number of cases used in the block, the first ones.
+/// \param  program     Array of commands, assumed valid.
+/// \param  nb_commands Number of commands in program.
+//  ----------------------------------------------------------------------------
+void machine_block_run(machine_block_t * const block, int const nb_cases,
+                       command_t const * const program,
+                       int const nb_commands);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Find the effective commands of a program, the ones that can
+/// influence the final value of the output register. The other commands can be
+/// removed without changing the result.
+/// \param  program     Array of valid commands.
+/// \param  nb_commands Number of commands in program.
+/// \param  output      The output register.
+/// \param  effective   Output array of nb_commands flags.
+/// \return Number of effective commands.
+//  ----------------------------------------------------------------------------
+int machine_program_effective_mark(command_t const * const program,
+                                   int const nb_commands,
+                                   register_t const output,
+                                   bool effective[]);
+
 //  ----------------------------------------------------------------------------
 /// \brief  Print the command passed as parameter.
 /// \param  command Pointer to the command to print.
 //  ----------------------------------------------------------------------------
 void machine_command_print(void const * const command);
 
+//  ----------------------------------------------------------------------------
+/// \brief  Format a command as one line of text, newline included, the way
+/// machine_command_print() prints it.
+/// \param  command Valid command.
+/// \param  buffer  Output, null terminated.
+/// \param  capacity    Size of buffer, MACHINE_COMMAND_FORMAT_MAX is always
+/// enough.
+/// \return Number of characters written, null excluded. 0 if buffer is too
+/// small.
+//  ----------------------------------------------------------------------------
+size_t machine_command_format(command_t const * const command, char buffer[],
+                              size_t const capacity);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the name of a register, as used in formatted commands.
+/// \param  reg
+/// \return Name of the register.
+//  ----------------------------------------------------------------------------
+char const *machine_register_name_get(register_t const reg);
+
 //  ----------------------------------------------------------------------------
 /// \brief  Check the validity of a command.
 /// \param  command Pointer to the command to check.
@@ -95,4 +276,12 @@ void machine_command_copy(command_t *dst, command_t *src);
 //  ----------------------------------------------------------------------------
 register_value_t machine_result_get(void);
 
+//  ----------------------------------------------------------------------------
+/// \brief  Get the fingerprint of the machine configuration: register size,
+/// float registers or not, number of registers and enabled operations. Genes
+/// only mean the same on machines with the same fingerprint.
+/// \param  config  Output.
+//  ----------------------------------------------------------------------------
+void machine_config_get(uint32_t config[MACHINE_CONFIG_SIZE]);
+
 #endif // MACHINE_H_INCLUDED
@@ -0,0 +1,194 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+// Module under benchmark.
+#include "../machine.h"
+#include "../machine.c" // Including c file in order to reach the internal
+                        // operations.
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+#define NB_PROGRAMS     (256)
+#define PROGRAM_SIZE    (256)
+#define NB_ROUNDS       (200)
+
+//******************************************************************************
+// Module variables
+//******************************************************************************
+static command_t programs[NB_PROGRAMS][PROGRAM_SIZE];
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+static register_value_t reference_add(register_value_t const a,
+                                      register_value_t const b);
+static register_value_t reference_sub(register_value_t const a,
+                                      register_value_t const b);
+static register_value_t reference_mul(register_value_t const a,
+                                      register_value_t const b);
+static register_value_t reference_div(register_value_t const a,
+                                      register_value_t const b);
+static large_register_value_t reference_clamp(large_register_value_t const
+                                              value);
+static void reference_program_run(register_value_t * const registers,
+                                  command_t const * const program,
+                                  int const nb_commands);
+static double run_time_get(void (*run)(register_value_t * const,
+                                       command_t const * const,
+                                       int const),
+                           register_value_t *checksum);
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+// The implementation before the operations were inlined: one indirect call
+// per command, and a clamp with two branches.
+static register_value_t (*reference_operation[DIV + 1]) (
+    register_value_t const a,
+    register_value_t const b) = {
+    [ADD] = reference_add,
+    [SUB] = reference_sub,
+    [MUL] = reference_mul,
+    [DIV] = reference_div
+};
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+int main(void)
+{
+    srand(1);
+    for (int p = 0; p < NB_PROGRAMS; p++) {
+        for (int i = 0; i < PROGRAM_SIZE; i++) {
+            // Only the operations the reference implements.
+            programs[p][i] = (command_t) {
+                .dst = rand() % NB_REGISTERS,
+                .op = rand() % (DIV + 1),
+                .src1 = rand() % NB_REGISTERS,
+                .src2 = rand() % NB_REGISTERS
+            };
+        }
+    }
+
+    register_value_t reference_checksum;
+    register_value_t checksum;
+    double reference_time = run_time_get(reference_program_run,
+                                         &reference_checksum);
+    double time = run_time_get(machine_program_run, &checksum);
+    assert(checksum == reference_checksum);
+
+    double nb_commands = (double) NB_ROUNDS * NB_PROGRAMS * PROGRAM_SIZE;
+#if defined(MACHINE_OPERATION_TABLES)
+    printf("MUL and DIV by table lookup.\n");
+#else
+    printf("MUL and DIV by arithmetic.\n");
+#endif
+    printf("reference:           %8.2f Mcommands/s\n",
+           nb_commands / reference_time / 1e6);
+    printf("machine_program_run: %8.2f Mcommands/s (x%.2f)\n",
+           nb_commands / time / 1e6, reference_time / time);
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+static register_value_t reference_add(register_value_t const a,
+                                      register_value_t const b)
+{
+    large_register_value_t result = (large_register_value_t) a + b;
+    result = reference_clamp(result);
+    return (register_value_t) result;
+}
+
+
+static register_value_t reference_sub(register_value_t const a,
+                                      register_value_t const b)
+{
+    large_register_value_t result = (large_register_value_t) a - b;
+    result = reference_clamp(result);
+    return (register_value_t) result;
+}
+
+
+static register_value_t reference_mul(register_value_t const a,
+                                      register_value_t const b)
+{
+    large_register_value_t result = (large_register_value_t) a * b;
+    result = reference_clamp(result);
+    return (register_value_t) result;
+}
+
+
+static register_value_t reference_div(register_value_t const a,
+                                      register_value_t const b)
+{
+    if (b == 0) {
+        return a;
+    }
+    large_register_value_t result = (large_register_value_t) a / b;
+    result = reference_clamp(result);
+    return (register_value_t) result;
+}
+
+
+static large_register_value_t reference_clamp(large_register_value_t const
+                                              value)
+{
+    if (value > REGISTER_MAX) {
+        return REGISTER_MAX;
+    } else if (value < REGISTER_MIN) {
+        return REGISTER_MIN;
+    }
+
+    return value;
+}
+
+
+static void reference_program_run(register_value_t * const registers,
+                                  command_t const * const program,
+                                  int const nb_commands)
+{
+    for (int i = 0; i < nb_commands; i++) {
+        command_t const *command = &program[i];
+        registers[command->dst] =
+            reference_operation[command->op](registers[command->src1],
+                                             registers[command->src2]);
+    }
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Run all programs NB_ROUNDS times with the given interpreter.
+/// \param  run         Interpreter.
+/// \param  checksum    Output, sum of the results, to compare interpreters.
+/// \return Time taken in seconds.
+//  ----------------------------------------------------------------------------
+static double run_time_get(void (*run)(register_value_t * const,
+                                       command_t const * const,
+                                       int const),
+                           register_value_t *checksum)
+{
+    register_value_t sum = 0;
+    clock_t start = clock();
+    for (int round = 0; round < NB_ROUNDS; round++) {
+        for (int p = 0; p < NB_PROGRAMS; p++) {
+            register_value_t registers[NB_REGISTERS];
+            for (int i = 0; i < NB_REGISTERS; i++) {
+                registers[i] = (register_value_t) (round + p + i);
+            }
+            run(registers, programs[p], PROGRAM_SIZE);
+            sum += registers[reg_A];
+        }
+    }
+    clock_t end = clock();
+
+    *checksum = sum;
+    return (double) (end - start) / CLOCKS_PER_SEC;
+}
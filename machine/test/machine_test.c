@@ -26,6 +26,7 @@ Copyright (c) 2013 Gauthier Fleutot Östervall
 //******************************************************************************
 // Module constants
 //******************************************************************************
+#define SEED    (1)
 
 //******************************************************************************
 // Module variables
@@ -38,16 +39,33 @@ static void test_machine_init(void);
 static void test_machine_command_create(void);
 static void test_machine_command_with_clamp(void);
 static void test_machine_command_valid_check(void);
+static void test_machine_program_run(void);
+static void test_machine_extended_operations(void);
+static void test_machine_program_run_random(void);
+static void test_machine_operation_tables(void);
+static void test_machine_program_effective_mark(void);
+static void test_machine_block_run(void);
+static void test_machine_command_format(void);
+static void test_machine_config_get(void);
 
 //******************************************************************************
 // Function definitions
 //******************************************************************************
 int main(void)
 {
+    random_seed_set(SEED);
     test_machine_init();
     test_machine_command_create();
     test_machine_command_with_clamp();
     test_machine_command_valid_check();
+    test_machine_program_run();
+    test_machine_extended_operations();
+    test_machine_program_run_random();
+    test_machine_operation_tables();
+    test_machine_program_effective_mark();
+    test_machine_block_run();
+    test_machine_command_format();
+    test_machine_config_get();
     printf("All tests passed.\n");
 }
 
@@ -95,6 +113,7 @@ static void test_machine_command_create(void)
 static void test_machine_command_with_clamp(void)
 {
     TEST_START_PRINT();
+#if MACHINE_NB_REGISTERS >= 11 // Uses registers up to reg_K.
     register_value_t data[] = {
         0,                          // A
         REGISTER_MAX - 10, 20,      // B, C
@@ -155,6 +174,15 @@ static void test_machine_command_with_clamp(void)
     result = machine_result_get();
     assert(result == data[reg_J]);
     machine_command_destroy(command);
+
+    // Division overflow.
+    command = machine_command_create(reg_A, DIV, reg_D, reg_A);
+    machine_init((register_value_t []) { -1, 0, 0, REGISTER_MIN }, 4);
+    machine_command_run(command);
+    result = machine_result_get();
+    assert(result == REGISTER_MAX);
+    machine_command_destroy(command);
+#endif
     TEST_END_PRINT();
 }
 
@@ -171,30 +199,328 @@ static void test_machine_command_valid_check(void)
 
     command.dst = -1;
     assert(!machine_command_valid_check(&command));
-    command.dst = INT_MAX;
+    command.dst = UINT8_MAX;
     assert(!machine_command_valid_check(&command));
     command.dst = reg_A;
     assert(machine_command_valid_check(&command));
 
     command.op = -1;
     assert(!machine_command_valid_check(&command));
-    command.op = INT_MAX;
+    command.op = UINT8_MAX;
     assert(!machine_command_valid_check(&command));
     command.op = ADD;
     assert(machine_command_valid_check(&command));
 
     command.src1 = -1;
     assert(!machine_command_valid_check(&command));
-    command.src1 = INT_MAX;
+    command.src1 = UINT8_MAX;
     assert(!machine_command_valid_check(&command));
     command.src1 = reg_B;
     assert(machine_command_valid_check(&command));
 
     command.src2 = -1;
     assert(!machine_command_valid_check(&command));
-    command.src2 = INT_MAX;
+    command.src2 = UINT8_MAX;
     assert(!machine_command_valid_check(&command));
     command.src2 = reg_C;
     assert(machine_command_valid_check(&command));
+
+    // The immediate value of LOAD is not a register index.
+    command.op = LOAD;
+    command.src2 = UINT8_MAX;
+    assert(machine_command_valid_check(&command));
+    TEST_END_PRINT();
+}
+
+static void test_machine_program_run(void)
+{
+    TEST_START_PRINT();
+    register_value_t data[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+                               15, 16};
+    command_t program[] = {
+        { .dst = reg_A, .op = ADD, .src1 = reg_B, .src2 = reg_C },
+        { .dst = reg_D, .op = MUL, .src1 = reg_A, .src2 = reg_A },
+        { .dst = reg_B, .op = SUB, .src1 = reg_D, .src2 = reg_C },
+        { .dst = reg_A, .op = DIV, .src1 = reg_B, .src2 = reg_A }
+    };
+    int const nb_commands = sizeof program / sizeof program[0];
+
+    // Same result as running the commands one by one on the machine.
+    machine_init(data, NB_REGISTERS);
+    for (int i = 0; i < nb_commands; i++) {
+        machine_command_run(&program[i]);
+    }
+
+    register_value_t registers[NB_REGISTERS];
+    for (int i = 0; i < NB_REGISTERS; i++) {
+        registers[i] = data[i];
+    }
+    machine_program_run(registers, program, nb_commands);
+
+    assert(registers[reg_A] == machine_result_get());
+    // (2 + 3)^2 - 3 = 22, 22 / 5 = 4.
+    assert(registers[reg_A] == (register_value_t) (22 / 5.0));
+    TEST_END_PRINT();
+}
+
+
+// Run a single command on the machine, starting from the given registers.
+static register_value_t command_result_get(command_t command,
+                                           register_value_t const *data)
+{
+    machine_init((register_value_t *) data, 4);
+    machine_command_run(&command);
+    return machine_result_get();
+}
+
+
+static void test_machine_extended_operations(void)
+{
+    TEST_START_PRINT();
+    register_value_t const data[] = {0, 5, -3, 5};
+    command_t command = { .dst = reg_A, .src1 = reg_B, .src2 = reg_C };
+
+    command.op = MIN;
+    assert(command_result_get(command, data) == -3);
+    command.op = MAX;
+    assert(command_result_get(command, data) == 5);
+    command.op = LESS;
+    assert(command_result_get(command, data) == 0);
+    command.op = EQUAL;
+    assert(command_result_get(command, data) == 0);
+    command.src2 = reg_D;
+    assert(command_result_get(command, data) == 1);
+    command.src2 = reg_C;
+
+#if !defined(MACHINE_REGISTER_FLOAT)
+    command.op = AND;
+    assert(command_result_get(command, data) == (5 & -3));
+    command.op = OR;
+    assert(command_result_get(command, data) == (5 | -3));
+    command.op = XOR;
+    assert(command_result_get(command, data) == (5 ^ -3));
+#endif
+
+    command_t *load = machine_command_load_create(reg_A, -42);
+    assert(machine_command_immediate_get(load) == -42);
+    assert(command_result_get(*load, data) == -42);
+
+    // IF_LESS skips the next command when its condition is false.
+    command_t program[] = {
+        { .dst = reg_A, .op = IF_LESS, .src1 = reg_B, .src2 = reg_C },
+        *load,
+        { .dst = reg_B, .op = IF_LESS, .src1 = reg_C, .src2 = reg_B },
+        { .dst = reg_A, .op = ADD, .src1 = reg_A, .src2 = reg_B }
+    };
+    machine_init((register_value_t *) data, 4);
+    for (int i = 0; i < 4; i++) {
+        machine_command_run(&program[i]);
+    }
+    assert(machine_result_get() == 5);
+
+    // A program ending with a false IF_LESS leaves no skip to the next one.
+    machine_init((register_value_t *) data, 4);
+    machine_command_run(&program[0]);
+    machine_init((register_value_t *) data, 4);
+    machine_command_run(load);
+    assert(machine_result_get() == -42);
+
+    register_value_t registers[NB_REGISTERS] = {0, 5, -3, 5};
+    machine_program_run(registers, program, 4);
+    assert(registers[reg_A] == 5);
+
+    machine_command_destroy(load);
+    TEST_END_PRINT();
+}
+
+
+static void test_machine_program_run_random(void)
+{
+    TEST_START_PRINT();
+    enum { NB_COMMANDS = 200, NB_RUNS = 100 };
+    command_t program[NB_COMMANDS];
+
+    for (int run = 0; run < NB_RUNS; run++) {
+        register_value_t registers[NB_REGISTERS];
+        for (int i = 0; i < NB_REGISTERS; i++) {
+            registers[i] = (register_value_t) (rand() % 256 - 128);
+        }
+        for (int i = 0; i < NB_COMMANDS; i++) {
+            command_t *command = machine_command_random_create();
+            assert(machine_command_valid_check(command));
+            program[i] = *command;
+            machine_command_destroy(command);
+        }
+
+        machine_init(registers, NB_REGISTERS);
+        for (int i = 0; i < NB_COMMANDS; i++) {
+            machine_command_run(&program[i]);
+        }
+        machine_program_run(registers, program, NB_COMMANDS);
+        assert(registers[reg_A] == machine_result_get());
+    }
+    TEST_END_PRINT();
+}
+
+
+static void test_machine_operation_tables(void)
+{
+    TEST_START_PRINT();
+#if defined(MACHINE_OPERATION_TABLES)
+    tables_init();
+    for (int a = INT8_MIN; a <= INT8_MAX; a++) {
+        for (int b = INT8_MIN; b <= INT8_MAX; b++) {
+            assert(operation_mul(a, b) == mul_compute(a, b));
+            assert(operation_div(a, b) == div_compute(a, b));
+        }
+    }
+#endif
+    TEST_END_PRINT();
+}
+
+
+static void test_machine_program_effective_mark(void)
+{
+    TEST_START_PRINT();
+    command_t const program[] = {
+        { .dst = reg_B, .op = ADD, .src1 = reg_C, .src2 = reg_D },  // Dead.
+        { .dst = reg_B, .op = ADD, .src1 = reg_C, .src2 = reg_C },
+        { .dst = reg_E, .op = SUB, .src1 = reg_B, .src2 = reg_B },  // Unused.
+        { .dst = reg_A, .op = IF_LESS, .src1 = reg_C, .src2 = reg_D },
+        { .dst = reg_A, .op = MUL, .src1 = reg_B, .src2 = reg_B },
+        { .dst = reg_C, .op = ADD, .src1 = reg_A, .src2 = reg_A }   // Unused.
+    };
+    bool const expected[] = {false, true, false, true, true, false};
+    bool effective[6];
+
+    assert(machine_program_effective_mark(program, 6, reg_A, effective) == 3);
+    for (int i = 0; i < 6; i++) {
+        assert(effective[i] == expected[i]);
+    }
+
+    // Removing the commands that are not effective does not change the result.
+    enum { NB_COMMANDS = 100, NB_RUNS = 200 };
+    command_t random_program[NB_COMMANDS];
+    command_t effective_program[NB_COMMANDS];
+    bool random_effective[NB_COMMANDS];
+    for (int run = 0; run < NB_RUNS; run++) {
+        for (int i = 0; i < NB_COMMANDS; i++) {
+            command_t *command = machine_command_random_create();
+            random_program[i] = *command;
+            machine_command_destroy(command);
+        }
+        int nb_effective = machine_program_effective_mark(random_program,
+                                                          NB_COMMANDS, reg_A,
+                                                          random_effective);
+        int k = 0;
+        for (int i = 0; i < NB_COMMANDS; i++) {
+            if (random_effective[i]) {
+                effective_program[k++] = random_program[i];
+            }
+        }
+        assert(k == nb_effective);
+
+        register_value_t registers[NB_REGISTERS];
+        register_value_t effective_registers[NB_REGISTERS];
+        for (int i = 0; i < NB_REGISTERS; i++) {
+            registers[i] = (register_value_t) (rand() % 256 - 128);
+            effective_registers[i] = registers[i];
+        }
+        machine_program_run(registers, random_program, NB_COMMANDS);
+        machine_program_run(effective_registers, effective_program, k);
+        assert(registers[reg_A] == effective_registers[reg_A]);
+    }
+    TEST_END_PRINT();
+}
+
+
+static void test_machine_block_run(void)
+{
+    TEST_START_PRINT();
+    enum { NB_COMMANDS = 100, NB_RUNS = 50, NB_CASES = 50 };
+    command_t program[NB_COMMANDS];
+    machine_block_t block;
+    register_value_t registers[NB_CASES][NB_REGISTERS];
+
+    // Same results as running each case alone.
+    for (int run = 0; run < NB_RUNS; run++) {
+        for (int i = 0; i < NB_COMMANDS; i++) {
+            command_t *command = machine_command_random_create();
+            program[i] = *command;
+            machine_command_destroy(command);
+        }
+        for (int c = 0; c < NB_CASES; c++) {
+            for (int r = 0; r < NB_REGISTERS; r++) {
+                registers[c][r] = (register_value_t) (rand() % 256 - 128);
+                block.registers[r][c] = registers[c][r];
+            }
+        }
+
+        machine_block_run(&block, NB_CASES, program, NB_COMMANDS);
+        for (int c = 0; c < NB_CASES; c++) {
+            machine_program_run(registers[c], program, NB_COMMANDS);
+            for (int r = 0; r < NB_REGISTERS; r++) {
+                assert(block.registers[r][c] == registers[c][r]);
+            }
+        }
+    }
+    TEST_END_PRINT();
+}
+
+
+static void test_machine_command_format(void)
+{
+    TEST_START_PRINT();
+    char line[MACHINE_COMMAND_FORMAT_MAX];
+
+    command_t command = { .dst = reg_A, .op = ADD, .src1 = reg_B,
+                          .src2 = reg_C };
+    assert(machine_command_format(&command, line, sizeof line) == 12);
+    assert(strcmp(line, "A = (+ B C)\n") == 0);
+    // Too small for the null.
+    assert(machine_command_format(&command, line, 12) == 0);
+
+    command.op = MAX;
+    assert(machine_command_format(&command, line, sizeof line) == 14);
+    assert(strcmp(line, "A = (max B C)\n") == 0);
+
+    command.op = IF_LESS;
+    machine_command_format(&command, line, sizeof line);
+    assert(strcmp(line, "if (< B C)\n") == 0);
+
+    command.op = LOAD;
+    command.src2 = (uint8_t) INT8_MIN;
+    machine_command_format(&command, line, sizeof line);
+    assert(strcmp(line, "A = -128\n") == 0);
+    command.src2 = 7;
+    machine_command_format(&command, line, sizeof line);
+    assert(strcmp(line, "A = 7\n") == 0);
+    command.src2 = 0;
+    machine_command_format(&command, line, sizeof line);
+    assert(strcmp(line, "A = 0\n") == 0);
+
+    for (uint64_t i = 0; i < 1000; i++) {
+        machine_command_random_set(&command, i * 0x9e3779b97f4a7c15ULL);
+        assert(machine_command_format(&command, line, sizeof line) > 0);
+    }
+    assert(strcmp(machine_register_name_get(reg_P), "P") == 0);
+    TEST_END_PRINT();
+}
+
+
+static void test_machine_config_get(void)
+{
+    TEST_START_PRINT();
+    uint32_t config[MACHINE_CONFIG_SIZE];
+    machine_config_get(config);
+    assert(config[0] == sizeof (register_value_t));
+#if defined(MACHINE_REGISTER_FLOAT)
+    assert(config[1] == 1);
+    assert(!(config[3] & (1U << AND)));
+#else
+    assert(config[1] == 0);
+#endif
+    assert(config[2] == NB_REGISTERS);
+    assert(__builtin_popcount(config[3]) == nb_enabled_operations);
     TEST_END_PRINT();
 }
@@ -0,0 +1,463 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+#define _POSIX_C_SOURCE 200809L
+
+#include "network.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+#define NETWORK_UNIX_PREFIX     "unix:"
+#define NETWORK_TCP_PREFIX      "tcp:"
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+static int unix_open(char const * const path, bool const listening);
+static int tcp_open(char const * const address, bool const listening);
+static void nodelay_set(int const connection);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+//  ----------------------------------------------------------------------------
+/// \brief  Listen on an address. An existing socket file is replaced.
+/// \param  address
+/// \return Listening connection, -1 on failure.
+//  ----------------------------------------------------------------------------
+int network_listen(char const * const address)
+{
+    assert(address);
+
+    if (strncmp(address, NETWORK_UNIX_PREFIX,
+                strlen(NETWORK_UNIX_PREFIX)) == 0) {
+        return unix_open(&address[strlen(NETWORK_UNIX_PREFIX)], true);
+    }
+    return tcp_open(address, true);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the port a TCP connection is bound to.
+/// \param  connection
+/// \return Port, -1 on failure.
+//  ----------------------------------------------------------------------------
+int network_port_get(int const connection)
+{
+    struct sockaddr_storage name;
+    socklen_t length = sizeof name;
+    if (getsockname(connection, (struct sockaddr *) &name, &length) != 0) {
+        fprintf(stderr, "%s: %s.\n", __func__, strerror(errno));
+        return -1;
+    }
+
+    if (name.ss_family == AF_INET) {
+        return ntohs(((struct sockaddr_in *) &name)->sin_port);
+    }
+    if (name.ss_family == AF_INET6) {
+        return ntohs(((struct sockaddr_in6 *) &name)->sin6_port);
+    }
+    fprintf(stderr, "%s: not a TCP connection.\n", __func__);
+    return -1;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Accept a connection on a listening connection.
+/// \param  listener
+/// \return Accepted connection, -1 on failure.
+//  ----------------------------------------------------------------------------
+int network_accept(int const listener)
+{
+    int connection;
+    do {
+        connection = accept(listener, NULL, NULL);
+    } while (connection < 0 && errno == EINTR);
+
+    if (connection < 0) {
+        fprintf(stderr, "%s: %s.\n", __func__, strerror(errno));
+        return -1;
+    }
+    nodelay_set(connection);
+    return connection;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Connect to an address.
+/// \param  address
+/// \return Connection, -1 on failure.
+//  ----------------------------------------------------------------------------
+int network_connect(char const * const address)
+{
+    assert(address);
+
+    if (strncmp(address, NETWORK_UNIX_PREFIX,
+                strlen(NETWORK_UNIX_PREFIX)) == 0) {
+        return unix_open(&address[strlen(NETWORK_UNIX_PREFIX)], false);
+    }
+    return tcp_open(address, false);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Close a connection.
+/// \param  connection
+//  ----------------------------------------------------------------------------
+void network_close(int const connection)
+{
+    close(connection);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Make the transfers on a connection return instead of waiting.
+/// \param  connection
+/// \param  nonblocking
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool network_nonblocking_set(int const connection, bool const nonblocking)
+{
+    int const flags = fcntl(connection, F_GETFL);
+    if (flags < 0) {
+        return false;
+    }
+    return fcntl(connection, F_SETFL, nonblocking ? flags | O_NONBLOCK
+                 : flags & ~O_NONBLOCK) == 0;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Read exactly size bytes from a blocking connection, retrying after
+/// interruptions and partial reads.
+/// \param  connection
+/// \param  data
+/// \param  size
+/// \return False on error or end of connection.
+//  ----------------------------------------------------------------------------
+bool network_read(int const connection, void * const data, size_t const size)
+{
+    size_t done = 0;
+    while (done < size) {
+        ssize_t const nb_read = recv(connection, (uint8_t *) data + done,
+                                     size - done, 0);
+        if (nb_read == 0 || (nb_read < 0 && errno != EINTR)) {
+            return false;
+        }
+        done += nb_read > 0 ? nb_read : 0;
+    }
+    return true;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Write exactly size bytes to a blocking connection, retrying after
+/// interruptions and partial writes.
+/// \param  connection
+/// \param  data
+/// \param  size
+/// \return False on error.
+//  ----------------------------------------------------------------------------
+bool network_write(int const connection, void const * const data,
+                   size_t const size)
+{
+    size_t done = 0;
+    while (done < size) {
+        ssize_t const nb_written = send(connection,
+                                        (uint8_t const *) data + done,
+                                        size - done, MSG_NOSIGNAL);
+        if (nb_written < 0 && errno != EINTR) {
+            return false;
+        }
+        done += nb_written > 0 ? nb_written : 0;
+    }
+    return true;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Read what is available, up to size bytes.
+/// \param  connection
+/// \param  data
+/// \param  size
+/// \return Number of bytes read, 0 if none was available, -1 on error or end
+/// of connection.
+//  ----------------------------------------------------------------------------
+long network_receive(int const connection, void * const data,
+                     size_t const size)
+{
+    ssize_t const nb_read = recv(connection, data, size, 0);
+    if (nb_read == 0) {
+        return -1;
+    }
+    if (nb_read < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ?
+               0 : -1;
+    }
+    return nb_read;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Write what the connection accepts, up to size bytes.
+/// \param  connection
+/// \param  data
+/// \param  size
+/// \return Number of bytes written, -1 on error.
+//  ----------------------------------------------------------------------------
+long network_send(int const connection, void const * const data,
+                  size_t const size)
+{
+    // A connection closed by the other end must not kill the process.
+    ssize_t const nb_written = send(connection, data, size, MSG_NOSIGNAL);
+    if (nb_written < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ?
+               0 : -1;
+    }
+    return nb_written;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Wait until connections can be read from or written to.
+/// \param  connections
+/// \param  writing
+/// \param  nb_connections
+/// \param  readable
+/// \param  writable
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool network_wait(int const connections[], bool const writing[],
+                  int const nb_connections, bool readable[], bool writable[])
+{
+    struct pollfd *polls = malloc(nb_connections * sizeof *polls);
+    if (polls == NULL) {
+        fprintf(stderr, "%s: could not allocate polls.\n", __func__);
+        return false;
+    }
+    for (int i = 0; i < nb_connections; i++) {
+        polls[i] = (struct pollfd) {
+            .fd = connections[i],
+            .events = POLLIN | (writing[i] ? POLLOUT : 0)
+        };
+    }
+
+    int result;
+    do {
+        result = poll(polls, nb_connections, -1);
+    } while (result < 0 && errno == EINTR);
+
+    if (result < 0) {
+        fprintf(stderr, "%s: %s.\n", __func__, strerror(errno));
+    }
+    for (int i = 0; i < nb_connections; i++) {
+        readable[i] = polls[i].revents & (POLLIN | POLLHUP | POLLERR);
+        writable[i] = polls[i].revents & POLLOUT;
+    }
+    free(polls);
+    return result >= 0;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Fork a process connected to the caller by a Unix socket pair.
+/// \param  connection
+/// \param  inherited
+/// \param  nb_inherited
+/// \return Process id of the child in the parent, 0 in the child, -1 on
+/// failure.
+//  ----------------------------------------------------------------------------
+int network_process_fork(int * const connection, int const inherited[],
+                         int const nb_inherited)
+{
+    assert(connection);
+
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+        fprintf(stderr, "%s: %s.\n", __func__, strerror(errno));
+        return -1;
+    }
+
+    // Output buffered in the parent must not be printed twice.
+    fflush(NULL);
+    pid_t const process = fork();
+    if (process < 0) {
+        fprintf(stderr, "%s: %s.\n", __func__, strerror(errno));
+        close(pair[0]);
+        close(pair[1]);
+        return -1;
+    }
+
+    if (process == 0) {
+        for (int i = 0; i < nb_inherited; i++) {
+            close(inherited[i]);
+        }
+        close(pair[0]);
+        *connection = pair[1];
+    } else {
+        close(pair[1]);
+        *connection = pair[0];
+    }
+    return (int) process;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Wait for a child process to end.
+/// \param  process
+/// \return True if it exited with status 0.
+//  ----------------------------------------------------------------------------
+bool network_process_wait(int const process)
+{
+    int status;
+    pid_t result;
+    do {
+        result = waitpid((pid_t) process, &status, 0);
+    } while (result < 0 && errno == EINTR);
+
+    return result == process && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  End a child process immediately, without the cleanups of exit().
+/// \param  success
+//  ----------------------------------------------------------------------------
+void network_process_exit(bool const success)
+{
+    _exit(success ? 0 : 1);
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+static int unix_open(char const * const path, bool const listening)
+{
+    struct sockaddr_un name = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof name.sun_path) {
+        fprintf(stderr, "%s: path too long.\n", __func__);
+        return -1;
+    }
+    strcpy(name.sun_path, path);
+
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0) {
+        fprintf(stderr, "%s: %s.\n", __func__, strerror(errno));
+        return -1;
+    }
+
+    bool opened;
+    if (listening) {
+        unlink(path);
+        opened = bind(connection, (struct sockaddr *) &name, sizeof name) == 0
+                 && listen(connection, SOMAXCONN) == 0;
+    } else {
+        opened = connect(connection, (struct sockaddr *) &name,
+                         sizeof name) == 0;
+    }
+    if (!opened) {
+        fprintf(stderr, "%s: %s: %s.\n", __func__, path, strerror(errno));
+        close(connection);
+        return -1;
+    }
+    return connection;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Open a TCP connection, trying each address the host resolves to.
+/// \param  address "tcp:<host>:<port>", the host can be empty to listen on
+/// all interfaces.
+/// \param  listening
+/// \return Connection, -1 on failure.
+//  ----------------------------------------------------------------------------
+static int tcp_open(char const * const address, bool const listening)
+{
+    size_t const prefix_length = strlen(NETWORK_TCP_PREFIX);
+    char const *port = strrchr(address, ':');
+    char host[256];
+    if (strncmp(address, NETWORK_TCP_PREFIX, prefix_length) != 0
+        || port < &address[prefix_length]
+        || (size_t) (port - address) - prefix_length >= sizeof host) {
+        fprintf(stderr, "%s: invalid address %s.\n", __func__, address);
+        return -1;
+    }
+    size_t const host_length = (size_t) (port - address) - prefix_length;
+    memcpy(host, &address[prefix_length], host_length);
+    host[host_length] = '\0';
+    port++;
+
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_flags = listening ? AI_PASSIVE : 0
+    };
+    struct addrinfo *infos;
+    int const error = getaddrinfo(host[0] ? host : NULL, port, &hints, &infos);
+    if (error != 0) {
+        fprintf(stderr, "%s: %s: %s.\n", __func__, address,
+                gai_strerror(error));
+        return -1;
+    }
+
+    int connection = -1;
+    for (struct addrinfo *info = infos; info != NULL && connection < 0;
+         info = info->ai_next) {
+        connection = socket(info->ai_family, info->ai_socktype,
+                            info->ai_protocol);
+        if (connection < 0) {
+            continue;
+        }
+
+        bool opened;
+        if (listening) {
+            int const on = 1;
+            setsockopt(connection, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+            opened = bind(connection, info->ai_addr, info->ai_addrlen) == 0
+                     && listen(connection, SOMAXCONN) == 0;
+        } else {
+            opened = connect(connection, info->ai_addr, info->ai_addrlen) == 0;
+            nodelay_set(connection);
+        }
+        if (!opened) {
+            close(connection);
+            connection = -1;
+        }
+    }
+    freeaddrinfo(infos);
+
+    if (connection < 0) {
+        fprintf(stderr, "%s: could not open %s.\n", __func__, address);
+    }
+    return connection;
+}
+
+
+// Messages are small and answered, do not wait to fill packets. Fails
+// harmlessly on Unix connections.
+static void nodelay_set(int const connection)
+{
+    int const on = 1;
+    setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+}
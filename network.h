@@ -0,0 +1,124 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+#ifndef NETWORK_H_INCLUDED
+#define NETWORK_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Stream connections and worker processes. The system headers these need
+// declare their own register_t, so they are kept out of the modules using the
+// machine, which only see plain file descriptors and process ids here.
+
+//  ----------------------------------------------------------------------------
+/// \brief  Listen on an address.
+/// \param  address "unix:<path>" or "tcp:<host>:<port>". An existing socket
+/// file at path is replaced. Port 0 picks a free port, see network_port_get().
+/// \return Listening connection, -1 on failure.
+//  ----------------------------------------------------------------------------
+int network_listen(char const * const address);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the port a TCP connection is bound to.
+/// \param  connection
+/// \return Port, -1 on failure.
+//  ----------------------------------------------------------------------------
+int network_port_get(int const connection);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Accept a connection on a listening connection.
+/// \param  listener
+/// \return Accepted connection, -1 on failure.
+//  ----------------------------------------------------------------------------
+int network_accept(int const listener);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Connect to an address.
+/// \param  address As for network_listen().
+/// \return Connection, -1 on failure.
+//  ----------------------------------------------------------------------------
+int network_connect(char const * const address);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Close a connection.
+/// \param  connection
+//  ----------------------------------------------------------------------------
+void network_close(int const connection);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Make the transfers on a connection return instead of waiting.
+/// \param  connection
+/// \param  nonblocking
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool network_nonblocking_set(int const connection, bool const nonblocking);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Read exactly size bytes from a blocking connection.
+/// \return False on error or end of connection.
+//  ----------------------------------------------------------------------------
+bool network_read(int const connection, void * const data, size_t const size);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Write exactly size bytes to a blocking connection.
+/// \return False on error.
+//  ----------------------------------------------------------------------------
+bool network_write(int const connection, void const * const data,
+                   size_t const size);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Read what is available, up to size bytes.
+/// \return Number of bytes read, 0 if none was available, -1 on error or end
+/// of connection.
+//  ----------------------------------------------------------------------------
+long network_receive(int const connection, void * const data,
+                     size_t const size);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Write what the connection accepts, up to size bytes.
+/// \return Number of bytes written, -1 on error.
+//  ----------------------------------------------------------------------------
+long network_send(int const connection, void const * const data,
+                  size_t const size);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Wait until connections can be read from or written to.
+/// \param  connections
+/// \param  writing     For each connection, whether writing is wanted.
+/// \param  nb_connections
+/// \param  readable    Output, for each connection. End of connection and
+/// errors count as readable.
+/// \param  writable    Output, for each connection.
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+bool network_wait(int const connections[], bool const writing[],
+                  int const nb_connections, bool readable[], bool writable[]);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Fork a process connected to the caller.
+/// \param  connection  Output, the caller's end in the parent, the child's end
+/// in the child.
+/// \param  inherited   Connections the child must not keep open.
+/// \param  nb_inherited    Number of such connections.
+/// \return Process id of the child in the parent, 0 in the child, -1 on
+/// failure.
+//  ----------------------------------------------------------------------------
+int network_process_fork(int * const connection, int const inherited[],
+                         int const nb_inherited);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Wait for a child process to end.
+/// \param  process Process id.
+/// \return True if it exited with status 0.
+//  ----------------------------------------------------------------------------
+bool network_process_wait(int const process);
+
+//  ----------------------------------------------------------------------------
+/// \brief  End a child process immediately, without the cleanups of exit().
+/// \param  success Exit status 0 if true, 1 else.
+//  ----------------------------------------------------------------------------
+void network_process_exit(bool const success);
+
+#endif // NETWORK_H_INCLUDED
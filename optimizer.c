@@ -0,0 +1,282 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+#include "optimizer.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "expression.h"
+#include "genome.h"
+#include "machine/machine.h"
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+// Largest number of simplification rounds, each one after the previous one
+// made the program shorter.
+#define OPTIMIZER_ROUNDS_MAX    (8)
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+static int effective_keep(command_t const program[], int const nb_commands,
+                          command_t kept[], bool effective[]);
+static int values_simplify(expression_graph_t * const graph,
+                           command_t program[], int const nb_commands,
+                           int const nb_inputs);
+static command_t command_rewrite(expression_graph_t const * const graph,
+                                 int const registers[],
+                                 command_t const command, int const value);
+static int copy_operation_get(void);
+static bool immediate_get(register_value_t const value,
+                          int8_t * const immediate);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+//  ----------------------------------------------------------------------------
+/// \brief  Simplify a program, in a copy of its effective commands.
+/// \param  program
+/// \param  nb_commands
+/// \param  nb_inputs
+/// \param  simplified
+/// \return Number of commands of the simplified program, -1 on failure.
+//  ----------------------------------------------------------------------------
+int optimizer_program_simplify(command_t const program[],
+                               int const nb_commands, int const nb_inputs,
+                               command_t simplified[])
+{
+    assert(program || nb_commands == 0);
+    assert(simplified || nb_commands == 0);
+    assert(nb_commands >= 0);
+
+    if (nb_commands == 0) {
+        return 0;
+    }
+
+    // Operands of commutative operations are ordered, so that A + B and B + A
+    // are the same value.
+    expression_graph_t *graph = expression_graph_create(nb_commands, true);
+    command_t *work = malloc(nb_commands * sizeof *work);
+    bool *effective = malloc(nb_commands * sizeof *effective);
+    if (graph == NULL || work == NULL || effective == NULL) {
+        fprintf(stderr, "%s: could not allocate the program.\n", __func__);
+        expression_graph_destroy(&graph);
+        free(work);
+        free(effective);
+        return -1;
+    }
+
+    int size = effective_keep(program, nb_commands, work, effective);
+    for (int round = 0; round < OPTIMIZER_ROUNDS_MAX; round++) {
+        int const previous_size = size;
+        size = values_simplify(graph, work, size, nb_inputs);
+        size = effective_keep(work, size, work, effective);
+        if (size == previous_size) {
+            break;
+        }
+    }
+
+    memcpy(simplified, work, size * sizeof *work);
+    expression_graph_destroy(&graph);
+    free(work);
+    free(effective);
+    return size;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create a simplified copy of a genome.
+/// \param  genome
+/// \param  nb_inputs
+/// \return Pointer to the new genome, NULL on failure.
+//  ----------------------------------------------------------------------------
+genome_t *optimizer_genome_simplify(genome_t const * const genome,
+                                    int const nb_inputs)
+{
+    assert(genome);
+
+    int const size = genome_size_get(genome);
+    command_t *genes = malloc((size + 1) * sizeof *genes);
+    if (genes == NULL) {
+        fprintf(stderr, "%s: could not allocate genes.\n", __func__);
+        return NULL;
+    }
+    int const nb_genes = optimizer_program_simplify(genome_genes_get(genome),
+                                                    size, nb_inputs, genes);
+    genome_t *simplified = nb_genes < 0 ? NULL
+                           : genome_genes_create(genes, nb_genes);
+    free(genes);
+    return simplified;
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+// Copy the effective commands of a program for reg_A, kept can be program.
+static int effective_keep(command_t const program[], int const nb_commands,
+                          command_t kept[], bool effective[])
+{
+    machine_program_effective_mark(program, nb_commands, reg_A, effective);
+    int nb_kept = 0;
+    for (int i = 0; i < nb_commands; i++) {
+        if (effective[i]) {
+            kept[nb_kept++] = program[i];
+        }
+    }
+    return nb_kept;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Run a program symbolically, each register holding a node of the
+/// graph instead of a value, and rewrite it in place. A command is removed
+/// with the IF_LESS guarding it when the register it writes keeps its node.
+/// Otherwise it is rewritten to compute its value more simply, and guarded by
+/// the IF_LESS it needs: an IF_LESS that always runs its next command is
+/// removed, and so are the ones before it in a chain, which only decide
+/// whether it runs. All registers then hold the same values before each
+/// command kept as before the original command.
+/// \param  graph       Graph with room for the program, emptied first.
+/// \param  program     Program to simplify in place.
+/// \param  nb_commands
+/// \param  nb_inputs
+/// \return Number of commands of the simplified program.
+//  ----------------------------------------------------------------------------
+static int values_simplify(expression_graph_t * const graph,
+                           command_t program[], int const nb_commands,
+                           int const nb_inputs)
+{
+    int registers[NB_REGISTERS];
+    expression_graph_start(graph, nb_inputs, registers);
+
+    // Condition for the current command to run, -1 if it always does. The
+    // guarding chain of IF_LESS starts at chain_start.
+    int guard = -1;
+    int chain_start = 0;
+    int nb_kept = 0;
+    for (int i = 0; i < nb_commands; i++) {
+        command_t const command = program[i];
+        int const condition = guard;
+        guard = -1;
+
+        if (command.op == IF_LESS) {
+            if (condition < 0) {
+                chain_start = i;
+            }
+            guard = expression_guard_node(graph, condition, registers,
+                                          &command);
+            continue;
+        }
+
+        int const value = expression_command_node(graph, registers, &command);
+        int const old = registers[command.dst];
+        int const result = expression_select_node(graph, condition, value,
+                                                  old);
+        if (result == old) {
+            continue;
+        }
+
+        // Kept commands are never more than read ones, so the chain is not
+        // overwritten yet.
+        if (condition >= 0) {
+            for (int j = chain_start; j < i; j++) {
+                program[nb_kept++] = program[j];
+            }
+        }
+        program[nb_kept++] = command_rewrite(graph, registers, command, value);
+        registers[command.dst] = result;
+    }
+    return nb_kept;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get a command computing a value more simply than the original
+/// command: a LOAD for a constant that fits, or a copy of a register already
+/// holding the value, which no longer reads the other operand.
+/// \param  graph
+/// \param  registers   Nodes of the registers before the command.
+/// \param  command     Original command.
+/// \param  value       Node of the value computed by command.
+/// \return The command to run instead.
+//  ----------------------------------------------------------------------------
+static command_t command_rewrite(expression_graph_t const * const graph,
+                                 int const registers[],
+                                 command_t const command, int const value)
+{
+    expression_node_t const *node = expression_node_get(graph, value);
+    int8_t immediate;
+    if (node->kind == EXPRESSION_CONSTANT && MACHINE_OPERATION_ENABLED(LOAD)
+        && immediate_get(node->value, &immediate)) {
+        return (command_t) {
+            .dst = command.dst,
+            .op = LOAD,
+            .src1 = reg_A,
+            .src2 = (uint8_t) immediate
+        };
+    }
+    if (command.op == LOAD) {
+        return command;
+    }
+
+    int const copy_op = copy_operation_get();
+    int source = -1;
+    if (registers[command.src1] == value) {
+        source = command.src1;
+    } else if (registers[command.src2] == value) {
+        source = command.src2;
+    } else {
+        for (int r = 0; r < NB_REGISTERS && source < 0; r++) {
+            source = registers[r] == value ? r : -1;
+        }
+    }
+    if (copy_op < 0 || source < 0
+        || (command.src1 == source && command.src2 == source)) {
+        return command;
+    }
+    return (command_t) {
+        .dst = command.dst,
+        .op = copy_op,
+        .src1 = source,
+        .src2 = source
+    };
+}
+
+
+// Get an enabled operation giving x for operands x and x, -1 if there is none.
+static int copy_operation_get(void)
+{
+    static operation_t const copies[] = { MIN, MAX, AND, OR };
+    for (size_t i = 0; i < sizeof copies / sizeof copies[0]; i++) {
+        if (MACHINE_OPERATION_ENABLED(copies[i])) {
+            return copies[i];
+        }
+    }
+    return -1;
+}
+
+
+// Get the immediate of a LOAD giving exactly value, false if there is none.
+static bool immediate_get(register_value_t const value,
+                          int8_t * const immediate)
+{
+    if (!(value >= INT8_MIN && value <= INT8_MAX)) {
+        return false;
+    }
+    // Also rejects fractions and -0 in floating point registers.
+    register_value_t const loaded = (int8_t) value;
+    if (memcmp(&loaded, &value, sizeof value) != 0) {
+        return false;
+    }
+    *immediate = (int8_t) value;
+    return true;
+}
+
@@ -0,0 +1,45 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+#ifndef OPTIMIZER_H_INCLUDED
+#define OPTIMIZER_H_INCLUDED
+
+#include "genome.h"
+#include "machine/machine.h"
+
+// Shorter programs computing the same reg_A as evolved ones, for execution
+// and export. The result of reg_A is exactly the same for all inputs,
+// clamping and division by zero included; other registers may end up
+// different.
+
+//  ----------------------------------------------------------------------------
+/// \brief  Simplify a program. Only its effective commands are kept, then
+/// values are tracked through the program: operations on known values are
+/// computed, with the machine's own operations, and become LOADs when the
+/// value fits; operations whose result does not depend on an operand, such
+/// as X - X, X + 0 or a division by zero, are reduced; and commands writing
+/// the value a register already holds are removed with their IF_LESS. This
+/// is repeated as long as the program gets shorter.
+/// \param  program     Array of valid commands.
+/// \param  nb_commands Number of commands in program.
+/// \param  nb_inputs   Number of registers holding inputs. The other
+/// registers start at 0, as in the evaluator.
+/// \param  simplified  Output, room for nb_commands commands. Can be program.
+/// \return Number of commands of the simplified program, -1 on failure.
+//  ----------------------------------------------------------------------------
+int optimizer_program_simplify(command_t const program[],
+                               int const nb_commands, int const nb_inputs,
+                               command_t simplified[]);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create a simplified copy of a genome, see
+/// optimizer_program_simplify().
+/// \param  genome
+/// \param  nb_inputs   Number of registers holding inputs.
+/// \return Pointer to the new genome, NULL on failure.
+//  ----------------------------------------------------------------------------
+genome_t *optimizer_genome_simplify(genome_t const * const genome,
+                                    int const nb_inputs);
+
+#endif // OPTIMIZER_H_INCLUDED
@@ -0,0 +1,311 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+#define _POSIX_C_SOURCE 200809L
+
+#include "parallel.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "placement.h"
+
+//******************************************************************************
+// Type definitions
+//******************************************************************************
+// A range run from a new thread is pinned to node, unless it is negative.
+typedef struct {
+    parallel_work_t work;
+    void *context;
+    int begin;
+    int end;
+    int node;
+} range_t;
+
+struct parallel_task_s {
+    parallel_task_work_t work;
+    void *context;
+    pthread_t thread;
+    bool started;
+    // Set by the thread once work has returned.
+    bool done;
+};
+
+// Ring of capacity items, from first on.
+struct parallel_queue_s {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    void **items;
+    int capacity;
+    int first;
+    int nb_items;
+    bool closed;
+};
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+static void *range_run(void *range);
+static parallel_task_t *task_create(parallel_task_work_t work,
+                                    void *context);
+static void *task_run(void *task);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+void parallel_for(int const nb_items, int const nb_threads,
+                  parallel_work_t work, void *context)
+{
+    assert(work);
+
+    int nb_ranges = nb_threads < nb_items ? nb_threads : nb_items;
+    if (nb_ranges <= 1) {
+        work(context, 0, nb_items);
+        return;
+    }
+
+    range_t *ranges = malloc(nb_ranges * sizeof *ranges);
+    pthread_t *threads = malloc(nb_ranges * sizeof *threads);
+    bool *started = malloc(nb_ranges * sizeof *started);
+    if (ranges == NULL || threads == NULL || started == NULL) {
+        fprintf(stderr, "%s: running on a single thread.\n", __func__);
+        free(ranges);
+        free(threads);
+        free(started);
+        work(context, 0, nb_items);
+        return;
+    }
+
+    // With pinning, the ranges go to the nodes in order, as do the parts of
+    // placement_split_alloc().
+    int const nb_nodes = placement_pinning_get() ? placement_nb_nodes_get()
+                         : 1;
+    for (int i = 0; i < nb_ranges; i++) {
+        ranges[i] = (range_t) {
+            .work = work,
+            .context = context,
+            .begin = (int) ((long long) nb_items * i / nb_ranges),
+            .end = (int) ((long long) nb_items * (i + 1) / nb_ranges),
+            .node = nb_nodes > 1 ? (int) ((long long) nb_nodes * i
+                                          / nb_ranges) : -1
+        };
+    }
+
+    // The first range is run by the calling thread, which is left where it
+    // is. A range whose thread could not be created is run there too.
+    for (int i = 1; i < nb_ranges; i++) {
+        started[i] = pthread_create(&threads[i], NULL, range_run,
+                                    &ranges[i]) == 0;
+    }
+    ranges[0].node = -1;
+    range_run(&ranges[0]);
+    for (int i = 1; i < nb_ranges; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            ranges[i].node = -1;
+            range_run(&ranges[i]);
+        }
+    }
+
+    free(ranges);
+    free(threads);
+    free(started);
+}
+
+
+parallel_task_t *parallel_task_start(parallel_task_work_t work, void *context)
+{
+    parallel_task_t *task = task_create(work, context);
+    if (task != NULL && !task->started) {
+        fprintf(stderr, "%s: running on the calling thread.\n", __func__);
+        task_run(task);
+    }
+    return task;
+}
+
+
+parallel_task_t *parallel_task_try_start(parallel_task_work_t work,
+                                         void *context)
+{
+    parallel_task_t *task = task_create(work, context);
+    if (task != NULL && !task->started) {
+        fprintf(stderr, "%s: could not create a thread.\n", __func__);
+        free(task);
+        return NULL;
+    }
+    return task;
+}
+
+
+bool parallel_task_done(parallel_task_t const * const task)
+{
+    assert(task);
+    return __atomic_load_n(&task->done, __ATOMIC_ACQUIRE);
+}
+
+
+void parallel_task_join(parallel_task_t **task)
+{
+    assert(task);
+    if (*task == NULL) {
+        return;
+    }
+    if ((*task)->started) {
+        pthread_join((*task)->thread, NULL);
+    }
+    free(*task);
+    *task = NULL;
+}
+
+
+parallel_queue_t *parallel_queue_create(int const capacity)
+{
+    assert(capacity >= 1);
+
+    parallel_queue_t *queue = malloc(sizeof *queue);
+    void **items = malloc(capacity * sizeof *items);
+    if (queue == NULL || items == NULL) {
+        fprintf(stderr, "%s: could not allocate queue.\n", __func__);
+        free(queue);
+        free(items);
+        return NULL;
+    }
+    *queue = (parallel_queue_t) {
+        .items = items,
+        .capacity = capacity
+    };
+    if (pthread_mutex_init(&queue->lock, NULL) != 0) {
+        fprintf(stderr, "%s: could not create the lock.\n", __func__);
+        free(queue);
+        free(items);
+        return NULL;
+    }
+    if (pthread_cond_init(&queue->changed, NULL) != 0) {
+        fprintf(stderr, "%s: could not create the condition.\n", __func__);
+        pthread_mutex_destroy(&queue->lock);
+        free(queue);
+        free(items);
+        return NULL;
+    }
+    return queue;
+}
+
+
+void parallel_queue_destroy(parallel_queue_t **queue)
+{
+    assert(queue);
+    if (*queue == NULL) {
+        return;
+    }
+    pthread_cond_destroy(&(*queue)->changed);
+    pthread_mutex_destroy(&(*queue)->lock);
+    free((*queue)->items);
+    free(*queue);
+    *queue = NULL;
+}
+
+
+bool parallel_queue_push(parallel_queue_t * const queue, void *item)
+{
+    assert(queue);
+    assert(item);
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->nb_items == queue->capacity && !queue->closed) {
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    }
+    bool const open = !queue->closed;
+    if (open) {
+        queue->items[(queue->first + queue->nb_items) % queue->capacity] =
+            item;
+        queue->nb_items++;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return open;
+}
+
+
+void *parallel_queue_pop(parallel_queue_t * const queue)
+{
+    assert(queue);
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->nb_items == 0 && !queue->closed) {
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    }
+    void *item = NULL;
+    if (queue->nb_items > 0) {
+        item = queue->items[queue->first];
+        queue->first = (queue->first + 1) % queue->capacity;
+        queue->nb_items--;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return item;
+}
+
+
+void parallel_queue_close(parallel_queue_t * const queue)
+{
+    assert(queue);
+
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+
+int parallel_nb_processors_get(void)
+{
+    long nb_processors = sysconf(_SC_NPROCESSORS_ONLN);
+    return nb_processors < 1 ? 1 : (int) nb_processors;
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+static void *range_run(void *range)
+{
+    range_t *r = range;
+    if (r->node >= 0) {
+        placement_thread_pin(r->node);
+    }
+    r->work(r->context, r->begin, r->end);
+    return NULL;
+}
+
+
+// Allocate a task and start its thread, if one can be created.
+static parallel_task_t *task_create(parallel_task_work_t work, void *context)
+{
+    assert(work);
+
+    parallel_task_t *task = malloc(sizeof *task);
+    if (task == NULL) {
+        fprintf(stderr, "%s: could not allocate task.\n", __func__);
+        return NULL;
+    }
+    *task = (parallel_task_t) {
+        .work = work,
+        .context = context
+    };
+    task->started = pthread_create(&task->thread, NULL, task_run, task) == 0;
+    return task;
+}
+
+
+static void *task_run(void *task)
+{
+    parallel_task_t *t = task;
+    t->work(t->context);
+    __atomic_store_n(&t->done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
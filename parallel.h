@@ -0,0 +1,113 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+#ifndef PARALLEL_H_INCLUDED
+#define PARALLEL_H_INCLUDED
+
+#include <stdbool.h>
+
+// Work on the items [begin, end) of a range.
+typedef void (*parallel_work_t)(void *context, int begin, int end);
+
+// Work run in the background, see parallel_task_start().
+typedef void (*parallel_task_work_t)(void *context);
+typedef struct parallel_task_s parallel_task_t;
+
+// Queue of bounded capacity handing items from threads to threads, in the
+// order they were pushed.
+typedef struct parallel_queue_s parallel_queue_t;
+
+//  ----------------------------------------------------------------------------
+/// \brief  Split nb_items into contiguous ranges and run work on each range
+/// from its own thread. Returns when all ranges are done. The result must not
+/// depend on how the items are split. If placement pins threads, the ranges
+/// run from new threads are pinned to the nodes in order, see placement.h.
+/// \param  nb_items    Number of items.
+/// \param  nb_threads  Number of threads to use, the calling thread included.
+/// 1 or less runs everything from the calling thread.
+/// \param  work        Function to run on each range.
+/// \param  context     Passed to work.
+//  ----------------------------------------------------------------------------
+void parallel_for(int const nb_items, int const nb_threads,
+                  parallel_work_t work, void *context);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Run work on a thread of its own while the caller goes on. If no
+/// thread can be created, work is run from the calling thread before
+/// returning.
+/// \param  work
+/// \param  context     Passed to work.
+/// \return Pointer to the task, to be joined. NULL if it could not be
+/// allocated, work has not run then.
+//  ----------------------------------------------------------------------------
+parallel_task_t *parallel_task_start(parallel_task_work_t work, void *context);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Run work on a thread of its own while the caller goes on, only if
+/// a thread can be created.
+/// \param  work
+/// \param  context     Passed to work.
+/// \return Pointer to the task, to be joined. NULL if there is no thread, work
+/// has not run then.
+//  ----------------------------------------------------------------------------
+parallel_task_t *parallel_task_try_start(parallel_task_work_t work,
+                                         void *context);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Check whether the work of a task has returned, without waiting.
+/// \param  task
+/// \return True if it has.
+//  ----------------------------------------------------------------------------
+bool parallel_task_done(parallel_task_t const * const task);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Wait for the work of a task to return and free the task.
+/// \param  task    Set to NULL.
+//  ----------------------------------------------------------------------------
+void parallel_task_join(parallel_task_t **task);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create an empty queue.
+/// \param  capacity    Number of items the queue holds at most, at least 1.
+/// \return Pointer to the new queue, NULL on failure.
+//  ----------------------------------------------------------------------------
+parallel_queue_t *parallel_queue_create(int const capacity);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Free a queue and set the pointer to NULL. No thread may be waiting
+/// on it. The items left in it are not freed.
+/// \param  queue
+//  ----------------------------------------------------------------------------
+void parallel_queue_destroy(parallel_queue_t **queue);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Add an item at the end of a queue, waiting while it is full.
+/// \param  queue
+/// \param  item        Not NULL.
+/// \return False if the queue is closed, the item was not added.
+//  ----------------------------------------------------------------------------
+bool parallel_queue_push(parallel_queue_t * const queue, void *item);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Take the first item of a queue, waiting while it is empty and
+/// open.
+/// \param  queue
+/// \return Item, NULL once the queue is closed and empty.
+//  ----------------------------------------------------------------------------
+void *parallel_queue_pop(parallel_queue_t * const queue);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Close a queue: no item can be pushed any more, and the items left
+/// can still be popped.
+/// \param  queue
+//  ----------------------------------------------------------------------------
+void parallel_queue_close(parallel_queue_t * const queue);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the number of processors online.
+/// \return Number of processors, at least 1.
+//  ----------------------------------------------------------------------------
+int parallel_nb_processors_get(void);
+
+#endif // PARALLEL_H_INCLUDED
@@ -0,0 +1,408 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+#include "pipeline.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "evaluator.h"
+#include "fitness.h"
+#include "genome.h"
+#include "parallel.h"
+#include "randomizer.h"
+
+//******************************************************************************
+// Type definitions
+//******************************************************************************
+// Stages run on threads of their own, in this order, between selection and
+// replacement.
+typedef enum {
+    STAGE_VARIATION,
+    STAGE_EVALUATION,
+    NB_STAGES
+} stage_id_t;
+
+// Offspring of a batch, with their objectives once evaluated.
+typedef struct {
+    int index;
+    genome_t **offspring;
+    double *objectives;
+    bool success;
+} batch_t;
+
+typedef struct pipeline_s pipeline_t;
+
+// Work of a stage on a batch.
+typedef void (*stage_work_t)(pipeline_t const * const pipeline,
+                             batch_t * const batch);
+
+// A stage takes batches from its input queue, works on them and hands them to
+// its output queue, which it closes once its input is closed and empty. With
+// no thread of its own, it is run from the calling thread.
+typedef struct {
+    pipeline_t *pipeline;
+    stage_work_t work;
+    parallel_queue_t *input;
+    parallel_queue_t *output;
+    parallel_task_t *task;
+} stage_t;
+
+// Queue q is the input of stage q, the last one holds the evaluated batches.
+struct pipeline_s {
+    pipeline_config_t const *config;
+    evaluator_cases_t const *cases;
+    int nb_threads;
+    parallel_queue_t *queues[NB_STAGES + 1];
+    stage_t stages[NB_STAGES];
+};
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+// Index of the streams of a batch, per stage drawing from one.
+enum {
+    STREAM_SELECTION,
+    STREAM_VARIATION,
+    STREAM_REPLACEMENT
+};
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+static bool config_check(pipeline_config_t const * const config);
+static batch_t *batches_create(pipeline_config_t const * const config);
+static void batches_destroy(batch_t *batches,
+                            pipeline_config_t const * const config);
+static bool batch_select(batch_t * const batch, int const index,
+                         genome_t * const population[], int const nb_genomes,
+                         double const objectives[],
+                         pipeline_config_t const * const config);
+static void batch_vary(pipeline_t const * const pipeline,
+                       batch_t * const batch);
+static void batch_evaluate(pipeline_t const * const pipeline,
+                           batch_t * const batch);
+static void batch_replace(batch_t * const batch, genome_t *population[],
+                          int const nb_genomes, double objectives[],
+                          pipeline_config_t const * const config);
+static bool stage_step(stage_t * const stage);
+static void stage_run(void *stage);
+static int tournament_draw(double const objectives[], int const nb_genomes,
+                           int const nb_draws, bool const largest,
+                           random_stream_t * const stream);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+//  ----------------------------------------------------------------------------
+/// \brief  Evolve a population through the pipeline. The calling thread
+/// selects batch k, hands it over, then takes back batch k - depth once
+/// evaluated and replaces it. There are at most depth + 1 batches in flight,
+/// which is the capacity of each queue, so a push never waits on a stage
+/// waiting itself on the caller. A stage whose thread could not be created
+/// is stepped from the calling thread after each push.
+//  ----------------------------------------------------------------------------
+bool pipeline_run(genome_t *population[], int const nb_genomes,
+                  double objectives[], evaluator_cases_t const * const cases,
+                  pipeline_config_t const * const config,
+                  int const nb_threads)
+{
+    assert(population);
+    assert(objectives);
+    assert(cases);
+    assert(config);
+
+    if (nb_genomes < 1 || !config_check(config)) {
+        fprintf(stderr, "%s: invalid configuration.\n", __func__);
+        return false;
+    }
+
+    batch_t *batches = batches_create(config);
+    if (batches == NULL) {
+        return false;
+    }
+    pipeline_t pipeline = {
+        .config = config,
+        .cases = cases,
+        .nb_threads = nb_threads
+    };
+    bool success = true;
+    for (int q = 0; q <= NB_STAGES; q++) {
+        pipeline.queues[q] = parallel_queue_create(config->depth + 1);
+        success = success && pipeline.queues[q] != NULL;
+    }
+    if (!success) {
+        for (int q = 0; q <= NB_STAGES; q++) {
+            parallel_queue_destroy(&pipeline.queues[q]);
+        }
+        batches_destroy(batches, config);
+        return false;
+    }
+
+    stage_work_t const works[NB_STAGES] = {
+        [STAGE_VARIATION] = batch_vary,
+        [STAGE_EVALUATION] = batch_evaluate
+    };
+    for (int s = 0; s < NB_STAGES; s++) {
+        stage_t *stage = &pipeline.stages[s];
+        *stage = (stage_t) {
+            .pipeline = &pipeline,
+            .work = works[s],
+            .input = pipeline.queues[s],
+            .output = pipeline.queues[s + 1]
+        };
+        stage->task = parallel_task_try_start(stage_run, stage);
+    }
+
+    parallel_queue_t *evaluated = pipeline.queues[NB_STAGES];
+    int nb_replaced = 0;
+    for (int k = 0; k < config->nb_batches && success; k++) {
+        batch_t *batch = &batches[k % (config->depth + 1)];
+        if (!batch_select(batch, k, population, nb_genomes, objectives,
+                          config)) {
+            success = false;
+            break;
+        }
+        parallel_queue_push(pipeline.queues[0], batch);
+        for (int s = 0; s < NB_STAGES; s++) {
+            if (pipeline.stages[s].task == NULL) {
+                stage_step(&pipeline.stages[s]);
+            }
+        }
+
+        if (k >= config->depth) {
+            batch_t *done = parallel_queue_pop(evaluated);
+            assert(done && done->index == nb_replaced);
+            success = done->success;
+            if (success) {
+                batch_replace(done, population, nb_genomes, objectives,
+                              config);
+                nb_replaced++;
+            }
+        }
+    }
+
+    // Drain the pipeline, replacing the batches left as long as all went well.
+    parallel_queue_close(pipeline.queues[0]);
+    for (int s = 0; s < NB_STAGES; s++) {
+        if (pipeline.stages[s].task == NULL) {
+            while (stage_step(&pipeline.stages[s])) {
+            }
+        }
+    }
+    batch_t *done;
+    while ((done = parallel_queue_pop(evaluated)) != NULL) {
+        success = success && done->success;
+        if (success) {
+            assert(done->index == nb_replaced);
+            batch_replace(done, population, nb_genomes, objectives, config);
+            nb_replaced++;
+        }
+    }
+
+    for (int s = 0; s < NB_STAGES; s++) {
+        parallel_task_join(&pipeline.stages[s].task);
+    }
+    for (int q = 0; q <= NB_STAGES; q++) {
+        parallel_queue_destroy(&pipeline.queues[q]);
+    }
+    batches_destroy(batches, config);
+    return success;
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+static bool config_check(pipeline_config_t const * const config)
+{
+    return config->batch_size >= 1 && config->nb_batches >= 0
+           && config->depth >= 0 && config->tournament_size >= 1
+           && config->crossover_percent >= 0
+           && config->mutation_percent >= 0;
+}
+
+
+// Allocate the depth + 1 batches in flight, with no offspring yet.
+static batch_t *batches_create(pipeline_config_t const * const config)
+{
+    int const nb_batches = config->depth + 1;
+    batch_t *batches = calloc(nb_batches, sizeof *batches);
+    if (batches == NULL) {
+        fprintf(stderr, "%s: could not allocate batches.\n", __func__);
+        return NULL;
+    }
+    for (int b = 0; b < nb_batches; b++) {
+        batches[b].offspring = calloc(config->batch_size,
+                                      sizeof *batches[b].offspring);
+        batches[b].objectives = malloc(config->batch_size
+                                       * FITNESS_NB_OBJECTIVES
+                                       * sizeof *batches[b].objectives);
+        if (batches[b].offspring == NULL || batches[b].objectives == NULL) {
+            fprintf(stderr, "%s: could not allocate batches.\n", __func__);
+            batches_destroy(batches, config);
+            return NULL;
+        }
+    }
+    return batches;
+}
+
+
+static void batches_destroy(batch_t *batches,
+                            pipeline_config_t const * const config)
+{
+    for (int b = 0; b < config->depth + 1; b++) {
+        if (batches[b].offspring != NULL) {
+            for (int i = 0; i < config->batch_size; i++) {
+                if (batches[b].offspring[i] != NULL) {
+                    genome_destroy(&batches[b].offspring[i]);
+                }
+            }
+        }
+        free(batches[b].offspring);
+        free(batches[b].objectives);
+    }
+    free(batches);
+}
+
+
+// Pick the parents of a batch by tournament on the error and copy them into
+// the offspring, which share their genes until varied.
+static bool batch_select(batch_t * const batch, int const index,
+                         genome_t * const population[], int const nb_genomes,
+                         double const objectives[],
+                         pipeline_config_t const * const config)
+{
+    random_stream_t stream;
+    random_stream_init(&stream, config->seed, index + 1, STREAM_SELECTION);
+
+    batch->index = index;
+    batch->success = true;
+    for (int i = 0; i < config->batch_size; i++) {
+        int const parent = tournament_draw(objectives, nb_genomes,
+                                           config->tournament_size, false,
+                                           &stream);
+        genome_copy(&batch->offspring[i], population[parent]);
+        if (batch->offspring[i] == NULL) {
+            fprintf(stderr, "%s: could not copy a parent.\n", __func__);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Cross over consecutive offspring in pairs, then mutate them.
+static void batch_vary(pipeline_t const * const pipeline,
+                       batch_t * const batch)
+{
+    pipeline_config_t const *config = pipeline->config;
+    random_stream_t stream;
+    random_stream_init(&stream, config->seed, batch->index + 1,
+                       STREAM_VARIATION);
+
+    for (int i = 0; i + 1 < config->batch_size; i += 2) {
+        if (random_stream_get(&stream, 100) < config->crossover_percent) {
+            genome_crossover_r(batch->offspring[i], batch->offspring[i + 1],
+                               &stream);
+        }
+    }
+    for (int i = 0; i < config->batch_size; i++) {
+        if (random_stream_get(&stream, 100) < config->mutation_percent) {
+            genome_mutate_r(batch->offspring[i], &stream);
+        }
+    }
+}
+
+
+static void batch_evaluate(pipeline_t const * const pipeline,
+                           batch_t * const batch)
+{
+    batch->success = fitness_population_evaluate(batch->offspring,
+                                                 pipeline->config->batch_size,
+                                                 pipeline->cases,
+                                                 batch->objectives,
+                                                 pipeline->nb_threads);
+}
+
+
+// Each offspring replaces the worst of a few random genomes, unless it is
+// worse. The replaced genomes are destroyed, the others stay in the batch.
+static void batch_replace(batch_t * const batch, genome_t *population[],
+                          int const nb_genomes, double objectives[],
+                          pipeline_config_t const * const config)
+{
+    random_stream_t stream;
+    random_stream_init(&stream, config->seed, batch->index + 1,
+                       STREAM_REPLACEMENT);
+
+    for (int i = 0; i < config->batch_size; i++) {
+        int const loser = tournament_draw(objectives, nb_genomes,
+                                          config->tournament_size, true,
+                                          &stream);
+        double const *offspring_objectives =
+            &batch->objectives[i * FITNESS_NB_OBJECTIVES];
+        double *loser_objectives = &objectives[loser * FITNESS_NB_OBJECTIVES];
+        if (offspring_objectives[FITNESS_ERROR]
+            > loser_objectives[FITNESS_ERROR]) {
+            continue;
+        }
+        genome_destroy(&population[loser]);
+        population[loser] = batch->offspring[i];
+        batch->offspring[i] = NULL;
+        memcpy(loser_objectives, offspring_objectives,
+               FITNESS_NB_OBJECTIVES * sizeof *loser_objectives);
+    }
+}
+
+
+// Run a stage on the next batch of its input.
+// Return false once the input is closed and empty, the output is closed then.
+static bool stage_step(stage_t * const stage)
+{
+    batch_t *batch = parallel_queue_pop(stage->input);
+    if (batch == NULL) {
+        parallel_queue_close(stage->output);
+        return false;
+    }
+    // A failed batch goes through untouched, its failure is reported on
+    // replacement.
+    if (batch->success) {
+        stage->work(stage->pipeline, batch);
+    }
+    parallel_queue_push(stage->output, batch);
+    return true;
+}
+
+
+// Thread of a stage. parallel_task_work_t.
+static void stage_run(void *stage)
+{
+    while (stage_step(stage)) {
+    }
+}
+
+
+// Index of the genome of smallest error, or of largest if largest is set,
+// among nb_draws random ones. Ties go to the first drawn.
+static int tournament_draw(double const objectives[], int const nb_genomes,
+                           int const nb_draws, bool const largest,
+                           random_stream_t * const stream)
+{
+    int best = random_stream_get(stream, nb_genomes);
+    for (int i = 1; i < nb_draws; i++) {
+        int const other = random_stream_get(stream, nb_genomes);
+        double const error = objectives[other * FITNESS_NB_OBJECTIVES
+                                        + FITNESS_ERROR];
+        double const best_error = objectives[best * FITNESS_NB_OBJECTIVES
+                                             + FITNESS_ERROR];
+        if (largest ? error > best_error : error < best_error) {
+            best = other;
+        }
+    }
+    return best;
+}
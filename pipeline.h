@@ -0,0 +1,55 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+#ifndef PIPELINE_H_INCLUDED
+#define PIPELINE_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "evaluator.h"
+#include "genome.h"
+
+// Steady state evolution as a pipeline of stages on threads of their own,
+// handing batches of offspring to each other through bounded queues:
+// selection of the parents and copy, from the calling thread; crossover and
+// mutation; evaluation; and replacement into the population, from the calling
+// thread again. A batch is bred while the batches before it are in variation
+// or evaluation, from the population as it is once the batch depth + 1
+// batches earlier is replaced. This lag is fixed, and each stage draws from
+// its own stream per batch, so the result only depends on the seed and on the
+// configuration, not on the threads.
+typedef struct {
+    int batch_size;         // Number of offspring per batch.
+    int nb_batches;         // Number of batches to breed.
+    int depth;              // Batches bred ahead of the replacement.
+    int tournament_size;    // Genomes drawn per selection and replacement.
+    int crossover_percent;  // Chance that a pair of offspring crosses over.
+    int mutation_percent;   // Chance that an offspring mutates.
+    uint64_t seed;
+} pipeline_config_t;
+
+//  ----------------------------------------------------------------------------
+/// \brief  Evolve a population through the pipeline. Parents are picked by
+/// tournament on the error, consecutive offspring of a batch are crossed
+/// over in pairs and mutated. Each offspring of an evaluated batch then
+/// competes against the genome of largest error among tournament_size random
+/// ones, and replaces it unless it has a larger error, so the best genome is
+/// never lost. The streams of batch k are those of generation k + 1 of the
+/// seed, indices 0 to 2 for selection, variation and replacement.
+/// \param  population  Array of genomes, updated.
+/// \param  nb_genomes  Number of genomes, at least 1.
+/// \param  objectives  FITNESS_NB_OBJECTIVES values per genome of the
+/// population on input, updated with it.
+/// \param  cases       Fitness cases, with targets.
+/// \param  config
+/// \param  nb_threads  Number of threads of the evaluation.
+/// \return True if no error. The population is valid in any case.
+//  ----------------------------------------------------------------------------
+bool pipeline_run(genome_t *population[], int const nb_genomes,
+                  double objectives[], evaluator_cases_t const * const cases,
+                  pipeline_config_t const * const config,
+                  int const nb_threads);
+
+#endif // PIPELINE_H_INCLUDED
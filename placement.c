@@ -0,0 +1,439 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+#define _GNU_SOURCE
+
+#include "placement.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+#define PLACEMENT_NODES_MAX     (64)
+
+// Bytes before the memory of an arena, to keep it aligned on cache lines.
+#define PLACEMENT_HEADER_SIZE   (64)
+
+#define PLACEMENT_HUGE_PAGE     ((size_t) 2 << 20)
+
+#define PLACEMENT_SYSFS_NODES   "/sys/devices/system/node"
+
+// From <numaif.h>, which is not part of the C library: prefer the node, and
+// fall back to others once it is full.
+#define PLACEMENT_MPOL_PREFERRED    (1)
+
+//******************************************************************************
+// Type definitions
+//******************************************************************************
+// Nodes of the machine as listed by the kernel: node n has the system id
+// ids[n] and runs on the CPUs of cpus[n].
+typedef struct {
+    int nb_nodes;
+    int ids[PLACEMENT_NODES_MAX];
+    cpu_set_t cpus[PLACEMENT_NODES_MAX];
+} topology_t;
+
+// Start of every arena, before the memory handed out.
+typedef struct {
+    size_t length;  // Length of the mapping, header included.
+} arena_header_t;
+
+// Without copies, data is used by all nodes.
+struct placement_replicas_s {
+    void const *data;
+    int nb_copies;
+    void *copies[PLACEMENT_NODES_MAX];
+};
+
+//******************************************************************************
+// Module variables
+//******************************************************************************
+static placement_config_t config;
+
+static topology_t topology = { .nb_nodes = 1 };
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+static void topology_read(void);
+static int list_parse(char const *list, int values[], int const nb_max);
+static bool file_read(char const * const path, char buffer[],
+                      size_t const size);
+static void *arena_map(size_t const size, size_t * const granule);
+static void range_bind(char * const base, size_t const begin,
+                       size_t const end, size_t const granule,
+                       int const node);
+static size_t round_up(size_t const value, size_t const granule);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+void placement_config_set(placement_config_t const * const new_config)
+{
+    assert(new_config);
+    config = *new_config;
+}
+
+
+int placement_nb_nodes_get(void)
+{
+    if (!config.numa) {
+        return 1;
+    }
+    pthread_once(&topology_once, topology_read);
+    return topology.nb_nodes;
+}
+
+
+bool placement_pinning_get(void)
+{
+    return config.pin_threads && placement_nb_nodes_get() > 1;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the node the calling thread runs on, from the CPU it is on.
+//  ----------------------------------------------------------------------------
+int placement_node_current_get(void)
+{
+    if (placement_nb_nodes_get() <= 1) {
+        return 0;
+    }
+#ifdef SYS_getcpu
+    unsigned cpu;
+    unsigned id;
+    if (syscall(SYS_getcpu, &cpu, &id, NULL) == 0) {
+        for (int n = 0; n < topology.nb_nodes; n++) {
+            if ((unsigned) topology.ids[n] == id) {
+                return n;
+            }
+        }
+    }
+#endif
+    return 0;
+}
+
+
+bool placement_wanted(size_t const size)
+{
+    return placement_nb_nodes_get() > 1
+           || (config.pages != PLACEMENT_PAGES_SMALL
+               && size >= PLACEMENT_HUGE_MIN);
+}
+
+
+void *placement_alloc(size_t const size, int const node)
+{
+    size_t granule;
+    char *base = arena_map(size, &granule);
+    if (base == NULL) {
+        return NULL;
+    }
+    if (node != PLACEMENT_NODE_ANY) {
+        range_bind(base, 0, PLACEMENT_HEADER_SIZE + size, granule, node);
+    }
+    return base + PLACEMENT_HEADER_SIZE;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Allocate an arena split in parts over the nodes. The parts are
+/// bound before any page is touched, so each page is first allocated on the
+/// node of its part.
+//  ----------------------------------------------------------------------------
+void *placement_split_alloc(size_t const ends[], int const nb_parts)
+{
+    assert(ends);
+    assert(nb_parts >= 1);
+
+    size_t granule;
+    char *base = arena_map(ends[nb_parts - 1], &granule);
+    if (base == NULL) {
+        return NULL;
+    }
+    int const nb_nodes = placement_nb_nodes_get();
+    if (nb_nodes > 1) {
+        size_t begin = 0;
+        for (int p = 0; p < nb_parts; p++) {
+            size_t const end = PLACEMENT_HEADER_SIZE + ends[p];
+            range_bind(base, begin, end, granule, p % nb_nodes);
+            begin = end;
+        }
+    }
+    return base + PLACEMENT_HEADER_SIZE;
+}
+
+
+void placement_free(void *memory)
+{
+    if (memory == NULL) {
+        return;
+    }
+    char *base = (char *) memory - PLACEMENT_HEADER_SIZE;
+    munmap(base, ((arena_header_t *) base)->length);
+}
+
+
+bool placement_thread_pin(int const node)
+{
+    int const nb_nodes = placement_nb_nodes_get();
+    if (nb_nodes <= 1) {
+        return true;
+    }
+    assert(node >= 0 && node < nb_nodes);
+    if (CPU_COUNT(&topology.cpus[node]) == 0) {
+        return false;
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof (cpu_set_t),
+                                  &topology.cpus[node]) == 0;
+}
+
+
+placement_replicas_t *placement_replicas_create(void const * const data,
+                                                size_t const size)
+{
+    assert(data || size == 0);
+
+    placement_replicas_t *replicas = calloc(1, sizeof *replicas);
+    if (replicas == NULL) {
+        fprintf(stderr, "%s: could not allocate the replicas.\n", __func__);
+        return NULL;
+    }
+    replicas->data = data;
+    if (!placement_wanted(size)) {
+        return replicas;
+    }
+
+    int const nb_nodes = placement_nb_nodes_get();
+    for (int n = 0; n < nb_nodes; n++) {
+        replicas->copies[n] = placement_alloc(size,
+                                              nb_nodes > 1 ? n
+                                              : PLACEMENT_NODE_ANY);
+        if (replicas->copies[n] == NULL) {
+            fprintf(stderr, "%s: could not allocate a copy.\n", __func__);
+            placement_replicas_destroy(&replicas);
+            return NULL;
+        }
+        replicas->nb_copies++;
+        memcpy(replicas->copies[n], data, size);
+    }
+    return replicas;
+}
+
+
+void placement_replicas_destroy(placement_replicas_t **replicas)
+{
+    assert(replicas);
+    if (*replicas == NULL) {
+        return;
+    }
+    for (int n = 0; n < (*replicas)->nb_copies; n++) {
+        placement_free((*replicas)->copies[n]);
+    }
+    free(*replicas);
+    *replicas = NULL;
+}
+
+
+void const *placement_replica_get(placement_replicas_t const * const replicas)
+{
+    assert(replicas);
+    if (replicas->nb_copies == 0) {
+        return replicas->data;
+    }
+    return replicas->copies[placement_node_current_get()
+                            % replicas->nb_copies];
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+//  ----------------------------------------------------------------------------
+/// \brief  Read the nodes and their CPUs from sysfs. Anything unexpected
+/// leaves a single node.
+//  ----------------------------------------------------------------------------
+static void topology_read(void)
+{
+    char buffer[4096];
+    int ids[PLACEMENT_NODES_MAX];
+    if (!file_read(PLACEMENT_SYSFS_NODES "/online", buffer, sizeof buffer)) {
+        return;
+    }
+    int const nb_nodes = list_parse(buffer, ids, PLACEMENT_NODES_MAX);
+    if (nb_nodes <= 1) {
+        return;
+    }
+
+    topology_t nodes = { .nb_nodes = nb_nodes };
+    for (int n = 0; n < nb_nodes; n++) {
+        char path[64];
+        snprintf(path, sizeof path, PLACEMENT_SYSFS_NODES "/node%d/cpulist",
+                 ids[n]);
+        int cpus[CPU_SETSIZE];
+        if (!file_read(path, buffer, sizeof buffer)) {
+            return;
+        }
+        int const nb_cpus = list_parse(buffer, cpus, CPU_SETSIZE);
+        if (nb_cpus < 0) {
+            return;
+        }
+        nodes.ids[n] = ids[n];
+        CPU_ZERO(&nodes.cpus[n]);
+        for (int c = 0; c < nb_cpus; c++) {
+            CPU_SET(cpus[c], &nodes.cpus[n]);
+        }
+    }
+    topology = nodes;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Parse a list of the kernel, such as "0-3,8,10-11".
+/// \param  list
+/// \param  values  Output, the values in the list.
+/// \param  nb_max  Size of values. Values at or above it are invalid.
+/// \return Number of values, -1 if the list is invalid.
+//  ----------------------------------------------------------------------------
+static int list_parse(char const *list, int values[], int const nb_max)
+{
+    int nb_values = 0;
+    while (*list != '\0' && *list != '\n') {
+        int first;
+        int last;
+        int length;
+        if (sscanf(list, "%d-%d%n", &first, &last, &length) == 2) {
+            list += length;
+        } else if (sscanf(list, "%d%n", &first, &length) == 1) {
+            last = first;
+            list += length;
+        } else {
+            return -1;
+        }
+        if (first < 0 || last < first || last >= nb_max
+            || nb_values + last - first + 1 > nb_max) {
+            return -1;
+        }
+        for (int value = first; value <= last; value++) {
+            values[nb_values++] = value;
+        }
+        if (*list == ',') {
+            list++;
+        }
+    }
+    return nb_values;
+}
+
+
+static bool file_read(char const * const path, char buffer[],
+                      size_t const size)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    size_t const nb_read = fread(buffer, 1, size - 1, file);
+    fclose(file);
+    buffer[nb_read] = '\0';
+    return nb_read > 0;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Map an arena and write its header. Large arenas get huge pages as
+/// configured, reserved ones falling back to transparent ones.
+/// \param  size    Size of the memory after the header.
+/// \param  granule Output, size of the pages of the mapping.
+/// \return Start of the mapping, NULL on failure.
+//  ----------------------------------------------------------------------------
+static void *arena_map(size_t const size, size_t * const granule)
+{
+    bool const huge = config.pages != PLACEMENT_PAGES_SMALL
+                      && size >= PLACEMENT_HUGE_MIN;
+    size_t const page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t length = round_up(PLACEMENT_HEADER_SIZE + size,
+                             huge ? PLACEMENT_HUGE_PAGE : page);
+    void *base = MAP_FAILED;
+    *granule = page;
+
+#ifdef MAP_HUGETLB
+    if (huge && config.pages == PLACEMENT_PAGES_HUGE) {
+        base = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        *granule = base != MAP_FAILED ? PLACEMENT_HUGE_PAGE : page;
+    }
+#endif
+    if (base == MAP_FAILED) {
+        base = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            fprintf(stderr, "%s: could not map %zu bytes.\n", __func__,
+                    length);
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        if (huge) {
+            // A hint only, the arena works without.
+            madvise(base, length, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+    ((arena_header_t *) base)->length = length;
+    return base;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Bind the pages from the one holding begin, unless it is shared with
+/// the part before, to the one holding end - 1, to a node. Failures are
+/// ignored, the pages then go wherever the kernel puts them.
+/// \param  base    Start of the mapping.
+/// \param  begin   Offset of the part in the mapping.
+/// \param  end     Offset of the end of the part.
+/// \param  granule Size of the pages.
+/// \param  node    Index of the node.
+//  ----------------------------------------------------------------------------
+static void range_bind(char * const base, size_t const begin,
+                       size_t const end, size_t const granule,
+                       int const node)
+{
+#ifdef SYS_mbind
+    size_t const first = begin == 0 ? 0 : round_up(begin, granule);
+    size_t const last = round_up(end, granule);
+    if (placement_nb_nodes_get() <= 1 || first >= last) {
+        return;
+    }
+    unsigned long mask[PLACEMENT_NODES_MAX / (8 * sizeof (unsigned long))]
+        = { 0 };
+    int const id = topology.ids[node];
+    mask[id / (8 * sizeof *mask)] |= 1UL << (id % (8 * sizeof *mask));
+    syscall(SYS_mbind, base + first, last - first, PLACEMENT_MPOL_PREFERRED,
+            mask, (unsigned long) (8 * sizeof mask + 1), 0);
+#else
+    (void) base;
+    (void) begin;
+    (void) end;
+    (void) granule;
+    (void) node;
+#endif
+}
+
+
+static size_t round_up(size_t const value, size_t const granule)
+{
+    return (value + granule - 1) / granule * granule;
+}
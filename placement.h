@@ -0,0 +1,131 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+#ifndef PLACEMENT_H_INCLUDED
+#define PLACEMENT_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Placement of large memory arenas and of threads on the NUMA nodes of the
+// machine. Nothing is placed unless configured: by default the arenas of
+// the other modules come from malloc() and threads run anywhere. The system
+// headers this needs declare their own register_t, so they are kept out of
+// the modules using the machine. On a single node machine, or where the
+// system does not support it, placement falls back to plain memory and
+// unpinned threads.
+
+// Pages used for large arenas.
+typedef enum {
+    PLACEMENT_PAGES_SMALL,
+    PLACEMENT_PAGES_TRANSPARENT,   // Huge pages given by the kernel if it can.
+    PLACEMENT_PAGES_HUGE           // Reserved huge pages, else transparent.
+} placement_pages_t;
+
+typedef struct {
+    bool numa;                  // Spread arenas and threads over the nodes.
+    bool pin_threads;           // Pin the threads of parallel_for().
+    placement_pages_t pages;    // Pages of arenas of PLACEMENT_HUGE_MIN bytes.
+} placement_config_t;
+
+// Arenas at least this large are given huge pages if configured.
+#define PLACEMENT_HUGE_MIN  ((size_t) 2 << 20)
+
+// Node argument for memory placed on no node in particular.
+#define PLACEMENT_NODE_ANY  (-1)
+
+// Copies of read only data, one per node, see placement_replicas_create().
+typedef struct placement_replicas_s placement_replicas_t;
+
+//  ----------------------------------------------------------------------------
+/// \brief  Configure placement. To be called before any thread or arena is
+/// created with the configuration.
+/// \param  config  Copied.
+//  ----------------------------------------------------------------------------
+void placement_config_set(placement_config_t const * const config);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the number of nodes arenas and threads are spread over.
+/// \return 1 unless numa is configured and the machine has several nodes.
+//  ----------------------------------------------------------------------------
+int placement_nb_nodes_get(void);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get whether the threads of parallel_for() are to be pinned.
+/// \return True if pin_threads is configured and there are several nodes.
+//  ----------------------------------------------------------------------------
+bool placement_pinning_get(void);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the node the calling thread runs on.
+/// \return Index of the node in [0, placement_nb_nodes_get()).
+//  ----------------------------------------------------------------------------
+int placement_node_current_get(void);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Whether an arena of this size is to be allocated with
+/// placement_alloc() rather than malloc().
+/// \param  size    Size of the arena in bytes.
+/// \return True if the arena would be spread over nodes or get huge pages.
+//  ----------------------------------------------------------------------------
+bool placement_wanted(size_t const size);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Allocate a zeroed arena on a node.
+/// \param  size    Size in bytes.
+/// \param  node    Index of the node, or PLACEMENT_NODE_ANY.
+/// \return Pointer to the arena, aligned on 64 bytes, to be freed with
+/// placement_free(). NULL on failure.
+//  ----------------------------------------------------------------------------
+void *placement_alloc(size_t const size, int const node);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Allocate a zeroed arena split in parts, part n on node
+/// n % placement_nb_nodes_get(). A page shared by two parts goes to the
+/// first.
+/// \param  ends    End of each part, in bytes from the start of the arena,
+/// increasing. The last is the size of the arena.
+/// \param  nb_parts    Number of parts, at least 1.
+/// \return As placement_alloc().
+//  ----------------------------------------------------------------------------
+void *placement_split_alloc(size_t const ends[], int const nb_parts);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Free an arena of placement_alloc() or placement_split_alloc().
+/// \param  memory  Can be NULL.
+//  ----------------------------------------------------------------------------
+void placement_free(void *memory);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Pin the calling thread to the CPUs of a node. Does nothing on a
+/// single node.
+/// \param  node    Index of the node.
+/// \return True if the thread is pinned or there is nothing to pin to.
+//  ----------------------------------------------------------------------------
+bool placement_thread_pin(int const node);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Copy read only data to each node. If placement is not wanted for
+/// its size, no copy is made and the data itself is used.
+/// \param  data    Must outlive the replicas.
+/// \param  size    Size in bytes.
+/// \return Pointer to the new replicas, NULL on failure.
+//  ----------------------------------------------------------------------------
+placement_replicas_t *placement_replicas_create(void const * const data,
+                                                size_t const size);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Free replicas and set the pointer to NULL.
+/// \param  replicas
+//  ----------------------------------------------------------------------------
+void placement_replicas_destroy(placement_replicas_t **replicas);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the copy on the node of the calling thread.
+/// \param  replicas
+/// \return Pointer to the copy.
+//  ----------------------------------------------------------------------------
+void const *placement_replica_get(placement_replicas_t const * const replicas);
+
+#endif // PLACEMENT_H_INCLUDED
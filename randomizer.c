@@ -3,28 +3,125 @@ Copyright (c) 2013 Gauthier Fleutot Östervall
 ----------------------------------------------------------------------------*/
 #include "randomizer.h"
 
+#include <assert.h>
 #include <stdbool.h>
-#include <stdlib.h>
+#include <stdint.h>
 #include <time.h>
 
+//******************************************************************************
+// Module constants
+//******************************************************************************
+// Increment of the SplitMix64 generator.
+#define GOLDEN_GAMMA    (0x9e3779b97f4a7c15ULL)
 
 //******************************************************************************
 // Module variables
 //******************************************************************************
 static bool randomizer_seeded = false;
+static random_stream_t default_stream;
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+static uint64_t mix64(uint64_t z);
 
 //******************************************************************************
 // Function definitions
 //******************************************************************************
 int random_get(const int limit)
+{
+    return random_stream_get(random_default_stream_get(), limit);
+}
+
+
+void random_seed_set(uint64_t const seed)
+{
+    random_stream_init(&default_stream, seed, 0, 0);
+    randomizer_seeded = true;
+}
+
+
+random_stream_t *random_default_stream_get(void)
 {
     if (!randomizer_seeded) {
-        srand(time(NULL));
-        randomizer_seeded = true;
+        random_seed_set((uint64_t) time(NULL));
+    }
+    return &default_stream;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Initialize a stream. The coordinates are mixed one after the other,
+/// so that streams of neighbouring coordinates are unrelated.
+//  ----------------------------------------------------------------------------
+void random_stream_init(random_stream_t * const stream, uint64_t const seed,
+                        uint64_t const generation, uint64_t const index)
+{
+    assert(stream);
+    stream->key = mix64(mix64(mix64(seed) + generation) + index);
+    stream->counter = 0;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Draw n of a stream is SplitMix64 at position key + n * gamma, which
+/// only depends on the key and on n.
+//  ----------------------------------------------------------------------------
+uint64_t random_stream_next(random_stream_t * const stream)
+{
+    assert(stream);
+    stream->counter++;
+    return mix64(stream->key + stream->counter * GOLDEN_GAMMA);
+}
+
+
+void random_stream_fill(random_stream_t * const stream, uint64_t * const words,
+                        int const nb_words)
+{
+    assert(stream);
+    assert(words || nb_words == 0);
+
+    uint64_t const key = stream->key;
+    uint64_t const counter = stream->counter;
+    for (int i = 0; i < nb_words; i++) {
+        words[i] = mix64(key + (counter + 1 + i) * GOLDEN_GAMMA);
+    }
+    stream->counter += nb_words;
+}
+
+
+int random_stream_get(random_stream_t * const stream, const int limit)
+{
+    if (limit <= 0) {
+        return 0;
     }
+    // Scale the upper 32 bits to the limit, which avoids the modulo. The bias
+    // is negligible for the limits used here.
+    uint64_t bits = random_stream_next(stream) >> 32;
+    return (int) ((bits * (uint64_t) limit) >> 32);
+}
 
-    // This does not give real uniformity, but since random returns long int and
-    // limit is not expect to be very large, it is enough.
-    return (int) (rand() % limit);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Mix the bits of a word.
+/// \param  word
+/// \return Mixed word.
+//  ----------------------------------------------------------------------------
+uint64_t random_mix(uint64_t const word)
+{
+    return mix64(word);
 }
 
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+//  ----------------------------------------------------------------------------
+/// \brief  SplitMix64 finalizer.
+//  ----------------------------------------------------------------------------
+static uint64_t mix64(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
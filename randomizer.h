@@ -5,6 +5,81 @@ Copyright (c) 2013 Gauthier Fleutot Östervall
 #ifndef RANDOMIZE_H_INCLUDED
 #define RANDOMIZE_H_INCLUDED
 
+#include <stdint.h>
+
+// Counter based random stream. Draw n of a stream is a pure function of the
+// stream key and n, and the key is a pure function of the coordinates the
+// stream was initialized with. Streams for different genomes can therefore be
+// used from any thread in any order and give the same results.
+typedef struct {
+    uint64_t key;
+    uint64_t counter;
+} random_stream_t;
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get a random number from the default stream.
+/// \param  limit   Upper limit, excluded.
+/// \return Random number in [0, limit), 0 if limit is not positive.
+//  ----------------------------------------------------------------------------
 int random_get(const int limit);
 
+//  ----------------------------------------------------------------------------
+/// \brief  Seed the default stream. If this is not called, the default stream
+/// is seeded from the time on first use.
+/// \param  seed
+//  ----------------------------------------------------------------------------
+void random_seed_set(uint64_t const seed);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the default stream, used by random_get().
+/// \return Pointer to the default stream.
+//  ----------------------------------------------------------------------------
+random_stream_t *random_default_stream_get(void);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Initialize a stream for the given coordinates.
+/// \param  stream      Stream to initialize.
+/// \param  seed        Seed of the run.
+/// \param  generation  Generation number.
+/// \param  index       Index of the genome, or of any other item, in the
+/// generation.
+//  ----------------------------------------------------------------------------
+void random_stream_init(random_stream_t * const stream, uint64_t const seed,
+                        uint64_t const generation, uint64_t const index);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Draw the next 64 random bits of a stream.
+/// \param  stream
+/// \return Random bits.
+//  ----------------------------------------------------------------------------
+uint64_t random_stream_next(random_stream_t * const stream);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Draw the next nb_words random words of a stream at once. Gives the
+/// same words as nb_words calls to random_stream_next(), but the draws are
+/// independent of each other and the loop vectorizes.
+/// \param  stream
+/// \param  words       Output array.
+/// \param  nb_words    Number of words to draw.
+//  ----------------------------------------------------------------------------
+void random_stream_fill(random_stream_t * const stream, uint64_t * const words,
+                        int const nb_words);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Draw a random number from a stream.
+/// \param  stream
+/// \param  limit   Upper limit, excluded.
+/// \return Random number in [0, limit), 0 if limit is not positive.
+//  ----------------------------------------------------------------------------
+int random_stream_get(random_stream_t * const stream, const int limit);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Mix the bits of a word with the SplitMix64 finalizer, the one the
+/// streams are built on. A bijection spreading each input bit over all output
+/// bits, for hashing.
+/// \param  word
+/// \return Mixed word.
+//  ----------------------------------------------------------------------------
+uint64_t random_mix(uint64_t const word);
+
 #endif // RANDOMIZE_H_INCLUDED
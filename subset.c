@@ -0,0 +1,402 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+#include "subset.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "evaluator.h"
+#include "fitness.h"
+#include "genome.h"
+#include "randomizer.h"
+
+//******************************************************************************
+// Type definitions
+//******************************************************************************
+// Key of a case for the draw without replacement, or error of a genome for
+// the choice of the elites. Sorted by decreasing key, then increasing index.
+typedef struct {
+    double key;
+    int index;
+} keyed_t;
+
+// The cases of the last evaluation are indices[0] to indices[size - 1],
+// gathered into inputs and targets, which cases_subset points to. failures
+// counts the genomes failing each of them during an evaluation.
+struct subset_s {
+    evaluator_cases_t const *cases;
+    subset_config_t config;
+    double *difficulties;
+    double *ages;
+    int *indices;
+    bool drawn;
+    register_value_t *inputs;
+    register_value_t *targets;
+    evaluator_cases_t cases_subset;
+    int *failures;
+    keyed_t *keys;
+};
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+// Outputs of at most this many values are kept at a time, the genomes are
+// run by batches.
+#define SUBSET_BATCH_VALUES (1 << 22)
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+static bool config_check(subset_config_t const * const config,
+                         int const nb_cases);
+static void cases_draw(subset_t * const subset, uint64_t const generation);
+static void failures_count(subset_t * const subset,
+                           register_value_t const outputs[],
+                           int const nb_genomes);
+static bool elites_rescore(subset_t const * const subset,
+                           genome_t * const population[],
+                           int const nb_genomes, double objectives[],
+                           bool rescored[], int const nb_threads);
+static int key_order(void const *a, void const *b);
+static int index_order(void const *a, void const *b);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+subset_t *subset_create(evaluator_cases_t const * const cases,
+                        subset_config_t const * const config)
+{
+    assert(cases);
+    assert(config);
+
+    if (cases->targets == NULL || !config_check(config, cases->nb_cases)) {
+        fprintf(stderr, "%s: invalid configuration.\n", __func__);
+        return NULL;
+    }
+
+    int const nb_cases = cases->nb_cases;
+    int const size = config->size;
+    subset_t *subset = calloc(1, sizeof *subset);
+    if (subset == NULL) {
+        fprintf(stderr, "%s: could not allocate the subset.\n", __func__);
+        return NULL;
+    }
+    subset->cases = cases;
+    subset->config = *config;
+    subset->difficulties = calloc(nb_cases, sizeof *subset->difficulties);
+    subset->ages = malloc(nb_cases * sizeof *subset->ages);
+    subset->keys = malloc(nb_cases * sizeof *subset->keys);
+    subset->indices = malloc(size * sizeof *subset->indices);
+    subset->failures = malloc(size * sizeof *subset->failures);
+    subset->inputs = malloc(((size_t) size * cases->nb_inputs + 1)
+                            * sizeof *subset->inputs);
+    subset->targets = malloc(size * sizeof *subset->targets);
+    if (subset->difficulties == NULL || subset->ages == NULL
+        || subset->keys == NULL || subset->indices == NULL
+        || subset->failures == NULL || subset->inputs == NULL
+        || subset->targets == NULL) {
+        fprintf(stderr, "%s: could not allocate the subset.\n", __func__);
+        subset_destroy(&subset);
+        return NULL;
+    }
+    for (int c = 0; c < nb_cases; c++) {
+        subset->ages[c] = 1.0;
+    }
+    return subset;
+}
+
+
+void subset_destroy(subset_t **subset)
+{
+    assert(subset);
+    if (*subset == NULL) {
+        return;
+    }
+    free((*subset)->difficulties);
+    free((*subset)->ages);
+    free((*subset)->keys);
+    free((*subset)->indices);
+    free((*subset)->failures);
+    free((*subset)->inputs);
+    free((*subset)->targets);
+    free(*subset);
+    *subset = NULL;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Evaluate a generation on a subset of the cases. The genomes are run
+/// by batches on the gathered cases, the failures of each case being counted
+/// from the outputs of each batch.
+//  ----------------------------------------------------------------------------
+bool subset_population_evaluate(subset_t * const subset,
+                                genome_t * const population[],
+                                int const nb_genomes,
+                                uint64_t const generation,
+                                double objectives[], bool rescored[],
+                                int const nb_threads)
+{
+    assert(subset);
+    assert(population || nb_genomes == 0);
+    assert(objectives || nb_genomes == 0);
+
+    subset_config_t const *config = &subset->config;
+    int const size = config->size;
+    cases_draw(subset, generation);
+    evaluator_cases_gather(subset->cases, subset->indices, size,
+                           subset->inputs, subset->targets,
+                           &subset->cases_subset);
+    memset(subset->failures, 0, size * sizeof *subset->failures);
+
+    // The subset is copied to each node as the cases are.
+    evaluator_replicas_t *replicas = NULL;
+    if (subset->cases->replicas != NULL) {
+        replicas = evaluator_cases_replicate(&subset->cases_subset);
+        if (replicas == NULL) {
+            fprintf(stderr, "%s: could not replicate the subset.\n", __func__);
+            return false;
+        }
+        subset->cases_subset.replicas = replicas;
+    }
+
+    int batch_size = nb_genomes < SUBSET_BATCH_VALUES / size ? nb_genomes
+                     : SUBSET_BATCH_VALUES / size;
+    batch_size = batch_size > 0 ? batch_size : 1;
+    register_value_t *outputs = malloc((size_t) batch_size * size
+                                       * sizeof *outputs);
+    if (outputs == NULL) {
+        fprintf(stderr, "%s: could not allocate outputs.\n", __func__);
+        subset->cases_subset.replicas = NULL;
+        evaluator_replicas_destroy(&replicas);
+        return false;
+    }
+
+    bool success = true;
+    for (int first = 0; first < nb_genomes && success; first += batch_size) {
+        int const nb = nb_genomes - first < batch_size ? nb_genomes - first
+                       : batch_size;
+        double *batch_objectives =
+            &objectives[(size_t) first * FITNESS_NB_OBJECTIVES];
+        success = evaluator_population_run(&population[first], nb,
+                                           &subset->cases_subset, outputs,
+                                           nb_threads)
+                  && fitness_outputs_evaluate(&population[first], nb,
+                                              &subset->cases_subset, outputs,
+                                              batch_objectives, nb_threads);
+        if (success) {
+            failures_count(subset, outputs, nb);
+        }
+    }
+    free(outputs);
+    subset->cases_subset.replicas = NULL;
+    evaluator_replicas_destroy(&replicas);
+    if (!success) {
+        return false;
+    }
+
+    double const scale = (double) subset->cases->nb_cases / size;
+    for (int g = 0; g < nb_genomes; g++) {
+        objectives[g * FITNESS_NB_OBJECTIVES + FITNESS_ERROR] *= scale;
+    }
+
+    // A drawn case gets its difficulty and starts again at age 0, the others
+    // grow older.
+    for (int c = 0; c < subset->cases->nb_cases; c++) {
+        subset->ages[c] += 1.0;
+    }
+    for (int i = 0; i < size; i++) {
+        subset->difficulties[subset->indices[i]] = subset->failures[i];
+        subset->ages[subset->indices[i]] = 0.0;
+    }
+
+    if (rescored != NULL) {
+        memset(rescored, 0, nb_genomes * sizeof *rescored);
+    }
+    if (config->rescore_interval > 0 && config->nb_elites > 0
+        && generation % config->rescore_interval == 0) {
+        return elites_rescore(subset, population, nb_genomes, objectives,
+                              rescored, nb_threads);
+    }
+    return true;
+}
+
+
+int const *subset_indices_get(subset_t const * const subset,
+                              int * const nb_indices)
+{
+    assert(subset);
+    assert(nb_indices);
+    *nb_indices = subset->drawn ? subset->config.size : 0;
+    return subset->drawn ? subset->indices : NULL;
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+static bool config_check(subset_config_t const * const config,
+                         int const nb_cases)
+{
+    return config->size >= 1 && config->size <= nb_cases
+           && config->difficulty_exponent >= 0.0
+           && config->age_exponent >= 0.0
+           && config->epsilon >= 0.0
+           && config->rescore_interval >= 0
+           && config->nb_elites >= 0;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Draw the cases of a generation without replacement, in proportion
+/// to their weights: each case gets the key log(u) / weight for a uniform u
+/// in (0, 1], and the size cases of largest keys are drawn (Efraimidis and
+/// Spirakis). A case of weight 0 is only drawn if the others are too few. The
+/// indices are then sorted, so the cases are gathered in memory order.
+/// \param  subset
+/// \param  generation
+//  ----------------------------------------------------------------------------
+static void cases_draw(subset_t * const subset, uint64_t const generation)
+{
+    subset_config_t const *config = &subset->config;
+    random_stream_t stream;
+    random_stream_init(&stream, config->seed, generation, 0);
+
+    int const nb_cases = subset->cases->nb_cases;
+    for (int c = 0; c < nb_cases; c++) {
+        double const weight =
+            pow(subset->difficulties[c], config->difficulty_exponent)
+            + pow(subset->ages[c], config->age_exponent);
+        double const u = ((random_stream_next(&stream) >> 11) + 1)
+                         * 0x1p-53;
+        subset->keys[c] = (keyed_t) {
+            .key = weight > 0.0 ? log(u) / weight : -INFINITY,
+            .index = c
+        };
+    }
+    qsort(subset->keys, nb_cases, sizeof *subset->keys, key_order);
+    for (int i = 0; i < config->size; i++) {
+        subset->indices[i] = subset->keys[i].index;
+    }
+    qsort(subset->indices, config->size, sizeof *subset->indices,
+          index_order);
+    subset->drawn = true;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Count the genomes failing each case of the subset, those whose
+/// output is further than epsilon from the target.
+/// \param  subset
+/// \param  outputs     config.size values per genome.
+/// \param  nb_genomes
+//  ----------------------------------------------------------------------------
+static void failures_count(subset_t * const subset,
+                           register_value_t const outputs[],
+                           int const nb_genomes)
+{
+    int const size = subset->config.size;
+    double const epsilon = subset->config.epsilon;
+    for (int g = 0; g < nb_genomes; g++) {
+        register_value_t const *genome_outputs = &outputs[(size_t) g * size];
+        for (int i = 0; i < size; i++) {
+            double const difference =
+                (double) genome_outputs[i] - subset->targets[i];
+            subset->failures[i] += difference > epsilon
+                                   || difference < -epsilon;
+        }
+    }
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Evaluate the genomes of least estimated error on all cases, and
+/// replace their objectives. Ties are broken by index.
+/// \param  subset
+/// \param  population
+/// \param  nb_genomes
+/// \param  objectives  Estimated objectives, updated.
+/// \param  rescored    Set for the elites. Can be NULL.
+/// \param  nb_threads
+/// \return True if no error.
+//  ----------------------------------------------------------------------------
+static bool elites_rescore(subset_t const * const subset,
+                           genome_t * const population[],
+                           int const nb_genomes, double objectives[],
+                           bool rescored[], int const nb_threads)
+{
+    int const nb_elites = subset->config.nb_elites < nb_genomes ?
+                          subset->config.nb_elites : nb_genomes;
+    if (nb_elites == 0) {
+        return true;
+    }
+
+    keyed_t *errors = malloc(nb_genomes * sizeof *errors);
+    genome_t **elites = malloc(nb_elites * sizeof *elites);
+    double *elite_objectives = malloc(nb_elites * FITNESS_NB_OBJECTIVES
+                                      * sizeof *elite_objectives);
+    if (errors == NULL || elites == NULL || elite_objectives == NULL) {
+        fprintf(stderr, "%s: could not allocate the elites.\n", __func__);
+        free(errors);
+        free(elites);
+        free(elite_objectives);
+        return false;
+    }
+
+    // Negated, so that the least errors come first.
+    for (int g = 0; g < nb_genomes; g++) {
+        errors[g] = (keyed_t) {
+            .key = -objectives[g * FITNESS_NB_OBJECTIVES + FITNESS_ERROR],
+            .index = g
+        };
+    }
+    qsort(errors, nb_genomes, sizeof *errors, key_order);
+    for (int e = 0; e < nb_elites; e++) {
+        elites[e] = population[errors[e].index];
+    }
+
+    bool const success = fitness_population_evaluate(elites, nb_elites,
+                                                     subset->cases,
+                                                     elite_objectives,
+                                                     nb_threads);
+    for (int e = 0; e < nb_elites && success; e++) {
+        int const g = errors[e].index;
+        memcpy(&objectives[g * FITNESS_NB_OBJECTIVES],
+               &elite_objectives[e * FITNESS_NB_OBJECTIVES],
+               FITNESS_NB_OBJECTIVES * sizeof *objectives);
+        if (rescored != NULL) {
+            rescored[g] = true;
+        }
+    }
+
+    free(errors);
+    free(elites);
+    free(elite_objectives);
+    return success;
+}
+
+
+static int key_order(void const *a, void const *b)
+{
+    keyed_t const *x = a;
+    keyed_t const *y = b;
+    if (x->key != y->key) {
+        return x->key < y->key ? 1 : -1;
+    }
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+
+static int index_order(void const *a, void const *b)
+{
+    int const x = *(int const *) a;
+    int const y = *(int const *) b;
+    return (x > y) - (x < y);
+}
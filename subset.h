@@ -0,0 +1,88 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+#ifndef SUBSET_H_INCLUDED
+#define SUBSET_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "evaluator.h"
+#include "genome.h"
+
+// Dynamic subset selection of the fitness cases: each generation is evaluated
+// on a subset of the cases only, drawn without replacement with a weight per
+// case of difficulty^difficulty_exponent + age^age_exponent. The difficulty
+// of a case is the number of genomes that failed it when it was last
+// evaluated, its age the number of generations since then. Cases the whole
+// population solves are drawn less and less, until their age brings them
+// back. The cases of the subset are gathered into compact arrays, so the run
+// only reads them. If the cases have replicas, the gathered cases are copied
+// to each NUMA node for each evaluation, see evaluator_cases_replicate().
+typedef struct {
+    int size;                   // Cases evaluated per generation.
+    double difficulty_exponent;
+    double age_exponent;
+    double epsilon;             // Largest absolute error of a solved case.
+    int rescore_interval;       // Generations between rescorings, 0 never.
+    int nb_elites;              // Genomes of least error rescored.
+    uint64_t seed;
+} subset_config_t;
+
+typedef struct subset_s subset_t;
+
+//  ----------------------------------------------------------------------------
+/// \brief  Create a subset selection over fitness cases. All cases start with
+/// the same weight.
+/// \param  cases   All fitness cases, with targets. Must outlive the subset
+/// selection.
+/// \param  config  Copied. size must be in [1, nb_cases].
+/// \return Pointer to the new subset selection, NULL on failure.
+//  ----------------------------------------------------------------------------
+subset_t *subset_create(evaluator_cases_t const * const cases,
+                        subset_config_t const * const config);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Free a subset selection and set the pointer to NULL.
+/// \param  subset
+//  ----------------------------------------------------------------------------
+void subset_destroy(subset_t **subset);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Evaluate a generation on a subset of the cases. The subset is drawn
+/// from the stream of index 0 of the generation, then the objectives are
+/// computed on it, the error being scaled by nb_cases / size to estimate the
+/// error on all cases. The difficulties and ages of the cases are then
+/// updated. Every rescore_interval generations, from generation 0, the
+/// nb_elites genomes of least estimated error are evaluated again on all
+/// cases, and get their exact objectives.
+/// \param  subset
+/// \param  population  Array of genomes.
+/// \param  nb_genomes  Number of genomes.
+/// \param  generation
+/// \param  objectives  Output array of FITNESS_NB_OBJECTIVES values per
+/// genome, genome after genome.
+/// \param  rescored    Output array, whether the objectives of each genome are
+/// on all cases. Can be NULL.
+/// \param  nb_threads  Number of threads to use.
+/// \return True if no error. The difficulties and ages are only updated then.
+//  ----------------------------------------------------------------------------
+bool subset_population_evaluate(subset_t * const subset,
+                                genome_t * const population[],
+                                int const nb_genomes,
+                                uint64_t const generation,
+                                double objectives[], bool rescored[],
+                                int const nb_threads);
+
+//  ----------------------------------------------------------------------------
+/// \brief  Get the cases of the last evaluation.
+/// \param  subset
+/// \param  nb_indices  Output, number of cases, 0 before any evaluation.
+/// \return Indices of the cases in increasing order, NULL before any
+/// evaluation.
+//  ----------------------------------------------------------------------------
+int const *subset_indices_get(subset_t const * const subset,
+                              int * const nb_indices);
+
+#endif // SUBSET_H_INCLUDED
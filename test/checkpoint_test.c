@@ -0,0 +1,302 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+// Module under test.
+#include "../checkpoint.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../genome.h"
+#include "../randomizer.h"
+
+
+//******************************************************************************
+// Module macros
+//******************************************************************************
+#define TEST_START_PRINT()    do {              \
+        printf("Running %s...", __func__);      \
+        fflush(stdout);                         \
+    } while (0)
+
+#define TEST_END_PRINT()  do {                  \
+        printf("OK.\n");                        \
+    } while (0)
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+#define NB_GENOMES      (500)
+#define NB_OBJECTIVES   (3)
+#define NB_STREAMS      (2)
+#define NB_GENERATIONS  (10)
+#define CHECKPOINT_PATH "/tmp/checkpoint_test.ckpt"
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+// Test functions.
+static void test_checkpoint_save_load(void);
+static void test_checkpoint_writer(void);
+static void test_checkpoint_resume(void);
+static void test_checkpoint_invalid(void);
+static void state_create(checkpoint_state_t * const state);
+static bool states_equal(checkpoint_state_t const * const state1,
+                         checkpoint_state_t const * const state2);
+static void generation_run(checkpoint_state_t * const state);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+int main(void)
+{
+    test_checkpoint_save_load();
+    test_checkpoint_writer();
+    test_checkpoint_resume();
+    test_checkpoint_invalid();
+    remove(CHECKPOINT_PATH);
+    printf("All tests passed.\n");
+}
+
+
+static void test_checkpoint_save_load(void)
+{
+    TEST_START_PRINT();
+    checkpoint_state_t state;
+    state_create(&state);
+
+    for (int nb_threads = 1; nb_threads <= 3; nb_threads++) {
+        assert(checkpoint_save(CHECKPOINT_PATH, &state));
+        checkpoint_state_t loaded;
+        assert(checkpoint_load(CHECKPOINT_PATH, &loaded, nb_threads));
+        assert(states_equal(&state, &loaded));
+        checkpoint_state_free(&loaded);
+        assert(loaded.population == NULL);
+    }
+
+    // An empty state is valid too.
+    checkpoint_state_t empty = { .generation = 7 };
+    assert(checkpoint_save(CHECKPOINT_PATH, &empty));
+    checkpoint_state_t loaded;
+    assert(checkpoint_load(CHECKPOINT_PATH, &loaded, 2));
+    assert(states_equal(&empty, &loaded));
+    checkpoint_state_free(&loaded);
+
+    checkpoint_state_free(&state);
+    TEST_END_PRINT();
+}
+
+
+// The state saved is the one at the time of the start, even if the caller goes
+// on modifying it during the save.
+static void test_checkpoint_writer(void)
+{
+    TEST_START_PRINT();
+    checkpoint_writer_t *writer = checkpoint_writer_create();
+    assert(writer);
+    assert(!checkpoint_writer_busy(writer));
+    assert(checkpoint_writer_wait(writer));
+
+    checkpoint_state_t state;
+    state_create(&state);
+    checkpoint_state_t expected;
+    state_create(&expected);
+
+    assert(checkpoint_writer_start(writer, CHECKPOINT_PATH, &state));
+    for (int g = 0; g < 3; g++) {
+        generation_run(&state);
+    }
+    assert(checkpoint_writer_wait(writer));
+    assert(!checkpoint_writer_busy(writer));
+
+    checkpoint_state_t loaded;
+    assert(checkpoint_load(CHECKPOINT_PATH, &loaded, 2));
+    assert(states_equal(&expected, &loaded));
+    assert(!states_equal(&state, &loaded));
+    checkpoint_state_free(&loaded);
+
+    // A new save waits for the previous one.
+    assert(checkpoint_writer_start(writer, CHECKPOINT_PATH, &expected));
+    assert(checkpoint_writer_start(writer, CHECKPOINT_PATH, &state));
+    checkpoint_writer_destroy(&writer);
+    assert(writer == NULL);
+    assert(checkpoint_load(CHECKPOINT_PATH, &loaded, 1));
+    assert(states_equal(&state, &loaded));
+    checkpoint_state_free(&loaded);
+
+    checkpoint_state_free(&expected);
+    checkpoint_state_free(&state);
+    TEST_END_PRINT();
+}
+
+
+// An evolution resumed from a checkpoint ends as if it had not stopped.
+static void test_checkpoint_resume(void)
+{
+    TEST_START_PRINT();
+    checkpoint_writer_t *writer = checkpoint_writer_create();
+    assert(writer);
+
+    checkpoint_state_t state;
+    state_create(&state);
+    for (int g = 0; g < NB_GENERATIONS; g++) {
+        if (g == NB_GENERATIONS / 2) {
+            assert(checkpoint_writer_start(writer, CHECKPOINT_PATH, &state));
+        }
+        generation_run(&state);
+    }
+    checkpoint_writer_destroy(&writer);
+
+    checkpoint_state_t resumed;
+    assert(checkpoint_load(CHECKPOINT_PATH, &resumed, 2));
+    assert(resumed.generation == NB_GENERATIONS / 2);
+    while (resumed.generation < NB_GENERATIONS) {
+        generation_run(&resumed);
+    }
+    assert(states_equal(&state, &resumed));
+
+    checkpoint_state_free(&resumed);
+    checkpoint_state_free(&state);
+    TEST_END_PRINT();
+}
+
+
+static void test_checkpoint_invalid(void)
+{
+    TEST_START_PRINT();
+    checkpoint_state_t state;
+    state_create(&state);
+    assert(checkpoint_save(CHECKPOINT_PATH, &state));
+
+    FILE *file = fopen(CHECKPOINT_PATH, "rb");
+    assert(file);
+    fseek(file, 0, SEEK_END);
+    long const size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = malloc(size);
+    assert(data);
+    assert(fread(data, 1, size, file) == (size_t) size);
+    fclose(file);
+
+    printf("\n\tExpect error messages:\n");
+    fflush(stdout);
+    checkpoint_state_t loaded;
+    assert(!checkpoint_load("/tmp/checkpoint_test_missing.ckpt", &loaded, 1));
+    assert(loaded.population == NULL);
+
+    // Truncated, with trailing data, and with a wrong magic.
+    long const sizes[] = { 10, size / 2, size - 1, size };
+    for (int i = 0; i < 4; i++) {
+        file = fopen(CHECKPOINT_PATH, "wb");
+        assert(file);
+        if (i == 3) {
+            data[0] ^= 1;
+        }
+        assert(fwrite(data, 1, sizes[i], file) == (size_t) sizes[i]);
+        if (i == 2) {
+            fputc(0, file);
+            fputc(0, file);
+        }
+        fclose(file);
+        assert(!checkpoint_load(CHECKPOINT_PATH, &loaded, 2));
+        assert(loaded.population == NULL && loaded.nb_genomes == 0);
+    }
+
+    // No directory to write into.
+    assert(!checkpoint_save("/tmp/checkpoint_test_missing/file", &state));
+
+    free(data);
+    checkpoint_state_free(&state);
+    TEST_END_PRINT();
+}
+
+
+// A state with random genomes and objectives, the same on every call.
+static void state_create(checkpoint_state_t * const state)
+{
+    genome_size_distribution_t const distribution = {
+        .size_min = 0,
+        .size_max = 100,
+        .nb_ramps = 0
+    };
+
+    *state = (checkpoint_state_t) {
+        .generation = 0,
+        .population = malloc(NB_GENOMES * sizeof *state->population),
+        .nb_genomes = NB_GENOMES,
+        .objectives = malloc(NB_GENOMES * NB_OBJECTIVES
+                             * sizeof *state->objectives),
+        .nb_objectives = NB_OBJECTIVES,
+        .streams = malloc(NB_STREAMS * sizeof *state->streams),
+        .nb_streams = NB_STREAMS
+    };
+    assert(state->population && state->objectives && state->streams);
+    assert(genome_population_random_create(state->population, NB_GENOMES,
+                                           &distribution, 1234, 2));
+    for (int i = 0; i < NB_STREAMS; i++) {
+        random_stream_init(&state->streams[i], 1234, 0, i);
+    }
+    for (int i = 0; i < NB_GENOMES * NB_OBJECTIVES; i++) {
+        state->objectives[i] = (double) (int64_t) random_stream_next(
+            &state->streams[0]) / 3.0;
+    }
+    state->objectives[1] = -0.0;
+    state->objectives[2] = 1.0 / 0.0;
+}
+
+
+// Compare the objectives bit for bit.
+static bool states_equal(checkpoint_state_t const * const state1,
+                         checkpoint_state_t const * const state2)
+{
+    if (state1->generation != state2->generation
+        || state1->nb_genomes != state2->nb_genomes
+        || state1->nb_objectives != state2->nb_objectives
+        || state1->nb_streams != state2->nb_streams) {
+        return false;
+    }
+    for (int i = 0; i < state1->nb_streams; i++) {
+        if (state1->streams[i].key != state2->streams[i].key
+            || state1->streams[i].counter != state2->streams[i].counter) {
+            return false;
+        }
+    }
+    size_t const nb_values = (size_t) state1->nb_genomes
+        * state1->nb_objectives;
+    if (nb_values > 0 && memcmp(state1->objectives, state2->objectives,
+                                nb_values * sizeof (double)) != 0) {
+        return false;
+    }
+    for (int i = 0; i < state1->nb_genomes; i++) {
+        if (!genome_compare(state1->population[i], state2->population[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// A mock generation, drawing from the streams of the state.
+static void generation_run(checkpoint_state_t * const state)
+{
+    for (int i = 0; i < state->nb_genomes; i++) {
+        genome_mutate_r(state->population[i], &state->streams[0]);
+        int const other = random_stream_get(&state->streams[1],
+                                            state->nb_genomes);
+        if (other != i) {
+            genome_crossover_r(state->population[i],
+                               state->population[other], &state->streams[1]);
+        }
+        for (int k = 0; k < state->nb_objectives; k++) {
+            state->objectives[i * state->nb_objectives + k] +=
+                genome_size_get(state->population[i]);
+        }
+    }
+    state->generation++;
+}
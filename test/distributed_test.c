@@ -0,0 +1,187 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+// Module under test.
+#include "../distributed.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "../evaluator.h"
+#include "../fitness.h"
+#include "../genome.h"
+#include "../network.h"
+
+
+//******************************************************************************
+// Module macros
+//******************************************************************************
+#define TEST_START_PRINT()    do {              \
+        printf("Running %s...", __func__);      \
+        fflush(stdout);                         \
+    } while (0)
+
+#define TEST_END_PRINT()  do {                  \
+        printf("OK.\n");                        \
+    } while (0)
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+#define NB_GENOMES  (300)
+#define NB_CASES    (100)
+#define NB_WORKERS  (3)
+
+//******************************************************************************
+// Module variables
+//******************************************************************************
+static register_value_t inputs[NB_CASES * 2];
+static register_value_t targets[NB_CASES];
+static evaluator_cases_t const cases = {
+    .nb_cases = NB_CASES,
+    .nb_inputs = 2,
+    .inputs = inputs,
+    .targets = targets
+};
+static genome_t *population[NB_GENOMES];
+static double expected[NB_GENOMES * FITNESS_NB_OBJECTIVES];
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+// Test functions.
+static void test_distributed_spawned_workers(void);
+static void test_distributed_addresses(void);
+static bool population_check(distributed_master_t * const master,
+                             int const batch_size);
+static int worker_start(char const * const address);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+int main(void)
+{
+    for (int c = 0; c < NB_CASES; c++) {
+        inputs[2 * c] = (register_value_t) (c % 20);
+        inputs[2 * c + 1] = (register_value_t) (c / 20);
+        targets[c] = (register_value_t) (inputs[2 * c] * inputs[2 * c + 1]);
+    }
+    assert(genome_population_random_create(population, NB_GENOMES,
+                                           &genome_size_distribution_default,
+                                           4, 1));
+    assert(fitness_population_evaluate(population, NB_GENOMES, &cases,
+                                       expected, 1));
+
+    test_distributed_spawned_workers();
+    test_distributed_addresses();
+
+    for (int g = 0; g < NB_GENOMES; g++) {
+        genome_destroy(&population[g]);
+    }
+    printf("All tests passed.\n");
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+static void test_distributed_spawned_workers(void)
+{
+    TEST_START_PRINT();
+    int connections[NB_WORKERS];
+    int processes[NB_WORKERS];
+
+    assert(distributed_workers_spawn(NB_WORKERS, 1, connections, processes));
+    distributed_master_t *master = distributed_master_create(connections,
+                                                             NB_WORKERS,
+                                                             &cases);
+    assert(master != NULL);
+
+    // Batches of one, uneven batches, a batch larger than the population.
+    assert(population_check(master, 1));
+    assert(population_check(master, 7));
+    assert(population_check(master, 1000));
+    distributed_master_destroy(&master);
+    assert(master == NULL);
+    assert(distributed_workers_wait(processes, NB_WORKERS));
+    TEST_END_PRINT();
+}
+
+
+static void test_distributed_addresses(void)
+{
+    TEST_START_PRINT();
+    char address[64];
+    int connections[2];
+    int processes[2];
+
+    snprintf(address, sizeof address, "unix:/tmp/distributed_test.sock");
+    int listener = network_listen(address);
+    assert(listener >= 0);
+    processes[0] = worker_start(address);
+    connections[0] = network_accept(listener);
+    assert(connections[0] >= 0);
+    network_close(listener);
+    remove(&address[5]);
+
+    // Any free port on the loopback.
+    listener = network_listen("tcp:127.0.0.1:0");
+    assert(listener >= 0);
+    snprintf(address, sizeof address, "tcp:127.0.0.1:%d",
+             network_port_get(listener));
+    processes[1] = worker_start(address);
+    connections[1] = network_accept(listener);
+    assert(connections[1] >= 0);
+    network_close(listener);
+
+    distributed_master_t *master = distributed_master_create(connections, 2,
+                                                             &cases);
+    assert(master != NULL);
+    assert(population_check(master, 16));
+    distributed_master_destroy(&master);
+    assert(distributed_workers_wait(processes, 2));
+    TEST_END_PRINT();
+}
+
+
+// Check that the workers give the same objectives as a local evaluation.
+static bool population_check(distributed_master_t * const master,
+                             int const batch_size)
+{
+    static double objectives[NB_GENOMES * FITNESS_NB_OBJECTIVES];
+    for (int i = 0; i < NB_GENOMES * FITNESS_NB_OBJECTIVES; i++) {
+        objectives[i] = -1;
+    }
+
+    if (!distributed_population_evaluate(master, population, NB_GENOMES,
+                                         objectives, batch_size)) {
+        return false;
+    }
+    for (int i = 0; i < NB_GENOMES * FITNESS_NB_OBJECTIVES; i++) {
+        if (objectives[i] != expected[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Start a worker process connecting to a master at address.
+static int worker_start(char const * const address)
+{
+    int unused;
+    int process = network_process_fork(&unused, NULL, 0);
+    assert(process >= 0);
+    if (process == 0) {
+        network_close(unused);
+        int connection = network_connect(address);
+        network_process_exit(connection >= 0
+                             && distributed_worker_run(connection, 1));
+    }
+    network_close(unused);
+    return process;
+}
@@ -0,0 +1,376 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+// Module under test.
+#include "../diversity.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../genome.h"
+#include "../randomizer.h"
+
+
+//******************************************************************************
+// Module macros
+//******************************************************************************
+#define TEST_START_PRINT()    do {              \
+        printf("Running %s...", __func__);      \
+        fflush(stdout);                         \
+    } while (0)
+
+#define TEST_END_PRINT()  do {                  \
+        printf("OK.\n");                        \
+    } while (0)
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+// Population of NB_FAMILIES families of close genomes.
+#define NB_FAMILIES     (20)
+#define FAMILY_SIZE     (10)
+#define NB_GENOMES      (NB_FAMILIES * FAMILY_SIZE)
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+// Test functions.
+static void test_diversity_edit_distance(void);
+static void test_diversity_histogram_distance(void);
+static void test_diversity_nearest_find(void);
+static void test_diversity_niche_counts_get(void);
+static void test_diversity_crowding_replace(void);
+static int edit_distance(genome_t const * const genome1,
+                         genome_t const * const genome2);
+static genome_t *genome_indels_create(genome_t const * const genome,
+                                      random_stream_t * const stream);
+static void population_create(genome_t *population[],
+                              int const nb_mutations);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+int main(void)
+{
+    test_diversity_edit_distance();
+    test_diversity_histogram_distance();
+    test_diversity_nearest_find();
+    test_diversity_niche_counts_get();
+    test_diversity_crowding_replace();
+    printf("All tests passed.\n");
+}
+
+
+static void test_diversity_edit_distance(void)
+{
+    TEST_START_PRINT();
+    random_stream_t stream;
+
+    for (int trial = 0; trial < 200; trial++) {
+        random_stream_init(&stream, 1, trial, 0);
+        genome_t *genome1 = genome_random_create_r(&stream);
+        genome_t *genome2 = NULL;
+        if (trial % 3 == 0) {
+            // Close genomes, as in an evolving population.
+            genome_copy(&genome2, genome1);
+            int const nb_mutations = random_stream_get(&stream, 10);
+            for (int m = 0; m < nb_mutations; m++) {
+                genome_mutate_r(genome2, &stream);
+            }
+        } else if (trial % 3 == 1) {
+            genome2 = genome_indels_create(genome1, &stream);
+        } else {
+            genome2 = genome_random_create_r(&stream);
+        }
+
+        int const expected = edit_distance(genome1, genome2);
+        int const size1 = genome_size_get(genome1);
+        int const size2 = genome_size_get(genome2);
+        int const size_max = size1 > size2 ? size1 : size2;
+        assert(diversity_edit_distance(genome1, genome2, size_max)
+               == expected);
+        assert(diversity_edit_distance(genome2, genome1, size_max + 5)
+               == expected);
+        for (int bound = 0; bound < expected && bound < 20; bound++) {
+            assert(diversity_edit_distance(genome1, genome2, bound)
+                   == bound + 1);
+        }
+        assert(diversity_edit_distance(genome1, genome1, 0) == 0);
+
+        genome_destroy(&genome1);
+        genome_destroy(&genome2);
+    }
+    TEST_END_PRINT();
+}
+
+
+static void test_diversity_histogram_distance(void)
+{
+    TEST_START_PRINT();
+    random_stream_t stream;
+
+    for (int trial = 0; trial < 200; trial++) {
+        random_stream_init(&stream, 2, trial, 0);
+        genome_t *genome1 = genome_random_create_r(&stream);
+        genome_t *genome2 = NULL;
+        genome_copy(&genome2, genome1);
+        int const nb_mutations = random_stream_get(&stream, 20);
+        for (int m = 0; m < nb_mutations; m++) {
+            genome_mutate_r(genome2, &stream);
+        }
+
+        diversity_histogram_t histogram1;
+        diversity_histogram_t histogram2;
+        diversity_histogram_compute(genome1, &histogram1);
+        diversity_histogram_compute(genome2, &histogram2);
+        int const bound = diversity_histogram_distance(&histogram1,
+                                                       &histogram2);
+        assert(bound == diversity_histogram_distance(&histogram2,
+                                                     &histogram1));
+        assert(bound <= edit_distance(genome1, genome2));
+        assert(diversity_histogram_distance(&histogram1, &histogram1) == 0);
+
+        genome_destroy(&genome1);
+        genome_destroy(&genome2);
+    }
+    TEST_END_PRINT();
+}
+
+
+// A slightly mutated member of a family finds its family.
+static void test_diversity_nearest_find(void)
+{
+    TEST_START_PRINT();
+    genome_t *population[NB_GENOMES];
+    population_create(population, 2);
+    diversity_index_t *index = diversity_index_create(population, NB_GENOMES,
+                                                      3, 2);
+    assert(index);
+
+    random_stream_t stream;
+    random_stream_init(&stream, 3, 1, 0);
+    for (int i = 0; i < NB_GENOMES; i++) {
+        // Itself, when not excluded.
+        int distance = -1;
+        assert(diversity_nearest_find(index, population[i], -1, &stream,
+                                      &distance) == i);
+        assert(distance == 0);
+
+        int const nearest = diversity_nearest_find(index, population[i], i,
+                                                   &stream, &distance);
+        assert(nearest >= 0 && nearest != i);
+        assert(distance == edit_distance(population[i],
+                                         population[nearest]));
+        assert(nearest / FAMILY_SIZE == i / FAMILY_SIZE);
+    }
+
+    // Only the excluded genome.
+    diversity_index_t *single = diversity_index_create(population, 1, 3, 1);
+    assert(single);
+    assert(diversity_nearest_find(single, population[0], 0, &stream, NULL)
+           == -1);
+    diversity_index_destroy(&single);
+
+    diversity_index_destroy(&index);
+    assert(index == NULL);
+    for (int i = 0; i < NB_GENOMES; i++) {
+        genome_destroy(&population[i]);
+    }
+    TEST_END_PRINT();
+}
+
+
+static void test_diversity_niche_counts_get(void)
+{
+    TEST_START_PRINT();
+    genome_t *population[NB_GENOMES];
+    population_create(population, 0);
+    diversity_index_t *index = diversity_index_create(population, NB_GENOMES,
+                                                      4, 3);
+    assert(index);
+
+    // Families of identical genomes.
+    int counts[NB_GENOMES];
+    for (int nb_threads = 1; nb_threads <= 3; nb_threads++) {
+        diversity_niche_counts_get(index, 0, counts, nb_threads);
+        for (int i = 0; i < NB_GENOMES; i++) {
+            assert(counts[i] == FAMILY_SIZE);
+        }
+    }
+
+    // A changed genome leaves its niche once reindexed.
+    genome_destroy(&population[0]);
+    random_stream_t stream;
+    random_stream_init(&stream, 4, 1, 0);
+    population[0] = genome_random_create_r(&stream);
+    diversity_index_update(index, 0);
+    diversity_niche_counts_get(index, 0, counts, 2);
+    assert(counts[0] == 1);
+    for (int i = 1; i < NB_GENOMES; i++) {
+        assert(counts[i] == (i < FAMILY_SIZE ? FAMILY_SIZE - 1 : FAMILY_SIZE));
+    }
+
+    diversity_index_destroy(&index);
+    for (int i = 0; i < NB_GENOMES; i++) {
+        genome_destroy(&population[i]);
+    }
+    TEST_END_PRINT();
+}
+
+
+// An offspring only competes with its own family.
+static void test_diversity_crowding_replace(void)
+{
+    TEST_START_PRINT();
+    genome_t *population[NB_GENOMES];
+    double fitness[NB_GENOMES];
+    population_create(population, 2);
+    for (int i = 0; i < NB_GENOMES; i++) {
+        fitness[i] = i % FAMILY_SIZE;
+    }
+    diversity_index_t *index = diversity_index_create(population, NB_GENOMES,
+                                                      5, 2);
+    assert(index);
+
+    random_stream_t stream;
+    random_stream_init(&stream, 5, 1, 0);
+    for (int trial = 0; trial < 50; trial++) {
+        int const parent = random_stream_get(&stream, NB_GENOMES);
+        genome_t *offspring = NULL;
+        genome_copy(&offspring, population[parent]);
+        genome_mutate_r(offspring, &stream);
+
+        int const nearest = diversity_nearest_find(index, offspring, -1,
+                                                   &stream, NULL);
+        random_stream_t replace_stream = stream;
+        double const offspring_fitness = trial % 2 == 0 ? -1.0 : 100.0;
+        int const replaced = diversity_crowding_replace(index, population,
+                                                        fitness, offspring,
+                                                        offspring_fitness,
+                                                        &replace_stream);
+        stream = replace_stream;
+        if (trial % 2 == 0) {
+            assert(replaced >= 0);
+            assert(replaced / FAMILY_SIZE == parent / FAMILY_SIZE);
+            assert(population[replaced] == offspring);
+            assert(fitness[replaced] == offspring_fitness);
+            assert(diversity_nearest_find(index, offspring, -1, &stream,
+                                          NULL) == replaced);
+        } else {
+            assert(replaced == -1);
+            assert(nearest / FAMILY_SIZE == parent / FAMILY_SIZE);
+            genome_destroy(&offspring);
+        }
+    }
+
+    diversity_index_destroy(&index);
+    for (int i = 0; i < NB_GENOMES; i++) {
+        genome_destroy(&population[i]);
+    }
+    TEST_END_PRINT();
+}
+
+
+// Plain dynamic programming over the whole table.
+static int edit_distance(genome_t const * const genome1,
+                         genome_t const * const genome2)
+{
+    int const size1 = genome_size_get(genome1);
+    int const size2 = genome_size_get(genome2);
+    command_t const *genes1 = genome_genes_get(genome1);
+    command_t const *genes2 = genome_genes_get(genome2);
+    int *table = malloc((size1 + 1) * (size2 + 1) * sizeof *table);
+    assert(table);
+
+    for (int i = 0; i <= size1; i++) {
+        for (int j = 0; j <= size2; j++) {
+            int *cell = &table[i * (size2 + 1) + j];
+            if (i == 0 || j == 0) {
+                *cell = i + j;
+                continue;
+            }
+            bool const equal = genes1[i - 1].dst == genes2[j - 1].dst
+                && genes1[i - 1].op == genes2[j - 1].op
+                && genes1[i - 1].src1 == genes2[j - 1].src1
+                && genes1[i - 1].src2 == genes2[j - 1].src2;
+            *cell = table[(i - 1) * (size2 + 1) + j - 1] + !equal;
+            if (table[(i - 1) * (size2 + 1) + j] + 1 < *cell) {
+                *cell = table[(i - 1) * (size2 + 1) + j] + 1;
+            }
+            if (table[i * (size2 + 1) + j - 1] + 1 < *cell) {
+                *cell = table[i * (size2 + 1) + j - 1] + 1;
+            }
+        }
+    }
+    int const distance = table[size1 * (size2 + 1) + size2];
+    free(table);
+    return distance;
+}
+
+
+// A copy of genome with a few genes deleted or duplicated.
+static genome_t *genome_indels_create(genome_t const * const genome,
+                                      random_stream_t * const stream)
+{
+    static uint8_t buffer[4 + 4 * 1024];
+    size_t size = genome_serialize(genome, buffer, sizeof buffer);
+    assert(size > 0);
+
+    int nb_genes = genome_size_get(genome);
+    int const nb_changes = random_stream_get(stream, 6);
+    for (int c = 0; c < nb_changes && nb_genes > 0; c++) {
+        uint8_t *gene = &buffer[4 + 4 * random_stream_get(stream, nb_genes)];
+        size_t const tail = &buffer[size] - gene;
+        if (random_stream_get(stream, 2) == 0) {
+            memmove(gene, gene + 4, tail - 4);
+            nb_genes--;
+            size -= 4;
+        } else {
+            memmove(gene + 4, gene, tail);
+            nb_genes++;
+            size += 4;
+        }
+    }
+    for (int i = 0; i < 4; i++) {
+        buffer[i] = (uint8_t) (nb_genes >> (8 * i));
+    }
+
+    genome_t *copy = genome_deserialize(buffer, size, NULL);
+    assert(copy);
+    return copy;
+}
+
+
+// Families of copies of a random genome, each copy mutated nb_mutations
+// times. Families are far apart, members close.
+static void population_create(genome_t *population[],
+                              int const nb_mutations)
+{
+    genome_size_distribution_t const distribution = {
+        .size_min = 100,
+        .size_max = 200,
+        .nb_ramps = 0
+    };
+    genome_t *ancestors[NB_FAMILIES];
+    assert(genome_population_random_create(ancestors, NB_FAMILIES,
+                                           &distribution, 10, 1));
+
+    random_stream_t stream;
+    for (int i = 0; i < NB_GENOMES; i++) {
+        population[i] = NULL;
+        genome_copy(&population[i], ancestors[i / FAMILY_SIZE]);
+        random_stream_init(&stream, 10, 1, i);
+        for (int k = 0; k < nb_mutations; k++) {
+            genome_mutate_r(population[i], &stream);
+        }
+    }
+    for (int f = 0; f < NB_FAMILIES; f++) {
+        genome_destroy(&ancestors[f]);
+    }
+}
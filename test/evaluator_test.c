@@ -0,0 +1,285 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+// Module under test.
+#include "../evaluator.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "../genome.h"
+#include "../randomizer.h"
+
+
+//******************************************************************************
+// Module macros
+//******************************************************************************
+#define TEST_START_PRINT()    do {              \
+        printf("Running %s...", __func__);      \
+        fflush(stdout);                         \
+    } while (0)
+
+#define TEST_END_PRINT()  do {                  \
+        printf("OK.\n");                        \
+    } while (0)
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+// Not a multiple of MACHINE_BLOCK_CASES, so that the last block is partial.
+#define NB_CASES    (150)
+#define NB_INPUTS   (3)
+#define NB_GENOMES  (60)
+
+//******************************************************************************
+// Module variables
+//******************************************************************************
+static register_value_t inputs[NB_CASES * NB_INPUTS];
+static evaluator_cases_t const cases = {
+    .nb_cases = NB_CASES,
+    .nb_inputs = NB_INPUTS,
+    .inputs = inputs
+};
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+// Test functions.
+static void test_evaluator_run(void);
+static void test_evaluator_resume_run(void);
+static void test_evaluator_population_run(void);
+static bool outputs_equal(register_value_t const *outputs1,
+                          register_value_t const *outputs2);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+int main(void)
+{
+    for (int i = 0; i < NB_CASES * NB_INPUTS; i++) {
+        inputs[i] = (register_value_t) (rand() % 256 - 128);
+    }
+
+    test_evaluator_run();
+    test_evaluator_resume_run();
+    test_evaluator_population_run();
+    printf("All tests passed.\n");
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+static void test_evaluator_run(void)
+{
+    TEST_START_PRINT();
+    random_stream_t stream;
+    register_value_t outputs[NB_CASES];
+
+    for (int trial = 0; trial < 20; trial++) {
+        random_stream_init(&stream, 1, trial, 0);
+        genome_t *genome = genome_random_create_r(&stream);
+
+        evaluator_run(genome, &cases, outputs);
+        for (int c = 0; c < NB_CASES; c++) {
+            register_value_t registers[NB_REGISTERS] = { 0 };
+            for (int i = 0; i < NB_INPUTS; i++) {
+                registers[i] = inputs[c * NB_INPUTS + i];
+            }
+            genome_run(genome, registers);
+            assert(outputs[c] == registers[reg_A]);
+        }
+
+        genome_destroy(&genome);
+    }
+    TEST_END_PRINT();
+}
+
+
+static void test_evaluator_resume_run(void)
+{
+    TEST_START_PRINT();
+    random_stream_t stream;
+    register_value_t outputs[NB_CASES];
+    register_value_t expected[NB_CASES];
+    int const intervals[] = { 1, 7, 32 };
+
+    for (int i = 0; i < 3; i++) {
+        evaluator_trace_t *parent_trace =
+            evaluator_trace_create(intervals[i]);
+        evaluator_trace_t *trace = evaluator_trace_create(intervals[i]);
+        assert(parent_trace != NULL && trace != NULL);
+
+        for (int trial = 0; trial < 20; trial++) {
+            random_stream_init(&stream, 2, trial, i);
+            genome_t *parent = genome_random_create_r(&stream);
+            genome_t *other = genome_random_create_r(&stream);
+            genome_t *offspring = NULL;
+
+            assert(evaluator_trace_run(parent, &cases, parent_trace, outputs));
+            evaluator_run(parent, &cases, expected);
+            assert(outputs_equal(outputs, expected));
+
+            // Unchanged genome.
+            genome_copy(&offspring, parent);
+            assert(evaluator_resume_run(offspring, &cases, parent_trace,
+                                        genome_diff_first(parent, offspring),
+                                        NULL, outputs));
+            assert(outputs_equal(outputs, expected));
+
+            // A few generations, each resumed from the trace of the previous.
+            for (int generation = 0; generation < 5; generation++) {
+                genome_copy(&offspring, parent);
+                if (generation % 2 == 0) {
+                    genome_mutate_r(offspring, &stream);
+                } else {
+                    genome_crossover_r(offspring, other, &stream);
+                }
+                assert(evaluator_resume_run(offspring, &cases, parent_trace,
+                                            genome_diff_first(parent,
+                                                              offspring),
+                                            trace, outputs));
+                evaluator_run(offspring, &cases, expected);
+                assert(outputs_equal(outputs, expected));
+
+                evaluator_trace_t *swap = parent_trace;
+                parent_trace = trace;
+                trace = swap;
+                genome_copy(&parent, offspring);
+            }
+
+            genome_destroy(&parent);
+            genome_destroy(&other);
+            genome_destroy(&offspring);
+        }
+        evaluator_trace_destroy(&parent_trace);
+        evaluator_trace_destroy(&trace);
+        assert(trace == NULL);
+    }
+
+    // Two IF_LESS in a row push the checkpoint of the parent at 10 to 12, so
+    // the resumed run plans one more checkpoint than whole intervals hold.
+    command_t genes[31];
+    for (int k = 0; k < 31; k++) {
+        genes[k] = (command_t) {
+            .dst = k % NB_REGISTERS, .op = ADD, .src1 = reg_A, .src2 = reg_B
+        };
+    }
+    genes[9].op = IF_LESS;
+    genes[10].op = IF_LESS;
+    genome_t *parent = genome_genes_create(genes, 31);
+    genes[15].op = SUB;
+    genome_t *offspring = genome_genes_create(genes, 31);
+    evaluator_trace_t *parent_trace = evaluator_trace_create(10);
+    evaluator_trace_t *trace = evaluator_trace_create(10);
+    assert(parent && offspring && parent_trace && trace);
+    assert(evaluator_trace_run(parent, &cases, parent_trace, outputs));
+    assert(evaluator_resume_run(offspring, &cases, parent_trace, 15, trace,
+                                outputs));
+    evaluator_run(offspring, &cases, expected);
+    assert(outputs_equal(outputs, expected));
+    evaluator_trace_destroy(&parent_trace);
+    evaluator_trace_destroy(&trace);
+    genome_destroy(&parent);
+    genome_destroy(&offspring);
+    TEST_END_PRINT();
+}
+
+
+static void test_evaluator_population_run(void)
+{
+    TEST_START_PRINT();
+    random_stream_t stream;
+    genome_t *population[NB_GENOMES] = { NULL };
+    static register_value_t outputs[NB_GENOMES * NB_CASES];
+    register_value_t expected[NB_CASES];
+
+    // Families of offspring, sharing prefixes of various lengths, with
+    // duplicates and an empty genome.
+    random_stream_init(&stream, 3, 0, 0);
+    for (int g = 0; g < NB_GENOMES - 4; g++) {
+        if (g % 8 == 0) {
+            population[g] = genome_random_create_r(&stream);
+            continue;
+        }
+        genome_copy(&population[g], population[g - g % 8 + g % 8 / 2]);
+        if (g % 4 == 1) {
+            genome_mutate_r(population[g], &stream);
+        } else if (g % 4 == 2) {
+            genome_crossover_r(population[g], population[g - g % 8],
+                               &stream);
+        }
+    }
+    population[NB_GENOMES - 4] = genome_create();
+
+    // Genomes branching off right after an IF_LESS, whose skip must not be
+    // lost.
+    command_t genes[] = {
+        { .dst = reg_D, .op = ADD, .src1 = reg_A, .src2 = reg_B },
+        { .dst = reg_A, .op = IF_LESS, .src1 = reg_B, .src2 = reg_C },
+        { .dst = reg_A, .op = ADD, .src1 = reg_D, .src2 = reg_D },
+        { .dst = reg_A, .op = SUB, .src1 = reg_A, .src2 = reg_C }
+    };
+    population[NB_GENOMES - 3] = genome_genes_create(genes, 4);
+    genes[2].op = SUB;
+    population[NB_GENOMES - 2] = genome_genes_create(genes, 4);
+    population[NB_GENOMES - 1] = genome_genes_create(genes, 2);
+
+    for (int nb_threads = 1; nb_threads <= 3; nb_threads += 2) {
+        assert(evaluator_population_run(population, NB_GENOMES, &cases,
+                                        outputs, nb_threads));
+        for (int g = 0; g < NB_GENOMES; g++) {
+            evaluator_run(population[g], &cases, expected);
+            assert(outputs_equal(&outputs[g * NB_CASES], expected));
+        }
+    }
+
+    // Pass bits, against the outputs.
+    static register_value_t targets[NB_CASES];
+    static uint64_t passes[NB_GENOMES * EVALUATOR_PASS_WORDS(NB_CASES)];
+    int const nb_words = EVALUATOR_PASS_WORDS(NB_CASES);
+    evaluator_cases_t scored = cases;
+    scored.targets = targets;
+    for (int c = 0; c < NB_CASES; c++) {
+        targets[c] = (register_value_t) (c % 7 - 3);
+    }
+    for (int epsilon = 0; epsilon <= 2; epsilon += 2) {
+        assert(evaluator_population_passes_run(population, NB_GENOMES,
+                                               &scored, epsilon, passes, 3));
+        for (int g = 0; g < NB_GENOMES; g++) {
+            for (int c = 0; c < NB_CASES; c++) {
+                int const error = outputs[g * NB_CASES + c] - targets[c];
+                bool const pass = passes[g * nb_words + c / 64] >> (c % 64)
+                                  & 1;
+                assert(pass == (error <= epsilon && error >= -epsilon));
+            }
+            assert(passes[g * nb_words + nb_words - 1] >> (NB_CASES % 64)
+                   == 0);
+        }
+    }
+
+    // Nothing to run.
+    assert(evaluator_population_run(population, 0, &cases, outputs, 2));
+
+    for (int g = 0; g < NB_GENOMES; g++) {
+        genome_destroy(&population[g]);
+    }
+    TEST_END_PRINT();
+}
+
+
+static bool outputs_equal(register_value_t const *outputs1,
+                          register_value_t const *outputs2)
+{
+    for (int c = 0; c < NB_CASES; c++) {
+        if (outputs1[c] != outputs2[c]) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,303 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+// Module under test.
+#include "../fitness.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../evaluator.h"
+#include "../genome.h"
+
+
+//******************************************************************************
+// Module macros
+//******************************************************************************
+#define TEST_START_PRINT()    do {              \
+        printf("Running %s...", __func__);      \
+        fflush(stdout);                         \
+    } while (0)
+
+#define TEST_END_PRINT()  do {                  \
+        printf("OK.\n");                        \
+    } while (0)
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+#define NB_INDIVIDUALS      (500)
+#define NB_OBJECTIVES_MAX   (3)
+// Enough individuals for the sort to go through the fronts by several blocks.
+#define NB_LARGE            (9000)
+
+//******************************************************************************
+// Module variables
+//******************************************************************************
+static double objectives[NB_INDIVIDUALS * NB_OBJECTIVES_MAX];
+static double large_objectives[NB_LARGE * NB_OBJECTIVES_MAX];
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+// Test functions.
+static void test_fitness_nondominated_sort(void);
+static void test_fitness_nondominated_sort_large(void);
+static void test_fitness_crowding_distance_compute(void);
+static void test_fitness_population_evaluate(void);
+static int reference_sort(int const nb_objectives, int ranks[]);
+static bool reference_dominates(int const nb_objectives, int const a,
+                                int const b);
+static bool large_dominates(int const nb_objectives, int const a,
+                            int const b);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+int main(void)
+{
+    test_fitness_nondominated_sort();
+    test_fitness_nondominated_sort_large();
+    test_fitness_crowding_distance_compute();
+    test_fitness_population_evaluate();
+    printf("All tests passed.\n");
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+static void test_fitness_nondominated_sort(void)
+{
+    TEST_START_PRINT();
+    int ranks[NB_INDIVIDUALS];
+    int expected[NB_INDIVIDUALS];
+
+    assert(fitness_nondominated_sort(objectives, 0, 2, ranks, 1) == 0);
+
+    // Few distinct values, so that there are ties and duplicates.
+    for (int nb_objectives = 1; nb_objectives <= NB_OBJECTIVES_MAX;
+         nb_objectives++) {
+        for (int i = 0; i < NB_INDIVIDUALS * nb_objectives; i++) {
+            objectives[i] = rand() % 20;
+        }
+        int nb_fronts = reference_sort(nb_objectives, expected);
+
+        int const nb_threads[] = { 1, 3, 8 };
+        for (int t = 0; t < 3; t++) {
+            assert(fitness_nondominated_sort(objectives, NB_INDIVIDUALS,
+                                             nb_objectives, ranks,
+                                             nb_threads[t]) == nb_fronts);
+            for (int i = 0; i < NB_INDIVIDUALS; i++) {
+                assert(ranks[i] == expected[i]);
+            }
+        }
+    }
+
+    printf("\n\tExpect error messages:\n");
+    fflush(stdout);
+    assert(fitness_nondominated_sort(objectives, NB_INDIVIDUALS, 0, ranks,
+                                     1) == -1);
+    assert(fitness_nondominated_sort(objectives, NB_INDIVIDUALS / 2, 4, ranks,
+                                     1) == -1);
+    TEST_END_PRINT();
+}
+
+
+// The fronts are checked for what defines them: no individual is dominated
+// by one of its front or a later one, and each but those of front 0 is
+// dominated by one of the front before.
+static void test_fitness_nondominated_sort_large(void)
+{
+    TEST_START_PRINT();
+    static int ranks[NB_LARGE];
+    static int threaded[NB_LARGE];
+
+    for (int nb_objectives = 2; nb_objectives <= NB_OBJECTIVES_MAX;
+         nb_objectives++) {
+        for (int i = 0; i < NB_LARGE * nb_objectives; i++) {
+            large_objectives[i] = rand() % 200;
+        }
+        int const nb_fronts = fitness_nondominated_sort(large_objectives,
+                                                        NB_LARGE,
+                                                        nb_objectives, ranks,
+                                                        1);
+        assert(nb_fronts > 1);
+
+        for (int i = 0; i < NB_LARGE; i++) {
+            assert(ranks[i] >= 0 && ranks[i] < nb_fronts);
+            bool previous_dominates = ranks[i] == 0;
+            for (int j = 0; j < NB_LARGE; j++) {
+                if (large_dominates(nb_objectives, j, i)) {
+                    assert(ranks[j] < ranks[i]);
+                    previous_dominates |= ranks[j] == ranks[i] - 1;
+                }
+            }
+            assert(previous_dominates);
+        }
+
+        int const nb_threads[] = { 3, 8 };
+        for (int t = 0; t < 2; t++) {
+            assert(fitness_nondominated_sort(large_objectives, NB_LARGE,
+                                             nb_objectives, threaded,
+                                             nb_threads[t]) == nb_fronts);
+            assert(memcmp(ranks, threaded, sizeof ranks) == 0);
+        }
+    }
+    TEST_END_PRINT();
+}
+
+
+static void test_fitness_crowding_distance_compute(void)
+{
+    TEST_START_PRINT();
+    // A front of four, and one individual dominated by all of them.
+    double const front[] = {
+        1, 3,
+        5, 5,
+        4, 0,
+        0, 4,
+        2, 1
+    };
+    int ranks[5];
+    double distances[5];
+
+    assert(fitness_nondominated_sort(front, 5, 2, ranks, 1) == 2);
+    assert(ranks[1] == 1);
+    assert(fitness_crowding_distance_compute(front, 5, 2, ranks, distances,
+                                             2));
+    assert(isinf(distances[1]));
+    assert(isinf(distances[2]));
+    assert(isinf(distances[3]));
+    assert(distances[0] == 0.5 + 0.75);
+    assert(distances[4] == 0.75 + 0.75);
+    TEST_END_PRINT();
+}
+
+
+static void test_fitness_population_evaluate(void)
+{
+    TEST_START_PRINT();
+    enum { NB_GENOMES = 30, NB_CASES = 70 };
+    register_value_t inputs[NB_CASES];
+    register_value_t targets[NB_CASES];
+    register_value_t outputs[NB_CASES];
+    genome_t *population[NB_GENOMES];
+    double expected[NB_GENOMES * FITNESS_NB_OBJECTIVES];
+    double computed[NB_GENOMES * FITNESS_NB_OBJECTIVES];
+
+    for (int c = 0; c < NB_CASES; c++) {
+        inputs[c] = (register_value_t) (c - NB_CASES / 2);
+        targets[c] = (register_value_t) (2 * inputs[c]);
+    }
+    evaluator_cases_t cases = {
+        .nb_cases = NB_CASES,
+        .nb_inputs = 1,
+        .inputs = inputs,
+        .targets = targets
+    };
+    assert(genome_population_random_create(population, NB_GENOMES,
+                                           &genome_size_distribution_default,
+                                           3, 1));
+
+    for (int g = 0; g < NB_GENOMES; g++) {
+        evaluator_run(population[g], &cases, outputs);
+        double error = 0;
+        for (int c = 0; c < NB_CASES; c++) {
+            error += fabs((double) outputs[c] - targets[c]);
+        }
+        expected[g * FITNESS_NB_OBJECTIVES + FITNESS_ERROR] = error;
+        expected[g * FITNESS_NB_OBJECTIVES + FITNESS_SIZE] =
+            genome_size_get(population[g]);
+        expected[g * FITNESS_NB_OBJECTIVES + FITNESS_EFFECTIVE] =
+            genome_effective_size_get(population[g]);
+    }
+
+    for (int nb_threads = 1; nb_threads <= 4; nb_threads += 3) {
+        assert(fitness_population_evaluate(population, NB_GENOMES, &cases,
+                                           computed, nb_threads));
+        for (int i = 0; i < NB_GENOMES * FITNESS_NB_OBJECTIVES; i++) {
+            assert(computed[i] == expected[i]);
+        }
+    }
+
+    cases.targets = NULL;
+    assert(!fitness_population_evaluate(population, NB_GENOMES, &cases,
+                                        computed, 1));
+
+    for (int g = 0; g < NB_GENOMES; g++) {
+        genome_destroy(&population[g]);
+    }
+    TEST_END_PRINT();
+}
+
+
+// Peel the fronts one after the other, comparing all pairs.
+static int reference_sort(int const nb_objectives, int ranks[])
+{
+    int nb_ranked = 0;
+    int nb_fronts = 0;
+    for (int i = 0; i < NB_INDIVIDUALS; i++) {
+        ranks[i] = -1;
+    }
+
+    while (nb_ranked < NB_INDIVIDUALS) {
+        for (int i = 0; i < NB_INDIVIDUALS; i++) {
+            if (ranks[i] >= 0) {
+                continue;
+            }
+            bool dominated = false;
+            for (int j = 0; j < NB_INDIVIDUALS && !dominated; j++) {
+                dominated = (ranks[j] < 0 || ranks[j] == nb_fronts)
+                            && reference_dominates(nb_objectives, j, i);
+            }
+            if (!dominated) {
+                ranks[i] = nb_fronts;
+            }
+        }
+        // The members of the new front were marked while looking for it.
+        for (int i = 0; i < NB_INDIVIDUALS; i++) {
+            nb_ranked += ranks[i] == nb_fronts;
+        }
+        nb_fronts++;
+    }
+    return nb_fronts;
+}
+
+
+static bool reference_dominates(int const nb_objectives, int const a,
+                                int const b)
+{
+    bool better = false;
+    for (int m = 0; m < nb_objectives; m++) {
+        double value_a = objectives[a * nb_objectives + m];
+        double value_b = objectives[b * nb_objectives + m];
+        if (value_a > value_b) {
+            return false;
+        }
+        better |= value_a < value_b;
+    }
+    return better;
+}
+
+
+static bool large_dominates(int const nb_objectives, int const a,
+                            int const b)
+{
+    bool better = false;
+    for (int m = 0; m < nb_objectives; m++) {
+        double value_a = large_objectives[a * nb_objectives + m];
+        double value_b = large_objectives[b * nb_objectives + m];
+        if (value_a > value_b) {
+            return false;
+        }
+        better |= value_a < value_b;
+    }
+    return better;
+}
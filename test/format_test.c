@@ -0,0 +1,274 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+// Module under test.
+#include "../format.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../genome.h"
+#include "../machine/machine.h"
+#include "../randomizer.h"
+
+
+//******************************************************************************
+// Module macros
+//******************************************************************************
+#define TEST_START_PRINT()    do {              \
+        printf("Running %s...", __func__);      \
+        fflush(stdout);                         \
+    } while (0)
+
+#define TEST_END_PRINT()  do {                  \
+        printf("OK.\n");                        \
+    } while (0)
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+#define NB_GENOMES      (50)
+#define TEXT_CAPACITY   (4096)
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+// Test functions.
+static void test_genome_format(void);
+static void test_format_population_write(void);
+static void test_format_expression(void);
+static genome_t *genome_from_commands(command_t const commands[],
+                                      int const nb_commands);
+static char const *expression_get(command_t const commands[],
+                                  int const nb_commands, int const nb_inputs);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+int main(void)
+{
+    test_genome_format();
+    test_format_population_write();
+    test_format_expression();
+    printf("All tests passed.\n");
+}
+
+
+static void test_genome_format(void)
+{
+    TEST_START_PRINT();
+    char text[TEXT_CAPACITY];
+
+    // The second command does not reach reg_A.
+    command_t const commands[] = {
+        { .dst = reg_B, .op = LOAD, .src2 = 3 },
+        { .dst = reg_C, .op = ADD, .src1 = reg_A, .src2 = reg_A },
+        { .dst = reg_A, .op = MAX, .src1 = reg_A, .src2 = reg_B }
+    };
+    genome_t *genome = genome_from_commands(commands, 3);
+    char const *expected = "Genome size: 3\n"
+        "B = 3\n"
+        "C = (+ A A)\n"
+        "A = (max A B)\n";
+    assert(genome_format(genome, false, text, sizeof text)
+           == strlen(expected));
+    assert(strcmp(text, expected) == 0);
+
+    expected = "Genome size: 3, effective: 2\n"
+        "B = 3\n"
+        "A = (max A B)\n";
+    assert(genome_format(genome, true, text, sizeof text)
+           == strlen(expected));
+    assert(strcmp(text, expected) == 0);
+    assert(genome_format(genome, true, text, strlen(expected)) == 0);
+    genome_destroy(&genome);
+
+    // Random genomes always fit the announced capacity, and their lines are
+    // the formatted commands.
+    random_stream_t stream;
+    for (int trial = 0; trial < 20; trial++) {
+        random_stream_init(&stream, 1, trial, 0);
+        genome = genome_random_create_r(&stream);
+        size_t const capacity = genome_format_capacity_get(genome);
+        char *buffer = malloc(capacity);
+        assert(buffer);
+        size_t const length = genome_format(genome, false, buffer, capacity);
+        assert(length > 0 && length < capacity);
+
+        char const *line = strchr(buffer, '\n') + 1;
+        for (int i = 0; i < genome_size_get(genome); i++) {
+            char expected_line[MACHINE_COMMAND_FORMAT_MAX];
+            size_t const line_length = machine_command_format(
+                &genome_genes_get(genome)[i], expected_line,
+                sizeof expected_line);
+            assert(strncmp(line, expected_line, line_length) == 0);
+            line += line_length;
+        }
+        assert(*line == '\0');
+        assert(genome_format(genome, true, buffer, capacity) > 0);
+
+        free(buffer);
+        genome_destroy(&genome);
+    }
+    TEST_END_PRINT();
+}
+
+
+static void test_format_population_write(void)
+{
+    TEST_START_PRINT();
+    genome_t *population[NB_GENOMES];
+    genome_size_distribution_t const distribution = {
+        .size_min = 0,
+        .size_max = 200,
+        .nb_ramps = 0
+    };
+    assert(genome_population_random_create(population, NB_GENOMES,
+                                           &distribution, 2, 1));
+
+    for (int effective_only = 0; effective_only < 2; effective_only++) {
+        FILE *file = tmpfile();
+        assert(file);
+        assert(format_population_write(file, population, NB_GENOMES,
+                                       effective_only));
+        rewind(file);
+
+        char text[TEXT_CAPACITY];
+        char read_text[TEXT_CAPACITY];
+        for (int i = 0; i < NB_GENOMES; i++) {
+            size_t length = snprintf(text, sizeof text, "Genome %i\n", i);
+            size_t const genome_length = genome_format(
+                population[i], effective_only, &text[length],
+                sizeof text - length);
+            assert(genome_length > 0);
+            length += genome_length;
+            assert(fread(read_text, 1, length, file) == length);
+            assert(memcmp(text, read_text, length) == 0);
+        }
+        assert(fgetc(file) == EOF);
+        fclose(file);
+    }
+
+    for (int i = 0; i < NB_GENOMES; i++) {
+        genome_destroy(&population[i]);
+    }
+    TEST_END_PRINT();
+}
+
+
+static void test_format_expression(void)
+{
+    TEST_START_PRINT();
+
+    command_t const operations[] = {
+        { .dst = reg_C, .op = LOAD, .src2 = 3 },
+        { .dst = reg_A, .op = ADD, .src1 = reg_A, .src2 = reg_C },
+        { .dst = reg_A, .op = MIN, .src1 = reg_A, .src2 = reg_B }
+    };
+    assert(strcmp(expression_get(operations, 3, 2), "min((A + 3), B)") == 0);
+    // Without inputs, all is constant: min(0 + 3, 0).
+    assert(strcmp(expression_get(operations, 3, 0), "0") == 0);
+
+    // Folded by the machine, with its clamping and division.
+    command_t const constants[] = {
+        { .dst = reg_B, .op = LOAD, .src2 = 5 },
+        { .dst = reg_C, .op = LOAD, .src2 = 7 },
+        { .dst = reg_A, .op = MUL, .src1 = reg_B, .src2 = reg_C },
+        { .dst = reg_A, .op = DIV, .src1 = reg_A, .src2 = reg_D }
+    };
+    register_value_t registers[NB_REGISTERS] = { 0 };
+    machine_program_run(registers, constants, 4);
+    char expected[32];
+#if defined(MACHINE_REGISTER_FLOAT)
+    snprintf(expected, sizeof expected, "%g", registers[reg_A]);
+#else
+    snprintf(expected, sizeof expected, "%li", (long) registers[reg_A]);
+#endif
+    assert(strcmp(expression_get(constants, 4, 1), expected) == 0);
+
+    // Reduced.
+    command_t const same[] = {
+        { .dst = reg_A, .op = MAX, .src1 = reg_A, .src2 = reg_A },
+        { .dst = reg_B, .op = SUB, .src1 = reg_A, .src2 = reg_B },
+        { .dst = reg_A, .op = MIN, .src1 = reg_B, .src2 = reg_B }
+    };
+    assert(strcmp(expression_get(same, 3, 2), "(A - B)") == 0);
+
+    // Guarded commands.
+    command_t const guarded[] = {
+        { .op = IF_LESS, .src1 = reg_A, .src2 = reg_B },
+        { .dst = reg_A, .op = ADD, .src1 = reg_B, .src2 = reg_B }
+    };
+    assert(strcmp(expression_get(guarded, 2, 2),
+                  "((A < B) ? (B + B) : A)") == 0);
+    command_t const chained[] = {
+        { .op = IF_LESS, .src1 = reg_A, .src2 = reg_B },
+        { .op = IF_LESS, .src1 = reg_B, .src2 = reg_A },
+        { .dst = reg_A, .op = LOAD, .src2 = 1 }
+    };
+    assert(strcmp(expression_get(chained, 3, 2),
+                  "(((A < B) ? (B < A) : 1) ? 1 : A)") == 0);
+    // C < C never holds, the load never runs.
+    command_t const never[] = {
+        { .op = IF_LESS, .src1 = reg_C, .src2 = reg_C },
+        { .dst = reg_A, .op = LOAD, .src2 = 1 }
+    };
+    assert(strcmp(expression_get(never, 2, 1), "A") == 0);
+
+    // The text doubles with each command, the buffer limits the work.
+    command_t doubling[40];
+    for (int i = 0; i < 40; i++) {
+        doubling[i] = (command_t) { .dst = reg_A, .op = ADD, .src1 = reg_A,
+                                    .src2 = reg_A };
+    }
+    genome_t *genome = genome_from_commands(doubling, 40);
+    char text[TEXT_CAPACITY];
+    assert(format_expression(genome, 1, text, sizeof text) == 0);
+    assert(text[0] == '\0');
+    assert(format_expression(genome, 1, text, 0) == 0);
+    assert(format_expression(genome, 1, text, 1) == 0);
+    genome_destroy(&genome);
+    genome = genome_from_commands(doubling, 2);
+    assert(format_expression(genome, 1, text, 18) == 0);
+    assert(format_expression(genome, 1, text, 20) == 19);
+    assert(strcmp(text, "((A + A) + (A + A))") == 0);
+    genome_destroy(&genome);
+    TEST_END_PRINT();
+}
+
+
+// Create a genome with the given genes, through its serialized form.
+static genome_t *genome_from_commands(command_t const commands[],
+                                      int const nb_commands)
+{
+    uint8_t buffer[4 + 4 * 64];
+    assert(nb_commands <= 64);
+    buffer[0] = (uint8_t) nb_commands;
+    buffer[1] = buffer[2] = buffer[3] = 0;
+    for (int i = 0; i < nb_commands; i++) {
+        buffer[4 + 4 * i] = commands[i].dst;
+        buffer[5 + 4 * i] = commands[i].op;
+        buffer[6 + 4 * i] = commands[i].src1;
+        buffer[7 + 4 * i] = commands[i].src2;
+    }
+    genome_t *genome = genome_deserialize(buffer, sizeof buffer, NULL);
+    assert(genome);
+    return genome;
+}
+
+
+static char const *expression_get(command_t const commands[],
+                                  int const nb_commands, int const nb_inputs)
+{
+    static char text[TEXT_CAPACITY];
+    genome_t *genome = genome_from_commands(commands, nb_commands);
+    assert(format_expression(genome, nb_inputs, text, sizeof text) > 0);
+    genome_destroy(&genome);
+    return text;
+}
@@ -0,0 +1,580 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+#define _POSIX_C_SOURCE 200809L
+
+// End to end benchmark of the evolution cycle: random creation, evaluation,
+// selection, crossover and mutation of a population, on synthetic problems,
+// from a fixed seed. This is the yardstick for performance changes to
+// genome.c and machine.c; the best error it reports must not change with
+// them. With the default machine configuration and number of generations, it
+// is checked against the recorded one, whatever the number of threads, and
+// a mismatch fails the run. With a depth, the same number of offspring is
+// also bred through the steady state pipeline of that depth, in batches of a
+// tenth of the population.
+// Usage: genome_bench [nb_threads [nb_generations [depth]]]
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../evaluator.h"
+#include "../fitness.h"
+#include "../genome.h"
+#include "../lexicase.h"
+#include "../machine/machine.h"
+#include "../pipeline.h"
+#include "../randomizer.h"
+
+//******************************************************************************
+// Type definitions
+//******************************************************************************
+typedef enum {
+    PHASE_CREATE,
+    PHASE_EVALUATE,
+    PHASE_SELECT,
+    PHASE_COPY,
+    PHASE_CROSSOVER,
+    PHASE_MUTATE,
+    PHASE_REPLACE,
+    NB_PHASES
+} phase_t;
+
+// Synthetic problem: the expected output of a case from its inputs.
+typedef struct {
+    char const *name;
+    int nb_inputs;
+    long (*target)(register_value_t const inputs[]);
+    double expected_error;  // Best error with the reference configuration.
+} workload_t;
+
+typedef struct {
+    double phase_times[NB_PHASES];
+    double nb_evaluations;
+    double nb_genes_run;
+    double best_error;
+    double lexicase_time;
+    long nb_allocations;
+    long nb_reallocations;
+    long nb_frees;
+} bench_result_t;
+
+//******************************************************************************
+// Module variables
+//******************************************************************************
+// Calls to the allocator, counted by the wrappers below.
+static long nb_allocations;
+static long nb_reallocations;
+static long nb_frees;
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nb, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+void __real_free(void *pointer);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t nb, size_t size);
+void *__wrap_realloc(void *pointer, size_t size);
+void __wrap_free(void *pointer);
+
+static void workload_run(workload_t const * const workload,
+                         int const nb_threads, int const nb_generations,
+                         bench_result_t * const result);
+static void workload_pipeline_run(workload_t const * const workload,
+                                  int const nb_threads,
+                                  int const nb_generations, int const depth);
+static void result_print(workload_t const * const workload,
+                         bench_result_t const * const result,
+                         int const nb_threads, int const nb_generations);
+static void cases_create(workload_t const * const workload,
+                         evaluator_cases_t * const cases);
+static int tournament_select(double const objectives[],
+                             random_stream_t * const stream);
+static long regression_target(register_value_t const inputs[]);
+static long classification_target(register_value_t const inputs[]);
+static long clamp(long const value);
+static double time_get(void);
+static long peak_rss_get(void);
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+#define BENCH_SEED          (1)
+#define NB_GENOMES          (1000)
+#define NB_CASES            (256)
+#define NB_GENERATIONS      (100)
+#define TOURNAMENT_SIZE     (4)
+#define CROSSOVER_PERCENT   (90)
+#define MUTATION_PERCENT    (50)
+#define BATCHES_PER_GENERATION  (10)
+
+// Largest absolute value of the inputs of the cases.
+#define INPUT_RANGE         (32)
+
+static char const *const phase_names[NB_PHASES] = {
+    [PHASE_CREATE] = "create",
+    [PHASE_EVALUATE] = "evaluate",
+    [PHASE_SELECT] = "select",
+    [PHASE_COPY] = "copy",
+    [PHASE_CROSSOVER] = "crossover",
+    [PHASE_MUTATE] = "mutate",
+    [PHASE_REPLACE] = "replace"
+};
+
+static genome_size_distribution_t const size_distribution = {
+    .size_min = 10,
+    .size_max = 100,
+    .nb_ramps = 4
+};
+
+static workload_t const workloads[] = {
+    { .name = "regression", .nb_inputs = 2, .target = regression_target,
+      .expected_error = 7113 },
+    { .name = "classification", .nb_inputs = 3,
+      .target = classification_target, .expected_error = 0 }
+};
+
+// Machine configuration the expected errors were recorded with, see
+// machine_config_get(): 16 registers of 8 bits, all operations enabled.
+static uint32_t const reference_config[MACHINE_CONFIG_SIZE] = {
+    1, 0, 16, (1U << NB_OPERATION_TYPES) - 1
+};
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+int main(int argc, char *argv[])
+{
+    int const nb_threads = argc > 1 ? atoi(argv[1]) : 1;
+    int const nb_generations = argc > 2 ? atoi(argv[2]) : NB_GENERATIONS;
+    int const depth = argc > 3 ? atoi(argv[3]) : -1;
+    if (nb_threads < 1 || nb_generations < 1 || (argc > 3 && depth < 0)) {
+        fprintf(stderr, "usage: %s [nb_threads [nb_generations [depth]]]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    uint32_t config[MACHINE_CONFIG_SIZE];
+    machine_config_get(config);
+    bool const checked = nb_generations == NB_GENERATIONS
+                         && memcmp(config, reference_config,
+                                   sizeof config) == 0;
+    bool success = true;
+
+    printf("%i registers of %i bits.\n", NB_REGISTERS,
+           (int) (8 * sizeof (register_value_t)));
+    for (size_t w = 0; w < sizeof workloads / sizeof workloads[0]; w++) {
+        bench_result_t result;
+        workload_run(&workloads[w], nb_threads, nb_generations, &result);
+        result_print(&workloads[w], &result, nb_threads, nb_generations);
+        if (checked && result.best_error != workloads[w].expected_error) {
+            fprintf(stderr, "%s: best error of %s is %.0f, expected %.0f.\n",
+                    __func__, workloads[w].name, result.best_error,
+                    workloads[w].expected_error);
+            success = false;
+        }
+        if (depth >= 0) {
+            workload_pipeline_run(&workloads[w], nb_threads, nb_generations,
+                                  depth);
+        }
+    }
+
+    long const peak_rss = peak_rss_get();
+    if (peak_rss >= 0) {
+        printf("Peak RSS: %li kB\n", peak_rss);
+    } else {
+        printf("Peak RSS: unknown\n");
+    }
+    if (!checked) {
+        printf("Best errors not checked, only recorded for the reference "
+               "configuration and %i generations.\n", NB_GENERATIONS);
+    }
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Allocator wrappers, linked in place of the allocator with
+/// -Wl,--wrap, counting the calls. Allocations made inside the C library
+/// itself are not seen.
+//  ----------------------------------------------------------------------------
+void *__wrap_malloc(size_t size)
+{
+    __atomic_fetch_add(&nb_allocations, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+
+void *__wrap_calloc(size_t nb, size_t size)
+{
+    __atomic_fetch_add(&nb_allocations, 1, __ATOMIC_RELAXED);
+    return __real_calloc(nb, size);
+}
+
+
+void *__wrap_realloc(void *pointer, size_t size)
+{
+    __atomic_fetch_add(pointer == NULL ? &nb_allocations : &nb_reallocations,
+                       1, __ATOMIC_RELAXED);
+    return __real_realloc(pointer, size);
+}
+
+
+void __wrap_free(void *pointer)
+{
+    if (pointer != NULL) {
+        __atomic_fetch_add(&nb_frees, 1, __ATOMIC_RELAXED);
+    }
+    __real_free(pointer);
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+//  ----------------------------------------------------------------------------
+/// \brief  Evolve a population on a workload. Each generation, the population
+/// is evaluated, parents are picked by tournament on the error, copied,
+/// crossed over and mutated into the offspring, and the offspring replace the
+/// population, but for the best genome which is kept.
+/// \param  workload
+/// \param  nb_threads      Number of threads of the evaluation.
+/// \param  nb_generations
+/// \param  result          Output.
+//  ----------------------------------------------------------------------------
+static void workload_run(workload_t const * const workload,
+                         int const nb_threads, int const nb_generations,
+                         bench_result_t * const result)
+{
+    *result = (bench_result_t) { .best_error = 0 };
+    evaluator_cases_t cases;
+    cases_create(workload, &cases);
+
+    genome_t **population = malloc(NB_GENOMES * sizeof *population);
+    genome_t **offspring = calloc(NB_GENOMES, sizeof *offspring);
+    int *parents = malloc(NB_GENOMES * sizeof *parents);
+    double *objectives = malloc(NB_GENOMES * FITNESS_NB_OBJECTIVES
+                                * sizeof *objectives);
+    if (population == NULL || offspring == NULL || parents == NULL
+        || objectives == NULL) {
+        fprintf(stderr, "%s: could not allocate the population.\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+
+    long const allocations_start = nb_allocations;
+    long const reallocations_start = nb_reallocations;
+    long const frees_start = nb_frees;
+    double *times = result->phase_times;
+
+    double start = time_get();
+    if (!genome_population_random_create(population, NB_GENOMES,
+                                         &size_distribution, BENCH_SEED,
+                                         nb_threads)) {
+        fprintf(stderr, "%s: could not create the population.\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    times[PHASE_CREATE] += time_get() - start;
+
+    for (int generation = 0; generation < nb_generations; generation++) {
+        random_stream_t stream;
+        random_stream_init(&stream, BENCH_SEED, generation + 1, 0);
+
+        start = time_get();
+        if (!fitness_population_evaluate(population, NB_GENOMES, &cases,
+                                         objectives, nb_threads)) {
+            fprintf(stderr, "%s: evaluation failed.\n", __func__);
+            exit(EXIT_FAILURE);
+        }
+        times[PHASE_EVALUATE] += time_get() - start;
+        int best = 0;
+        for (int i = 0; i < NB_GENOMES; i++) {
+            result->nb_genes_run += (double) genome_size_get(population[i])
+                                    * NB_CASES;
+            if (objectives[i * FITNESS_NB_OBJECTIVES + FITNESS_ERROR]
+                < objectives[best * FITNESS_NB_OBJECTIVES + FITNESS_ERROR]) {
+                best = i;
+            }
+        }
+        result->nb_evaluations += NB_GENOMES;
+        result->best_error = objectives[best * FITNESS_NB_OBJECTIVES
+                                        + FITNESS_ERROR];
+
+        start = time_get();
+        for (int i = 0; i < NB_GENOMES; i++) {
+            parents[i] = tournament_select(objectives, &stream);
+        }
+        times[PHASE_SELECT] += time_get() - start;
+
+        start = time_get();
+        for (int i = 0; i < NB_GENOMES; i++) {
+            genome_copy(&offspring[i], population[parents[i]]);
+        }
+        times[PHASE_COPY] += time_get() - start;
+
+        start = time_get();
+        for (int i = 0; i + 1 < NB_GENOMES; i += 2) {
+            if (random_stream_get(&stream, 100) < CROSSOVER_PERCENT) {
+                genome_crossover_r(offspring[i], offspring[i + 1], &stream);
+            }
+        }
+        times[PHASE_CROSSOVER] += time_get() - start;
+
+        start = time_get();
+        for (int i = 0; i < NB_GENOMES; i++) {
+            if (random_stream_get(&stream, 100) < MUTATION_PERCENT) {
+                genome_mutate_r(offspring[i], &stream);
+            }
+        }
+        times[PHASE_MUTATE] += time_get() - start;
+
+        start = time_get();
+        genome_copy(&offspring[0], population[best]);
+        genome_t **swap = population;
+        population = offspring;
+        offspring = swap;
+        times[PHASE_REPLACE] += time_get() - start;
+    }
+
+    result->nb_allocations = nb_allocations - allocations_start;
+    result->nb_reallocations = nb_reallocations - reallocations_start;
+    result->nb_frees = nb_frees - frees_start;
+
+    // Lexicase selection of as many parents on the last population, from its
+    // pass bits. Running the population for them is not timed, it is an
+    // evaluation.
+    uint64_t *passes = malloc(NB_GENOMES * EVALUATOR_PASS_WORDS(NB_CASES)
+                              * sizeof *passes);
+    if (passes == NULL
+        || !evaluator_population_passes_run(population, NB_GENOMES, &cases, 0,
+                                            passes, nb_threads)) {
+        fprintf(stderr, "%s: could not compute the passes.\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    start = time_get();
+    lexicase_t *lexicase = lexicase_create(passes, NB_GENOMES, NB_CASES);
+    if (lexicase == NULL
+        || !lexicase_parents_select(lexicase, NB_GENOMES, BENCH_SEED,
+                                    nb_generations + 1, parents,
+                                    nb_threads)) {
+        fprintf(stderr, "%s: lexicase selection failed.\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    result->lexicase_time = time_get() - start;
+    lexicase_destroy(&lexicase);
+    free(passes);
+
+    for (int i = 0; i < NB_GENOMES; i++) {
+        genome_destroy(&population[i]);
+        if (offspring[i] != NULL) {
+            genome_destroy(&offspring[i]);
+        }
+    }
+    free(population);
+    free(offspring);
+    free(parents);
+    free(objectives);
+    free((void *) cases.inputs);
+    free((void *) cases.targets);
+}
+
+
+//  ----------------------------------------------------------------------------
+/// \brief  Evolve a population on a workload through the steady state
+/// pipeline, from the same initial population and with the same rates as
+/// workload_run(), and print the throughput and the best error.
+/// \param  workload
+/// \param  nb_threads      Number of threads of the evaluation.
+/// \param  nb_generations  Number of populations worth of offspring.
+/// \param  depth           Batches bred ahead of the replacement.
+//  ----------------------------------------------------------------------------
+static void workload_pipeline_run(workload_t const * const workload,
+                                  int const nb_threads,
+                                  int const nb_generations, int const depth)
+{
+    evaluator_cases_t cases;
+    cases_create(workload, &cases);
+    genome_t **population = malloc(NB_GENOMES * sizeof *population);
+    double *objectives = malloc(NB_GENOMES * FITNESS_NB_OBJECTIVES
+                                * sizeof *objectives);
+    if (population == NULL || objectives == NULL) {
+        fprintf(stderr, "%s: could not allocate the population.\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+
+    double const start = time_get();
+    if (!genome_population_random_create(population, NB_GENOMES,
+                                         &size_distribution, BENCH_SEED,
+                                         nb_threads)
+        || !fitness_population_evaluate(population, NB_GENOMES, &cases,
+                                        objectives, nb_threads)) {
+        fprintf(stderr, "%s: could not create the population.\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    pipeline_config_t const config = {
+        .batch_size = NB_GENOMES / BATCHES_PER_GENERATION,
+        .nb_batches = nb_generations * BATCHES_PER_GENERATION,
+        .depth = depth,
+        .tournament_size = TOURNAMENT_SIZE,
+        .crossover_percent = CROSSOVER_PERCENT,
+        .mutation_percent = MUTATION_PERCENT,
+        .seed = BENCH_SEED
+    };
+    if (!pipeline_run(population, NB_GENOMES, objectives, &cases, &config,
+                      nb_threads)) {
+        fprintf(stderr, "%s: pipeline failed.\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    double const total = time_get() - start;
+
+    double best_error = objectives[FITNESS_ERROR];
+    for (int i = 1; i < NB_GENOMES; i++) {
+        double const error = objectives[i * FITNESS_NB_OBJECTIVES
+                                        + FITNESS_ERROR];
+        best_error = error < best_error ? error : best_error;
+    }
+    printf("  pipelined, depth %i:\n", depth);
+    printf("  generations/s: %10.2f\n", nb_generations / total);
+    printf("  best error:    %10.0f\n", best_error);
+
+    for (int i = 0; i < NB_GENOMES; i++) {
+        genome_destroy(&population[i]);
+    }
+    free(population);
+    free(objectives);
+    free((void *) cases.inputs);
+    free((void *) cases.targets);
+}
+
+
+static void result_print(workload_t const * const workload,
+                         bench_result_t const * const result,
+                         int const nb_threads, int const nb_generations)
+{
+    double total = 0;
+    for (int p = 0; p < NB_PHASES; p++) {
+        total += result->phase_times[p];
+    }
+    double const evaluate_time = result->phase_times[PHASE_EVALUATE];
+
+    printf("Workload %s: %i genomes, %i cases, %i generations, "
+           "%i thread(s).\n", workload->name, NB_GENOMES, NB_CASES,
+           nb_generations, nb_threads);
+    printf("  generations/s: %10.2f\n", nb_generations / total);
+    printf("  evaluations/s: %10.0f (%.1f Mgenes/s)\n",
+           result->nb_evaluations / evaluate_time,
+           result->nb_genes_run / evaluate_time / 1e6);
+    printf("  allocations:   %10li (%.1f per generation), "
+           "reallocations: %li, frees: %li\n", result->nb_allocations,
+           (double) result->nb_allocations / nb_generations,
+           result->nb_reallocations, result->nb_frees);
+    printf("  best error:    %10.0f\n", result->best_error);
+    printf("  lexicase:      %10.3f ms per population\n",
+           result->lexicase_time * 1e3);
+    for (int p = 0; p < NB_PHASES; p++) {
+        printf("  %-10s %9.3f s %5.1f%%\n", phase_names[p],
+               result->phase_times[p],
+               100 * result->phase_times[p] / total);
+    }
+}
+
+
+// Draw the inputs of the cases from a fixed stream, and compute the targets.
+static void cases_create(workload_t const * const workload,
+                         evaluator_cases_t * const cases)
+{
+    register_value_t *inputs = malloc(NB_CASES * workload->nb_inputs
+                                      * sizeof *inputs);
+    register_value_t *targets = malloc(NB_CASES * sizeof *targets);
+    if (inputs == NULL || targets == NULL) {
+        fprintf(stderr, "%s: could not allocate the cases.\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+
+    random_stream_t stream;
+    random_stream_init(&stream, BENCH_SEED, 0, workload->nb_inputs);
+    for (int c = 0; c < NB_CASES; c++) {
+        register_value_t *case_inputs = &inputs[c * workload->nb_inputs];
+        for (int i = 0; i < workload->nb_inputs; i++) {
+            case_inputs[i] = (register_value_t)
+                (random_stream_get(&stream, 2 * INPUT_RANGE) - INPUT_RANGE);
+        }
+        targets[c] = (register_value_t) workload->target(case_inputs);
+    }
+
+    *cases = (evaluator_cases_t) {
+        .nb_cases = NB_CASES,
+        .nb_inputs = workload->nb_inputs,
+        .inputs = inputs,
+        .targets = targets
+    };
+}
+
+
+// Index of the genome of lowest error among a few random ones.
+static int tournament_select(double const objectives[],
+                             random_stream_t * const stream)
+{
+    int best = random_stream_get(stream, NB_GENOMES);
+    for (int i = 1; i < TOURNAMENT_SIZE; i++) {
+        int const other = random_stream_get(stream, NB_GENOMES);
+        if (objectives[other * FITNESS_NB_OBJECTIVES + FITNESS_ERROR]
+            < objectives[best * FITNESS_NB_OBJECTIVES + FITNESS_ERROR]) {
+            best = other;
+        }
+    }
+    return best;
+}
+
+
+static long regression_target(register_value_t const inputs[])
+{
+    long const x = inputs[0];
+    long const y = inputs[1];
+    return clamp(x * y / 4 + x - 3);
+}
+
+
+static long classification_target(register_value_t const inputs[])
+{
+    return (long) inputs[0] + inputs[1] > inputs[2];
+}
+
+
+static long clamp(long const value)
+{
+    return value > REGISTER_MAX ? REGISTER_MAX
+           : value < REGISTER_MIN ? REGISTER_MIN : value;
+}
+
+
+static double time_get(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+
+// Peak resident set size of the process in kB, -1 if unknown.
+static long peak_rss_get(void)
+{
+    FILE *status = fopen("/proc/self/status", "r");
+    if (status == NULL) {
+        return -1;
+    }
+    long peak = -1;
+    char line[256];
+    while (fgets(line, sizeof line, status) != NULL) {
+        if (strncmp(line, "VmHWM:", 6) == 0) {
+            peak = strtol(&line[6], NULL, 10);
+            break;
+        }
+    }
+    fclose(status);
+    return peak;
+}
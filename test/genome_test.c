@@ -6,7 +6,9 @@ Copyright (c) 2013 Gauthier Fleutot Östervall
 #include "../genome.h"
 
 #include <assert.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <stdio.h>
 
 
@@ -35,6 +37,13 @@ static void test_genome_copy(void);
 static void test_genome_crossover(void);
 static void test_genome_mutate(void);
 static void test_genome_compare(void);
+static void test_genome_diff_first(void);
+static void test_genome_duplicates_find(void);
+static void test_genome_reproducible(void);
+static void test_genome_population_random_create(void);
+static void test_genome_effective_variation(void);
+static void test_genome_serialize(void);
+static bool genomes_agree(genome_t *genome1, genome_t *genome2);
 
 //******************************************************************************
 // Function definitions
@@ -45,7 +54,13 @@ int main(void)
     test_genome_copy();
     test_genome_crossover();
     test_genome_compare();
+    test_genome_diff_first();
+    test_genome_duplicates_find();
     test_genome_mutate();
+    test_genome_reproducible();
+    test_genome_population_random_create();
+    test_genome_effective_variation();
+    test_genome_serialize();
     printf("All tests passed.\n");
 }
 
@@ -85,6 +100,53 @@ static void test_genome_copy(void)
     assert(genome_sanity_check(dst));
     assert(genome_size_get(dst) == genome_size_get(src2));
 
+    // Copies share the genes until one of them is modified.
+    genome_t *copy = NULL;
+    genome_copy(&copy, src1);
+    assert(genome_genes_get(copy) == genome_genes_get(src1));
+    genome_t *reference = genome_genes_create(genome_genes_get(src1),
+                                              genome_size_get(src1));
+    assert(reference);
+    random_stream_t stream;
+    random_stream_init(&stream, 5, 0, 0);
+    for (int i = 0; i < 20; i++) {
+        genome_mutate_r(copy, &stream);
+    }
+    assert(genome_compare(src1, reference));
+    if (genome_size_get(src1) > 0) {
+        assert(genome_genes_get(copy) != genome_genes_get(src1));
+    }
+
+    // Crossing over copies leaves their parents as they were.
+    genome_t *copy2 = NULL;
+    genome_copy(&copy, src1);
+    genome_copy(&copy2, src1);
+    for (int i = 0; i < 20; i++) {
+        genome_crossover_r(copy, copy2, &stream);
+    }
+    assert(genome_compare(src1, reference));
+    assert(genome_sanity_check(copy) && genome_sanity_check(copy2));
+    genome_destroy(&copy2);
+    genome_destroy(&reference);
+
+    // A copy outlives its source.
+    genome_t *source = genome_random_create();
+    genome_copy(&copy, source);
+    reference = genome_genes_create(genome_genes_get(source),
+                                    genome_size_get(source));
+    genome_destroy(&source);
+    assert(genome_compare(copy, reference));
+    genome_mutate_r(copy, &stream);
+    genome_destroy(&copy);
+    genome_destroy(&reference);
+
+    // Genome created from the genes of another.
+    genome_t *created = genome_genes_create(genome_genes_get(src1),
+                                            genome_size_get(src1));
+    assert(created);
+    assert(genome_compare(created, src1));
+    genome_destroy(&created);
+
     genome_destroy(&dst);
     genome_destroy(&src1);
     genome_destroy(&src2);
@@ -142,6 +204,73 @@ static void test_genome_compare(void)
 }
 
 
+static void test_genome_diff_first(void)
+{
+    TEST_START_PRINT();
+    genome_t *origin = genome_random_create();
+    genome_t *mutant = NULL;
+
+    genome_copy(&mutant, origin);
+    assert(genome_diff_first(origin, mutant) == -1);
+    assert(genome_hash(origin) == genome_hash(mutant));
+
+    genome_mutate(mutant);
+    int diff = genome_diff_first(origin, mutant);
+    assert(diff == -1 || (diff >= 0 && diff < genome_size_get(origin)));
+    assert((diff == -1) == genome_compare(origin, mutant));
+
+    // An empty genome is a prefix of any genome.
+    genome_t *empty = genome_create();
+    assert(genome_diff_first(origin, empty)
+           == (genome_size_get(origin) == 0 ? -1 : 0));
+
+    genome_destroy(&origin);
+    genome_destroy(&mutant);
+    genome_destroy(&empty);
+
+    TEST_END_PRINT();
+}
+
+
+static void test_genome_duplicates_find(void)
+{
+    TEST_START_PRINT();
+    genome_t *population[6] = { NULL };
+    int duplicate_of[6];
+
+    // Fixed genes: random genomes can be empty, and then equal. The third
+    // genome is a prefix of the first, which does not make it a duplicate.
+    command_t const genes[] = {
+        { .dst = reg_A, .op = ADD, .src1 = reg_B, .src2 = reg_C },
+        { .dst = reg_C, .op = LOAD, .src2 = 3 }
+    };
+    command_t const other_genes[] = {
+        { .dst = reg_A, .op = SUB, .src1 = reg_B, .src2 = reg_C }
+    };
+    population[0] = genome_genes_create(genes, 2);
+    population[1] = genome_genes_create(other_genes, 1);
+    genome_copy(&population[2], population[0]);
+    population[3] = genome_genes_create(genes, 1);
+    genome_copy(&population[4], population[1]);
+    genome_copy(&population[5], population[0]);
+
+    int nb_duplicates = genome_duplicates_find(population, 6, duplicate_of);
+    assert(nb_duplicates == 3);
+    assert(duplicate_of[0] == -1);
+    assert(duplicate_of[1] == -1);
+    assert(duplicate_of[2] == 0);
+    assert(duplicate_of[3] == -1);
+    assert(duplicate_of[4] == 1);
+    assert(duplicate_of[5] == 0);
+
+    for (int i = 0; i < 6; i++) {
+        genome_destroy(&population[i]);
+    }
+
+    TEST_END_PRINT();
+}
+
+
 static void test_genome_mutate(void)
 {
     TEST_START_PRINT();
@@ -162,3 +291,241 @@ static void test_genome_mutate(void)
 
     TEST_END_PRINT();
 }
+
+
+static void test_genome_reproducible(void)
+{
+    TEST_START_PRINT();
+    uint64_t const seed = 1234;
+    random_stream_t stream1;
+    random_stream_t stream2;
+
+    // Same coordinates, same genome.
+    random_stream_init(&stream1, seed, 3, 7);
+    random_stream_init(&stream2, seed, 3, 7);
+    genome_t *genome1 = genome_random_create_r(&stream1);
+    genome_t *genome2 = genome_random_create_r(&stream2);
+    assert(genome_compare(genome1, genome2));
+
+    // Another genome index, another genome.
+    random_stream_init(&stream2, seed, 3, 8);
+    genome_t *other = genome_random_create_r(&stream2);
+    assert(!genome_compare(genome1, other));
+
+    // Variation only depends on the coordinates of the stream, not on other
+    // draws made in between.
+    genome_t *copy1 = NULL;
+    genome_t *copy2 = NULL;
+    genome_copy(&copy1, genome1);
+    genome_copy(&copy2, other);
+
+    random_stream_init(&stream1, seed, 4, 0);
+    genome_crossover_r(genome1, other, &stream1);
+    genome_mutate_r(genome1, &stream1);
+
+    genome_mutate(genome2);
+    random_stream_init(&stream2, seed, 4, 0);
+    genome_crossover_r(copy1, copy2, &stream2);
+    genome_mutate_r(copy1, &stream2);
+
+    assert(genome_compare(genome1, copy1));
+    assert(genome_compare(other, copy2));
+
+    genome_destroy(&genome1);
+    genome_destroy(&genome2);
+    genome_destroy(&other);
+    genome_destroy(&copy1);
+    genome_destroy(&copy2);
+
+    TEST_END_PRINT();
+}
+
+
+static void test_genome_population_random_create(void)
+{
+    TEST_START_PRINT();
+    enum { NB_GENOMES = 100 };
+    uint64_t const seed = 99;
+    genome_t *population[NB_GENOMES];
+    genome_t *threaded[NB_GENOMES];
+
+    assert(genome_population_random_create(population, NB_GENOMES,
+                                           &genome_size_distribution_default,
+                                           seed, 1));
+    assert(genome_population_random_create(threaded, NB_GENOMES,
+                                           &genome_size_distribution_default,
+                                           seed, 4));
+
+    for (int i = 0; i < NB_GENOMES; i++) {
+        assert(genome_sanity_check(population[i]));
+        assert(genome_compare(population[i], threaded[i]));
+
+        // Same genome as created alone.
+        random_stream_t stream;
+        random_stream_init(&stream, seed, 0, i);
+        genome_t *alone = genome_random_create_r(&stream);
+        assert(genome_compare(population[i], alone));
+        genome_destroy(&alone);
+    }
+
+    // Modifying a genome does not affect the others sharing its gene block.
+    for (int i = 0; i < 10; i++) {
+        genome_mutate(population[0]);
+    }
+    genome_crossover(population[2], population[3]);
+    assert(genome_compare(population[1], threaded[1]));
+    assert(genome_compare(population[4], threaded[4]));
+
+    for (int i = 0; i < NB_GENOMES; i++) {
+        genome_destroy(&population[i]);
+        genome_destroy(&threaded[i]);
+    }
+
+    // Ramped sizes.
+    genome_size_distribution_t const ramped = {
+        .size_min = 10,
+        .size_max = 50,
+        .nb_ramps = 4
+    };
+    assert(genome_population_random_create(population, NB_GENOMES, &ramped,
+                                           seed, 2));
+    for (int i = 0; i < NB_GENOMES; i++) {
+        int size = genome_size_get(population[i]);
+        assert(size >= 10);
+        assert(size <= 10 + 40 * (i % 4 + 1) / 4);
+        genome_destroy(&population[i]);
+    }
+
+    TEST_END_PRINT();
+}
+
+
+static void test_genome_effective_variation(void)
+{
+    TEST_START_PRINT();
+    enum { NB_TRIALS = 200 };
+    random_stream_t stream;
+    int nb_neutral = 0;
+
+    for (int trial = 0; trial < NB_TRIALS; trial++) {
+        random_stream_init(&stream, 5, trial, 0);
+        genome_t *parent1 = genome_random_create_r(&stream);
+        genome_t *parent2 = genome_random_create_r(&stream);
+        genome_t *offspring1 = NULL;
+        genome_t *offspring2 = NULL;
+
+        int nb_effective = genome_effective_size_get(parent1);
+        assert(nb_effective >= 0 && nb_effective <= genome_size_get(parent1));
+
+        // Neutral offspring compute the same as their parent.
+        genome_copy(&offspring1, parent1);
+        if (genome_mutate_effective_r(offspring1, &stream)) {
+            assert(genomes_agree(offspring1, parent1));
+            nb_neutral++;
+        }
+
+        genome_copy(&offspring1, parent1);
+        genome_copy(&offspring2, parent2);
+        bool neutral1;
+        bool neutral2;
+        genome_crossover_effective_r(offspring1, offspring2, &stream,
+                                     &neutral1, &neutral2);
+        assert(genome_size_get(offspring1) + genome_size_get(offspring2)
+               == genome_size_get(parent1) + genome_size_get(parent2));
+        assert(!neutral1 || genomes_agree(offspring1, parent1));
+        assert(!neutral2 || genomes_agree(offspring2, parent2));
+
+        genome_destroy(&parent1);
+        genome_destroy(&parent2);
+        genome_destroy(&offspring1);
+        genome_destroy(&offspring2);
+    }
+    // Mutating effective genes is seldom neutral.
+    assert(nb_neutral < NB_TRIALS / 2);
+
+    TEST_END_PRINT();
+}
+
+
+static void test_genome_serialize(void)
+{
+    TEST_START_PRINT();
+    random_stream_t stream;
+    uint8_t buffer[4 + 4 * 255];
+
+    for (int trial = 0; trial < 20; trial++) {
+        random_stream_init(&stream, 6, trial, 0);
+        genome_t *genome = genome_random_create_r(&stream);
+        size_t size = genome_serialized_size_get(genome);
+        assert(size == 4 + 4 * (size_t) genome_size_get(genome));
+
+        assert(genome_serialize(genome, buffer, sizeof buffer) == size);
+        assert(buffer[0] == genome_size_get(genome) && buffer[1] == 0);
+
+        size_t nb_read = 0;
+        genome_t *copy = genome_deserialize(buffer, sizeof buffer, &nb_read);
+        assert(copy != NULL);
+        assert(nb_read == size);
+        assert(genome_diff_first(genome, copy) == -1);
+        genome_destroy(&copy);
+
+        // Small buffer, truncated or invalid data, printing errors.
+        if (trial == 0 && size > 4) {
+            assert(genome_serialize(genome, buffer, size - 1) == 0);
+            assert(genome_deserialize(buffer, size - 1, NULL) == NULL);
+            buffer[4] = UINT8_MAX;
+            assert(genome_deserialize(buffer, size, NULL) == NULL);
+        }
+
+        genome_destroy(&genome);
+    }
+
+    // Several genomes one after the other, read at once.
+    enum { NB_GENOMES = 20 };
+    genome_t *population[NB_GENOMES];
+    genome_t *copies[NB_GENOMES];
+    static uint8_t data[NB_GENOMES * sizeof buffer];
+    size_t size = 0;
+    for (int i = 0; i < NB_GENOMES; i++) {
+        random_stream_init(&stream, 7, 0, i);
+        population[i] = genome_random_create_r(&stream);
+        size += genome_serialize(population[i], &data[size],
+                                 sizeof data - size);
+    }
+    for (int nb_threads = 1; nb_threads <= 3; nb_threads++) {
+        size_t nb_read = 0;
+        assert(genome_population_deserialize(data, size, copies, NB_GENOMES,
+                                             &nb_read, nb_threads));
+        assert(nb_read == size);
+        for (int i = 0; i < NB_GENOMES; i++) {
+            assert(genome_diff_first(population[i], copies[i]) == -1);
+            genome_destroy(&copies[i]);
+        }
+    }
+    assert(!genome_population_deserialize(data, size - 1, copies, NB_GENOMES,
+                                          NULL, 2));
+    for (int i = 0; i < NB_GENOMES; i++) {
+        genome_destroy(&population[i]);
+    }
+    TEST_END_PRINT();
+}
+
+
+// Check that two genomes give the same result on a few random inputs.
+static bool genomes_agree(genome_t *genome1, genome_t *genome2)
+{
+    for (int run = 0; run < 10; run++) {
+        register_value_t registers1[NB_REGISTERS];
+        register_value_t registers2[NB_REGISTERS];
+        for (int i = 0; i < NB_REGISTERS; i++) {
+            registers1[i] = (register_value_t) (rand() % 256 - 128);
+            registers2[i] = registers1[i];
+        }
+        genome_run(genome1, registers1);
+        genome_run(genome2, registers2);
+        if (registers1[reg_A] != registers2[reg_A]) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,270 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+// Module under test.
+#include "../lexicase.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../evaluator.h"
+
+
+//******************************************************************************
+// Module macros
+//******************************************************************************
+#define TEST_START_PRINT()    do {              \
+        printf("Running %s...", __func__);      \
+        fflush(stdout);                         \
+    } while (0)
+
+#define TEST_END_PRINT()  do {                  \
+        printf("OK.\n");                        \
+    } while (0)
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+// Neither a multiple of 64, so that the last words are partial.
+#define NB_GENOMES  (130)
+#define NB_CASES    (150)
+#define NB_WORDS    (EVALUATOR_PASS_WORDS(NB_CASES))
+#define NB_PARENTS  (1000)
+
+//******************************************************************************
+// Module variables
+//******************************************************************************
+static uint64_t passes[NB_GENOMES * NB_WORDS];
+static int parents[NB_PARENTS];
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+// Test functions.
+static void test_lexicase_parents_select(void);
+static void test_lexicase_dominant(void);
+static void test_lexicase_specialists(void);
+static void test_lexicase_epsilon_passes_compute(void);
+static bool pass_get(int const genome, int const c);
+static void pass_set(int const genome, int const c);
+static bool dominated(int const genome);
+static int double_order(void const *a, void const *b);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+int main(void)
+{
+    test_lexicase_parents_select();
+    test_lexicase_dominant();
+    test_lexicase_specialists();
+    test_lexicase_epsilon_passes_compute();
+    printf("All tests passed.\n");
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+static void test_lexicase_parents_select(void)
+{
+    TEST_START_PRINT();
+    int parents_threaded[NB_PARENTS];
+
+    // Sparse random passes, and a few cases that all genomes or none pass.
+    memset(passes, 0, sizeof passes);
+    for (int g = 0; g < NB_GENOMES; g++) {
+        for (int c = 0; c < NB_CASES; c++) {
+            if (c % 10 == 0 || (c % 10 != 1 && rand() % 8 == 0)) {
+                pass_set(g, c);
+            }
+        }
+    }
+    int nb_telling = 0;
+    for (int c = 0; c < NB_CASES; c++) {
+        int count = 0;
+        for (int g = 0; g < NB_GENOMES; g++) {
+            count += pass_get(g, c);
+        }
+        nb_telling += count > 0 && count < NB_GENOMES;
+    }
+
+    lexicase_t *lexicase = lexicase_create(passes, NB_GENOMES, NB_CASES);
+    assert(lexicase);
+    assert(lexicase_nb_cases_get(lexicase) == nb_telling);
+    assert(lexicase_parents_select(lexicase, NB_PARENTS, 3, 1, parents, 1));
+    assert(lexicase_parents_select(lexicase, NB_PARENTS, 3, 1,
+                                   parents_threaded, 3));
+    assert(memcmp(parents, parents_threaded, sizeof parents) == 0);
+
+    // A genome whose passes are a strict subset of those of another is never
+    // selected.
+    for (int i = 0; i < NB_PARENTS; i++) {
+        assert(parents[i] >= 0 && parents[i] < NB_GENOMES);
+        assert(!dominated(parents[i]));
+    }
+
+    // Another generation draws other parents.
+    assert(lexicase_parents_select(lexicase, NB_PARENTS, 3, 2,
+                                   parents_threaded, 1));
+    assert(memcmp(parents, parents_threaded, sizeof parents) != 0);
+    lexicase_destroy(&lexicase);
+    assert(lexicase == NULL);
+    TEST_END_PRINT();
+}
+
+
+static void test_lexicase_dominant(void)
+{
+    TEST_START_PRINT();
+    // Genome 100 passes every case passed by any other, and more.
+    memset(passes, 0, sizeof passes);
+    for (int g = 0; g < NB_GENOMES; g++) {
+        pass_set(g, g);
+        pass_set(100, g);
+    }
+    lexicase_t *lexicase = lexicase_create(passes, NB_GENOMES, NB_CASES);
+    assert(lexicase);
+    assert(lexicase_parents_select(lexicase, NB_PARENTS, 4, 1, parents, 2));
+    for (int i = 0; i < NB_PARENTS; i++) {
+        assert(parents[i] == 100);
+    }
+    lexicase_destroy(&lexicase);
+
+    // Nothing tells the genomes apart, all are drawn.
+    memset(passes, 0, sizeof passes);
+    lexicase = lexicase_create(passes, NB_GENOMES, NB_CASES);
+    assert(lexicase && lexicase_nb_cases_get(lexicase) == 0);
+    assert(lexicase_parents_select(lexicase, NB_PARENTS, 4, 1, parents, 2));
+    bool drawn[NB_GENOMES] = { false };
+    for (int i = 0; i < NB_PARENTS; i++) {
+        drawn[parents[i]] = true;
+    }
+    for (int g = 0; g < NB_GENOMES; g++) {
+        assert(drawn[g]);
+    }
+    lexicase_destroy(&lexicase);
+    TEST_END_PRINT();
+}
+
+
+static void test_lexicase_specialists(void)
+{
+    TEST_START_PRINT();
+    // Genomes 5 and 70 each pass half the cases, which no other passes. Each
+    // is selected about half of the time, no other is.
+    memset(passes, 0, sizeof passes);
+    for (int c = 0; c < NB_CASES; c++) {
+        pass_set(c % 2 == 0 ? 5 : 70, c);
+    }
+    lexicase_t *lexicase = lexicase_create(passes, NB_GENOMES, NB_CASES);
+    assert(lexicase);
+    assert(lexicase_parents_select(lexicase, NB_PARENTS, 5, 1, parents, 1));
+    int nb_first = 0;
+    for (int i = 0; i < NB_PARENTS; i++) {
+        assert(parents[i] == 5 || parents[i] == 70);
+        nb_first += parents[i] == 5;
+    }
+    assert(nb_first > NB_PARENTS * 2 / 5 && nb_first < NB_PARENTS * 3 / 5);
+    lexicase_destroy(&lexicase);
+    TEST_END_PRINT();
+}
+
+
+static void test_lexicase_epsilon_passes_compute(void)
+{
+    TEST_START_PRINT();
+    static register_value_t outputs[NB_GENOMES * NB_CASES];
+    static register_value_t targets[NB_CASES];
+    evaluator_cases_t const cases = {
+        .nb_cases = NB_CASES,
+        .targets = targets
+    };
+    for (int c = 0; c < NB_CASES; c++) {
+        targets[c] = (register_value_t) (rand() % 64 - 32);
+    }
+    for (int i = 0; i < NB_GENOMES * NB_CASES; i++) {
+        outputs[i] = (register_value_t) (rand() % 64 - 32);
+    }
+
+    for (int nb_threads = 1; nb_threads <= 3; nb_threads += 2) {
+        memset(passes, 0xff, sizeof passes);
+        assert(lexicase_epsilon_passes_compute(outputs, NB_GENOMES, &cases,
+                                               passes, nb_threads));
+        for (int c = 0; c < NB_CASES; c++) {
+            // Reference median absolute deviation, by sorting.
+            double errors[NB_GENOMES];
+            double deviations[NB_GENOMES];
+            for (int g = 0; g < NB_GENOMES; g++) {
+                double const error = (double) outputs[g * NB_CASES + c]
+                                     - targets[c];
+                errors[g] = error < 0 ? -error : error;
+            }
+            memcpy(deviations, errors, sizeof errors);
+            qsort(deviations, NB_GENOMES, sizeof (double), double_order);
+            double const best = deviations[0];
+            double const median = deviations[NB_GENOMES / 2];
+            for (int g = 0; g < NB_GENOMES; g++) {
+                double const deviation = errors[g] - median;
+                deviations[g] = deviation < 0 ? -deviation : deviation;
+            }
+            qsort(deviations, NB_GENOMES, sizeof (double), double_order);
+            double const threshold = best + deviations[NB_GENOMES / 2];
+            for (int g = 0; g < NB_GENOMES; g++) {
+                assert(pass_get(g, c) == (errors[g] <= threshold));
+            }
+        }
+        // The bits past the last case are clear.
+        for (int g = 0; g < NB_GENOMES; g++) {
+            assert(passes[g * NB_WORDS + NB_WORDS - 1]
+                   >> (NB_CASES % 64) == 0);
+        }
+    }
+    TEST_END_PRINT();
+}
+
+
+static bool pass_get(int const genome, int const c)
+{
+    return passes[genome * NB_WORDS + c / 64] >> (c % 64) & 1;
+}
+
+
+static void pass_set(int const genome, int const c)
+{
+    passes[genome * NB_WORDS + c / 64] |= (uint64_t) 1 << (c % 64);
+}
+
+
+// Whether another genome passes all the cases a genome passes, and more.
+static bool dominated(int const genome)
+{
+    for (int other = 0; other < NB_GENOMES; other++) {
+        bool superset = true;
+        bool more = false;
+        for (int w = 0; w < NB_WORDS; w++) {
+            uint64_t const mine = passes[genome * NB_WORDS + w];
+            uint64_t const theirs = passes[other * NB_WORDS + w];
+            superset = superset && (mine & ~theirs) == 0;
+            more = more || (theirs & ~mine) != 0;
+        }
+        if (superset && more) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static int double_order(void const *a, void const *b)
+{
+    double const x = *(double const *) a;
+    double const y = *(double const *) b;
+    return (x > y) - (x < y);
+}
@@ -0,0 +1,286 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+// Module under test.
+#include "../optimizer.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../genome.h"
+#include "../machine/machine.h"
+#include "../randomizer.h"
+
+
+//******************************************************************************
+// Module macros
+//******************************************************************************
+#define TEST_START_PRINT()    do {              \
+        printf("Running %s...", __func__);      \
+        fflush(stdout);                         \
+    } while (0)
+
+#define TEST_END_PRINT()  do {                  \
+        printf("OK.\n");                        \
+    } while (0)
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+#define NB_PROGRAMS         (2000)
+#define PROGRAM_SIZE_MAX    (60)
+#define NB_CASES            (40)
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+// Test functions.
+static void test_optimizer_rules(void);
+static void test_optimizer_equivalence(void);
+static void test_optimizer_genome_simplify(void);
+static int simplified_size_get(command_t const commands[],
+                               int const nb_commands, int const nb_inputs,
+                               command_t simplified[]);
+static void outputs_compare(command_t const program1[], int const size1,
+                            command_t const program2[], int const size2,
+                            int const nb_inputs,
+                            random_stream_t * const stream);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+int main(void)
+{
+    test_optimizer_rules();
+    test_optimizer_equivalence();
+    test_optimizer_genome_simplify();
+    printf("All tests passed.\n");
+}
+
+
+static void test_optimizer_rules(void)
+{
+    TEST_START_PRINT();
+    command_t simplified[8];
+
+    // X = X - X gives 0, subtracting it changes nothing. Adding it would too,
+    // but not in floating point, where -0 + 0 is 0.
+    command_t const sub[] = {
+        { .dst = reg_B, .op = SUB, .src1 = reg_A, .src2 = reg_A },
+        { .dst = reg_A, .op = SUB, .src1 = reg_A, .src2 = reg_B }
+    };
+    assert(simplified_size_get(sub, 2, 1, simplified) == 0);
+
+    // Dividing by a register known to be zero gives the dividend.
+    command_t const div[] = {
+        { .dst = reg_A, .op = DIV, .src1 = reg_A, .src2 = reg_C }
+    };
+    assert(simplified_size_get(div, 1, 2, simplified) == 0);
+
+    // A write of the value the register already holds is removed.
+    command_t const repeated[] = {
+        { .dst = reg_C, .op = MUL, .src1 = reg_A, .src2 = reg_B },
+        { .dst = reg_D, .op = ADD, .src1 = reg_C, .src2 = reg_A },
+        { .dst = reg_C, .op = MUL, .src1 = reg_B, .src2 = reg_A },
+        { .dst = reg_A, .op = SUB, .src1 = reg_D, .src2 = reg_C }
+    };
+    assert(simplified_size_get(repeated, 4, 2, simplified) == 3);
+    assert(memcmp(&simplified[0], &repeated[0], 2 * sizeof *simplified)
+           == 0);
+    assert(memcmp(&simplified[2], &repeated[3], sizeof *simplified) == 0);
+
+    // min(A, B) and min(B, A) are the same value, except for the sign of a
+    // zero in floating point.
+    command_t const minimum[] = {
+        { .dst = reg_C, .op = MIN, .src1 = reg_A, .src2 = reg_B },
+        { .dst = reg_D, .op = ADD, .src1 = reg_C, .src2 = reg_A },
+        { .dst = reg_C, .op = MIN, .src1 = reg_B, .src2 = reg_A },
+        { .dst = reg_A, .op = SUB, .src1 = reg_D, .src2 = reg_C }
+    };
+#if defined(MACHINE_REGISTER_FLOAT)
+    assert(simplified_size_get(minimum, 4, 2, simplified) == 4);
+#else
+    assert(simplified_size_get(minimum, 4, 2, simplified) == 3);
+#endif
+
+    // Constants are computed and loaded.
+    command_t const constants[] = {
+        { .dst = reg_B, .op = LOAD, .src2 = 5 },
+        { .dst = reg_C, .op = MUL, .src1 = reg_B, .src2 = reg_B },
+        { .dst = reg_A, .op = ADD, .src1 = reg_A, .src2 = reg_C }
+    };
+    command_t const loaded = { .dst = reg_C, .op = LOAD, .src2 = 25 };
+    assert(simplified_size_get(constants, 3, 1, simplified) == 2);
+    assert(memcmp(&simplified[0], &loaded, sizeof loaded) == 0);
+    assert(memcmp(&simplified[1], &constants[2], sizeof loaded) == 0);
+
+    // A result equal to an operand becomes a copy, which no longer reads the
+    // other operand.
+    command_t const copied[] = {
+        { .dst = reg_C, .op = SUB, .src1 = reg_A, .src2 = reg_D },
+        { .dst = reg_A, .op = MAX, .src1 = reg_C, .src2 = reg_B }
+    };
+    command_t const copy = {
+        .dst = reg_C, .op = MIN, .src1 = reg_A, .src2 = reg_A
+    };
+    assert(simplified_size_get(copied, 2, 2, simplified) == 2);
+    assert(memcmp(&simplified[0], &copy, sizeof copy) == 0);
+    assert(memcmp(&simplified[1], &copied[1], sizeof copy) == 0);
+
+    // A guarded command that changes nothing goes with its IF_LESS.
+    command_t const guarded[] = {
+        { .dst = reg_A, .op = IF_LESS, .src1 = reg_A, .src2 = reg_B },
+        { .dst = reg_C, .op = SUB, .src1 = reg_C, .src2 = reg_C },
+        { .dst = reg_A, .op = SUB, .src1 = reg_A, .src2 = reg_C }
+    };
+    assert(simplified_size_get(guarded, 3, 2, simplified) == 0);
+
+    // IF_LESS on known values: never true, always true.
+    command_t const never[] = {
+        { .dst = reg_A, .op = IF_LESS, .src1 = reg_C, .src2 = reg_D },
+        { .dst = reg_A, .op = LOAD, .src2 = 3 }
+    };
+    assert(simplified_size_get(never, 2, 2, simplified) == 0);
+    command_t const always[] = {
+        { .dst = reg_C, .op = LOAD, .src2 = 1 },
+        { .dst = reg_A, .op = IF_LESS, .src1 = reg_D, .src2 = reg_C },
+        { .dst = reg_A, .op = ADD, .src1 = reg_B, .src2 = reg_B }
+    };
+    assert(simplified_size_get(always, 3, 2, simplified) == 1);
+    assert(memcmp(&simplified[0], &always[2], sizeof always[2]) == 0);
+
+    // A guarded command that does change reg_A is kept, with its guard.
+    command_t const kept[] = {
+        { .dst = reg_A, .op = IF_LESS, .src1 = reg_A, .src2 = reg_B },
+        { .dst = reg_A, .op = LOAD, .src2 = 7 }
+    };
+    assert(simplified_size_get(kept, 2, 2, simplified) == 2);
+    assert(memcmp(simplified, kept, sizeof kept) == 0);
+    TEST_END_PRINT();
+}
+
+
+static void test_optimizer_equivalence(void)
+{
+    TEST_START_PRINT();
+    random_stream_t stream;
+    command_t program[PROGRAM_SIZE_MAX];
+    command_t simplified[PROGRAM_SIZE_MAX];
+    long nb_effective = 0;
+    long nb_simplified = 0;
+    bool effective[PROGRAM_SIZE_MAX];
+
+    for (int trial = 0; trial < NB_PROGRAMS; trial++) {
+        random_stream_init(&stream, 2, trial, 0);
+        int const size = random_stream_get(&stream, PROGRAM_SIZE_MAX + 1);
+        int const nb_inputs = random_stream_get(&stream, 4);
+        // Few registers, so that values meet often.
+        int const nb_registers = 2 + random_stream_get(&stream, 4);
+        for (int i = 0; i < size; i++) {
+            machine_command_random_set(&program[i],
+                                       random_stream_next(&stream));
+            program[i].dst %= nb_registers;
+            if (program[i].op != LOAD) {
+                program[i].src1 %= nb_registers;
+                program[i].src2 %= nb_registers;
+            }
+        }
+
+        int const nb = optimizer_program_simplify(program, size, nb_inputs,
+                                                  simplified);
+        assert(nb >= 0);
+        int const nb_marked = machine_program_effective_mark(program, size,
+                                                             reg_A,
+                                                             effective);
+        assert(nb <= nb_marked);
+        nb_effective += nb_marked;
+        nb_simplified += nb;
+        outputs_compare(program, size, simplified, nb, nb_inputs, &stream);
+
+        // Simplified again, the program does not change.
+        assert(optimizer_program_simplify(simplified, nb, nb_inputs,
+                                          program) == nb);
+        assert(memcmp(program, simplified, nb * sizeof *program) == 0);
+    }
+    // The random programs have plenty to simplify.
+    assert(nb_simplified < nb_effective / 2);
+    TEST_END_PRINT();
+}
+
+
+static void test_optimizer_genome_simplify(void)
+{
+    TEST_START_PRINT();
+    random_stream_t stream;
+    for (int trial = 0; trial < 50; trial++) {
+        random_stream_init(&stream, 3, trial, 0);
+        genome_t *genome = genome_random_create_r(&stream);
+        genome_t *simplified = optimizer_genome_simplify(genome, 2);
+        assert(simplified);
+        assert(genome_sanity_check(simplified));
+        assert(genome_size_get(simplified)
+               <= genome_effective_size_get(genome));
+        outputs_compare(genome_genes_get(genome), genome_size_get(genome),
+                        genome_genes_get(simplified),
+                        genome_size_get(simplified), 2, &stream);
+        genome_destroy(&simplified);
+        genome_destroy(&genome);
+    }
+
+    genome_t *empty = genome_create();
+    genome_t *simplified = optimizer_genome_simplify(empty, 2);
+    assert(simplified && genome_size_get(simplified) == 0);
+    genome_destroy(&simplified);
+    genome_destroy(&empty);
+    TEST_END_PRINT();
+}
+
+
+static int simplified_size_get(command_t const commands[],
+                               int const nb_commands, int const nb_inputs,
+                               command_t simplified[])
+{
+    int const nb = optimizer_program_simplify(commands, nb_commands,
+                                              nb_inputs, simplified);
+    assert(nb >= 0);
+    random_stream_t stream;
+    random_stream_init(&stream, 4, nb_commands, 0);
+    outputs_compare(commands, nb_commands, simplified, nb, nb_inputs,
+                    &stream);
+    return nb;
+}
+
+
+// Check that two programs leave the same reg_A for random inputs, extreme
+// values included so that clamping happens.
+static void outputs_compare(command_t const program1[], int const size1,
+                            command_t const program2[], int const size2,
+                            int const nb_inputs,
+                            random_stream_t * const stream)
+{
+    register_value_t const special[] = {
+        0, 1, -1, REGISTER_MAX, REGISTER_MIN, 2, -2
+    };
+    int const nb_special = sizeof special / sizeof special[0];
+
+    for (int c = 0; c < NB_CASES; c++) {
+        register_value_t registers1[NB_REGISTERS] = { 0 };
+        register_value_t registers2[NB_REGISTERS] = { 0 };
+        for (int r = 0; r < nb_inputs && r < NB_REGISTERS; r++) {
+            int const draw = random_stream_get(stream, 2 * nb_special);
+            registers1[r] = draw < nb_special ? special[draw]
+                            : (register_value_t) (random_stream_next(stream)
+                                                  >> 32);
+            registers2[r] = registers1[r];
+        }
+        machine_program_run(registers1, program1, size1);
+        machine_program_run(registers2, program2, size2);
+        assert(registers1[reg_A] == registers2[reg_A]);
+    }
+}
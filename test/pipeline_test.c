@@ -0,0 +1,240 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+// Module under test.
+#include "../pipeline.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../evaluator.h"
+#include "../fitness.h"
+#include "../genome.h"
+#include "../parallel.h"
+
+
+//******************************************************************************
+// Module macros
+//******************************************************************************
+#define TEST_START_PRINT()    do {              \
+        printf("Running %s...", __func__);      \
+        fflush(stdout);                         \
+    } while (0)
+
+#define TEST_END_PRINT()  do {                  \
+        printf("OK.\n");                        \
+    } while (0)
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+#define NB_GENOMES  (200)
+#define NB_CASES    (100)
+#define NB_INPUTS   (2)
+#define SEED        (7)
+
+static genome_size_distribution_t const size_distribution = {
+    .size_min = 5,
+    .size_max = 40,
+    .nb_ramps = 2
+};
+
+//******************************************************************************
+// Module variables
+//******************************************************************************
+static register_value_t inputs[NB_CASES * NB_INPUTS];
+static register_value_t targets[NB_CASES];
+static evaluator_cases_t const cases = {
+    .nb_cases = NB_CASES,
+    .nb_inputs = NB_INPUTS,
+    .inputs = inputs,
+    .targets = targets
+};
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+// Test functions.
+static void test_parallel_queue(void);
+static void test_pipeline_run(void);
+static void test_pipeline_invalid(void);
+static void population_create(genome_t *population[], double objectives[]);
+static void population_destroy(genome_t *population[]);
+static double best_error_get(double const objectives[]);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+int main(void)
+{
+    for (int c = 0; c < NB_CASES; c++) {
+        inputs[c * NB_INPUTS] = (register_value_t) (rand() % 32 - 16);
+        inputs[c * NB_INPUTS + 1] = (register_value_t) (rand() % 32 - 16);
+        targets[c] = (register_value_t) (inputs[c * NB_INPUTS] * 2
+                                         - inputs[c * NB_INPUTS + 1]);
+    }
+
+    test_parallel_queue();
+    test_pipeline_run();
+    test_pipeline_invalid();
+    printf("All tests passed.\n");
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+static void test_parallel_queue(void)
+{
+    TEST_START_PRINT();
+    int items[3];
+    parallel_queue_t *queue = parallel_queue_create(3);
+    assert(queue);
+
+    for (int i = 0; i < 3; i++) {
+        assert(parallel_queue_push(queue, &items[i]));
+    }
+    assert(parallel_queue_pop(queue) == &items[0]);
+    assert(parallel_queue_push(queue, &items[0]));
+    parallel_queue_close(queue);
+    assert(!parallel_queue_push(queue, &items[0]));
+
+    // The items left are still popped in order once closed.
+    assert(parallel_queue_pop(queue) == &items[1]);
+    assert(parallel_queue_pop(queue) == &items[2]);
+    assert(parallel_queue_pop(queue) == &items[0]);
+    assert(parallel_queue_pop(queue) == NULL);
+
+    parallel_queue_destroy(&queue);
+    assert(queue == NULL);
+    TEST_END_PRINT();
+}
+
+
+static void test_pipeline_run(void)
+{
+    TEST_START_PRINT();
+    genome_t *population[NB_GENOMES];
+    genome_t *reference[NB_GENOMES];
+    static double objectives[NB_GENOMES * FITNESS_NB_OBJECTIVES];
+    static double reference_objectives[NB_GENOMES * FITNESS_NB_OBJECTIVES];
+    static double expected[NB_GENOMES * FITNESS_NB_OBJECTIVES];
+    int const depths[] = { 0, 1, 4 };
+
+    for (int d = 0; d < 3; d++) {
+        pipeline_config_t const config = {
+            .batch_size = 25,
+            .nb_batches = 40,
+            .depth = depths[d],
+            .tournament_size = 3,
+            .crossover_percent = 80,
+            .mutation_percent = 50,
+            .seed = SEED
+        };
+
+        population_create(reference, reference_objectives);
+        double const start_error = best_error_get(reference_objectives);
+        assert(pipeline_run(reference, NB_GENOMES, reference_objectives,
+                            &cases, &config, 1));
+        // The best genome is never replaced by a worse one.
+        assert(best_error_get(reference_objectives) <= start_error);
+
+        // The objectives follow the genomes.
+        assert(fitness_population_evaluate(reference, NB_GENOMES, &cases,
+                                           expected, 1));
+        assert(memcmp(expected, reference_objectives, sizeof expected) == 0);
+
+        // The same run on more threads gives the same population.
+        population_create(population, objectives);
+        assert(pipeline_run(population, NB_GENOMES, objectives, &cases,
+                            &config, 3));
+        for (int g = 0; g < NB_GENOMES; g++) {
+            assert(genome_sanity_check(population[g]));
+            assert(genome_compare(population[g], reference[g]));
+        }
+        assert(memcmp(objectives, reference_objectives, sizeof objectives)
+               == 0);
+
+        population_destroy(population);
+        population_destroy(reference);
+    }
+
+    // No batch leaves the population as it is.
+    pipeline_config_t const none = {
+        .batch_size = 10,
+        .nb_batches = 0,
+        .depth = 2,
+        .tournament_size = 2,
+        .seed = SEED
+    };
+    population_create(population, objectives);
+    population_create(reference, reference_objectives);
+    assert(pipeline_run(population, NB_GENOMES, objectives, &cases, &none,
+                        2));
+    for (int g = 0; g < NB_GENOMES; g++) {
+        assert(genome_compare(population[g], reference[g]));
+    }
+    population_destroy(population);
+    population_destroy(reference);
+    TEST_END_PRINT();
+}
+
+
+static void test_pipeline_invalid(void)
+{
+    TEST_START_PRINT();
+    genome_t *population[NB_GENOMES];
+    static double objectives[NB_GENOMES * FITNESS_NB_OBJECTIVES];
+    pipeline_config_t const config = {
+        .batch_size = 0,
+        .nb_batches = 1,
+        .depth = 1,
+        .tournament_size = 2,
+        .seed = SEED
+    };
+
+    printf("\n\tExpect error messages:\n");
+    fflush(stdout);
+    population_create(population, objectives);
+    assert(!pipeline_run(population, NB_GENOMES, objectives, &cases, &config,
+                         1));
+    pipeline_config_t valid = config;
+    valid.batch_size = 1;
+    assert(!pipeline_run(population, 0, objectives, &cases, &valid, 1));
+    population_destroy(population);
+    TEST_END_PRINT();
+}
+
+
+static void population_create(genome_t *population[], double objectives[])
+{
+    assert(genome_population_random_create(population, NB_GENOMES,
+                                           &size_distribution, SEED, 2));
+    assert(fitness_population_evaluate(population, NB_GENOMES, &cases,
+                                       objectives, 2));
+}
+
+
+static void population_destroy(genome_t *population[])
+{
+    for (int g = 0; g < NB_GENOMES; g++) {
+        genome_destroy(&population[g]);
+    }
+}
+
+
+static double best_error_get(double const objectives[])
+{
+    double best = objectives[FITNESS_ERROR];
+    for (int g = 1; g < NB_GENOMES; g++) {
+        double const error = objectives[g * FITNESS_NB_OBJECTIVES
+                                        + FITNESS_ERROR];
+        best = error < best ? error : best;
+    }
+    return best;
+}
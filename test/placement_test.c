@@ -0,0 +1,298 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+// Module under test.
+#include "../placement.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../evaluator.h"
+#include "../genome.h"
+#include "../randomizer.h"
+
+
+//******************************************************************************
+// Module macros
+//******************************************************************************
+#define TEST_START_PRINT()    do {              \
+        printf("Running %s...", __func__);      \
+        fflush(stdout);                         \
+    } while (0)
+
+#define TEST_END_PRINT()  do {                  \
+        printf("OK.\n");                        \
+    } while (0)
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+// Enough genes for the population block to be a large arena.
+#define NB_GENOMES  (4000)
+#define NB_CASES    (300)
+#define NB_INPUTS   (3)
+#define SEED        (13)
+
+static genome_size_distribution_t const size_distribution = {
+    .size_min = 200,
+    .size_max = 300,
+    .nb_ramps = 0
+};
+
+static placement_config_t const config_none = { .numa = false };
+
+// Everything on, which must also work on a single node machine.
+static placement_config_t const config_all = {
+    .numa = true,
+    .pin_threads = true,
+    .pages = PLACEMENT_PAGES_TRANSPARENT
+};
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+// Test functions.
+static void test_placement_alloc(void);
+static void test_placement_nodes(void);
+static void test_placement_replicas(void);
+static void test_placement_population(void);
+static void test_placement_cases(void);
+static void arena_check(unsigned char * const arena, size_t const size);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+int main(void)
+{
+    test_placement_alloc();
+    test_placement_nodes();
+    test_placement_replicas();
+    test_placement_population();
+    test_placement_cases();
+    printf("All tests passed.\n");
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+static void test_placement_alloc(void)
+{
+    TEST_START_PRINT();
+    // Not configured, nothing is placed.
+    placement_config_set(&config_none);
+    assert(!placement_wanted(PLACEMENT_HUGE_MIN * 4));
+    arena_check(placement_alloc(1000, PLACEMENT_NODE_ANY), 1000);
+
+    placement_pages_t const pages[] = {
+        PLACEMENT_PAGES_TRANSPARENT,
+        PLACEMENT_PAGES_HUGE
+    };
+    for (int p = 0; p < 2; p++) {
+        placement_config_t const config = { .pages = pages[p] };
+        placement_config_set(&config);
+        assert(!placement_wanted(PLACEMENT_HUGE_MIN - 1));
+        assert(placement_wanted(PLACEMENT_HUGE_MIN));
+
+        // Reserved huge pages fall back to transparent ones if there are
+        // none.
+        size_t const size = PLACEMENT_HUGE_MIN + 12345;
+        arena_check(placement_alloc(size, PLACEMENT_NODE_ANY), size);
+        arena_check(placement_alloc(size, 0), size);
+        size_t const ends[] = { 100, 5000, 5000, size };
+        arena_check(placement_split_alloc(ends, 4), size);
+    }
+    placement_free(NULL);
+    placement_config_set(&config_none);
+    TEST_END_PRINT();
+}
+
+
+static void test_placement_nodes(void)
+{
+    TEST_START_PRINT();
+    placement_config_set(&config_none);
+    assert(placement_nb_nodes_get() == 1);
+    assert(!placement_pinning_get());
+    assert(placement_node_current_get() == 0);
+    assert(placement_thread_pin(0));
+
+    placement_config_set(&config_all);
+    int const nb_nodes = placement_nb_nodes_get();
+    assert(nb_nodes >= 1);
+    assert(placement_pinning_get() == (nb_nodes > 1));
+    int const node = placement_node_current_get();
+    assert(node >= 0 && node < nb_nodes);
+    // The node the thread runs on has CPUs to pin to.
+    assert(placement_thread_pin(node));
+    assert(placement_node_current_get() == node);
+    placement_config_set(&config_none);
+    TEST_END_PRINT();
+}
+
+
+static void test_placement_replicas(void)
+{
+    TEST_START_PRINT();
+    size_t const size = PLACEMENT_HUGE_MIN + 100;
+    unsigned char *data = malloc(size);
+    assert(data);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (unsigned char) (i * 7);
+    }
+
+    // Small data is used as it is.
+    placement_config_set(&config_all);
+    placement_replicas_t *replicas = placement_replicas_create(data, 100);
+    assert(replicas);
+    assert(placement_nb_nodes_get() > 1
+           || placement_replica_get(replicas) == data);
+    assert(memcmp(placement_replica_get(replicas), data, 100) == 0);
+    placement_replicas_destroy(&replicas);
+    assert(replicas == NULL);
+
+    // Large data is copied, to huge pages.
+    replicas = placement_replicas_create(data, size);
+    assert(replicas);
+    assert(placement_replica_get(replicas) != data);
+    assert(memcmp(placement_replica_get(replicas), data, size) == 0);
+    placement_replicas_destroy(&replicas);
+
+    placement_config_set(&config_none);
+    replicas = placement_replicas_create(data, size);
+    assert(replicas && placement_replica_get(replicas) == data);
+    placement_replicas_destroy(&replicas);
+    free(data);
+    TEST_END_PRINT();
+}
+
+
+static void test_placement_population(void)
+{
+    TEST_START_PRINT();
+    static genome_t *population[NB_GENOMES];
+    static genome_t *placed[NB_GENOMES];
+
+    assert(genome_population_random_create(population, NB_GENOMES,
+                                           &size_distribution, SEED, 3));
+    placement_config_set(&config_all);
+    assert(genome_population_random_create(placed, NB_GENOMES,
+                                           &size_distribution, SEED, 3));
+    placement_config_set(&config_none);
+
+    // Placement changes where the genes are, not what they are.
+    for (int g = 0; g < NB_GENOMES; g++) {
+        assert(genome_sanity_check(placed[g]));
+        assert(genome_compare(placed[g], population[g]));
+    }
+
+    // The first genome, last user of the placed block, is changed in place
+    // and grows out of it.
+    for (int g = 1; g < NB_GENOMES; g++) {
+        genome_destroy(&placed[g]);
+    }
+    random_stream_t stream;
+    random_stream_init(&stream, SEED, 1, 0);
+    for (int i = 0; i < 20; i++) {
+        genome_mutate_r(placed[0], &stream);
+        genome_crossover_r(placed[0], population[i], &stream);
+        assert(genome_sanity_check(placed[0]));
+    }
+    genome_destroy(&placed[0]);
+    for (int g = 0; g < NB_GENOMES; g++) {
+        genome_destroy(&population[g]);
+    }
+    TEST_END_PRINT();
+}
+
+
+static void test_placement_cases(void)
+{
+    TEST_START_PRINT();
+    static register_value_t inputs[NB_CASES * NB_INPUTS];
+    static register_value_t targets[NB_CASES];
+    static uint64_t passes[20 * EVALUATOR_PASS_WORDS(NB_CASES)];
+    static uint64_t replica_passes[20 * EVALUATOR_PASS_WORDS(NB_CASES)];
+    static register_value_t outputs[20 * NB_CASES];
+    static register_value_t replica_outputs[20 * NB_CASES];
+    for (int i = 0; i < NB_CASES * NB_INPUTS; i++) {
+        inputs[i] = (register_value_t) (rand() % 64 - 32);
+    }
+    for (int c = 0; c < NB_CASES; c++) {
+        targets[c] = inputs[c * NB_INPUTS];
+    }
+    evaluator_cases_t cases = {
+        .nb_cases = NB_CASES,
+        .nb_inputs = NB_INPUTS,
+        .inputs = inputs,
+        .targets = targets
+    };
+    genome_size_distribution_t const small = {
+        .size_min = 0,
+        .size_max = 30
+    };
+    genome_t *population[20];
+    assert(genome_population_random_create(population, 20, &small, SEED, 1));
+    assert(evaluator_population_run(population, 20, &cases, outputs, 1));
+    assert(evaluator_population_passes_run(population, 20, &cases, 0,
+                                           passes, 1));
+
+    // The threads read their copy of the cases, and get the same results.
+    placement_config_set(&config_all);
+    evaluator_replicas_t *replicas = evaluator_cases_replicate(&cases);
+    assert(replicas);
+    cases.replicas = replicas;
+    evaluator_cases_t local;
+    evaluator_cases_local_get(&cases, &local);
+    assert(local.replicas == NULL && local.nb_cases == NB_CASES);
+    assert(memcmp(local.inputs, inputs, sizeof inputs) == 0);
+    assert(memcmp(local.targets, targets, sizeof targets) == 0);
+    assert(evaluator_population_run(population, 20, &cases, replica_outputs,
+                                    3));
+    assert(evaluator_population_passes_run(population, 20, &cases, 0,
+                                           replica_passes, 3));
+    assert(memcmp(outputs, replica_outputs, sizeof outputs) == 0);
+    assert(memcmp(passes, replica_passes, sizeof passes) == 0);
+    // So do the runs of single genomes.
+    evaluator_trace_t *trace = evaluator_trace_create(4);
+    assert(trace);
+    for (int g = 0; g < 20; g++) {
+        register_value_t genome_outputs[NB_CASES];
+        evaluator_run(population[g], &cases, genome_outputs);
+        assert(memcmp(&outputs[g * NB_CASES], genome_outputs,
+                      sizeof genome_outputs) == 0);
+        assert(evaluator_trace_run(population[g], &cases, trace,
+                                   genome_outputs));
+        assert(memcmp(&outputs[g * NB_CASES], genome_outputs,
+                      sizeof genome_outputs) == 0);
+    }
+    evaluator_trace_destroy(&trace);
+    evaluator_replicas_destroy(&replicas);
+    assert(replicas == NULL);
+    placement_config_set(&config_none);
+
+    for (int g = 0; g < 20; g++) {
+        genome_destroy(&population[g]);
+    }
+    TEST_END_PRINT();
+}
+
+
+// Check that an arena is zeroed, aligned and writable, then free it.
+static void arena_check(unsigned char * const arena, size_t const size)
+{
+    assert(arena);
+    assert((uintptr_t) arena % 64 == 0);
+    for (size_t i = 0; i < size; i += 4096) {
+        assert(arena[i] == 0);
+    }
+    assert(arena[size - 1] == 0);
+    memset(arena, 0xa5, size);
+    placement_free(arena);
+}
@@ -0,0 +1,320 @@
+/*----------------------------------------------------------------------------
+Copyright (c) 2013 Gauthier Fleutot Östervall
+----------------------------------------------------------------------------*/
+
+// Module under test.
+#include "../subset.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../evaluator.h"
+#include "../fitness.h"
+#include "../genome.h"
+#include "../placement.h"
+
+
+//******************************************************************************
+// Module macros
+//******************************************************************************
+#define TEST_START_PRINT()    do {              \
+        printf("Running %s...", __func__);      \
+        fflush(stdout);                         \
+    } while (0)
+
+#define TEST_END_PRINT()  do {                  \
+        printf("OK.\n");                        \
+    } while (0)
+
+//******************************************************************************
+// Module constants
+//******************************************************************************
+#define NB_GENOMES  (150)
+#define NB_CASES    (200)
+#define NB_INPUTS   (2)
+#define SIZE        (30)
+#define SEED        (11)
+
+static genome_size_distribution_t const size_distribution = {
+    .size_min = 5,
+    .size_max = 40,
+    .nb_ramps = 2
+};
+
+//******************************************************************************
+// Module variables
+//******************************************************************************
+static register_value_t inputs[NB_CASES * NB_INPUTS];
+static register_value_t targets[NB_CASES];
+static evaluator_cases_t const cases = {
+    .nb_cases = NB_CASES,
+    .nb_inputs = NB_INPUTS,
+    .inputs = inputs,
+    .targets = targets
+};
+
+//******************************************************************************
+// Function prototypes
+//******************************************************************************
+// Test functions.
+static void test_evaluator_cases_gather(void);
+static void test_subset_population_evaluate(void);
+static void test_subset_difficulty(void);
+static void test_subset_invalid(void);
+static void population_destroy(genome_t *population[]);
+
+//******************************************************************************
+// Function definitions
+//******************************************************************************
+int main(void)
+{
+    for (int c = 0; c < NB_CASES; c++) {
+        inputs[c * NB_INPUTS] = (register_value_t) (rand() % 32 - 16);
+        inputs[c * NB_INPUTS + 1] = (register_value_t) (rand() % 32 - 16);
+        targets[c] = (register_value_t) (inputs[c * NB_INPUTS]
+                                         - 3 * inputs[c * NB_INPUTS + 1]);
+    }
+
+    test_evaluator_cases_gather();
+    test_subset_population_evaluate();
+    test_subset_difficulty();
+    test_subset_invalid();
+    printf("All tests passed.\n");
+}
+
+
+//******************************************************************************
+// Internal functions
+//******************************************************************************
+static void test_evaluator_cases_gather(void)
+{
+    TEST_START_PRINT();
+    int const indices[] = { 3, 0, 199, 42 };
+    register_value_t subset_inputs[4 * NB_INPUTS];
+    register_value_t subset_targets[4];
+    evaluator_cases_t subset;
+
+    evaluator_cases_gather(&cases, indices, 4, subset_inputs, subset_targets,
+                           &subset);
+    assert(subset.nb_cases == 4 && subset.nb_inputs == NB_INPUTS);
+    assert(subset.inputs == subset_inputs && subset.targets == subset_targets);
+    for (int i = 0; i < 4; i++) {
+        assert(memcmp(&subset_inputs[i * NB_INPUTS],
+                      &inputs[indices[i] * NB_INPUTS],
+                      sizeof subset_inputs[0] * NB_INPUTS) == 0);
+        assert(subset_targets[i] == targets[indices[i]]);
+    }
+
+    // Cases without targets give a subset without targets.
+    evaluator_cases_t const no_targets = {
+        .nb_cases = NB_CASES,
+        .nb_inputs = NB_INPUTS,
+        .inputs = inputs
+    };
+    evaluator_cases_gather(&no_targets, indices, 4, subset_inputs, NULL,
+                           &subset);
+    assert(subset.targets == NULL);
+    TEST_END_PRINT();
+}
+
+
+static void test_subset_population_evaluate(void)
+{
+    TEST_START_PRINT();
+    genome_t *population[NB_GENOMES];
+    static double objectives[NB_GENOMES * FITNESS_NB_OBJECTIVES];
+    static double threaded[NB_GENOMES * FITNESS_NB_OBJECTIVES];
+    static double full[NB_GENOMES * FITNESS_NB_OBJECTIVES];
+    static register_value_t outputs[NB_CASES];
+    bool rescored[NB_GENOMES];
+    subset_config_t const config = {
+        .size = SIZE,
+        .difficulty_exponent = 1.0,
+        .age_exponent = 2.0,
+        .rescore_interval = 3,
+        .nb_elites = 5,
+        .seed = SEED
+    };
+
+    assert(genome_population_random_create(population, NB_GENOMES,
+                                           &size_distribution, SEED, 2));
+    assert(fitness_population_evaluate(population, NB_GENOMES, &cases, full,
+                                       1));
+    subset_t *subset = subset_create(&cases, &config);
+    // The threaded runs read copies of the cases, and of each subset.
+    placement_config_t const numa = { .numa = true };
+    placement_config_set(&numa);
+    evaluator_cases_t replicated = cases;
+    evaluator_replicas_t *replicas = evaluator_cases_replicate(&cases);
+    assert(replicas);
+    replicated.replicas = replicas;
+    subset_t *subset_threaded = subset_create(&replicated, &config);
+    assert(subset && subset_threaded);
+    int nb_indices;
+    assert(subset_indices_get(subset, &nb_indices) == NULL
+           && nb_indices == 0);
+
+    for (uint64_t generation = 0; generation < 5; generation++) {
+        assert(subset_population_evaluate(subset, population, NB_GENOMES,
+                                          generation, objectives, rescored,
+                                          1));
+        assert(subset_population_evaluate(subset_threaded, population,
+                                          NB_GENOMES, generation, threaded,
+                                          NULL, 3));
+        assert(memcmp(objectives, threaded, sizeof objectives) == 0);
+
+        int const *indices = subset_indices_get(subset, &nb_indices);
+        int nb_threaded;
+        assert(nb_indices == SIZE);
+        assert(memcmp(indices, subset_indices_get(subset_threaded,
+                                                  &nb_threaded),
+                      SIZE * sizeof *indices) == 0);
+        for (int i = 0; i < SIZE; i++) {
+            assert(indices[i] >= 0 && indices[i] < NB_CASES);
+            assert(i == 0 || indices[i] > indices[i - 1]);
+        }
+
+        // The error is that on the subset, scaled to all cases, except for
+        // the elites every third generation.
+        int nb_rescored = 0;
+        for (int g = 0; g < NB_GENOMES; g++) {
+            double const *genome_objectives =
+                &objectives[g * FITNESS_NB_OBJECTIVES];
+            if (rescored[g]) {
+                nb_rescored++;
+                assert(memcmp(genome_objectives,
+                              &full[g * FITNESS_NB_OBJECTIVES],
+                              sizeof full[0] * FITNESS_NB_OBJECTIVES) == 0);
+                continue;
+            }
+            evaluator_run(population[g], &cases, outputs);
+            double error = 0.0;
+            for (int i = 0; i < SIZE; i++) {
+                double const difference = (double) outputs[indices[i]]
+                                          - targets[indices[i]];
+                error += difference < 0 ? -difference : difference;
+            }
+            assert(genome_objectives[FITNESS_ERROR]
+                   == error * ((double) NB_CASES / SIZE));
+            assert(genome_objectives[FITNESS_SIZE]
+                   == genome_size_get(population[g]));
+        }
+        assert(nb_rescored == (generation % 3 == 0 ? 5 : 0));
+    }
+
+    // The whole set as subset gives the objectives on all cases.
+    subset_config_t all = config;
+    all.size = NB_CASES;
+    subset_destroy(&subset);
+    subset = subset_create(&cases, &all);
+    assert(subset_population_evaluate(subset, population, NB_GENOMES, 1,
+                                      objectives, NULL, 2));
+    assert(memcmp(objectives, full, sizeof full) == 0);
+
+    subset_destroy(&subset);
+    subset_destroy(&subset_threaded);
+    assert(subset == NULL);
+    evaluator_replicas_destroy(&replicas);
+    placement_config_t const none = { .numa = false };
+    placement_config_set(&none);
+    population_destroy(population);
+    TEST_END_PRINT();
+}
+
+
+static void test_subset_difficulty(void)
+{
+    TEST_START_PRINT();
+    // Empty genomes output their first input. It is the target of the even
+    // cases, which all solve, but not of the odd ones, which none solves.
+    static register_value_t easy_inputs[NB_CASES * NB_INPUTS];
+    static register_value_t easy_targets[NB_CASES];
+    evaluator_cases_t const half_solved = {
+        .nb_cases = NB_CASES,
+        .nb_inputs = NB_INPUTS,
+        .inputs = easy_inputs,
+        .targets = easy_targets
+    };
+    for (int c = 0; c < NB_CASES; c++) {
+        easy_inputs[c * NB_INPUTS] = (register_value_t) c;
+        easy_targets[c] = (register_value_t) (c % 2 == 0 ? c : c + 1);
+    }
+    genome_t *population[NB_GENOMES];
+    for (int g = 0; g < NB_GENOMES; g++) {
+        population[g] = genome_create();
+        assert(population[g]);
+    }
+    static double objectives[NB_GENOMES * FITNESS_NB_OBJECTIVES];
+    subset_config_t const config = {
+        .size = SIZE,
+        .difficulty_exponent = 1.0,
+        .age_exponent = 2.0,
+        .seed = SEED
+    };
+    subset_t *subset = subset_create(&half_solved, &config);
+    assert(subset);
+
+    int nb_drawn[NB_CASES] = { 0 };
+    for (uint64_t generation = 0; generation < 100; generation++) {
+        assert(subset_population_evaluate(subset, population, NB_GENOMES,
+                                          generation, objectives, NULL, 1));
+        int nb_indices;
+        int const *indices = subset_indices_get(subset, &nb_indices);
+        for (int i = 0; i < nb_indices; i++) {
+            nb_drawn[indices[i]]++;
+        }
+    }
+
+    // The unsolved cases are drawn much more often, but age brings each
+    // solved case back.
+    int nb_easy = 0;
+    int nb_hard = 0;
+    for (int c = 0; c < NB_CASES; c++) {
+        assert(nb_drawn[c] > 0);
+        *(c % 2 == 0 ? &nb_easy : &nb_hard) += nb_drawn[c];
+    }
+    assert(nb_hard > 2 * nb_easy);
+
+    subset_destroy(&subset);
+    population_destroy(population);
+    TEST_END_PRINT();
+}
+
+
+static void test_subset_invalid(void)
+{
+    TEST_START_PRINT();
+    subset_config_t config = {
+        .size = 0,
+        .seed = SEED
+    };
+    evaluator_cases_t const no_targets = {
+        .nb_cases = NB_CASES,
+        .nb_inputs = NB_INPUTS,
+        .inputs = inputs
+    };
+
+    printf("\n\tExpect error messages:\n");
+    fflush(stdout);
+    assert(subset_create(&cases, &config) == NULL);
+    config.size = NB_CASES + 1;
+    assert(subset_create(&cases, &config) == NULL);
+    config.size = 1;
+    config.age_exponent = -1.0;
+    assert(subset_create(&cases, &config) == NULL);
+    config.age_exponent = 0.0;
+    assert(subset_create(&no_targets, &config) == NULL);
+    TEST_END_PRINT();
+}
+
+
+static void population_destroy(genome_t *population[])
+{
+    for (int g = 0; g < NB_GENOMES; g++) {
+        genome_destroy(&population[g]);
+    }
+}